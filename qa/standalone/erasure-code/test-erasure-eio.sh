@@ -316,6 +316,39 @@ function TEST_rados_get_with_subreadall_eio_shard_1() {
     delete_pool $poolname
 }
 
+#
+# A 4096 byte object only has data in the first data shard, so reads of
+# it are partial reads that want shard 0 alone.  An error on another
+# data shard must not matter, and an error on the wanted shard must be
+# recovered by reconstructing it from the remaining shards.
+#
+function TEST_rados_get_partial_read_eio() {
+    local dir=$1
+    setup_osds || return 1
+
+    local poolname=pool-jerasure
+    create_erasure_coded_pool $poolname || return 1
+
+    # eio on the unwanted data shard (1)
+    local objname=obj-partial-eio-$$-1
+    rados_put $dir $poolname $objname || return 1
+    inject_eio ec data $poolname $objname $dir 1 || return 1
+    rados_get $dir $poolname $objname || return 1
+
+    # eio on the wanted data shard (0): degraded read
+    objname=obj-partial-eio-$$-0
+    rados_put $dir $poolname $objname || return 1
+    inject_eio ec data $poolname $objname $dir 0 || return 1
+    rados_get $dir $poolname $objname || return 1
+
+    # and with the coding shard (2) gone too it can't be reconstructed
+    inject_eio ec data $poolname $objname $dir 2 || return 1
+    rados_get $dir $poolname $objname fail || return 1
+
+    rm $dir/ORIGINAL
+    delete_pool $poolname
+}
+
 main test-erasure-eio "$@"
 
 # Local Variables:
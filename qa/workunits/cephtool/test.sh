@@ -2050,6 +2050,15 @@ function test_mon_osd_pool_set()
       ceph osd pool get $TEST_POOL_GETSET $size | expect_false grep '.'
   done
 
+  for qos in qos_reservation qos_weight qos_limit; do
+      ceph osd pool get $TEST_POOL_GETSET $qos | expect_false grep '.'
+      ceph osd pool set $TEST_POOL_GETSET $qos 250
+      ceph osd pool get $TEST_POOL_GETSET $qos | grep '250'
+      expect_false ceph osd pool set $TEST_POOL_GETSET $qos -1
+      ceph osd pool set $TEST_POOL_GETSET $qos 0
+      ceph osd pool get $TEST_POOL_GETSET $qos | expect_false grep '.'
+  done
+
   ceph osd pool set $TEST_POOL_GETSET nodelete 1
   expect_false ceph osd pool delete $TEST_POOL_GETSET $TEST_POOL_GETSET --yes-i-really-really-mean-it
   ceph osd pool set $TEST_POOL_GETSET nodelete 0
@@ -4,10 +4,14 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include "include/crc32c.h"
 #include "xxHash/xxhash.h"
 
 class Checksummer {
 public:
+  /// most csum blocks handed to an Alg::calc_batch() call
+  static const unsigned MAX_BATCH = 16;
+
   enum CSumType {
     CSUM_NONE = 1,	//intentionally set to 1 to be aligned with OSDMnitor's pool_opts_t handling - it treats 0 as unset while we need to distinguish none and unset cases
     CSUM_XXHASH32 = 2,
@@ -86,6 +90,23 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+
+    static void calc_batch(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char **data,
+      unsigned num,
+      value_t *out
+      ) {
+      uint32_t crc[MAX_BATCH];
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const**>(data),
+			len, num, crc);
+      for (unsigned i = 0; i < num; ++i) {
+	out[i] = crc[i];
+      }
+    }
   };
 
   struct crc32c_16 {
@@ -107,6 +128,23 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+
+    static void calc_batch(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char **data,
+      unsigned num,
+      value_t *out
+      ) {
+      uint32_t crc[MAX_BATCH];
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const**>(data),
+			len, num, crc);
+      for (unsigned i = 0; i < num; ++i) {
+	out[i] = crc[i] & 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -128,6 +166,23 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+
+    static void calc_batch(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char **data,
+      unsigned num,
+      value_t *out
+      ) {
+      uint32_t crc[MAX_BATCH];
+      ceph_crc32c_multi(init_value,
+			reinterpret_cast<unsigned char const**>(data),
+			len, num, crc);
+      for (unsigned i = 0; i < num; ++i) {
+	out[i] = crc[i] & 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -157,6 +212,20 @@ public:
       }
       return XXH32_digest(state);
     }
+
+    static void calc_batch(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char **data,
+      unsigned num,
+      value_t *out
+      ) {
+      // contiguous blocks can skip the streaming state entirely
+      for (unsigned i = 0; i < num; ++i) {
+	out[i] = XXH32(data[i], len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -186,8 +255,59 @@ public:
       }
       return XXH64_digest(state);
     }
+
+    static void calc_batch(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      const char **data,
+      unsigned num,
+      value_t *out
+      ) {
+      // contiguous blocks can skip the streaming state entirely
+      for (unsigned i = 0; i < num; ++i) {
+	out[i] = XXH64(data[i], len, init_value);
+      }
+    }
   };
 
+  /**
+   * checksum the next run of up to MAX_BATCH blocks at p
+   *
+   * Blocks that lie within a single buffer are handed to
+   * Alg::calc_batch together; a block that spans buffers goes
+   * through Alg::calc on its own.
+   *
+   * @returns number of blocks checksummed into out (at least one)
+   */
+  template<class Alg>
+  static size_t calc_next(
+    typename Alg::state_t state,
+    typename Alg::init_value_t init_value,
+    size_t csum_block_size,
+    size_t blocks,
+    bufferlist::const_iterator& p,
+    typename Alg::value_t *out) {
+    size_t want = MIN(blocks, (size_t)MAX_BATCH);
+    const char *data;
+    size_t l = p.get_ptr_and_advance(want * csum_block_size, &data);
+    size_t n = l / csum_block_size;
+    size_t tail = l - n * csum_block_size;
+    if (tail) {
+      p.advance(-(int)tail);
+    }
+    if (n == 0) {
+      *out = Alg::calc(state, init_value, csum_block_size, p);
+      return 1;
+    }
+    const char *ptrs[MAX_BATCH];
+    for (size_t i = 0; i < n; ++i) {
+      ptrs[i] = data + i * csum_block_size;
+    }
+    Alg::calc_batch(state, init_value, csum_block_size, ptrs, n, out);
+    return n;
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -221,9 +341,11 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
+    while (blocks) {
+      size_t n = calc_next<Alg>(state, init_value, csum_block_size, blocks,
+				p, pv);
+      pv += n;
+      blocks -= n;
     }
     Alg::fini(&state);
     return 0;
@@ -249,18 +371,22 @@ public:
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
     size_t pos = offset;
-    while (length > 0) {
-      typename Alg::value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    size_t blocks = length / csum_block_size;
+    typename Alg::value_t v[MAX_BATCH];
+    while (blocks) {
+      size_t n = calc_next<Alg>(state, -1, csum_block_size, blocks, p, v);
+      for (size_t i = 0; i < n; ++i) {
+	if (*pv != v[i]) {
+	  if (bad_csum) {
+	    *bad_csum = v[i];
+	  }
+	  Alg::fini(&state);
+	  return pos;
 	}
-	Alg::fini(&state);
-	return pos;
+	++pv;
+	pos += csum_block_size;
       }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
+      blocks -= n;
     }
     Alg::fini(&state);
     return -1;  // no errors
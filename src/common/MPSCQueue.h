@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_MPSCQUEUE_H
+#define CEPH_COMMON_MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/**
+ * Unbounded multi-producer queue, drained in batches.
+ *
+ * push() is lock-free: it links a node onto the head of a list with a
+ * single compare-and-swap.  drain() detaches the whole list with one
+ * exchange and hands the items to the caller oldest first, so items
+ * pushed by any one thread come out in the order they were pushed, and
+ * a later drain() only ever returns items pushed after those already
+ * returned.  Concurrent drain() calls each get a disjoint batch, but to
+ * keep the batches in order callers should serialize them.
+ */
+template <typename T>
+class MPSCQueue {
+  struct Node {
+    T item;
+    Node *next = nullptr;
+    explicit Node(T&& i) : item(std::move(i)) {}
+  };
+
+  std::atomic<Node*> head = {nullptr};
+
+public:
+  MPSCQueue() = default;
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+  ~MPSCQueue() {
+    drain([](T&&) {});
+  }
+
+  void push(T item) {
+    Node *n = new Node(std::move(item));
+    n->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(n->next, n,
+				       std::memory_order_release,
+				       std::memory_order_relaxed))
+      ;
+  }
+
+  bool empty() const {
+    return head.load(std::memory_order_acquire) == nullptr;
+  }
+
+  /// pass everything pushed so far to f, oldest first; returns the count
+  template <typename F>
+  size_t drain(F&& f) {
+    Node *n = head.exchange(nullptr, std::memory_order_acquire);
+    // the list is newest first; reverse it
+    Node *oldest = nullptr;
+    while (n) {
+      Node *next = n->next;
+      n->next = oldest;
+      oldest = n;
+      n = next;
+    }
+    size_t count = 0;
+    while (oldest) {
+      Node *next = oldest->next;
+      f(std::move(oldest->item));
+      delete oldest;
+      oldest = next;
+      ++count;
+    }
+    return count;
+  }
+};
+
+#endif
@@ -934,6 +934,20 @@ static std::atomic_flag buffer_debug_lock = ATOMIC_FLAG_INIT;
     other._len = l;
   }
 
+  void buffer::ptr::reassign_to_mempool(int pool)
+  {
+    if (_raw) {
+      _raw->reassign_to_mempool(pool);
+    }
+  }
+
+  void buffer::ptr::try_assign_to_mempool(int pool)
+  {
+    if (_raw) {
+      _raw->try_assign_to_mempool(pool);
+    }
+  }
+
   void buffer::ptr::release()
   {
     if (_raw) {
@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "acconfig.h"
+#include "include/int_types.h"
+#include "include/crc32c.h"
+#include "common/crc32c_intel_multi.h"
+
+#ifdef __x86_64__
+
+/* use the assembler directly so this file needs no -msse4.2 */
+#define CRC32Q(crc, value) \
+	__asm__("crc32q %[v], %[c]":[c]"+r"(crc):[v]"rm"(value))
+#define CRC32B(crc, value) \
+	__asm__("crc32b %[v], %k[c]":[c]"+r"(crc):[v]"rm"(value))
+
+#define LANES 4
+
+static inline uint64_t load_u64(unsigned char const *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+void ceph_crc32c_intel_multi(uint32_t crc, unsigned char const **buffers,
+			     unsigned len, unsigned num, uint32_t *out)
+{
+	unsigned n = 0;
+
+	for (; n + LANES <= num; n += LANES) {
+		unsigned char const *b0 = buffers[n];
+		unsigned char const *b1 = buffers[n + 1];
+		unsigned char const *b2 = buffers[n + 2];
+		unsigned char const *b3 = buffers[n + 3];
+		uint64_t c0 = crc, c1 = crc, c2 = crc, c3 = crc;
+		unsigned i;
+
+		for (i = 0; i + 8 <= len; i += 8) {
+			CRC32Q(c0, load_u64(b0 + i));
+			CRC32Q(c1, load_u64(b1 + i));
+			CRC32Q(c2, load_u64(b2 + i));
+			CRC32Q(c3, load_u64(b3 + i));
+		}
+		for (; i < len; ++i) {
+			CRC32B(c0, b0[i]);
+			CRC32B(c1, b1[i]);
+			CRC32B(c2, b2[i]);
+			CRC32B(c3, b3[i]);
+		}
+		out[n] = (uint32_t)c0;
+		out[n + 1] = (uint32_t)c1;
+		out[n + 2] = (uint32_t)c2;
+		out[n + 3] = (uint32_t)c3;
+	}
+	/*
+	 * too few left to fill the lanes: one at a time through the
+	 * single buffer implementation, which interleaves within a buffer
+	 */
+	for (; n < num; ++n)
+		out[n] = ceph_crc32c_func(crc, buffers[n], len);
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef CEPH_COMMON_CRC32C_INTEL_MULTI_H
+#define CEPH_COMMON_CRC32C_INTEL_MULTI_H
+
+#include "include/int_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __x86_64__
+
+/*
+ * crc32c of num independent buffers of the same length, each seeded
+ * with crc.  Four buffers are hashed in lock step so that the crc32
+ * instructions of different streams overlap in the pipeline instead
+ * of waiting on each other's latency.  Requires SSE 4.2.
+ */
+extern void ceph_crc32c_intel_multi(uint32_t crc,
+				    unsigned char const **buffers,
+				    unsigned len, unsigned num,
+				    uint32_t *out);
+
+#else
+
+static inline void ceph_crc32c_intel_multi(uint32_t crc,
+					   unsigned char const **buffers,
+					   unsigned len, unsigned num,
+					   uint32_t *out)
+{
+}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
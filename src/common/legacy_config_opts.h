@@ -425,6 +425,7 @@ OPTION(objecter_completion_locks_per_session, OPT_U64) // num of completion lock
 OPTION(objecter_inject_no_watch_ping, OPT_BOOL)   // suppress watch pings
 OPTION(objecter_retry_writes_after_first_reply, OPT_BOOL)   // ignore the first reply for each write, and resend the osd op instead
 OPTION(objecter_debug_inject_relock_delay, OPT_BOOL)
+OPTION(objecter_mclock_service_tracker, OPT_BOOL) // send dmclock delta/rho with each op
 
 // Max number of deletes at once in a single Filer::purge call
 OPTION(filer_max_purge_ops, OPT_U32)
@@ -689,6 +690,8 @@ OPTION(osd_op_num_threads_per_shard_ssd, OPT_INT)
 OPTION(osd_op_num_shards, OPT_INT)
 OPTION(osd_op_num_shards_hdd, OPT_INT)
 OPTION(osd_op_num_shards_ssd, OPT_INT)
+OPTION(osd_op_inline_dispatch, OPT_BOOL)
+OPTION(osd_op_queue_lockfree_intake, OPT_BOOL)
 
 // PrioritzedQueue (prio), Weighted Priority Queue (wpq ; default),
 // mclock_opclass, mclock_client, or debug_random. "mclock_opclass"
@@ -724,6 +727,7 @@ OPTION(osd_ignore_stale_divergent_priors, OPT_BOOL) // do not assert on divergen
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL) // return error if any ec shard has an error
+OPTION(osd_read_ec_partial_stripe, OPT_BOOL) // read only the ec shards covering the range
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -976,6 +980,9 @@ OPTION(bdev_aio, OPT_BOOL)
 OPTION(bdev_aio_poll_ms, OPT_INT)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT)
 OPTION(bdev_aio_reap_max, OPT_INT)
+OPTION(bdev_aio_num_queues, OPT_INT)  // completion queues (and reaper threads) per device
+OPTION(bdev_ioring, OPT_BOOL)  // use io_uring instead of libaio, if available
+OPTION(bdev_ioring_sqthread_poll, OPT_BOOL)
 OPTION(bdev_block_size, OPT_INT)
 OPTION(bdev_debug_aio, OPT_BOOL)
 OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT)
@@ -998,7 +1005,7 @@ OPTION(bluefs_min_flush_size, OPT_U64)  // ignore flush until its this big
 OPTION(bluefs_compact_log_sync, OPT_BOOL)  // sync or async log compaction?
 OPTION(bluefs_buffered_io, OPT_BOOL)
 OPTION(bluefs_sync_write, OPT_BOOL)
-OPTION(bluefs_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluefs_allocator, OPT_STR)     // stupid | bitmap | avl
 OPTION(bluefs_preextend_wal_files, OPT_BOOL)  // this *requires* that rocksdb has recycling enabled
 
 OPTION(bluestore_bluefs, OPT_BOOL)
@@ -1024,6 +1031,9 @@ OPTION(bluestore_spdk_coremask, OPT_STR)
 // Specify the maximal I/Os to be batched completed while checking queue pair completions.
 // Default value 0 means that let SPDK nvme library determine the value.
 OPTION(bluestore_spdk_max_io_completion, OPT_U32)
+// Submit and reap SPDK io on the calling thread, using a qpair of its own,
+// instead of handing it to the DPDK io threads.
+OPTION(bluestore_spdk_inline_poll, OPT_BOOL)
 OPTION(bluestore_block_path, OPT_STR)
 OPTION(bluestore_block_size, OPT_U64)  // 10gb for testing
 OPTION(bluestore_block_create, OPT_BOOL)
@@ -1033,6 +1043,13 @@ OPTION(bluestore_block_db_create, OPT_BOOL)
 OPTION(bluestore_block_wal_path, OPT_STR)
 OPTION(bluestore_block_wal_size, OPT_U64) // rocksdb wal
 OPTION(bluestore_block_wal_create, OPT_BOOL)
+OPTION(bluestore_block_fast_path, OPT_STR)
+OPTION(bluestore_block_fast_size, OPT_U64)  // fast data tier
+OPTION(bluestore_block_fast_create, OPT_BOOL)
+OPTION(bluestore_block_pmem_path, OPT_STR)
+OPTION(bluestore_block_pmem_size, OPT_U64)  // kv commit log on pmem
+OPTION(bluestore_block_pmem_create, OPT_BOOL)
+OPTION(bluestore_pmem_log_checkpoint_ratio, OPT_FLOAT)
 OPTION(bluestore_block_preallocate_file, OPT_BOOL) //whether preallocate space if block/db_path/wal_path is file rather that block device.
 OPTION(bluestore_csum_type, OPT_STR) // none|xxhash32|xxhash64|crc32c|crc32c_16|crc32c_8
 OPTION(bluestore_csum_min_block, OPT_U32)
@@ -1044,6 +1061,9 @@ OPTION(bluestore_max_alloc_size, OPT_U32)
 OPTION(bluestore_prefer_deferred_size, OPT_U32)
 OPTION(bluestore_prefer_deferred_size_hdd, OPT_U32)
 OPTION(bluestore_prefer_deferred_size_ssd, OPT_U32)
+OPTION(bluestore_prefer_deferred_size_adaptive, OPT_BOOL)
+OPTION(bluestore_prefer_deferred_size_adaptive_interval, OPT_FLOAT)
+OPTION(bluestore_prefer_deferred_size_adaptive_max, OPT_U32)
 OPTION(bluestore_compression_mode, OPT_STR)  // force|aggressive|passive|none
 OPTION(bluestore_compression_algorithm, OPT_STR)
 OPTION(bluestore_compression_min_blob_size, OPT_U32)
@@ -1079,8 +1099,12 @@ OPTION(bluestore_extent_map_shard_target_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_min_size, OPT_U32)
 OPTION(bluestore_extent_map_shard_target_size_slop, OPT_DOUBLE)
 OPTION(bluestore_extent_map_inline_shard_prealloc_size, OPT_U32)
+OPTION(bluestore_extent_map_shard_delta, OPT_BOOL)
+OPTION(bluestore_extent_map_shard_delta_cache_max, OPT_U64)
+OPTION(bluestore_shared_blob_ref_log, OPT_BOOL)
 OPTION(bluestore_cache_trim_interval, OPT_DOUBLE)
 OPTION(bluestore_cache_trim_max_skip_pinned, OPT_U32) // skip this many onodes pinned in cache before we give up
+OPTION(bluestore_cache_concurrent_lookup, OPT_BOOL)
 OPTION(bluestore_cache_type, OPT_STR)   // lru, 2q
 OPTION(bluestore_2q_cache_kin_ratio, OPT_DOUBLE)    // kin page slot size / max page slot size
 OPTION(bluestore_2q_cache_kout_ratio, OPT_DOUBLE)   // number of kout page slot / total number of page slot
@@ -1090,13 +1114,34 @@ OPTION(bluestore_cache_size_ssd, OPT_U64)
 OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_ratio, OPT_DOUBLE)
 OPTION(bluestore_cache_kv_max, OPT_U64) // limit the maximum amount of cache for the kv store
+OPTION(bluestore_cache_decompressed_size, OPT_U64) // decompressed blob cache; 0 disables
 OPTION(bluestore_kvbackend, OPT_STR)
-OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap
+OPTION(bluestore_allocator, OPT_STR)     // stupid | bitmap | avl
+OPTION(bluestore_avl_alloc_ff_max_search_count, OPT_U64)
+OPTION(bluestore_avl_alloc_bf_free_pct, OPT_U64)
+OPTION(bluestore_alloc_snapshot, OPT_BOOL)
+OPTION(bluestore_alloc_snapshot_region_size, OPT_U64)
+OPTION(bluestore_defrag, OPT_BOOL)
+OPTION(bluestore_defrag_interval, OPT_FLOAT)
+OPTION(bluestore_defrag_sleep, OPT_FLOAT)
+OPTION(bluestore_defrag_scan_max, OPT_U64)
+OPTION(bluestore_defrag_max_objects, OPT_U64)
+OPTION(bluestore_defrag_min_shards, OPT_U64)
+OPTION(bluestore_defrag_min_blobs, OPT_U64)
+OPTION(bluestore_tier_fast_max_write, OPT_U64)
+OPTION(bluestore_tier_fast_min_free_ratio, OPT_FLOAT)
+OPTION(bluestore_tier_cold_age, OPT_U64)
+OPTION(bluestore_tier_interval, OPT_FLOAT)
+OPTION(bluestore_tier_sleep, OPT_FLOAT)
+OPTION(bluestore_tier_scan_max, OPT_U64)
+OPTION(bluestore_tier_max_objects, OPT_U64)
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_max_deferred_txc, OPT_U64)
 OPTION(bluestore_rocksdb_options, OPT_STR)
+OPTION(bluestore_rocksdb_cf, OPT_BOOL)
+OPTION(bluestore_rocksdb_cfs, OPT_STR)
 OPTION(bluestore_fsck_on_mount, OPT_BOOL)
 OPTION(bluestore_fsck_on_mount_deep, OPT_BOOL)
 OPTION(bluestore_fsck_on_umount, OPT_BOOL)
@@ -1104,6 +1149,8 @@ OPTION(bluestore_fsck_on_umount_deep, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs, OPT_BOOL)
 OPTION(bluestore_fsck_on_mkfs_deep, OPT_BOOL)
 OPTION(bluestore_sync_submit_transaction, OPT_BOOL) // submit kv txn in queueing thread (not kv_sync_thread)
+OPTION(bluestore_kv_sync_pipeline, OPT_BOOL) // sync kv batches on a separate commit thread
+OPTION(bluestore_kv_sync_target_lat, OPT_FLOAT) // let kv batches grow up to this commit latency
 OPTION(bluestore_throttle_bytes, OPT_U64)
 OPTION(bluestore_throttle_deferred_bytes, OPT_U64)
 OPTION(bluestore_throttle_cost_per_io_hdd, OPT_U64)
@@ -1117,6 +1164,12 @@ OPTION(bluestore_blobid_prealloc, OPT_U64)
 OPTION(bluestore_clone_cow, OPT_BOOL)  // do copy-on-write for clones
 OPTION(bluestore_default_buffered_read, OPT_BOOL)
 OPTION(bluestore_default_buffered_write, OPT_BOOL)
+OPTION(bluestore_readahead_max_bytes, OPT_U64)
+OPTION(bluestore_readahead_max_bytes_hdd, OPT_U64)
+OPTION(bluestore_readahead_max_bytes_ssd, OPT_U64)
+OPTION(bluestore_readahead_min_bytes, OPT_U64)
+OPTION(bluestore_readahead_trigger_requests, OPT_INT)
+OPTION(bluestore_readahead_max_inflight_bytes, OPT_U64)
 OPTION(bluestore_debug_misc, OPT_BOOL)
 OPTION(bluestore_debug_no_reuse_blocks, OPT_BOOL)
 OPTION(bluestore_debug_small_allocations, OPT_INT)
@@ -301,6 +301,13 @@ namespace ceph {
       queue.add_request(std::move(item), cl, cost);
     }
 
+    // as enqueue, but with the delta/rho the client sent along
+    void enqueue_distributed(K cl, unsigned priority, unsigned cost, T item,
+			     const dmc::ReqParams& req_params) {
+      // priority is ignored
+      queue.add_request(std::move(item), cl, req_params, cost);
+    }
+
     void enqueue_front(K cl,
 		       unsigned priority,
 		       unsigned cost,
@@ -313,7 +320,16 @@ namespace ceph {
     }
 
     T dequeue() override final {
+      return dequeue_distributed(nullptr);
+    }
+
+    // as dequeue, but also report the phase the item was scheduled
+    // in; strict and front items count as priority
+    T dequeue_distributed(dmc::PhaseType *phase) {
       assert(!empty());
+      if (phase) {
+	*phase = dmc::PhaseType::priority;
+      }
 
       if (!(high_queue.empty())) {
 	T ret = high_queue.rbegin()->second.front().second;
@@ -333,6 +349,9 @@ namespace ceph {
       auto pr = queue.pull_request();
       assert(pr.is_retn());
       auto& retn = pr.get_retn();
+      if (phase) {
+	*phase = retn.phase;
+      }
       return *(retn.request);
     }
 
@@ -1511,6 +1511,12 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("objecter_mclock_service_tracker", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("track dmclock delta/rho per OSD and send them with each op")
+    .set_long_description("when enabled, the client counts the replies it gets from every OSD, and in which mclock phase each was served, and tags each op with the delta/rho values so that OSDs running osd_op_queue = mclock_client enforce reservations and limits across the whole cluster rather than per OSD")
+    .add_see_also("osd_op_queue"),
+
     Option("filer_max_purge_ops", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -1891,6 +1897,18 @@ std::vector<Option> get_global_options() {
     .set_default(8)
     .set_description(""),
 
+    Option("osd_op_inline_dispatch", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Run client reads on the messenger thread that received them when their shard is idle")
+    .set_long_description("If the op shard that a newly received client read maps to has nothing queued, the op's PG is already instantiated with nothing else queued or running for it, and the PG lock can be taken without waiting, the op is processed directly on the messenger thread instead of being handed to an op worker thread.  Writes and replica ops always go through the op queue, since they can block on the object store throttle.  This saves a thread handoff per op on lightly queued, fast devices.  Reads are synchronous in the object store, so this is best avoided on rotational media.")
+    .add_see_also("osd_op_num_shards"),
+
+    Option("osd_op_queue_lockfree_intake", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Queue new ops on a lock-free list per op shard")
+    .set_long_description("Instead of taking the op shard's ordering lock to insert each new op into the priority queue, push it onto a lock-free per-shard list; worker threads move the list into the priority queue in batches the next time they take the lock.  This keeps messenger threads from contending with the op workers.  Takes effect on OSD start.")
+    .add_see_also("osd_op_num_shards"),
+
     Option("osd_op_queue", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("wpq")
     .set_enum_allowed( { "wpq", "prioritized", "mclock_opclass", "mclock_client", "debug_random" } )
@@ -2213,6 +2231,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_read_ec_partial_stripe", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(true)
+    .set_description("Only read the erasure coded shards holding the requested range")
+    .set_long_description("Client reads fetch only the data shards covering the requested extents when they are available, and reconstruct only those chunks when they are not.  When false, every read fetches and decodes whole stripes."),
+
     Option("osd_recover_clone_overlap_limit", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(10)
     .set_description(""),
@@ -3028,6 +3051,23 @@ std::vector<Option> get_global_options() {
     .set_default(16)
     .set_description(""),
 
+    Option("bdev_aio_num_queues", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_description("Number of aio completion queues per block device")
+    .set_long_description("Each queue has its own completion thread.  IO submitted on behalf of a sequencer (PG) always goes to the same queue, so completions are spread across threads by PG."),
+
+    Option("bdev_ioring", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use io_uring instead of libaio for KernelDevice io")
+    .set_long_description("Requires ceph to be built with liburing and a kernel that supports io_uring; otherwise we fall back to libaio.")
+    .add_see_also("bdev_ioring_sqthread_poll"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Have a kernel thread poll the io_uring submission queue")
+    .set_long_description("With SQPOLL the kernel picks up new submissions without an io_uring_enter(2) syscall, at the cost of a kernel thread spinning per device.  Usually requires root (CAP_SYS_ADMIN) on older kernels.")
+    .add_see_also("bdev_ioring"),
+
     Option("bdev_block_size", Option::TYPE_INT, Option::LEVEL_ADVANCED)
     .set_default(4096)
     .set_description(""),
@@ -3143,6 +3183,12 @@ std::vector<Option> get_global_options() {
     .set_default(0)
     .set_description(""),
 
+    Option("bluestore_spdk_inline_poll", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_description("Submit and poll SPDK io on the submitting thread")
+    .set_long_description("Each thread that submits io (e.g. an OSD op shard thread) allocates its own NVMe queue pair on first use, issues its requests on it and polls for their completion before returning, so there is no handoff to the DPDK io threads.  Threads fall back to the shared io threads once the controller runs out of queue pairs.")
+    .add_see_also("bluestore_spdk_max_io_completion"),
+
     Option("bluestore_block_path", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("")
     .add_tag("mkfs")
@@ -3193,6 +3239,48 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_block_wal_path")
     .add_see_also("bluestore_block_wal_size"),
 
+    Option("bluestore_block_fast_path", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("")
+    .add_tag("mkfs")
+    .set_description("Path to block device/file for the fast data tier")
+    .set_long_description("If set at mkfs, a second, faster device is appended to the main block device's address space.  New small writes are placed on it and data that has not been touched for bluestore_tier_cold_age seconds is moved to the main device in the background.")
+    .add_see_also("bluestore_tier_cold_age"),
+
+    Option("bluestore_block_fast_size", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(0)
+    .add_tag("mkfs")
+    .set_description("Size of file to create for bluestore_block_fast_path"),
+
+    Option("bluestore_block_fast_create", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .add_tag("mkfs")
+    .set_description("Create bluestore_block_fast_path if it doesn't exist")
+    .add_see_also("bluestore_block_fast_path")
+    .add_see_also("bluestore_block_fast_size"),
+
+    Option("bluestore_block_pmem_path", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("")
+    .add_tag("mkfs")
+    .set_description("Path to persistent memory region for the kv commit log")
+    .set_long_description("A pmem or DAX region (or, for testing, a regular file) that kv transactions are committed to before they are applied to the database.  Commits then cost a cache flush to pmem rather than a sync of the database log, which is only synced when the region fills up.  Requires the rocksdb kv backend."),
+
+    Option("bluestore_block_pmem_size", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(0)
+    .add_tag("mkfs")
+    .set_description("Size of file to create for bluestore_block_pmem_path"),
+
+    Option("bluestore_block_pmem_create", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .add_tag("mkfs")
+    .set_description("Create bluestore_block_pmem_path if it doesn't exist")
+    .add_see_also("bluestore_block_pmem_path")
+    .add_see_also("bluestore_block_pmem_size"),
+
+    Option("bluestore_pmem_log_checkpoint_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.5)
+    .set_description("Sync the database and trim the pmem log once it is this full")
+    .add_see_also("bluestore_block_pmem_path"),
+
     Option("bluestore_block_preallocate_file", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .add_tag("mkfs")
@@ -3254,6 +3342,25 @@ std::vector<Option> get_global_options() {
     .set_safe()
     .set_description("Default bluestore_prefer_deferred_size for non-rotational (solid state) media"),
 
+    Option("bluestore_prefer_deferred_size_adaptive", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_safe()
+    .set_description("Adjust bluestore_prefer_deferred_size online from observed latencies")
+    .set_long_description("Starting from the static bluestore_prefer_deferred_size value, periodically compare the latency of direct data writes with the kv sync latency.  The threshold is doubled while the device is more than twice as slow as the kv sync, and halved when the kv sync is the slower of the two or the deferred write backlog is past half of bluestore_throttle_deferred_bytes.")
+    .add_see_also("bluestore_prefer_deferred_size")
+    .add_see_also("bluestore_prefer_deferred_size_adaptive_interval")
+    .add_see_also("bluestore_prefer_deferred_size_adaptive_max"),
+
+    Option("bluestore_prefer_deferred_size_adaptive_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_description("Seconds between adaptive prefer_deferred_size adjustments")
+    .add_see_also("bluestore_prefer_deferred_size_adaptive"),
+
+    Option("bluestore_prefer_deferred_size_adaptive_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(128*1024)
+    .set_description("Upper bound for the adaptive prefer_deferred_size")
+    .add_see_also("bluestore_prefer_deferred_size_adaptive"),
+
     Option("bluestore_compression_mode", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("none")
     .set_enum_allowed({"none", "passive", "aggressive", "force"})
@@ -3345,6 +3452,24 @@ std::vector<Option> get_global_options() {
     .set_default(.2)
     .set_description("Ratio above/below target for a shard when trying to align to an existing extent or blob boundary"),
 
+    Option("bluestore_extent_map_shard_delta", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Write small extent map shard changes as deltas")
+    .set_long_description("Keep the last written encoding of each recently written extent map shard and, when a shard changes, write only the changed byte range as a kv merge operand instead of the whole shard.  The kv store applies the deltas on read and during compaction.  Once enabled, older versions can no longer read the store.")
+    .add_see_also("bluestore_extent_map_shard_target_size"),
+
+    Option("bluestore_extent_map_shard_delta_cache_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(32ull*1024*1024)
+    .set_description("Max bytes of persisted shard encodings kept to write deltas against")
+    .set_long_description("Each shard written while bluestore_extent_map_shard_delta is enabled keeps a copy of its last written encoding so the next change can be written as a delta.  Once the copies reach this many bytes, further shards are written in full instead.  The copies count against the metadata share of the cache.")
+    .add_see_also("bluestore_extent_map_shard_delta"),
+
+    Option("bluestore_shared_blob_ref_log", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Write shared blob reference changes as deltas")
+    .set_long_description("When a clone or an overwrite changes the references on a shared blob, write the individual reference changes as a kv merge operand instead of re-encoding the whole shared blob record.  The kv store folds them into the record on read and during compaction.  Once enabled, older versions can no longer read the store.")
+    .add_see_also("bluestore_extent_map_shard_delta"),
+
     Option("bluestore_extent_map_inline_shard_prealloc_size", Option::TYPE_UINT, Option::LEVEL_DEV)
     .set_default(256)
     .set_description("Preallocated buffer for inline shards"),
@@ -3357,6 +3482,11 @@ std::vector<Option> get_global_options() {
     .set_default(64)
     .set_description("Max pinned cache entries we consider before giving up"),
 
+    Option("bluestore_cache_concurrent_lookup", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Look up cached onodes without taking the cache shard lock")
+    .set_long_description("Onode lookups only take a per-collection read lock and mark the onode referenced instead of moving it to the head of the LRU; trim gives referenced onodes a second chance (CLOCK).  This removes the cache shard lock from the read hot path at the cost of a less precise LRU."),
+
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
     .set_enum_allowed({"2q", "lru"})
@@ -3395,6 +3525,12 @@ std::vector<Option> get_global_options() {
     .set_default(512*1024*1024)
     .set_description("Max memory (bytes) to devote to kv database (rocksdb)"),
 
+    Option("bluestore_cache_decompressed_size", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Memory (bytes) for caching decompressed contents of compressed blobs")
+    .set_long_description("Reads that hit a compressed blob normally read and decompress the whole blob each time.  When non-zero, the decompressed blob is kept in a dedicated LRU cache of this size, separate from bluestore_cache_size, so later reads of the same blob skip the device read and the decompression.  0 disables the cache.")
+    .add_see_also("bluestore_compression_mode"),
+
     Option("bluestore_kvbackend", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("rocksdb")
     .add_tag("mkfs")
@@ -3402,9 +3538,102 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("stupid")
-    .set_enum_allowed({"bitmap", "stupid"})
+    .set_enum_allowed({"bitmap", "stupid", "avl"})
     .set_description("Allocator policy"),
 
+    Option("bluestore_avl_alloc_ff_max_search_count", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(100)
+    .set_description("Max free extents the avl allocator walks looking for a near fit before falling back to best fit")
+    .add_see_also("bluestore_allocator"),
+
+    Option("bluestore_avl_alloc_bf_free_pct", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4)
+    .set_description("Percent of free space below which the avl allocator goes straight to best fit")
+    .add_see_also("bluestore_allocator"),
+
+    Option("bluestore_alloc_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Persist the allocator state at umount to speed up the next mount")
+    .set_long_description("On clean umount the free extents are written to the kv store.  While mounted, freelist changes mark their region of the device dirty, so the next mount only has to read the dirty regions back from the freelist instead of walking all of it.  A snapshot that fails its checksum, does not match the device, or was not tracked while mounted is discarded and the full freelist is read instead.  Only the stupid and avl allocators support snapshots.")
+    .add_see_also("bluestore_alloc_snapshot_region_size"),
+
+    Option("bluestore_alloc_snapshot_region_size", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(1ull << 30)
+    .set_description("Granularity of dirty tracking for the allocator snapshot")
+    .add_see_also("bluestore_alloc_snapshot"),
+
+    Option("bluestore_defrag", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Rewrite fragmented objects in the background")
+    .set_long_description("Periodically scan the object keyspace for onodes whose extent map is split into many shards and blobs, and rewrite their data into contiguous, min_alloc_size aligned blobs, recompressing according to the compression policy.")
+    .add_see_also("bluestore_defrag_interval")
+    .add_see_also("bluestore_defrag_sleep"),
+
+    Option("bluestore_defrag_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_description("Seconds between background defrag passes")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_defrag_sleep", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .set_description("Seconds to sleep between objects rewritten by background defrag")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_defrag_scan_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(10000)
+    .set_description("Max onodes examined per background defrag pass")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_defrag_max_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_description("Max objects rewritten per background defrag pass")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_defrag_min_shards", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(4)
+    .set_description("Extent map shards an onode needs before defrag looks at it")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_defrag_min_blobs", Option::TYPE_UINT, Option::LEVEL_DEV)
+    .set_default(16)
+    .set_description("Blobs an object needs, and more than twice what a sequential write would use, before defrag rewrites it")
+    .add_see_also("bluestore_defrag"),
+
+    Option("bluestore_tier_fast_max_write", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Largest write placed on the fast data tier (0 for any size)")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_fast_min_free_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .set_description("Stop placing new writes on the fast data tier when less than this fraction of it is free")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_cold_age", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(3600)
+    .set_description("Seconds without reads or writes after which a blob on the fast data tier is moved to the main device")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(60)
+    .set_description("Seconds between fast data tier demotion passes")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_sleep", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.01)
+    .set_description("Seconds to sleep between objects demoted from the fast data tier")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_scan_max", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(10000)
+    .set_description("Max onodes examined per demotion pass")
+    .add_see_also("bluestore_block_fast_path"),
+
+    Option("bluestore_tier_max_objects", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64)
+    .set_description("Max objects demoted per pass")
+    .add_see_also("bluestore_block_fast_path"),
+
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_INT, Option::LEVEL_DEV)
     .set_default(128)
     .set_description("Block (and bits) per database key"),
@@ -3425,6 +3654,18 @@ std::vector<Option> get_global_options() {
     .set_default("compression=kNoCompression,max_write_buffer_number=4,min_write_buffer_number_to_merge=1,recycle_log_file_num=4,write_buffer_size=268435456,writable_file_max_buffer_size=0,compaction_readahead_size=2097152")
     .set_description("Rocksdb options"),
 
+    Option("bluestore_rocksdb_cf", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Store metadata prefixes in their own RocksDB column families")
+    .set_long_description("Only takes effect at mkfs: the prefixes listed in bluestore_rocksdb_cfs then each get a column family, with its own memtables, SST files and compaction, instead of sharing the default one.  Short-lived deferred records and omap churn then no longer add to the write amplification of onode lookups.")
+    .add_see_also("bluestore_rocksdb_cfs"),
+
+    Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
+    .set_default("O= M=prefix_extractor=rocksdb.CappedPrefix.8 L=")
+    .set_description("Column families and their RocksDB options, as prefix=options pairs separated by spaces")
+    .set_long_description("The options of each family are given in RocksDB's column family option string format and are applied on top of bluestore_rocksdb_options.  They are read at every mount, but the set of families is fixed at mkfs.  Note that FIFO compaction drops SST files regardless of their contents, so it is only safe for L if the size limit covers the deferred records still pending replay.")
+    .add_see_also("bluestore_rocksdb_cf"),
+
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Run fsck at mount"),
@@ -3453,6 +3694,19 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_sync_pipeline", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Overlap kv batch preparation with the synchronous kv commit")
+    .set_long_description("When enabled, kv_sync_thread only flushes the block device and submits the batch's transactions; the final synchronous commit happens on a separate bstore_kv_commit thread.  The next batch is gathered and prepared while the previous one is syncing, so batches naturally grow when sync latency rises.  Takes effect on mount.")
+    .add_see_also("bluestore_sync_submit_transaction")
+    .add_see_also("bluestore_kv_sync_target_lat"),
+
+    Option("bluestore_kv_sync_target_lat", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Target kv commit latency in seconds, used to size kv batches (0 disables)")
+    .set_long_description("When set, kv_sync_thread waits for more transactions to join a batch for as long as the measured flush-and-commit time of recent batches leaves room under this target.  Larger batches mean fewer kv syncs per transaction at the cost of commit latency up to the target.")
+    .add_see_also("bluestore_kv_sync_pipeline"),
+
     Option("bluestore_throttle_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
     .set_default(64*1024*1024)
     .set_safe()
@@ -3517,6 +3771,42 @@ std::vector<Option> get_global_options() {
     .set_safe()
     .set_description("Cache writes by default (unless hinted NOCACHE or WONTNEED)"),
 
+    Option("bluestore_readahead_max_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_safe()
+    .set_description("Largest readahead issued for sequential object reads (0 = use bluestore_readahead_max_bytes_hdd or bluestore_readahead_max_bytes_ssd)")
+    .set_long_description("Once an object has been read sequentially bluestore_readahead_trigger_requests times, the data following the read is prefetched into the buffer cache in the background.  Prefetches start at bluestore_readahead_min_bytes and grow up to this size."),
+
+    Option("bluestore_readahead_max_bytes_hdd", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1024*1024)
+    .set_safe()
+    .set_description("Default bluestore_readahead_max_bytes for rotational media")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
+    Option("bluestore_readahead_max_bytes_ssd", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_safe()
+    .set_description("Default bluestore_readahead_max_bytes for non-rotational (solid state) media")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
+    Option("bluestore_readahead_min_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(128*1024)
+    .set_safe()
+    .set_description("Smallest readahead issued for sequential object reads")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
+    Option("bluestore_readahead_trigger_requests", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+    .set_default(3)
+    .set_safe()
+    .set_description("Number of sequential reads of an object that start readahead")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
+    Option("bluestore_readahead_max_inflight_bytes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(64*1024*1024)
+    .set_safe()
+    .set_description("Readahead that would have more than this many bytes in flight is skipped")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
     Option("bluestore_debug_misc", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description(""),
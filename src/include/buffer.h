@@ -263,6 +263,8 @@ namespace buffer CEPH_BUFFER_API {
     raw *clone();
     void swap(ptr& other);
     ptr& make_shareable();
+    void reassign_to_mempool(int pool);
+    void try_assign_to_mempool(int pool);
 
     iterator begin(size_t offset=0) const {
       return iterator(this, offset, false);
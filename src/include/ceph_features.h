@@ -165,7 +165,15 @@ DEFINE_CEPH_FEATURE(59, 1, FS_CHANGE_ATTR) // overlap
 DEFINE_CEPH_FEATURE(59, 1, MSG_ADDR2) // overlap
 DEFINE_CEPH_FEATURE(60, 1, OSD_RECOVERY_DELETES) // *do not share this bit*
 
-DEFINE_CEPH_FEATURE(61, 1, RESERVED2)          // unused, but slow down!
+/*
+ * QOS_DMC takes bit 61, which upstream keeps as RESERVED2 ("unused, but
+ * slow down!"); every other bit is in use or only retired at incarnation
+ * 1.  If upstream assigns bit 61, peers would read it with different
+ * meanings, so before picking that up QOS_DMC must move to a bit at a
+ * later incarnation (e.g. 16 at incarnation 3, once SERVER_MIMIC is
+ * advertised) and this one go through DEPRECATED and RETIRED as above.
+ */
+DEFINE_CEPH_FEATURE(61, 1, QOS_DMC)           // *do not share this bit*
 DEFINE_CEPH_FEATURE(62, 1, RESERVED)           // do not use; used as a sentinal
 DEFINE_CEPH_FEATURE_DEPRECATED(63, 1, RESERVED_BROKEN, LUMINOUS) // client-facing
 
@@ -231,6 +239,7 @@ DEFINE_CEPH_FEATURE_DEPRECATED(63, 1, RESERVED_BROKEN, LUMINOUS) // client-facin
 	 CEPH_FEATURE_RESEND_ON_SPLIT |		\
 	 CEPH_FEATURE_RADOS_BACKOFF |		\
 	 CEPH_FEATURE_OSD_RECOVERY_DELETES | \
+	 CEPH_FEATURE_QOS_DMC | \
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
@@ -255,7 +264,6 @@ DEFINE_CEPH_FEATURE_DEPRECATED(63, 1, RESERVED_BROKEN, LUMINOUS) // client-facin
 static inline void ____build_time_check_for_reserved_bits(void) {
 	CEPH_STATIC_ASSERT((CEPH_FEATURES_ALL &
 			    (CEPH_FEATURE_RESERVED |
-			     CEPH_FEATURE_RESERVED2 |
 			     DEPRECATED_CEPH_FEATURE_RESERVED_BROKEN)) == 0);
 }
 
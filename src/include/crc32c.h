@@ -17,6 +17,19 @@ extern ceph_crc32c_func_t ceph_crc32c_func;
 
 extern ceph_crc32c_func_t ceph_choose_crc32(void);
 
+typedef void (*ceph_crc32c_multi_func_t)(uint32_t crc,
+					 unsigned char const **data,
+					 unsigned length, unsigned num,
+					 uint32_t *out);
+
+/*
+ * the chosen implementation for checksumming many equally sized
+ * buffers at once.
+ */
+extern ceph_crc32c_multi_func_t ceph_crc32c_multi_func;
+
+extern ceph_crc32c_multi_func_t ceph_choose_crc32_multi(void);
+
 /**
  * calculate crc32c for data that is entirely 0 (ZERO)
  *
@@ -50,6 +63,26 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+/**
+ * calculate crc32c of several buffers
+ *
+ * Equivalent to out[i] = ceph_crc32c(crc, data[i], length) for each
+ * of the num buffers, which must all be non-NULL.  Independent
+ * buffers are interleaved where the CPU allows it.
+ *
+ * @param crc initial value for every buffer
+ * @param data array of num buffer pointers
+ * @param length length of each buffer
+ * @param num number of buffers
+ * @param out array of num results
+ */
+static inline void ceph_crc32c_multi(uint32_t crc, unsigned char const **data,
+				     unsigned length, unsigned num,
+				     uint32_t *out)
+{
+  ceph_crc32c_multi_func(crc, data, length, num, out);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -141,6 +141,7 @@ namespace mempool {
   f(bluestore_cache_data)	      \
   f(bluestore_cache_onode)	      \
   f(bluestore_cache_other)	      \
+  f(bluestore_cache_shard_base)	      \
   f(bluestore_fsck)		      \
   f(bluestore_txc)		      \
   f(bluestore_writing_deferred)	      \
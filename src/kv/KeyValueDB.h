@@ -8,6 +8,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include "include/memory.h"
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
@@ -130,10 +131,23 @@ public:
       const bufferlist  &value     ///< [in] value to be merged into key
     ) { assert(0 == "Not implemented"); }
 
+    /// Serialized form of the transaction, for submit_transaction_rep()
+    virtual int get_rep(bufferlist *bl) {
+      return -EOPNOTSUPP;
+    }
+
     virtual ~TransactionImpl() {}
   };
   typedef ceph::shared_ptr< TransactionImpl > Transaction;
 
+  /// A column family holding all keys of one prefix, with its own options
+  struct ColumnFamily {
+    std::string name;    ///< prefix whose keys live in this family
+    std::string option;  ///< backend specific option string for it
+    ColumnFamily(const std::string &name, const std::string &option)
+      : name(name), option(option) {}
+  };
+
   /// create a new instance
   static KeyValueDB *create(CephContext *cct, const std::string& type,
 			    const std::string& dir,
@@ -144,6 +158,19 @@ public:
   virtual int init(string option_str="") = 0;
   virtual int open(std::ostream &out) = 0;
   virtual int create_and_open(std::ostream &out) = 0;
+  /// Opens underlying db, passing options for existing column families
+  virtual int open(std::ostream &out, const std::vector<ColumnFamily>& cfs) {
+    if (!cfs.empty())
+      return -EOPNOTSUPP;
+    return open(out);
+  }
+  /// Creates underlying db if missing, along with the given column families
+  virtual int create_and_open(std::ostream &out,
+			      const std::vector<ColumnFamily>& cfs) {
+    if (!cfs.empty())
+      return -EOPNOTSUPP;
+    return create_and_open(out);
+  }
   virtual void close() { }
 
   virtual Transaction get_transaction() = 0;
@@ -151,6 +178,10 @@ public:
   virtual int submit_transaction_sync(Transaction t) {
     return submit_transaction(t);
   }
+  /// Apply a transaction serialized with TransactionImpl::get_rep()
+  virtual int submit_transaction_rep(bufferlist& rep) {
+    return -EOPNOTSUPP;
+  }
 
   /// Retrieve Keys
   virtual int get(
@@ -295,7 +326,7 @@ public:
     return _get_iterator();
   }
 
-  Iterator get_iterator(const std::string &prefix) {
+  virtual Iterator get_iterator(const std::string &prefix) {
     return std::make_shared<IteratorImpl>(prefix, get_iterator());
   }
 
@@ -96,6 +96,35 @@ class RocksDBStore::MergeOperatorRouter : public rocksdb::AssociativeMergeOperat
 
 };
 
+//
+// One of these per column family with a merge operator; the family holds
+// a single prefix, so there is nothing to route
+//
+class RocksDBStore::MergeOperatorLinker : public rocksdb::AssociativeMergeOperator {
+  std::shared_ptr<KeyValueDB::MergeOperator> mop;
+  string name;
+  public:
+  const char *Name() const override {
+    return name.c_str();
+  }
+  explicit MergeOperatorLinker(std::shared_ptr<KeyValueDB::MergeOperator> o)
+    : mop(o), name(o->name()) {}
+  bool Merge(const rocksdb::Slice& key,
+	     const rocksdb::Slice* existing_value,
+	     const rocksdb::Slice& value,
+	     std::string* new_value,
+	     rocksdb::Logger* logger) const override {
+    if (existing_value) {
+      mop->merge(existing_value->data(), existing_value->size(),
+		 value.data(), value.size(),
+		 new_value);
+    } else {
+      mop->merge_nonexistent(value.data(), value.size(), new_value);
+    }
+    return true;
+  }
+};
+
 int RocksDBStore::set_merge_operator(
   const string& prefix,
   std::shared_ptr<KeyValueDB::MergeOperator> mop)
@@ -227,7 +256,8 @@ int RocksDBStore::init(string _options_str)
   return 0;
 }
 
-int RocksDBStore::create_and_open(ostream &out)
+int RocksDBStore::create_and_open(ostream &out,
+				  const vector<ColumnFamily>& cfs)
 {
   if (env) {
     unique_ptr<rocksdb::Directory> dir;
@@ -242,10 +272,39 @@ int RocksDBStore::create_and_open(ostream &out)
       return r;
     }
   }
-  return do_open(out, true);
+  return do_open(out, true, cfs);
+}
+
+int RocksDBStore::get_cf_options(const string& name, const string& option_str,
+				 const rocksdb::Options& opt,
+				 rocksdb::ColumnFamilyOptions *cf_opt)
+{
+  // start from the db wide options, so the block cache, bloom filter
+  // and write buffer settings are shared unless overridden
+  *cf_opt = rocksdb::ColumnFamilyOptions(opt);
+  if (option_str.length()) {
+    rocksdb::Status status = rocksdb::GetColumnFamilyOptionsFromString(
+      *cf_opt, option_str, cf_opt);
+    if (!status.ok()) {
+      derr << __func__ << " invalid options '" << option_str
+	   << "' for column family " << name << ": " << status.ToString()
+	   << dendl;
+      return -EINVAL;
+    }
+  }
+  cf_opt->merge_operator.reset();
+  for (auto& p : merge_ops) {
+    if (p.first == name) {
+      cf_opt->merge_operator.reset(new MergeOperatorLinker(p.second));
+    }
+  }
+  dout(10) << __func__ << " column family " << name << " options '"
+	   << option_str << "'" << dendl;
+  return 0;
 }
 
-int RocksDBStore::do_open(ostream &out, bool create_if_missing)
+int RocksDBStore::do_open(ostream &out, bool create_if_missing,
+			  const vector<ColumnFamily>& cfs)
 {
   rocksdb::Options opt;
   rocksdb::Status status;
@@ -362,11 +421,75 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
 	   << dendl;
 
   opt.merge_operator.reset(new MergeOperatorRouter(*this));
-  status = rocksdb::DB::Open(opt, path, &db);
+
+  // every existing column family must be opened; use the caller's
+  // options for those it named.  there is nothing to list yet on create.
+  map<string, string> cf_options;
+  for (auto& cf : cfs) {
+    cf_options[cf.name] = cf.option;
+  }
+  vector<string> existing_cfs;
+  status = rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(opt), path,
+					   &existing_cfs);
+  if (!status.ok() || existing_cfs.size() <= 1) {
+    status = rocksdb::DB::Open(opt, path, &db);
+  } else {
+    vector<rocksdb::ColumnFamilyDescriptor> descriptors;
+    for (auto& name : existing_cfs) {
+      rocksdb::ColumnFamilyOptions cf_opt(opt);
+      if (name != rocksdb::kDefaultColumnFamilyName) {
+	int r = get_cf_options(name, cf_options[name], opt, &cf_opt);
+	if (r < 0) {
+	  return r;
+	}
+      }
+      descriptors.push_back(rocksdb::ColumnFamilyDescriptor(name, cf_opt));
+    }
+    vector<rocksdb::ColumnFamilyHandle*> handles;
+    status = rocksdb::DB::Open(rocksdb::DBOptions(opt), path, descriptors,
+			       &handles, &db);
+    if (status.ok()) {
+      for (unsigned i = 0; i < descriptors.size(); ++i) {
+	if (descriptors[i].name == rocksdb::kDefaultColumnFamilyName) {
+	  default_cf = handles[i];
+	} else {
+	  cf_handles[descriptors[i].name] = handles[i];
+	}
+      }
+    }
+  }
   if (!status.ok()) {
     derr << status.ToString() << dendl;
     return -EINVAL;
   }
+
+  // keys of an existing prefix would be stranded in the default column
+  // family if it got its own one now, so families are only added on create
+  for (auto& cf : cfs) {
+    if (cf_handles.count(cf.name)) {
+      continue;
+    }
+    if (!create_if_missing) {
+      dout(1) << __func__ << " column family " << cf.name
+	      << " does not exist, keeping its keys in the default one"
+	      << dendl;
+      continue;
+    }
+    rocksdb::ColumnFamilyOptions cf_opt;
+    int r = get_cf_options(cf.name, cf.option, opt, &cf_opt);
+    if (r < 0) {
+      return r;
+    }
+    rocksdb::ColumnFamilyHandle *cf_handle;
+    status = db->CreateColumnFamily(cf_opt, cf.name, &cf_handle);
+    if (!status.ok()) {
+      derr << __func__ << " failed to create column family " << cf.name
+	   << ": " << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    dout(1) << __func__ << " created column family " << cf.name << dendl;
+    cf_handles[cf.name] = cf_handle;
+  }
   
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
@@ -411,6 +534,14 @@ RocksDBStore::~RocksDBStore()
   close();
   delete logger;
 
+  // column family handles must go before the db itself
+  for (auto& p : cf_handles) {
+    delete p.second;
+  }
+  cf_handles.clear();
+  delete default_cf;
+  default_cf = nullptr;
+
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   delete db;
   db = nullptr;
@@ -575,25 +706,54 @@ int RocksDBStore::submit_transaction_sync(KeyValueDB::Transaction t)
   return result;
 }
 
+int RocksDBStore::submit_transaction_rep(bufferlist& rep)
+{
+  utime_t start = ceph_clock_now();
+  rocksdb::WriteBatch bat(std::string(rep.c_str(), rep.length()));
+  rocksdb::WriteOptions woptions;
+  woptions.sync = false;
+  woptions.disableWAL = disableWAL;
+  rocksdb::Status s = db->Write(woptions, &bat);
+  if (!s.ok()) {
+    derr << __func__ << " error: " << s.ToString() << " code = " << s.code()
+	 << dendl;
+  }
+
+  utime_t lat = ceph_clock_now() - start;
+  logger->inc(l_rocksdb_txns);
+  logger->tinc(l_rocksdb_submit_latency, lat);
+
+  return s.ok() ? 0 : -1;
+}
+
 RocksDBStore::RocksDBTransactionImpl::RocksDBTransactionImpl(RocksDBStore *_db)
 {
   db = _db;
 }
 
+int RocksDBStore::RocksDBTransactionImpl::get_rep(bufferlist *bl)
+{
+  const std::string& rep = bat.Data();
+  bl->append(rep.data(), rep.size());
+  return 0;
+}
+
 static void put_bat(
   rocksdb::WriteBatch& bat, 
+  rocksdb::ColumnFamilyHandle *cf,
   const string &key, 
   const bufferlist &to_set_bl)
 {
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Put(cf,
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			   to_set_bl.length()));
   } else {
     rocksdb::Slice key_slice(key);
     vector<rocksdb::Slice> value_slices(to_set_bl.buffers().size());
-    bat.Put(nullptr, rocksdb::SliceParts(&key_slice, 1),
+    bat.Put(cf, rocksdb::SliceParts(&key_slice, 1),
             prepare_sliceparts(to_set_bl, &value_slices));
   }
 }
@@ -603,9 +763,13 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  string key = combine_strings(prefix, k);
-
-  put_bat(bat, key, to_set_bl);
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    put_bat(bat, cf, k, to_set_bl);
+  } else {
+    string key = combine_strings(prefix, k);
+    put_bat(bat, nullptr, key, to_set_bl);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::set(
@@ -613,36 +777,65 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  string key;
-  combine_strings(prefix, k, keylen, &key);
-
-  put_bat(bat, key, to_set_bl);
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    put_bat(bat, cf, string(k, keylen), to_set_bl);
+  } else {
+    string key;
+    combine_strings(prefix, k, keylen, &key);
+    put_bat(bat, nullptr, key, to_set_bl);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  bat.Delete(combine_strings(prefix, k));
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    bat.Delete(cf, rocksdb::Slice(k));
+  } else {
+    bat.Delete(combine_strings(prefix, k));
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  string key;
-  combine_strings(prefix, k, keylen, &key);
-  bat.Delete(key);
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    bat.Delete(cf, rocksdb::Slice(k, keylen));
+  } else {
+    string key;
+    combine_strings(prefix, k, keylen, &key);
+    bat.Delete(key);
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  bat.SingleDelete(combine_strings(prefix, k));
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    bat.SingleDelete(cf, k);
+  } else {
+    bat.SingleDelete(combine_strings(prefix, k));
+  }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
-  if (db->enable_rmrange) {
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    // the whole family is this prefix; there is no upper bound key to
+    // hand to DeleteRange, so remove key by key
+    KeyValueDB::Iterator it = db->get_iterator(prefix);
+    for (it->seek_to_first();
+	 it->valid();
+	 it->next()) {
+      bat.Delete(cf, rocksdb::Slice(it->key()));
+    }
+  } else if (db->enable_rmrange) {
     string endprefix = prefix;
     endprefix.push_back('\x01');
     bat.DeleteRange(combine_strings(prefix, string()),
@@ -661,7 +854,22 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &start,
                                                          const string &end)
 {
-  if (db->enable_rmrange) {
+  auto cf = db->get_cf_handle(prefix);
+  if (cf) {
+    if (db->enable_rmrange) {
+      bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+    } else {
+      auto it = db->get_iterator(prefix);
+      it->lower_bound(start);
+      while (it->valid()) {
+	if (it->key() >= end) {
+	  break;
+	}
+	bat.Delete(cf, rocksdb::Slice(it->key()));
+	it->next();
+      }
+    }
+  } else if (db->enable_rmrange) {
     bat.DeleteRange(combine_strings(prefix, start), combine_strings(prefix, end));
   } else {
     auto it = db->get_iterator(prefix);
@@ -681,18 +889,20 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  string key = combine_strings(prefix, k);
+  auto cf = db->get_cf_handle(prefix);
+  string key = cf ? k : combine_strings(prefix, k);
 
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Merge(rocksdb::Slice(key),
-	       rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Merge(cf,
+	      rocksdb::Slice(key),
+	      rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			     to_set_bl.length()));
   } else {
     // make a copy
     rocksdb::Slice key_slice(key);
     vector<rocksdb::Slice> value_slices(to_set_bl.buffers().size());
-    bat.Merge(nullptr, rocksdb::SliceParts(&key_slice, 1),
+    bat.Merge(cf, rocksdb::SliceParts(&key_slice, 1),
               prepare_sliceparts(to_set_bl, &value_slices));
   }
 }
@@ -704,11 +914,17 @@ int RocksDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
+  auto cf = get_cf_handle(prefix);
   for (std::set<string>::const_iterator i = keys.begin();
        i != keys.end(); ++i) {
     std::string value;
-    std::string bound = combine_strings(prefix, *i);
-    auto status = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(bound), &value);
+    rocksdb::Status status;
+    if (cf) {
+      status = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(*i), &value);
+    } else {
+      std::string bound = combine_strings(prefix, *i);
+      status = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(bound), &value);
+    }
     if (status.ok()) {
       (*out)[*i].append(value);
     } else if (status.IsIOError()) {
@@ -732,8 +948,13 @@ int RocksDBStore::get(
   int r = 0;
   string value, k;
   rocksdb::Status s;
-  k = combine_strings(prefix, key);
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    s = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(key), &value);
+  } else {
+    k = combine_strings(prefix, key);
+    s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  }
   if (s.ok()) {
     out->append(value);
   } else if (s.IsNotFound()) {
@@ -757,9 +978,15 @@ int RocksDBStore::get(
   utime_t start = ceph_clock_now();
   int r = 0;
   string value, k;
-  combine_strings(prefix, key, keylen, &k);
   rocksdb::Status s;
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  auto cf = get_cf_handle(prefix);
+  if (cf) {
+    s = db->Get(rocksdb::ReadOptions(), cf, rocksdb::Slice(key, keylen),
+		&value);
+  } else {
+    combine_strings(prefix, key, keylen, &k);
+    s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  }
   if (s.ok()) {
     out->append(value);
   } else if (s.IsNotFound()) {
@@ -798,6 +1025,9 @@ void RocksDBStore::compact()
   logger->inc(l_rocksdb_compact);
   rocksdb::CompactRangeOptions options;
   db->CompactRange(options, nullptr, nullptr);
+  for (auto& p : cf_handles) {
+    db->CompactRange(options, p.second, nullptr, nullptr);
+  }
 }
 
 
@@ -872,6 +1102,22 @@ bool RocksDBStore::check_omap_dir(string &omap_dir)
 void RocksDBStore::compact_range(const string& start, const string& end)
 {
   rocksdb::CompactRangeOptions options;
+  string prefix, kstart, kend;
+  if (!cf_handles.empty() &&
+      split_key(start, &prefix, &kstart) == 0 &&
+      get_cf_handle(prefix)) {
+    // a range within a prefix family; an end outside it (past_prefix)
+    // means the rest of the family
+    rocksdb::Slice cstart(kstart);
+    string end_prefix;
+    if (split_key(end, &end_prefix, &kend) == 0 && end_prefix == prefix) {
+      rocksdb::Slice cend(kend);
+      db->CompactRange(options, get_cf_handle(prefix), &cstart, &cend);
+    } else {
+      db->CompactRange(options, get_cf_handle(prefix), &cstart, nullptr);
+    }
+    return;
+  }
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   db->CompactRange(options, &cstart, &cend);
@@ -1005,9 +1251,222 @@ string RocksDBStore::past_prefix(const string &prefix)
   return limit;
 }
 
+void RocksDBStore::RocksDBCFIteratorImpl::invalidate()
+{
+  // rocksdb iterators have no end position to seek to; step past the last
+  dbiter->SeekToLast();
+  if (dbiter->Valid())
+    dbiter->Next();
+}
+// the family's keys all sort as (prefix, key), so positioning against
+// another prefix lands on either its first key or past its last one
+int RocksDBStore::RocksDBCFIteratorImpl::seek_to_first(const string &prefix)
+{
+  if (prefix <= this->prefix)
+    dbiter->SeekToFirst();
+  else
+    invalidate();
+  assert(!dbiter->status().IsIOError());
+  return dbiter->status().ok() ? 0 : -1;
+}
+int RocksDBStore::RocksDBCFIteratorImpl::seek_to_last(const string &prefix)
+{
+  if (this->prefix <= prefix)
+    dbiter->SeekToLast();
+  else
+    invalidate();
+  assert(!dbiter->status().IsIOError());
+  return dbiter->status().ok() ? 0 : -1;
+}
+int RocksDBStore::RocksDBCFIteratorImpl::lower_bound(const string &prefix, const string &to)
+{
+  if (prefix == this->prefix)
+    dbiter->Seek(rocksdb::Slice(to));
+  else if (prefix < this->prefix)
+    dbiter->SeekToFirst();
+  else
+    invalidate();
+  return dbiter->status().ok() ? 0 : -1;
+}
+string RocksDBStore::RocksDBCFIteratorImpl::key()
+{
+  return dbiter->key().ToString();
+}
+pair<string,string> RocksDBStore::RocksDBCFIteratorImpl::raw_key()
+{
+  return make_pair(prefix, dbiter->key().ToString());
+}
+bool RocksDBStore::RocksDBCFIteratorImpl::raw_key_is_prefixed(const string &prefix)
+{
+  return prefix == this->prefix;
+}
+size_t RocksDBStore::RocksDBCFIteratorImpl::key_size()
+{
+  // as if it were stored combined with the prefix
+  return prefix.size() + 1 + dbiter->key().size();
+}
+
+int RocksDBStore::RocksDBMergedIteratorImpl::pick(bool fwd)
+{
+  forward = fwd;
+  cur.reset();
+  pair<string,string> cur_key;
+  for (auto& i : iters) {
+    if (!i->valid())
+      continue;
+    pair<string,string> k = i->raw_key();
+    if (!cur || (forward ? k < cur_key : k > cur_key)) {
+      cur = i;
+      cur_key = std::move(k);
+    }
+  }
+  return status();
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::seek_to_first()
+{
+  for (auto& i : iters)
+    i->seek_to_first();
+  return pick(true);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::seek_to_first(const string &prefix)
+{
+  for (auto& i : iters)
+    i->seek_to_first(prefix);
+  return pick(true);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::seek_to_last()
+{
+  for (auto& i : iters)
+    i->seek_to_last();
+  return pick(false);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::seek_to_last(const string &prefix)
+{
+  for (auto& i : iters)
+    i->seek_to_last(prefix);
+  return pick(false);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::upper_bound(const string &prefix, const string &after)
+{
+  for (auto& i : iters)
+    i->upper_bound(prefix, after);
+  return pick(true);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::lower_bound(const string &prefix, const string &to)
+{
+  for (auto& i : iters)
+    i->lower_bound(prefix, to);
+  return pick(true);
+}
+bool RocksDBStore::RocksDBMergedIteratorImpl::valid()
+{
+  return cur && cur->valid();
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::next()
+{
+  if (!valid())
+    return status();
+  if (!forward) {
+    // the others sit before the current key; move them past it.  a key
+    // lives in exactly one family, so lower_bound is past it for them.
+    pair<string,string> k = cur->raw_key();
+    for (auto& i : iters) {
+      if (i != cur)
+	i->lower_bound(k.first, k.second);
+    }
+  }
+  cur->next();
+  return pick(true);
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::prev()
+{
+  if (!valid())
+    return status();
+  if (forward) {
+    // the others sit past the current key; move them before it
+    pair<string,string> k = cur->raw_key();
+    for (auto& i : iters) {
+      if (i == cur)
+	continue;
+      i->lower_bound(k.first, k.second);
+      if (i->valid())
+	i->prev();
+      else
+	i->seek_to_last();
+    }
+  }
+  cur->prev();
+  return pick(false);
+}
+string RocksDBStore::RocksDBMergedIteratorImpl::key()
+{
+  return cur->key();
+}
+pair<string,string> RocksDBStore::RocksDBMergedIteratorImpl::raw_key()
+{
+  return cur->raw_key();
+}
+bool RocksDBStore::RocksDBMergedIteratorImpl::raw_key_is_prefixed(const string &prefix)
+{
+  return cur->raw_key_is_prefixed(prefix);
+}
+bufferlist RocksDBStore::RocksDBMergedIteratorImpl::value()
+{
+  return cur->value();
+}
+bufferptr RocksDBStore::RocksDBMergedIteratorImpl::value_as_ptr()
+{
+  return cur->value_as_ptr();
+}
+int RocksDBStore::RocksDBMergedIteratorImpl::status()
+{
+  for (auto& i : iters) {
+    int r = i->status();
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+size_t RocksDBStore::RocksDBMergedIteratorImpl::key_size()
+{
+  return cur->key_size();
+}
+size_t RocksDBStore::RocksDBMergedIteratorImpl::value_size()
+{
+  return cur->value_size();
+}
+
+RocksDBStore::Iterator RocksDBStore::get_iterator(const string &prefix)
+{
+  auto cf = get_cf_handle(prefix);
+  if (!cf) {
+    return KeyValueDB::get_iterator(prefix);
+  }
+  // a prefix extractor may be set for the family; iterators still need
+  // to see keys in total order
+  rocksdb::ReadOptions options;
+  options.total_order_seek = true;
+  return std::make_shared<IteratorImpl>(
+    prefix,
+    std::make_shared<RocksDBCFIteratorImpl>(prefix,
+					    db->NewIterator(options, cf)));
+}
+
 RocksDBStore::WholeSpaceIterator RocksDBStore::_get_iterator()
 {
-  return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-        db->NewIterator(rocksdb::ReadOptions()));
+  if (cf_handles.empty()) {
+    return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+          db->NewIterator(rocksdb::ReadOptions()));
+  }
+  rocksdb::ReadOptions options;
+  options.total_order_seek = true;
+  std::vector<WholeSpaceIterator> iters;
+  iters.push_back(std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+                    db->NewIterator(options)));
+  for (auto& p : cf_handles) {
+    iters.push_back(std::make_shared<RocksDBCFIteratorImpl>(
+                      p.first, db->NewIterator(options, p.second)));
+  }
+  return std::make_shared<RocksDBMergedIteratorImpl>(std::move(iters));
 }
 
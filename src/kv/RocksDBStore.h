@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -55,7 +56,9 @@ namespace rocksdb{
   class WriteBatch;
   class Iterator;
   class Logger;
+  class ColumnFamilyHandle;
   struct Options;
+  struct ColumnFamilyOptions;
   struct BlockBasedTableOptions;
 }
 
@@ -78,8 +81,25 @@ class RocksDBStore : public KeyValueDB {
   uint64_t cache_size = 0;
   bool set_cache_flag = false;
 
+  /// column families by the prefix they hold; anything else goes to default
+  std::unordered_map<std::string, rocksdb::ColumnFamilyHandle*> cf_handles;
+  rocksdb::ColumnFamilyHandle *default_cf = nullptr;
+
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix) {
+    if (cf_handles.empty())
+      return nullptr;
+    auto p = cf_handles.find(prefix);
+    if (p == cf_handles.end())
+      return nullptr;
+    return p->second;
+  }
+  int get_cf_options(const std::string& name, const std::string& option_str,
+		     const rocksdb::Options& opt,
+		     rocksdb::ColumnFamilyOptions *cf_opt);
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
-  int do_open(ostream &out, bool create_if_missing);
+  int do_open(ostream &out, bool create_if_missing,
+	      const std::vector<ColumnFamily>& cfs);
 
   // manage async compactions
   Mutex compact_queue_lock;
@@ -115,10 +135,19 @@ public:
   int init(string options_str) override;
   /// compact rocksdb for all keys with a given prefix
   void compact_prefix(const string& prefix) override {
-    compact_range(prefix, past_prefix(prefix));
+    if (get_cf_handle(prefix)) {
+      compact_range(combine_strings(prefix, string()), past_prefix(prefix));
+    } else {
+      compact_range(prefix, past_prefix(prefix));
+    }
   }
   void compact_prefix_async(const string& prefix) override {
-    compact_range_async(prefix, past_prefix(prefix));
+    if (get_cf_handle(prefix)) {
+      compact_range_async(combine_strings(prefix, string()),
+			  past_prefix(prefix));
+    } else {
+      compact_range_async(prefix, past_prefix(prefix));
+    }
   }
 
   void compact_range(const string& prefix, const string& start, const string& end) override {
@@ -149,10 +178,19 @@ public:
   static bool check_omap_dir(string &omap_dir);
   /// Opens underlying db
   int open(ostream &out) override {
-    return do_open(out, false);
+    return do_open(out, false, std::vector<ColumnFamily>());
+  }
+  /// Opens underlying db, with options for any of its column families
+  int open(ostream &out, const std::vector<ColumnFamily>& cfs) override {
+    return do_open(out, false, cfs);
   }
   /// Creates underlying db if missing and opens it
-  int create_and_open(ostream &out) override;
+  int create_and_open(ostream &out) override {
+    return create_and_open(out, std::vector<ColumnFamily>());
+  }
+  /// Creates underlying db and any missing column families, and opens it
+  int create_and_open(ostream &out,
+		      const std::vector<ColumnFamily>& cfs) override;
 
   void close() override;
 
@@ -287,6 +325,7 @@ public:
       const string& prefix,
       const string& k,
       const bufferlist &bl) override;
+    int get_rep(bufferlist *bl) override;
   };
 
   KeyValueDB::Transaction get_transaction() override {
@@ -295,6 +334,7 @@ public:
 
   int submit_transaction(KeyValueDB::Transaction t) override;
   int submit_transaction_sync(KeyValueDB::Transaction t) override;
+  int submit_transaction_rep(bufferlist& rep) override;
   int get(
     const string &prefix,
     const std::set<string> &key,
@@ -341,6 +381,61 @@ public:
     size_t value_size() override;
   };
 
+  /// Iterates a column family holding a single prefix, presenting its
+  /// keys as if they were stored under that prefix in the default one.
+  class RocksDBCFIteratorImpl : public RocksDBWholeSpaceIteratorImpl {
+    const string prefix;
+    void invalidate();
+  public:
+    RocksDBCFIteratorImpl(const string &prefix, rocksdb::Iterator *iter) :
+      RocksDBWholeSpaceIteratorImpl(iter), prefix(prefix) { }
+
+    int seek_to_first(const string &prefix) override;
+    int seek_to_last(const string &prefix) override;
+    int lower_bound(const string &prefix, const string &to) override;
+    string key() override;
+    pair<string,string> raw_key() override;
+    bool raw_key_is_prefixed(const string &prefix) override;
+    size_t key_size() override;
+    using RocksDBWholeSpaceIteratorImpl::seek_to_first;
+    using RocksDBWholeSpaceIteratorImpl::seek_to_last;
+  };
+
+  /// Walks the default column family and all prefix families together,
+  /// in the same (prefix, key) order a single keyspace would have.
+  class RocksDBMergedIteratorImpl :
+    public KeyValueDB::WholeSpaceIteratorImpl {
+    std::vector<WholeSpaceIterator> iters;
+    WholeSpaceIterator cur;  ///< iterator at the current position, if any
+    bool forward = true;     ///< whether the others are past or before cur
+
+    int pick(bool fwd);
+  public:
+    explicit RocksDBMergedIteratorImpl(std::vector<WholeSpaceIterator>&& i) :
+      iters(std::move(i)) { }
+
+    int seek_to_first() override;
+    int seek_to_first(const string &prefix) override;
+    int seek_to_last() override;
+    int seek_to_last(const string &prefix) override;
+    int upper_bound(const string &prefix, const string &after) override;
+    int lower_bound(const string &prefix, const string &to) override;
+    bool valid() override;
+    int next() override;
+    int prev() override;
+    string key() override;
+    pair<string,string> raw_key() override;
+    bool raw_key_is_prefixed(const string &prefix) override;
+    bufferlist value() override;
+    bufferptr value_as_ptr() override;
+    int status() override;
+    size_t key_size() override;
+    size_t value_size() override;
+  };
+
+  using KeyValueDB::get_iterator;
+  Iterator get_iterator(const string &prefix) override;
+
   /// Utility
   static string combine_strings(const string &prefix, const string &value) {
     string out = prefix;
@@ -368,6 +463,7 @@ public:
   static string past_prefix(const string &prefix);
 
   class MergeOperatorRouter;
+  class MergeOperatorLinker;
   friend class MergeOperatorRouter;
   int set_merge_operator(const std::string& prefix,
 				 std::shared_ptr<KeyValueDB::MergeOperator> mop) override;
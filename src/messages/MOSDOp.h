@@ -19,6 +19,7 @@
 #include "MOSDFastDispatchOp.h"
 #include "include/ceph_features.h"
 #include "common/hobject.h"
+#include "dmclock/src/dmclock_recs.h"
 #include <atomic>
 
 /*
@@ -33,7 +34,7 @@ class OSD;
 
 class MOSDOp : public MOSDFastDispatchOp {
 
-  static const int HEAD_VERSION = 8;
+  static const int HEAD_VERSION = 9;
   static const int COMPAT_VERSION = 3;
 
 private:
@@ -62,6 +63,13 @@ private:
   bool bdata_encode;
   osd_reqid_t reqid; // reqid explicitly set by sender
 
+  // dmclock delta/rho from the client's ServiceTracker (v9)
+  uint32_t qos_delta = 1;
+  uint32_t qos_rho = 1;
+  // phase the op was scheduled in; OSD-local, echoed in the reply
+  crimson::dmclock::PhaseType qos_phase =
+    crimson::dmclock::PhaseType::priority;
+
 public:
   friend class MOSDOpReply;
 
@@ -166,6 +174,21 @@ public:
     return get_connection()->get_features();
   }
 
+  void set_qos_params(const crimson::dmclock::ReqParams& rp) {
+    qos_delta = rp.delta;
+    qos_rho = rp.rho;
+  }
+  crimson::dmclock::ReqParams get_qos_params() const {
+    assert(!partial_decode_needed);
+    // don't let a bogus peer trip the ReqParams asserts
+    uint32_t delta = std::max<uint32_t>(qos_delta, 1);
+    uint32_t rho = std::min(std::max<uint32_t>(qos_rho, 1), delta);
+    return crimson::dmclock::ReqParams(delta, rho);
+  }
+  void set_qos_phase(crimson::dmclock::PhaseType phase) {
+    qos_phase = phase;
+  }
+
   MOSDOp()
     : MOSDFastDispatchOp(CEPH_MSG_OSD_OP, HEAD_VERSION, COMPAT_VERSION),
       partial_decode_needed(true),
@@ -357,15 +380,19 @@ struct ceph_osd_request_head {
       ::encode(retry_attempt, payload);
       ::encode(features, payload);
     } else {
-      // latest v8 encoding with hobject_t hash separate from pgid, no
-      // reassert version
-      header.version = HEAD_VERSION;
+      // v8 encoding with hobject_t hash separate from pgid, no
+      // reassert version; v9 adds the dmclock request params
+      header.version = HAVE_FEATURE(features, QOS_DMC) ? HEAD_VERSION : 8;
       ::encode(pgid, payload);
       ::encode(hobj.get_hash(), payload);
       ::encode(osdmap_epoch, payload);
       ::encode(flags, payload);
       ::encode(reqid, payload);
       encode_trace(payload, features);
+      if (header.version >= 9) {
+	::encode(qos_delta, payload);
+	::encode(qos_rho, payload);
+      }
 
       // -- above decoded up front; below decoded post-dispatch thread --
 
@@ -393,7 +420,7 @@ struct ceph_osd_request_head {
     p = payload.begin();
 
     // Always keep here the newest version of decoding order/rule
-    if (header.version == HEAD_VERSION) {
+    if (header.version >= 8) {
       ::decode(pgid, p);      // actual pgid
       uint32_t hash;
       ::decode(hash, p); // raw hash value
@@ -402,6 +429,10 @@ struct ceph_osd_request_head {
       ::decode(flags, p);
       ::decode(reqid, p);
       decode_trace(p);
+      if (header.version >= 9) {
+	::decode(qos_delta, p);
+	::decode(qos_rho, p);
+      }
     } else if (header.version == 7) {
       ::decode(pgid.pgid, p);      // raw pgid
       hobj.set_hash(pgid.pgid.ps());
@@ -32,7 +32,7 @@
 
 class MOSDOpReply : public Message {
 
-  static const int HEAD_VERSION = 8;
+  static const int HEAD_VERSION = 9;
   static const int COMPAT_VERSION = 2;
 
   object_t oid;
@@ -48,6 +48,8 @@ class MOSDOpReply : public Message {
   int32_t retry_attempt = -1;
   bool do_redirect;
   request_redirect_t redirect;
+  crimson::dmclock::PhaseType qos_phase =
+    crimson::dmclock::PhaseType::priority;
 
 public:
   const object_t& get_oid() const { return oid; }
@@ -95,6 +97,9 @@ public:
   const request_redirect_t& get_redirect() const { return redirect; }
   bool is_redirect_reply() const { return do_redirect; }
 
+  /// dmclock phase the OSD scheduled the request in
+  crimson::dmclock::PhaseType get_qos_phase() const { return qos_phase; }
+
   void add_flags(int f) { flags |= f; }
 
   void claim_op_out_data(vector<OSDOp>& o) {
@@ -145,6 +150,7 @@ public:
     user_version = 0;
     retry_attempt = req->get_retry_attempt();
     do_redirect = false;
+    qos_phase = req->qos_phase;
 
     // zero out ops payload_len and possibly out data
     for (unsigned i = 0; i < ops.size(); i++) {
@@ -211,6 +217,11 @@ public:
         }
       }
       encode_trace(payload, features);
+      if (HAVE_FEATURE(features, QOS_DMC)) {
+	::encode((__u8)qos_phase, payload);
+      } else if (header.version == HEAD_VERSION) {
+	header.version = 8;
+      }
     }
   }
   void decode_payload() override {
@@ -243,6 +254,9 @@ public:
       if (do_redirect)
 	::decode(redirect, p);
       decode_trace(p);
+      __u8 phase;
+      ::decode(phase, p);
+      qos_phase = (crimson::dmclock::PhaseType)phase;
     } else if (header.version < 2) {
       ceph_osd_reply_head head;
       ::decode(head, p);
@@ -13,6 +13,7 @@
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
 #include <ostream>
+#include <functional>
 #include "include/assert.h"
 #include "os/bluestore/bluestore_types.h"
 
@@ -48,11 +49,25 @@ public:
 
   virtual void dump() = 0;
 
+  /// call notify for each free extent; false if not supported
+  virtual bool foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) {
+    return false;
+  }
+
   virtual void init_add_free(uint64_t offset, uint64_t length) = 0;
   virtual void init_rm_free(uint64_t offset, uint64_t length) = 0;
 
   virtual uint64_t get_free() = 0;
 
+  /*
+   * Fragmentation score of the free space, from 0 (one contiguous free
+   * extent) to 1 (every free alloc_unit is a separate extent).
+   */
+  virtual double get_fragmentation(uint64_t alloc_unit) {
+    return 0.0;
+  }
+
   virtual void shutdown() = 0;
   static Allocator *create(CephContext* cct, string type, int64_t size,
 			   int64_t block_size);
@@ -0,0 +1,354 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "AvlAllocator.h"
+#include "bluestore_types.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "avlalloc "
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(range_seg_t, range_seg_t, bluestore_alloc);
+
+AvlAllocator::AvlAllocator(CephContext* cct,
+			   int64_t device_size,
+			   int64_t block_size)
+  : cct(cct),
+    device_size(device_size),
+    num_free(0),
+    num_reserved(0),
+    last_alloc(0)
+{
+}
+
+AvlAllocator::~AvlAllocator()
+{
+  _shutdown();
+}
+
+/// first offset >= from within rs that is aligned to alloc_unit
+uint64_t AvlAllocator::_aligned_start(const range_seg_t& rs, uint64_t from,
+				      uint64_t alloc_unit) const
+{
+  uint64_t start = std::max(rs.start, from);
+  uint64_t skew = start % alloc_unit;
+  if (skew)
+    start += alloc_unit - skew;
+  return start;
+}
+
+bool AvlAllocator::_pick_near(uint64_t want, uint64_t alloc_unit,
+			      uint64_t hint, uint64_t *offset)
+{
+  uint64_t max_search = cct->_conf->bluestore_avl_alloc_ff_max_search_count;
+  uint64_t searched = 0;
+
+  // start with the extent containing hint, if there is one
+  auto p = range_tree.upper_bound(hint, range_seg_t::before_t());
+  if (p != range_tree.begin()) {
+    --p;
+    if (p->end <= hint)
+      ++p;
+  }
+  for (; p != range_tree.end() && searched < max_search; ++p, ++searched) {
+    uint64_t start = _aligned_start(*p, hint, alloc_unit);
+    if (start + want <= p->end) {
+      *offset = start;
+      return true;
+    }
+  }
+
+  // wrap around
+  for (p = range_tree.begin();
+       p != range_tree.end() && p->start < hint && searched < max_search;
+       ++p, ++searched) {
+    uint64_t start = _aligned_start(*p, p->start, alloc_unit);
+    if (start + want <= p->end) {
+      *offset = start;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AvlAllocator::_pick_best(uint64_t want, uint64_t alloc_unit,
+			      uint64_t *offset)
+{
+  // smallest extent that is long enough; alignment may still rule it
+  // out, in which case try the next larger one.
+  for (auto p = range_size_tree.lower_bound(want, range_seg_t::shorter_t());
+       p != range_size_tree.end();
+       ++p) {
+    uint64_t start = _aligned_start(*p, p->start, alloc_unit);
+    if (start + want <= p->end) {
+      *offset = start;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool AvlAllocator::_pick_largest(uint64_t alloc_unit, uint64_t *offset,
+				 uint64_t *length)
+{
+  for (auto p = range_size_tree.rbegin();
+       p != range_size_tree.rend();
+       ++p) {
+    uint64_t start = _aligned_start(*p, p->start, alloc_unit);
+    if (start >= p->end)
+      continue;
+    uint64_t len = p->end - start;
+    len -= len % alloc_unit;
+    if (len) {
+      *offset = start;
+      *length = len;
+      return true;
+    }
+  }
+  return false;
+}
+
+void AvlAllocator::_add_to_tree(uint64_t start, uint64_t size)
+{
+  assert(size != 0);
+
+  uint64_t end = start + size;
+
+  auto rs_after = range_tree.upper_bound(start, range_seg_t::before_t());
+
+  /* Make sure we don't overlap with either of our neighbors */
+  auto rs_before = range_tree.end();
+  if (rs_after != range_tree.begin()) {
+    rs_before = std::prev(rs_after);
+  }
+  assert(rs_before == range_tree.end() || rs_before->end <= start);
+  assert(rs_after == range_tree.end() || rs_after->start >= end);
+
+  bool merge_before = (rs_before != range_tree.end() && rs_before->end == start);
+  bool merge_after = (rs_after != range_tree.end() && rs_after->start == end);
+
+  if (merge_before && merge_after) {
+    range_size_tree.erase(*rs_before);
+    range_size_tree.erase(*rs_after);
+    rs_before->end = rs_after->end;
+    range_tree.erase_and_dispose(rs_after, [](range_seg_t *p) { delete p; });
+    range_size_tree.insert(*rs_before);
+  } else if (merge_before) {
+    range_size_tree.erase(*rs_before);
+    rs_before->end = end;
+    range_size_tree.insert(*rs_before);
+  } else if (merge_after) {
+    range_size_tree.erase(*rs_after);
+    rs_after->start = start;
+    range_size_tree.insert(*rs_after);
+  } else {
+    auto rs = new range_seg_t(start, end);
+    range_tree.insert_before(rs_after, *rs);
+    range_size_tree.insert(*rs);
+  }
+  num_free += size;
+}
+
+void AvlAllocator::_remove_from_tree(uint64_t start, uint64_t size)
+{
+  uint64_t end = start + size;
+
+  assert(size != 0);
+  auto rs = range_tree.upper_bound(start, range_seg_t::before_t());
+  assert(rs != range_tree.begin());
+  --rs;
+  /* Make sure we completely overlap with someone */
+  assert(rs->start <= start);
+  assert(rs->end >= end);
+
+  bool left_over = (rs->start != start);
+  bool right_over = (rs->end != end);
+
+  range_size_tree.erase(*rs);
+
+  if (left_over && right_over) {
+    auto new_seg = new range_seg_t(end, rs->end);
+    rs->end = start;
+    range_tree.insert(std::next(rs), *new_seg);
+    range_size_tree.insert(*new_seg);
+    range_size_tree.insert(*rs);
+  } else if (left_over) {
+    rs->end = start;
+    range_size_tree.insert(*rs);
+  } else if (right_over) {
+    rs->start = end;
+    range_size_tree.insert(*rs);
+  } else {
+    range_tree.erase_and_dispose(rs, [](range_seg_t *p) { delete p; });
+  }
+  assert(num_free >= (int64_t)size);
+  num_free -= size;
+}
+
+int64_t AvlAllocator::_allocate(
+  uint64_t want, uint64_t alloc_unit, uint64_t hint,
+  uint64_t *offset, uint64_t *length)
+{
+  dout(10) << __func__ << " want 0x" << std::hex << want
+	   << " alloc_unit 0x" << alloc_unit
+	   << " hint 0x" << hint << std::dec
+	   << dendl;
+  want = MAX(alloc_unit, want);
+
+  if (!hint)
+    hint = last_alloc;
+
+  // near-fit keeps consecutive allocations together; once space is
+  // scarce, best-fit preserves the large extents instead.
+  bool best_fit = (uint64_t)num_free * 100 <
+    device_size * cct->_conf->bluestore_avl_alloc_bf_free_pct;
+
+  *length = want;
+  if ((best_fit || !_pick_near(want, alloc_unit, hint, offset)) &&
+      !_pick_best(want, alloc_unit, offset) &&
+      !_pick_largest(alloc_unit, offset, length)) {
+    return -ENOSPC;
+  }
+  dout(30) << __func__ << " got 0x" << std::hex << *offset << "~" << *length
+	   << std::dec << (best_fit ? " (best-fit)" : "") << dendl;
+
+  _remove_from_tree(*offset, *length);
+  num_reserved -= *length;
+  assert(num_reserved >= 0);
+  last_alloc = *offset + *length;
+  return 0;
+}
+
+int AvlAllocator::reserve(uint64_t need)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " need 0x" << std::hex << need
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  if ((int64_t)need > num_free - num_reserved)
+    return -ENOSPC;
+  num_reserved += need;
+  return 0;
+}
+
+void AvlAllocator::unreserve(uint64_t unused)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " unused 0x" << std::hex << unused
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  assert(num_reserved >= (int64_t)unused);
+  num_reserved -= unused;
+}
+
+int64_t AvlAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  mempool::bluestore_alloc::vector<AllocExtent> *extents)
+{
+  uint64_t allocated_size = 0;
+  uint64_t offset = 0;
+  uint64_t length = 0;
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+
+  ExtentList block_list = ExtentList(extents, 1, max_alloc_size);
+
+  std::lock_guard<std::mutex> l(lock);
+  while (allocated_size < want_size) {
+    int r = _allocate(MIN(max_alloc_size, (want_size - allocated_size)),
+		      alloc_unit, hint, &offset, &length);
+    if (r < 0) {
+      break;
+    }
+    block_list.add_extents(offset, length);
+    allocated_size += length;
+    hint = offset + length;
+  }
+
+  if (allocated_size == 0) {
+    return -ENOSPC;
+  }
+  return allocated_size;
+}
+
+void AvlAllocator::release(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+uint64_t AvlAllocator::get_free()
+{
+  std::lock_guard<std::mutex> l(lock);
+  return num_free;
+}
+
+double AvlAllocator::get_fragmentation(uint64_t alloc_unit)
+{
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t free_blocks = (num_free + alloc_unit - 1) / alloc_unit;
+  if (free_blocks <= 1) {
+    return 0.0;
+  }
+  return (double)(range_tree.size() - 1) / (free_blocks - 1);
+}
+
+void AvlAllocator::dump()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(0) << __func__ << " range_tree: " << range_tree.size()
+	  << " extents" << dendl;
+  for (auto& rs : range_tree) {
+    dout(0) << __func__ << "  0x" << std::hex << rs.start << "~"
+	    << rs.length() << std::dec << dendl;
+  }
+}
+
+bool AvlAllocator::foreach(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(lock);
+  for (auto& rs : range_tree) {
+    notify(rs.start, rs.length());
+  }
+  return true;
+}
+
+void AvlAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+void AvlAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  _remove_from_tree(offset, length);
+}
+
+void AvlAllocator::_shutdown()
+{
+  range_size_tree.clear();
+  range_tree.clear_and_dispose([](range_seg_t *p) { delete p; });
+  num_free = 0;
+}
+
+void AvlAllocator::shutdown()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(1) << __func__ << dendl;
+  _shutdown();
+}
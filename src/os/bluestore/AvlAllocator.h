@@ -0,0 +1,145 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_AVLALLOCATOR_H
+#define CEPH_OS_BLUESTORE_AVLALLOCATOR_H
+
+#include <mutex>
+#include <boost/intrusive/avl_set.hpp>
+
+#include "Allocator.h"
+#include "os/bluestore/bluestore_types.h"
+#include "include/mempool.h"
+
+/// a free extent [start, end), linked into both the offset and size trees
+struct range_seg_t {
+  MEMPOOL_CLASS_HELPERS();  ///< memory monitoring
+  uint64_t start;  ///< starting offset of this segment
+  uint64_t end;    ///< ending offset (non-inclusive)
+
+  range_seg_t(uint64_t start, uint64_t end)
+    : start{start},
+      end{end}
+  {}
+  uint64_t length() const {
+    return end - start;
+  }
+
+  // order by offset; free segments never overlap
+  struct before_t {
+    bool operator()(const range_seg_t& lhs, const range_seg_t& rhs) const {
+      return lhs.start < rhs.start;
+    }
+    bool operator()(const range_seg_t& lhs, uint64_t offset) const {
+      return lhs.start < offset;
+    }
+    bool operator()(uint64_t offset, const range_seg_t& rhs) const {
+      return offset < rhs.start;
+    }
+  };
+  boost::intrusive::avl_set_member_hook<> offset_hook;
+
+  // order by size, then by offset so equal sized segments stay distinct
+  struct shorter_t {
+    bool operator()(const range_seg_t& lhs, const range_seg_t& rhs) const {
+      auto lhs_size = lhs.length();
+      auto rhs_size = rhs.length();
+      if (lhs_size != rhs_size) {
+	return lhs_size < rhs_size;
+      }
+      return lhs.start < rhs.start;
+    }
+    bool operator()(const range_seg_t& lhs, uint64_t size) const {
+      return lhs.length() < size;
+    }
+    bool operator()(uint64_t size, const range_seg_t& rhs) const {
+      return size < rhs.length();
+    }
+  };
+  boost::intrusive::avl_set_member_hook<> size_hook;
+};
+
+/*
+ * Free space is kept as a set of non-adjacent extents, indexed twice:
+ * by offset, for near-fit allocation and for coalescing on release,
+ * and by (size, offset), for best-fit allocation.  Both lookups are
+ * O(log n) in the number of free extents, and the memory used grows
+ * with fragmentation rather than with device size.
+ *
+ * Allocation normally takes the first extent at or after the hint
+ * (or the end of the previous allocation) that can hold the request,
+ * giving up after bluestore_avl_alloc_ff_max_search_count extents.
+ * It then falls back to best-fit, which is also used straight away
+ * once the free space drops below bluestore_avl_alloc_bf_free_pct.
+ */
+class AvlAllocator : public Allocator {
+  CephContext* cct;
+  std::mutex lock;
+
+  typedef boost::intrusive::avl_set<
+    range_seg_t,
+    boost::intrusive::compare<range_seg_t::before_t>,
+    boost::intrusive::member_hook<
+      range_seg_t,
+      boost::intrusive::avl_set_member_hook<>,
+      &range_seg_t::offset_hook>> range_tree_t;
+  typedef boost::intrusive::avl_multiset<
+    range_seg_t,
+    boost::intrusive::compare<range_seg_t::shorter_t>,
+    boost::intrusive::member_hook<
+      range_seg_t,
+      boost::intrusive::avl_set_member_hook<>,
+      &range_seg_t::size_hook>> range_size_tree_t;
+
+  range_tree_t range_tree;           ///< free extents by offset
+  range_size_tree_t range_size_tree; ///< free extents by size
+
+  const uint64_t device_size;
+  int64_t num_free;     ///< total bytes in freelist
+  int64_t num_reserved; ///< reserved bytes
+
+  uint64_t last_alloc;  ///< near-fit cursor when no hint is given
+
+  uint64_t _aligned_start(const range_seg_t& rs, uint64_t from,
+			  uint64_t alloc_unit) const;
+  bool _pick_near(uint64_t want, uint64_t alloc_unit, uint64_t hint,
+		  uint64_t *offset);
+  bool _pick_best(uint64_t want, uint64_t alloc_unit, uint64_t *offset);
+  bool _pick_largest(uint64_t alloc_unit, uint64_t *offset,
+		     uint64_t *length);
+
+  void _add_to_tree(uint64_t start, uint64_t size);
+  void _remove_from_tree(uint64_t start, uint64_t size);
+
+  int64_t _allocate(uint64_t want, uint64_t alloc_unit, uint64_t hint,
+		    uint64_t *offset, uint64_t *length);
+  void _shutdown();
+
+public:
+  AvlAllocator(CephContext* cct, int64_t device_size, int64_t block_size);
+  ~AvlAllocator() override;
+
+  int reserve(uint64_t need) override;
+  void unreserve(uint64_t unused) override;
+
+  int64_t allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, mempool::bluestore_alloc::vector<AllocExtent> *extents) override;
+
+  void release(
+    uint64_t offset, uint64_t length) override;
+
+  uint64_t get_free() override;
+  double get_fragmentation(uint64_t alloc_unit) override;
+
+  void dump() override;
+  bool foreach(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  void shutdown() override;
+};
+
+#endif
@@ -325,6 +325,55 @@ bool BitmapFreelistManager::enumerate_next(uint64_t *offset, uint64_t *length)
   return false;
 }
 
+void BitmapFreelistManager::enumerate_range(
+  uint64_t offset, uint64_t length,
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  uint64_t end = std::min(offset + length, size);
+  uint64_t first_key = offset & key_mask;
+
+  KeyValueDB::Iterator it = kvdb->get_iterator(bitmap_prefix);
+  string k;
+  make_offset_key(first_key, &k);
+  it->lower_bound(k);
+
+  // a missing key means all of its blocks are free
+  uint64_t free_start = end;
+  for (uint64_t key_off = first_key; key_off < end; key_off += bytes_per_key) {
+    bufferlist bl;
+    if (it->valid()) {
+      uint64_t it_off;
+      string ik = it->key();
+      const char *p = ik.c_str();
+      _key_decode_u64(p, &it_off);
+      if (it_off == key_off) {
+	bl = it->value();
+	it->next();
+      }
+    }
+    const char *p = bl.length() ? bl.c_str() : nullptr;
+    for (unsigned i = 0; i < blocks_per_key; ++i) {
+      uint64_t off = _get_offset(key_off, i);
+      if (off < offset)
+	continue;
+      if (off >= end)
+	break;
+      bool used = p && (p[i >> 3] & (1u << (i & 7)));
+      if (!used && free_start == end) {
+	free_start = off;
+      } else if (used && free_start != end) {
+	notify(free_start, off - free_start);
+	free_start = end;
+      }
+    }
+  }
+  if (free_start != end) {
+    notify(free_start, end - free_start);
+  }
+}
+
 void BitmapFreelistManager::dump()
 {
   enumerate_reset();
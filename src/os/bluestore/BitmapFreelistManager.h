@@ -60,6 +60,9 @@ public:
 
   void enumerate_reset() override;
   bool enumerate_next(uint64_t *offset, uint64_t *length) override;
+  void enumerate_range(
+    uint64_t offset, uint64_t length,
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
 
   void allocate(
     uint64_t offset, uint64_t length,
@@ -101,8 +101,7 @@ BlockDevice *BlockDevice::create(CephContext* cct, const string& path,
 void BlockDevice::queue_reap_ioc(IOContext *ioc)
 {
   std::lock_guard<std::mutex> l(ioc_reap_lock);
-  if (ioc_reap_count.load() == 0)
-    ++ioc_reap_count;
+  ioc_reap_count = 1;
   ioc_reap_queue.push_back(ioc);
 }
 
@@ -115,6 +114,6 @@ void BlockDevice::reap_ioc()
       delete p;
     }
     ioc_reap_queue.clear();
-    --ioc_reap_count;
+    ioc_reap_count = 0;
   }
 }
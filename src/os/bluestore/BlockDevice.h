@@ -46,6 +46,8 @@ public:
   std::list<aio_t> running_aios;    ///< submitting or submitted
   std::atomic_int num_pending = {0};
   std::atomic_int num_running = {0};
+  int shard_hint = -1;  ///< selects device completion queue (-1 = any)
+  int io_queue = -1;    ///< completion queue picked on our first submit
 
   explicit IOContext(CephContext* cct, void *p)
     : cct(cct), priv(p)
@@ -62,12 +64,9 @@ public:
   void aio_wait();
 
   void try_aio_wake() {
+    // all completions of an ioc are reaped by one thread, so only the
+    // last one needs the lock to make sure aio_wait() can't miss it
     if (num_running == 1) {
-
-      // we might have some pending IOs submitted after the check
-      // as there is no lock protection for aio_submit.
-      // Hence we might have false conditional trigger.
-      // aio_wait has to handle that hence do not care here.
       std::lock_guard<std::mutex> l(lock);
       cond.notify_all();
       --num_running;
@@ -92,6 +91,7 @@ protected:
   uint64_t size;
   uint64_t block_size;
   bool rotational = true;
+  uint64_t fast_base = 0;  ///< start of the fast tier, if any
 
 public:
   aio_callback_t aio_callback;
@@ -115,6 +115,17 @@ public:
   uint64_t get_size() const { return size; }
   uint64_t get_block_size() const { return block_size; }
 
+  /// map a second, faster device at [base, base + its size)
+  virtual int add_fast_tier(const std::string& path, uint64_t base) {
+    return -EOPNOTSUPP;
+  }
+  uint64_t get_fast_base() const { return fast_base; }  ///< 0 if none
+  /// size of the main device alone
+  uint64_t get_main_size() const { return fast_base ? fast_base : size; }
+  bool is_fast(uint64_t off) const {
+    return fast_base && off >= fast_base;
+  }
+
   virtual int collect_metadata(const std::string& prefix, std::map<std::string,std::string> *pm) const = 0;
 
   virtual int read(
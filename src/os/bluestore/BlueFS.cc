@@ -96,6 +96,13 @@ void BlueFS::_init_logger()
   b.add_u64_counter(l_bluefs_bytes_written_sst, "bytes_written_sst",
 		    "Bytes written to SSTs", "sst",
 		    PerfCountersBuilder::PRIO_CRITICAL);
+  b.add_u64_counter(l_bluefs_read_random_bytes, "read_random_bytes",
+		    "Bytes read with random reads");
+  b.add_u64_counter(l_bluefs_read_prefetch_bytes, "read_prefetch_bytes",
+		    "Bytes read into the prefetch buffer");
+  b.add_u64_counter(l_bluefs_read_direct_bytes, "read_direct_bytes",
+		    "Bytes read straight into the caller's buffer, bypassing "
+		    "the prefetch buffer");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -912,6 +919,8 @@ int BlueFS::_read_random(
   }
 
   dout(20) << __func__ << " got " << ret << dendl;
+  if (logger)
+    logger->inc(l_bluefs_read_random_bytes, ret);
   --h->file->num_reading;
   return ret;
 }
@@ -942,17 +951,38 @@ int BlueFS::_read(
   if (outbl)
     outbl->clear();
 
+  buf->update_prefetch(off, super.block_size);
+  buf->last_end = off + len;
+
   int ret = 0;
   while (len > 0) {
     size_t left;
     if (off < buf->bl_off || off >= buf->get_buf_end()) {
+      uint64_t x_off = 0;
+      auto p = h->file->fnode.seek(off, &x_off);
+      if (out && !outbl &&
+	  len >= buf->cur_prefetch &&
+	  x_off + len <= p->length) {
+	// the caller's buffer covers at least a full readahead window;
+	// read straight into it instead of staging in buf->bl.
+	dout(20) << __func__ << " direct read 0x"
+		 << std::hex << x_off << "~" << len << std::dec
+		 << " of " << *p << dendl;
+	int r = bdev[p->bdev]->read_random(p->offset + x_off, len, out,
+					   cct->_conf->bluefs_buffered_io);
+	assert(r == 0);
+	if (logger)
+	  logger->inc(l_bluefs_read_direct_bytes, len);
+	ret += len;
+	buf->pos += len;
+	break;
+      }
       buf->bl.clear();
       buf->bl_off = off & super.block_mask();
-      uint64_t x_off = 0;
-      auto p = h->file->fnode.seek(buf->bl_off, &x_off);
+      p = h->file->fnode.seek(buf->bl_off, &x_off);
       uint64_t want = ROUND_UP_TO(len + (off & ~super.block_mask()),
 				  super.block_size);
-      want = MAX(want, buf->max_prefetch);
+      want = MAX(want, buf->cur_prefetch);
       uint64_t l = MIN(p->length - x_off, want);
       uint64_t eof_offset = ROUND_UP_TO(h->file->fnode.size, super.block_size);
       if (!h->ignore_eof &&
@@ -965,6 +995,8 @@ int BlueFS::_read(
       int r = bdev[p->bdev]->read(p->offset + x_off, l, &buf->bl, ioc[p->bdev],
 				  cct->_conf->bluefs_buffered_io);
       assert(r == 0);
+      if (logger)
+	logger->inc(l_bluefs_read_prefetch_bytes, l);
     }
     left = buf->get_buf_remaining(off);
     dout(20) << __func__ << " left 0x" << std::hex << left
@@ -1063,36 +1095,59 @@ bool BlueFS::_should_compact_log()
   return true;
 }
 
-void BlueFS::_compact_log_dump_metadata(bluefs_transaction_t *t)
+void BlueFS::_compact_log_snapshot(log_snapshot_t *s)
+{
+  // only copy here; the encoding is left to _compact_log_dump_metadata,
+  // which does not need the lock
+  s->block_all.assign(block_all.begin(), block_all.end());
+  s->files.reserve(file_map.size());
+  for (auto& p : file_map) {
+    if (p.first == 1)
+      continue;
+    assert(p.first > 1);
+    s->files.push_back(p.second->fnode);
+  }
+  s->dirs.reserve(dir_map.size());
+  for (auto& p : dir_map) {
+    s->dirs.push_back(make_pair(p.first, vector<pair<string,uint64_t>>()));
+    auto& links = s->dirs.back().second;
+    links.reserve(p.second->file_map.size());
+    for (auto& q : p.second->file_map) {
+      links.push_back(make_pair(q.first, q.second->fnode.ino));
+    }
+  }
+  dout(10) << __func__ << " " << s->files.size() << " files in "
+	   << s->dirs.size() << " dirs" << dendl;
+}
+
+void BlueFS::_compact_log_dump_metadata(const log_snapshot_t& s,
+					bluefs_transaction_t *t)
 {
   t->seq = 1;
   t->uuid = super.uuid;
   dout(20) << __func__ << " op_init" << dendl;
 
   t->op_init();
-  for (unsigned bdev = 0; bdev < MAX_BDEV; ++bdev) {
-    interval_set<uint64_t>& p = block_all[bdev];
-    for (interval_set<uint64_t>::iterator q = p.begin(); q != p.end(); ++q) {
+  for (unsigned bdev = 0; bdev < s.block_all.size(); ++bdev) {
+    const interval_set<uint64_t>& p = s.block_all[bdev];
+    for (auto q = p.begin(); q != p.end(); ++q) {
       dout(20) << __func__ << " op_alloc_add " << bdev << " 0x"
                << std::hex << q.get_start() << "~" << q.get_len() << std::dec
                << dendl;
       t->op_alloc_add(bdev, q.get_start(), q.get_len());
     }
   }
-  for (auto& p : file_map) {
-    if (p.first == 1)
-      continue;
-    dout(20) << __func__ << " op_file_update " << p.second->fnode << dendl;
-    assert(p.first > 1);
-    t->op_file_update(p.second->fnode);
+  for (auto& fnode : s.files) {
+    dout(20) << __func__ << " op_file_update " << fnode << dendl;
+    t->op_file_update(fnode);
   }
-  for (auto& p : dir_map) {
+  for (auto& p : s.dirs) {
     dout(20) << __func__ << " op_dir_create " << p.first << dendl;
     t->op_dir_create(p.first);
-    for (auto& q : p.second->file_map) {
+    for (auto& q : p.second) {
       dout(20) << __func__ << " op_dir_link " << p.first << "/" << q.first
-	       << " to " << q.second->fnode.ino << dendl;
-      t->op_dir_link(p.first, q.first, q.second->fnode.ino);
+	       << " to " << q.second << dendl;
+      t->op_dir_link(p.first, q.first, q.second);
     }
   }
 }
@@ -1106,7 +1161,11 @@ void BlueFS::_compact_log_sync()
   log_t.clear();
 
   bluefs_transaction_t t;
-  _compact_log_dump_metadata(&t);
+  {
+    log_snapshot_t snap;
+    _compact_log_snapshot(&snap);
+    _compact_log_dump_metadata(snap, &t);
+  }
 
   dout(20) << __func__ << " op_jump_seq " << log_seq << dendl;
   t.op_jump_seq(log_seq);
@@ -1163,11 +1222,13 @@ void BlueFS::_compact_log_sync()
  * old extent(s) won't be written to, and reflect everything to compact.
  * New events will be written to the new region that we'll keep.
  *
- * 2. While still holding the lock, encode a bufferlist that dumps all of the
- * in-memory fnodes and names.  This will become the new beginning of the
- * log.  The last event will jump to the log continuation extent from #1.
+ * 2. While still holding the lock, copy all of the in-memory fnodes and
+ * names.  Drop the lock and encode them into a bufferlist that will become
+ * the new beginning of the log.  The last event will jump to the log
+ * continuation extent from #1.
  *
- * 3. Queue a write to a new extent for the new beginnging of the log.
+ * 3. Retake the lock and queue a write to a new extent for the new
+ * beginning of the log.
  *
  * 4. Drop lock and wait
  *
@@ -1186,6 +1247,15 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   assert(!new_log);
   assert(!new_log_writer);
 
+  // the new log is in place until we are done, so that nobody else starts
+  // a compaction or grows the log while we drop the lock below
+  new_log = new File;
+  new_log->fnode.ino = 0;   // so that _flush_range won't try to log the fnode
+
+  // data must be stable before the log refers to it; flush it now
+  // rather than with the log ops below queued but not yet written
+  _flush_bdev_for_log();
+
   // 1. allocate new log space and jump to it.
   old_log_jump_to = log_file->fnode.get_allocated();
   uint64_t need = old_log_jump_to + cct->_conf->bluefs_max_log_runway;
@@ -1205,31 +1275,34 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   log_t.op_file_update(log_file->fnode);
   log_t.op_jump(log_seq, old_log_jump_to);
 
-  flush_bdev();  // FIXME?
-
   _flush_and_sync_log(l, 0, old_log_jump_to);
 
   // 2. prepare compacted log
   bluefs_transaction_t t;
+  log_snapshot_t snap;
   //avoid record two times in log_t and _compact_log_dump_metadata.
   log_t.clear();
-  _compact_log_dump_metadata(&t);
+  _compact_log_snapshot(&snap);
+  uint64_t jump_seq = log_seq;
+
+  lock.unlock();
+  _compact_log_dump_metadata(snap, &t);
 
   // conservative estimate for final encoded size
   new_log_jump_to = ROUND_UP_TO(t.op_bl.length() + super.block_size * 2,
                                 cct->_conf->bluefs_alloc_size);
-  t.op_jump(log_seq, new_log_jump_to);
+  t.op_jump(jump_seq, new_log_jump_to);
 
   bufferlist bl;
   ::encode(t, bl);
   _pad_bl(bl);
+  snap = log_snapshot_t();
+  lock.lock();
 
   dout(10) << __func__ << " new_log_jump_to 0x" << std::hex << new_log_jump_to
 	   << std::dec << dendl;
 
-  // create a new log [writer]
-  new_log = new File;
-  new_log->fnode.ino = 0;   // so that _flush_range won't try to log the fnode
+  // 3. create a new log [writer] and flush
   int r = _allocate(BlueFS::BDEV_DB, new_log_jump_to,
                     &new_log->fnode.extents);
   assert(r == 0);
@@ -1237,7 +1310,6 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   new_log_writer = _create_writer(new_log);
   new_log_writer->append(bl);
 
-  // 3. flush
   r = _flush(new_log_writer, true);
   assert(r == 0);
   lock.unlock();
@@ -1384,7 +1456,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   if (runway < (int64_t)cct->_conf->bluefs_min_log_runway) {
     dout(10) << __func__ << " allocating more log runway (0x"
 	     << std::hex << runway << std::dec  << " remaining)" << dendl;
-    while (new_log_writer) {
+    while (new_log) {
       dout(10) << __func__ << " waiting for async compaction" << dendl;
       log_cond.wait(l);
     }
@@ -1789,6 +1861,26 @@ void BlueFS::_flush_bdev_safely(FileWriter *h)
   }
 }
 
+/*
+ * Make data written so far stable before the pending log_t is written,
+ * without holding the lock across the device flush.  Anything logged
+ * while the lock was dropped may refer to data that flush missed, so if
+ * log_t changed meanwhile, flush again with the lock held.
+ */
+void BlueFS::_flush_bdev_for_log()
+{
+  uint64_t seq = log_seq;
+  uint64_t len = log_t.op_bl.length();
+  lock.unlock();
+  flush_bdev();
+  lock.lock();
+  if (!log_t.empty() && (log_seq != seq || log_t.op_bl.length() != len)) {
+    dout(20) << __func__ << " log changed while flushing, flushing again"
+	     << dendl;
+    flush_bdev();
+  }
+}
+
 void BlueFS::flush_bdev()
 {
   // NOTE: this is safe to call without a lock.
@@ -1897,7 +1989,9 @@ void BlueFS::sync_metadata()
   utime_t start = ceph_clock_now();
   vector<interval_set<uint64_t>> to_release(pending_release.size());
   to_release.swap(pending_release);
-  flush_bdev(); // FIXME?
+  // data must be stable before the log refers to it, but there is no
+  // need to hold up every other writer meanwhile
+  _flush_bdev_for_log();
   _flush_and_sync_log(l);
   for (unsigned i = 0; i < to_release.size(); ++i) {
     for (auto p = to_release[i].begin(); p != to_release[i].end(); ++p) {
@@ -35,6 +35,9 @@ enum {
   l_bluefs_files_written_sst,
   l_bluefs_bytes_written_wal,
   l_bluefs_bytes_written_sst,
+  l_bluefs_read_random_bytes,
+  l_bluefs_read_prefetch_bytes,
+  l_bluefs_read_direct_bytes,
   l_bluefs_last,
 };
 
@@ -165,11 +168,15 @@ public:
     bufferlist bl;          ///< prefetch buffer
     uint64_t pos;           ///< current logical offset
     uint64_t max_prefetch;  ///< max allowed prefetch
+    uint64_t cur_prefetch;  ///< current readahead window (<= max_prefetch)
+    uint64_t last_end;      ///< end of the previous read
 
     explicit FileReaderBuffer(uint64_t mpf)
       : bl_off(0),
 	pos(0),
-	max_prefetch(mpf) {}
+	max_prefetch(mpf),
+	cur_prefetch(mpf),
+	last_end(0) {}
 
     uint64_t get_buf_end() {
       return bl_off + bl.length();
@@ -180,6 +187,16 @@ public:
       return 0;
     }
 
+    /// double the readahead window while reads stay sequential and
+    /// drop back to min_prefetch on a seek
+    void update_prefetch(uint64_t off, uint64_t min_prefetch) {
+      if (off == last_end) {
+	cur_prefetch = MIN(MAX(cur_prefetch * 2, min_prefetch), max_prefetch);
+      } else {
+	cur_prefetch = MIN(min_prefetch, max_prefetch);
+      }
+    }
+
     void skip(size_t n) {
       pos += n;
     }
@@ -241,6 +258,14 @@ private:
   FileRef new_log = nullptr;
   FileWriter *new_log_writer = nullptr;
 
+  /// namespace as of a log compaction point, so that it can be encoded
+  /// without holding the lock
+  struct log_snapshot_t {
+    vector<interval_set<uint64_t>> block_all;
+    vector<bluefs_fnode_t> files;
+    vector<pair<string, vector<pair<string,uint64_t>>>> dirs;
+  };
+
   /*
    * There are up to 3 block devices:
    *
@@ -281,13 +306,16 @@ private:
 			  uint64_t jump_to = 0);
   uint64_t _estimate_log_size();
   bool _should_compact_log();
-  void _compact_log_dump_metadata(bluefs_transaction_t *t);
+  void _compact_log_snapshot(log_snapshot_t *s);
+  void _compact_log_dump_metadata(const log_snapshot_t& s,
+				  bluefs_transaction_t *t);
   void _compact_log_sync();
   void _compact_log_async(std::unique_lock<std::mutex>& l);
 
   //void _aio_finish(void *priv);
 
   void _flush_bdev_safely(FileWriter *h);
+  void _flush_bdev_for_log();
   void flush_bdev();  // this is safe to call without a lock
 
   int _preallocate(FileRef f, uint64_t off, uint64_t len);
@@ -341,6 +369,9 @@ public:
   uint64_t get_free(unsigned id);
   void get_usage(vector<pair<uint64_t,uint64_t>> *usage); // [<free,total> ...]
   void dump_perf_counters(Formatter *f);
+  const PerfCounters* get_perf_counters() const {
+    return logger;
+  }
 
   /// get current extents that we own for given block device
   int get_block_extents(unsigned id, interval_set<uint64_t> *extents);
@@ -388,6 +419,9 @@ public:
   int add_block_device(unsigned bdev, const string& path);
   bool bdev_support_label(unsigned id);
   uint64_t get_block_device_size(unsigned bdev);
+  uint64_t get_block_size() const {
+    return super.block_size;
+  }
 
   /// gift more block space
   void add_block_extent(unsigned bdev, uint64_t offset, uint64_t len);
@@ -117,6 +117,12 @@ class BlueRocksRandomAccessFile : public rocksdb::RandomAccessFile {
 		    (unsigned long long)h->file->fnode.ino);
   };
 
+  // RocksDB aligns its readahead buffers (and their offsets) to this,
+  // which lets O_DIRECT reads land in them without a bounce buffer.
+  size_t GetRequiredBufferAlignment() const override {
+    return fs->get_block_size();
+  }
+
   //enum AccessPattern { NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED };
 
   void Hint(AccessPattern pattern) override {
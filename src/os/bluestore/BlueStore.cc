@@ -24,12 +24,14 @@
 #include "include/compat.h"
 #include "include/intarith.h"
 #include "include/stringify.h"
+#include "include/str_map.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "Allocator.h"
 #include "FreelistManager.h"
 #include "BlueFS.h"
 #include "BlueRocksEnv.h"
+#include "PMEMLog.h"
 #include "auth/Crypto.h"
 #include "common/EventTrace.h"
 
@@ -66,6 +68,7 @@ const string PREFIX_OMAP = "M";    // u64 + keyname -> value
 const string PREFIX_DEFERRED = "L";  // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";   // u64 offset -> u64 length (freelist)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_ALLOC_SNAP = "a"; // allocator snapshot, see _write_alloc_snapshot
 
 // write a label in the first block.  always use this size.  note that
 // bluefs makes a matching assumption about the location of its
@@ -531,6 +534,18 @@ static void get_deferred_key(uint64_t seq, string *out)
   _key_encode_u64(seq, out);
 }
 
+static void get_alloc_snap_chunk_key(uint64_t chunk, string *out)
+{
+  out->push_back('c');
+  _key_encode_u64(chunk, out);
+}
+
+static void get_alloc_snap_dirty_key(uint64_t region, string *out)
+{
+  out->push_back('d');
+  _key_encode_u64(region, out);
+}
+
 
 // merge operators
 
@@ -560,6 +575,164 @@ struct Int64ArrayMergeOperator : public KeyValueDB::MergeOperator {
   }
 };
 
+/*
+ * Extent map shard deltas.  A delta operand is SHARD_DELTA_MAGIC
+ * followed by splice records (__le32 offset, removed and inserted
+ * lengths, then the inserted bytes), applied in order.  Full shard
+ * encodings start with their struct_v, never with the magic, so we
+ * can tell a base value from operands that were merged together
+ * before reaching one.
+ */
+static const char SHARD_DELTA_MAGIC = '\xff';
+
+/*
+ * Common part of the delta merge operators: an operand is a magic byte
+ * followed by records.  Operands merged with each other are
+ * concatenated; once merged onto a base value, apply() replays the
+ * records onto it.
+ */
+struct DeltaMergeOperator : public KeyValueDB::MergeOperator {
+  const char magic;
+  explicit DeltaMergeOperator(char magic) : magic(magic) {}
+  void merge_nonexistent(
+    const char *rdata, size_t rlen, std::string *new_value) override {
+    // nothing to apply it to; leave it for the decoder to trip over
+    *new_value = std::string(rdata, rlen);
+  }
+  void merge(
+    const char *ldata, size_t llen,
+    const char *rdata, size_t rlen,
+    std::string *new_value) override {
+    assert(rlen && rdata[0] == magic);
+    if (llen && ldata[0] == magic) {
+      // two operands: concatenate
+      new_value->reserve(llen + rlen - 1);
+      new_value->assign(ldata, llen);
+      new_value->append(rdata + 1, rlen - 1);
+      return;
+    }
+    apply(ldata, llen, rdata + 1, rlen - 1, new_value);
+  }
+  /// replay the records [rec, rec + len) onto the base value
+  virtual void apply(
+    const char *base, size_t base_len,
+    const char *rec, size_t len,
+    std::string *new_value) = 0;
+};
+
+struct ShardDeltaMergeOperator : public DeltaMergeOperator {
+  ShardDeltaMergeOperator() : DeltaMergeOperator(SHARD_DELTA_MAGIC) {}
+  void apply(
+    const char *base, size_t base_len,
+    const char *rec, size_t len,
+    std::string *new_value) override {
+    new_value->assign(base, base_len);
+    const char *p = rec;
+    const char *end = rec + len;
+    while (p < end) {
+      // records follow the magic byte, so they are not aligned
+      ceph_le32 v[3];
+      assert(p + sizeof(v) <= end);
+      memcpy(v, p, sizeof(v));
+      uint32_t off = le32_to_cpu(v[0]);
+      uint32_t removed = le32_to_cpu(v[1]);
+      uint32_t inserted = le32_to_cpu(v[2]);
+      p += sizeof(v);
+      assert(p + inserted <= end);
+      assert(off + removed <= new_value->size());
+      new_value->replace(off, removed, p, inserted);
+      p += inserted;
+    }
+  }
+  string name() const override {
+    return "extent_shard_delta";
+  }
+};
+
+/// splice record turning old into cur, in ShardDeltaMergeOperator form
+static void encode_shard_delta(bufferlist& old, bufferlist& cur,
+			       bufferlist *delta)
+{
+  const char *o = old.c_str();
+  const char *c = cur.c_str();
+  uint32_t olen = old.length(), clen = cur.length();
+  uint32_t prefix = 0;
+  while (prefix < olen && prefix < clen && o[prefix] == c[prefix]) {
+    ++prefix;
+  }
+  uint32_t suffix = 0;
+  while (suffix < olen - prefix && suffix < clen - prefix &&
+	 o[olen - suffix - 1] == c[clen - suffix - 1]) {
+    ++suffix;
+  }
+  delta->append(SHARD_DELTA_MAGIC);
+  ceph_le32 v[3];
+  v[0] = prefix;
+  v[1] = olen - prefix - suffix;
+  v[2] = clen - prefix - suffix;
+  delta->append((const char*)v, sizeof(v));
+  delta->append(c + prefix, clen - prefix - suffix);
+}
+
+/*
+ * Shared blob reference deltas.  An operand is SHARED_BLOB_DELTA_MAGIC
+ * followed by shared_blob_ref_op_t records, each taking or dropping one
+ * reference on a physical extent, applied in order to the decoded
+ * bluestore_shared_blob_t.  As with shard deltas, the full encoding
+ * starts with its struct_v, so operands can't be mistaken for it.
+ */
+static const char SHARED_BLOB_DELTA_MAGIC = '\xff';
+
+struct shared_blob_ref_op_t {
+  ceph_le64 offset;
+  ceph_le32 length;
+  ceph_le32 put;       ///< 1 to drop a reference, 0 to take one
+} __attribute__ ((packed));
+
+static void append_shared_blob_ref_op(bufferlist& log, uint64_t offset,
+				      uint32_t length, bool put)
+{
+  if (log.length() == 0) {
+    log.append(SHARED_BLOB_DELTA_MAGIC);
+  }
+  shared_blob_ref_op_t op;
+  op.offset = offset;
+  op.length = length;
+  op.put = put;
+  log.append((const char*)&op, sizeof(op));
+}
+
+struct SharedBlobDeltaMergeOperator : public DeltaMergeOperator {
+  SharedBlobDeltaMergeOperator()
+    : DeltaMergeOperator(SHARED_BLOB_DELTA_MAGIC) {}
+  void apply(
+    const char *base, size_t base_len,
+    const char *rec, size_t len,
+    std::string *new_value) override {
+    assert(len % sizeof(shared_blob_ref_op_t) == 0);
+    bluestore_shared_blob_t sb(0);
+    bufferlist bl;
+    bl.append(base, base_len);
+    bufferlist::iterator p = bl.begin();
+    ::decode(sb, p);
+    const shared_blob_ref_op_t *op = (const shared_blob_ref_op_t*)rec;
+    const shared_blob_ref_op_t *end = (const shared_blob_ref_op_t*)(rec + len);
+    for (; op < end; ++op) {
+      if (op->put) {
+	sb.ref_map.put(op->offset, op->length, nullptr, nullptr);
+      } else {
+	sb.ref_map.get(op->offset, op->length);
+      }
+    }
+    bl.clear();
+    ::encode(sb, bl);
+    new_value->assign(bl.c_str(), bl.length());
+  }
+  string name() const override {
+    return "shared_blob_delta";
+  }
+};
+
 
 // Buffer
 
@@ -568,8 +741,10 @@ ostream& operator<<(ostream& out, const BlueStore::Buffer& b)
   out << "buffer(" << &b << " space " << b.space << " 0x" << std::hex
       << b.offset << "~" << b.length << std::dec
       << " " << BlueStore::Buffer::get_state_name(b.state);
-  if (b.flags)
-    out << " " << BlueStore::Buffer::get_flag_name(b.flags);
+  for (unsigned f = 1; f <= b.flags; f <<= 1) {
+    if (b.flags & f)
+      out << " " << BlueStore::Buffer::get_flag_name(f);
+  }
   return out << ")";
 }
 
@@ -892,8 +1067,25 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   --p;
   int skipped = 0;
   int max_skipped = g_conf->bluestore_cache_trim_max_skip_pinned;
+  size_t promoted = 0;
+  size_t max_promote = onode_lru.size();
   while (num > 0) {
     Onode *o = &*p;
+    if (o->referenced.load(std::memory_order_relaxed) &&
+	promoted < max_promote) {
+      // hit by a concurrent lookup since we last looked; give it a
+      // second chance at the head of the lru instead of evicting it.
+      o->referenced.store(false, std::memory_order_relaxed);
+      ++promoted;
+      dout(30) << __func__ << "  " << o->oid << " referenced, promoting"
+	       << dendl;
+      if (p == onode_lru.begin()) {
+	break;
+      }
+      onode_lru.erase(p--);
+      onode_lru.push_front(*o);
+      continue;
+    }
     int refs = o->nref.load();
     if (refs > 1) {
       dout(20) << __func__ << "  " << o->oid << " has " << refs
@@ -913,14 +1105,24 @@ void BlueStore::LRUCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       }
     }
     dout(30) << __func__ << "  rm " << o->oid << dendl;
+    o->get();  // paranoia
+    if (!o->c->onode_map.try_remove(o)) {
+      o->put();
+      dout(20) << __func__ << "  " << o->oid << " raced with lookup, skipping"
+	       << dendl;
+      if (++skipped >= max_skipped || p == onode_lru.begin()) {
+	break;
+      }
+      p--;
+      num--;
+      continue;
+    }
     if (p != onode_lru.begin()) {
       onode_lru.erase(p--);
     } else {
       onode_lru.erase(p);
       assert(num == 1);
     }
-    o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
     o->put();
     --num;
   }
@@ -1188,8 +1390,25 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
   --p;
   int skipped = 0;
   int max_skipped = g_conf->bluestore_cache_trim_max_skip_pinned;
+  size_t promoted = 0;
+  size_t max_promote = onode_lru.size();
   while (num > 0) {
     Onode *o = &*p;
+    if (o->referenced.load(std::memory_order_relaxed) &&
+	promoted < max_promote) {
+      // hit by a concurrent lookup since we last looked; give it a
+      // second chance at the head of the lru instead of evicting it.
+      o->referenced.store(false, std::memory_order_relaxed);
+      ++promoted;
+      dout(30) << __func__ << "  " << o->oid << " referenced, promoting"
+	       << dendl;
+      if (p == onode_lru.begin()) {
+	break;
+      }
+      onode_lru.erase(p--);
+      onode_lru.push_front(*o);
+      continue;
+    }
     dout(20) << __func__ << " considering " << o << dendl;
     int refs = o->nref.load();
     if (refs > 1) {
@@ -1210,14 +1429,24 @@ void BlueStore::TwoQCache::_trim(uint64_t onode_max, uint64_t buffer_max)
       }
     }
     dout(30) << __func__ << " " << o->oid << " num=" << num <<" lru size="<<onode_lru.size()<< dendl;
+    o->get();  // paranoia
+    if (!o->c->onode_map.try_remove(o)) {
+      o->put();
+      dout(20) << __func__ << "  " << o->oid << " raced with lookup; skipping"
+	       << dendl;
+      if (++skipped >= max_skipped || p == onode_lru.begin()) {
+	break;
+      }
+      p--;
+      num--;
+      continue;
+    }
     if (p != onode_lru.begin()) {
       onode_lru.erase(p--);
     } else {
       onode_lru.erase(p);
       assert(num == 1);
     }
-    o->get();  // paranoia
-    o->c->onode_map.remove(o->oid);
     o->put();
     --num;
   }
@@ -1364,6 +1593,7 @@ void BlueStore::BufferSpace::read(
   res_intervals.clear();
   uint32_t want_bytes = length;
   uint32_t end = offset + length;
+  uint64_t readahead_bytes = 0;
 
   {
     std::lock_guard<std::recursive_mutex> l(cache->lock);
@@ -1380,6 +1610,9 @@ void BlueStore::BufferSpace::read(
 	  res_intervals.insert(offset, l);
 	  offset += l;
 	  length -= l;
+	  if (b->flags & Buffer::FLAG_READAHEAD) {
+	    readahead_bytes += l;
+	  }
 	  if (!b->is_writing()) {
 	    cache->_touch_buffer(b);
 	  }
@@ -1396,6 +1629,9 @@ void BlueStore::BufferSpace::read(
         if (!b->is_writing()) {
 	  cache->_touch_buffer(b);
         }
+	if (b->flags & Buffer::FLAG_READAHEAD) {
+	  readahead_bytes += MIN(length, b->length);
+	}
         if (b->length > length) {
 	  res[offset].substr_of(b->data, 0, length);
 	  res_intervals.insert(offset, length);
@@ -1417,6 +1653,32 @@ void BlueStore::BufferSpace::read(
   uint64_t miss_bytes = want_bytes - hit_bytes;
   cache->logger->inc(l_bluestore_buffer_hit_bytes, hit_bytes);
   cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
+  if (readahead_bytes) {
+    cache->logger->inc(l_bluestore_readahead_hit_bytes, readahead_bytes);
+  }
+}
+
+bool BlueStore::BufferSpace::want_readahead(
+  Cache* cache,
+  uint32_t offset,
+  uint32_t length)
+{
+  std::lock_guard<std::recursive_mutex> l(cache->lock);
+  uint32_t end = offset + length;
+  uint32_t covered = 0;
+  for (auto i = _data_lower_bound(offset);
+       i != buffer_map.end() && i->first < end;
+       ++i) {
+    Buffer *b = i->second.get();
+    if (b->is_writing()) {
+      // the device may not have this yet
+      return false;
+    }
+    if (b->is_clean()) {
+      covered += MIN(end, b->end()) - MAX(offset, b->offset);
+    }
+  }
+  return covered < length;
 }
 
 void BlueStore::BufferSpace::finish_write(Cache* cache, uint64_t seq)
@@ -1503,6 +1765,65 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
   assert(writing.empty());
 }
 
+// DecompressedCache
+
+bool BlueStore::DecompressedCache::lookup(uint64_t key, bufferlist *bl)
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto p = entries.find(key);
+  if (p == entries.end()) {
+    return false;
+  }
+  lru.splice(lru.begin(), lru, p->second.lru_pos);
+  *bl = p->second.bl;
+  return true;
+}
+
+void BlueStore::DecompressedCache::insert(uint64_t key, const bufferlist& bl)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (bl.length() > max_bytes) {
+    return;
+  }
+  auto p = entries.find(key);
+  if (p != entries.end()) {
+    // raced with another reader of the same blob
+    return;
+  }
+  entry_t& e = entries[key];
+  e.bl = bl;
+  e.bl.reassign_to_mempool(mempool::mempool_bluestore_cache_data);
+  lru.push_front(key);
+  e.lru_pos = lru.begin();
+  bytes += bl.length();
+  _trim();
+}
+
+void BlueStore::DecompressedCache::invalidate(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  auto p = entries.lower_bound(offset);
+  while (p != entries.end() && p->first < offset + length) {
+    _rm(p++);
+  }
+}
+
+void BlueStore::DecompressedCache::_rm(map<uint64_t, entry_t>::iterator p)
+{
+  assert(bytes >= p->second.bl.length());
+  bytes -= p->second.bl.length();
+  lru.erase(p->second.lru_pos);
+  entries.erase(p);
+}
+
+void BlueStore::DecompressedCache::_trim()
+{
+  while (bytes > max_bytes) {
+    assert(!lru.empty());
+    _rm(entries.find(lru.back()));
+  }
+}
+
 // OnodeSpace
 
 #undef dout_prefix
@@ -1519,7 +1840,10 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::add(const ghobject_t& oid, OnodeRef o
     return p->second;
   }
   ldout(cache->cct, 30) << __func__ << " " << oid << " " << o << dendl;
-  onode_map[oid] = o;
+  {
+    RWLock::WLocker wl(map_lock);
+    onode_map[oid] = o;
+  }
   cache->_add_onode(o, 1);
   return o;
 }
@@ -1530,7 +1854,23 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
   OnodeRef o;
   bool hit = false;
 
-  {
+  if (cache->cct->_conf->bluestore_cache_concurrent_lookup) {
+    // only take our map's read lock, and leave the lru alone: mark the
+    // onode referenced and let trim promote it instead of evicting it.
+    RWLock::RLocker l(map_lock);
+    auto p = onode_map.find(oid);
+    if (p == onode_map.end()) {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " miss" << dendl;
+    } else {
+      ldout(cache->cct, 30) << __func__ << " " << oid << " hit " << p->second
+			    << dendl;
+      if (!p->second->referenced.load(std::memory_order_relaxed)) {
+	p->second->referenced.store(true, std::memory_order_relaxed);
+      }
+      hit = true;
+      o = p->second;
+    }
+  } else {
     std::lock_guard<std::recursive_mutex> l(cache->lock);
     ceph::unordered_map<ghobject_t,OnodeRef>::iterator p = onode_map.find(oid);
     if (p == onode_map.end()) {
@@ -1555,6 +1895,7 @@ BlueStore::OnodeRef BlueStore::OnodeSpace::lookup(const ghobject_t& oid)
 void BlueStore::OnodeSpace::clear()
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  RWLock::WLocker wl(map_lock);
   ldout(cache->cct, 10) << __func__ << dendl;
   for (auto &p : onode_map) {
     cache->_rm_onode(p.second);
@@ -1575,6 +1916,7 @@ void BlueStore::OnodeSpace::rename(
   const mempool::bluestore_cache_other::string& new_okey)
 {
   std::lock_guard<std::recursive_mutex> l(cache->lock);
+  RWLock::WLocker wl(map_lock);
   ldout(cache->cct, 30) << __func__ << " " << old_oid << " -> " << new_oid
 			<< dendl;
   ceph::unordered_map<ghobject_t,OnodeRef>::iterator po, pn;
@@ -1678,6 +2020,9 @@ void BlueStore::SharedBlob::get_ref(uint64_t offset, uint32_t length)
 {
   assert(persistent);
   persistent->ref_map.get(offset, length);
+  if (persisted) {
+    append_shared_blob_ref_op(ref_log, offset, length, false);
+  }
 }
 
 void BlueStore::SharedBlob::put_ref(uint64_t offset, uint32_t length,
@@ -1687,6 +2032,9 @@ void BlueStore::SharedBlob::put_ref(uint64_t offset, uint32_t length,
   assert(persistent);
   bool maybe = false;
   persistent->ref_map.put(offset, length, r, maybe_unshared ? &maybe : nullptr);
+  if (persisted) {
+    append_shared_blob_ref_op(ref_log, offset, length, true);
+  }
   if (maybe_unshared && maybe) {
     maybe_unshared->insert(this);
   }
@@ -2059,18 +2407,58 @@ void BlueStore::ExtentMap::update(KeyValueDB::Transaction t,
     }
 
     // schedule DB update for dirty shards
+    bool use_delta = cct->_conf->bluestore_extent_map_shard_delta;
+    auto logger = onode->c->store->logger;
+    // shards we cannot keep a base for are simply written in full next time
+    uint64_t base_room = 0;
+    if (use_delta) {
+      uint64_t base_bytes = mempool::bluestore_cache_shard_base::allocated_bytes();
+      uint64_t base_max = cct->_conf->bluestore_extent_map_shard_delta_cache_max;
+      if (base_bytes < base_max) {
+	base_room = base_max - base_bytes;
+      }
+    }
     string key;
     for (auto& it : encoded_shards) {
       it.shard->dirty = false;
       it.shard->shard_info->bytes = it.bl.length();
+      bufferlist delta;
+      if (use_delta && it.shard->persisted.length()) {
+	encode_shard_delta(it.shard->persisted, it.bl, &delta);
+	// not worth it if the shard mostly changed anyway, and bound the
+	// merge operands the kv store has to apply on read to about one
+	// full shard's worth
+	if (delta.length() * 2 > it.bl.length() ||
+	    it.shard->delta_written + delta.length() > it.bl.length()) {
+	  delta.clear();
+	}
+      }
       generate_extent_shard_key_and_apply(
 	onode->key,
 	it.shard->shard_info->offset,
 	&key,
         [&](const string& final_key) {
-          t->set(PREFIX_OBJ, final_key, it.bl);
+	  if (delta.length()) {
+	    t->merge(PREFIX_OBJ, final_key, delta);
+	  } else {
+	    t->set(PREFIX_OBJ, final_key, it.bl);
+	  }
         }
       );
+      if (delta.length()) {
+	logger->inc(l_bluestore_onode_shard_delta_bytes, delta.length());
+	it.shard->delta_written += delta.length();
+      } else {
+	logger->inc(l_bluestore_onode_shard_full_bytes, it.bl.length());
+	it.shard->delta_written = 0;
+      }
+      it.shard->persisted.clear();
+      if (use_delta && base_room >= it.bl.length()) {
+	it.shard->persisted = it.bl;
+	it.shard->persisted.reassign_to_mempool(
+	  mempool::mempool_bluestore_cache_shard_base);
+	base_room -= it.bl.length();
+      }
     }
   }
 }
@@ -3143,6 +3531,7 @@ void BlueStore::Collection::load_shared_blob(SharedBlobRef sb)
 
     sb->loaded = true;
     sb->persistent = new bluestore_shared_blob_t(sbid);
+    sb->persisted = true;
     bufferlist::iterator p = v.begin();
     ::decode(*(sb->persistent), p);
     ldout(store->cct, 10) << __func__ << " sbid 0x" << std::hex << sbid
@@ -3183,6 +3572,8 @@ uint64_t BlueStore::Collection::make_blob_unshared(SharedBlob *sb)
   sb->loaded = false;
   delete sb->persistent;
   sb->sbid_unloaded = 0;
+  sb->persisted = false;
+  sb->ref_log.clear();
   ldout(store->cct, 20) << __func__ << " now " << *sb << dendl;
   return sbid;
 }
@@ -3254,6 +3645,8 @@ void BlueStore::Collection::split_cache(
   std::lock(cache->lock, dest->cache->lock);
   std::lock_guard<std::recursive_mutex> l(cache->lock, std::adopt_lock);
   std::lock_guard<std::recursive_mutex> l2(dest->cache->lock, std::adopt_lock);
+  RWLock::WLocker ml(onode_map.map_lock);
+  RWLock::WLocker ml2(dest->onode_map.map_lock);
 
   int destbits = dest->cnode.bits;
   spg_t destpg;
@@ -3324,7 +3717,8 @@ void *BlueStore::MempoolThread::entry()
   while (!stop) {
     uint64_t meta_bytes =
       mempool::bluestore_cache_other::allocated_bytes() +
-      mempool::bluestore_cache_onode::allocated_bytes();
+      mempool::bluestore_cache_onode::allocated_bytes() +
+      mempool::bluestore_cache_shard_base::allocated_bytes();
     uint64_t onode_num =
       mempool::bluestore_cache_onode::allocated_items();
 
@@ -3355,6 +3749,51 @@ void *BlueStore::MempoolThread::entry()
   return NULL;
 }
 
+void *BlueStore::DefragThread::entry()
+{
+  Mutex::Locker l(lock);
+  while (!stop) {
+    if (store->cct->_conf->bluestore_defrag) {
+      lock.Unlock();
+      store->_defrag_pass();
+      lock.Lock();
+      if (stop) {
+	break;
+      }
+    }
+    utime_t wait;
+    wait.set_from_double(store->cct->_conf->bluestore_defrag_interval);
+    cond.WaitInterval(lock, wait);
+  }
+  stop = false;
+  return NULL;
+}
+
+/// coarse seconds for blob heat; never 0, which means "not seen yet"
+static uint32_t tier_clock_now()
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(
+    ceph::coarse_mono_clock::now().time_since_epoch()).count() + 1;
+}
+
+void *BlueStore::TierThread::entry()
+{
+  Mutex::Locker l(lock);
+  while (!stop) {
+    lock.Unlock();
+    store->_tier_pass();
+    lock.Lock();
+    if (stop) {
+      break;
+    }
+    utime_t wait;
+    wait.set_from_double(store->cct->_conf->bluestore_tier_interval);
+    cond.WaitInterval(lock, wait);
+  }
+  stop = false;
+  return NULL;
+}
+
 // =======================================================
 
 // OmapIteratorImpl
@@ -3478,8 +3917,11 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 		       cct->_conf->bluestore_throttle_bytes +
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     kv_sync_thread(this),
+    kv_commit_thread(this),
     kv_finalize_thread(this),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this),
+    tier_thread(this)
 {
   _init_logger();
   cct->_conf->add_observer(this);
@@ -3496,10 +3938,13 @@ BlueStore::BlueStore(CephContext *cct,
 		       cct->_conf->bluestore_throttle_bytes +
 		       cct->_conf->bluestore_throttle_deferred_bytes),
     kv_sync_thread(this),
+    kv_commit_thread(this),
     kv_finalize_thread(this),
     min_alloc_size(_min_alloc_size),
     min_alloc_size_order(ctz(_min_alloc_size)),
-    mempool_thread(this)
+    mempool_thread(this),
+    defrag_thread(this),
+    tier_thread(this)
 {
   _init_logger();
   cct->_conf->add_observer(this);
@@ -3541,6 +3986,7 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_compression_required_ratio",
     "bluestore_max_alloc_size",
     "bluestore_prefer_deferred_size",
+    "bluestore_prefer_deferred_size_adaptive",
     "bluestore_deferred_batch_ops",
     "bluestore_deferred_batch_ops_hdd",
     "bluestore_deferred_batch_ops_ssd",
@@ -3552,6 +3998,10 @@ const char **BlueStore::get_tracked_conf_keys() const
     "bluestore_max_blob_size",
     "bluestore_max_blob_size_ssd",
     "bluestore_max_blob_size_hdd",
+    "bluestore_cache_decompressed_size",
+    "bluestore_readahead_max_bytes",
+    "bluestore_readahead_max_bytes_hdd",
+    "bluestore_readahead_max_bytes_ssd",
     NULL
   };
   return KEYS;
@@ -3579,7 +4029,15 @@ void BlueStore::handle_conf_change(const struct md_config_t *conf,
       _set_blob_size();
     }
   }
+  if (changed.count("bluestore_readahead_max_bytes") ||
+      changed.count("bluestore_readahead_max_bytes_hdd") ||
+      changed.count("bluestore_readahead_max_bytes_ssd")) {
+    if (mounted) {
+      _set_readahead();
+    }
+  }
   if (changed.count("bluestore_prefer_deferred_size") ||
+      changed.count("bluestore_prefer_deferred_size_adaptive") ||
       changed.count("bluestore_max_alloc_size") ||
       changed.count("bluestore_deferred_batch_ops") ||
       changed.count("bluestore_deferred_batch_ops_hdd") ||
@@ -3605,6 +4063,9 @@ void BlueStore::handle_conf_change(const struct md_config_t *conf,
     throttle_deferred_bytes.reset_max(
       conf->bluestore_throttle_bytes + conf->bluestore_throttle_deferred_bytes);
   }
+  if (changed.count("bluestore_cache_decompressed_size")) {
+    decompressed_cache.set_max(conf->bluestore_cache_decompressed_size);
+  }
 }
 
 void BlueStore::_set_compression()
@@ -3708,6 +4169,22 @@ void BlueStore::_set_blob_size()
            << std::dec << dendl;
 }
 
+void BlueStore::_set_readahead()
+{
+  if (cct->_conf->bluestore_readahead_max_bytes) {
+    readahead_max = cct->_conf->bluestore_readahead_max_bytes;
+  } else {
+    assert(bdev);
+    if (bdev->is_rotational()) {
+      readahead_max = cct->_conf->bluestore_readahead_max_bytes_hdd;
+    } else {
+      readahead_max = cct->_conf->bluestore_readahead_max_bytes_ssd;
+    }
+  }
+  dout(10) << __func__ << " readahead_max 0x" << std::hex << readahead_max
+	   << std::dec << dendl;
+}
+
 int BlueStore::_set_cache_sizes()
 {
   assert(bdev);
@@ -3763,10 +4240,12 @@ int BlueStore::_set_cache_sizes()
     // deal with floating point imprecision
     cache_data_ratio = 0;
   }
+  decompressed_cache.set_max(cct->_conf->bluestore_cache_decompressed_size);
   dout(1) << __func__ << " cache_size " << cache_size
           << " meta " << cache_meta_ratio
 	  << " kv " << cache_kv_ratio
 	  << " data " << cache_data_ratio
+	  << " decompressed " << cct->_conf->bluestore_cache_decompressed_size
 	  << dendl;
   return 0;
 }
@@ -3783,6 +4262,16 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_lat, "kv_lat",
 		 "Average kv_thread sync latency",
 		 "k_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_time_avg(l_bluestore_kv_prepare_lat, "kv_prepare_lat",
+		 "Average kv_thread batch prepare latency (submit txns, build synct)");
+  b.add_time_avg(l_bluestore_kv_sync_wait_lat, "kv_sync_wait_lat",
+		 "Average time a prepared batch waits for the kv commit thread");
+  b.add_time_avg(l_bluestore_kv_sync_lat, "kv_sync_lat",
+		 "Average kv sync transaction latency");
+  b.add_u64_avg(l_bluestore_kv_batch_txc, "kv_batch_txc",
+		"Average number of transactions per kv sync");
+  b.add_time_avg(l_bluestore_kv_batch_linger_lat, "kv_batch_linger_lat",
+		 "Average time kv_thread waits for a batch to grow");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -3838,6 +4327,12 @@ void BlueStore::_init_logger()
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def");
+  b.add_u64(l_bluestore_deferred_adapt_size, "deferred_adapt_size",
+	    "Current prefer_deferred_size threshold");
+  b.add_u64_counter(l_bluestore_deferred_adapt_grow, "deferred_adapt_grow",
+		    "Adaptive deferred policy raised the threshold");
+  b.add_u64_counter(l_bluestore_deferred_adapt_shrink, "deferred_adapt_shrink",
+		    "Adaptive deferred policy lowered the threshold");
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -3862,6 +4357,21 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_onode_shard_misses,
 		    "bluestore_onode_shard_misses",
 		    "Sum for onode-shard lookups missed in the cache");
+  b.add_u64_counter(l_bluestore_onode_shard_full_bytes,
+		    "bluestore_onode_shard_full_bytes",
+		    "Bytes of extent map shards written in full");
+  b.add_u64_counter(l_bluestore_onode_shard_delta_bytes,
+		    "bluestore_onode_shard_delta_bytes",
+		    "Bytes of extent map shard deltas written");
+  b.add_u64(l_bluestore_onode_shard_base_bytes,
+	    "bluestore_onode_shard_base_bytes",
+	    "Bytes of cached extent map shard encodings kept for deltas");
+  b.add_u64_counter(l_bluestore_shared_blob_full_bytes,
+		    "bluestore_shared_blob_full_bytes",
+		    "Bytes of full shared blob records written");
+  b.add_u64_counter(l_bluestore_shared_blob_delta_bytes,
+		    "bluestore_shared_blob_delta_bytes",
+		    "Bytes of shared blob reference deltas written");
   b.add_u64(l_bluestore_extents, "bluestore_extents",
 	    "Number of extents in cache");
   b.add_u64(l_bluestore_blobs, "bluestore_blobs",
@@ -3874,6 +4384,15 @@ void BlueStore::_init_logger()
     "Sum for bytes of read hit in the cache");
   b.add_u64(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
     "Sum for bytes of read missed in the cache");
+  b.add_u64_counter(l_bluestore_decompressed_cache_hits,
+    "decompressed_cache_hits",
+    "Compressed blob reads served from the decompressed cache");
+  b.add_u64_counter(l_bluestore_decompressed_cache_misses,
+    "decompressed_cache_misses",
+    "Compressed blob reads that had to read and decompress the blob");
+  b.add_u64(l_bluestore_decompressed_cache_bytes,
+    "decompressed_cache_bytes",
+    "Bytes in the decompressed blob cache");
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -3908,6 +4427,42 @@ void BlueStore::_init_logger()
   b.add_u64_counter(l_bluestore_gc_merged, "bluestore_gc_merged",
 		    "Sum for extents that have been merged due to garbage "
 		    "collection");
+  b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation",
+	    "Free space fragmentation of the allocator, in parts per thousand");
+  b.add_u64_counter(l_bluestore_defrag_scanned, "bluestore_defrag_scanned",
+		    "Onodes examined by the background defrag scan");
+  b.add_u64_counter(l_bluestore_defrag_objects, "bluestore_defrag_objects",
+		    "Fragmented objects rewritten by background defrag");
+  b.add_u64_counter(l_bluestore_defrag_bytes, "bluestore_defrag_bytes",
+		    "Bytes rewritten by background defrag");
+  b.add_u64_counter(l_bluestore_defrag_blobs_removed,
+		    "bluestore_defrag_blobs_removed",
+		    "Blobs eliminated by background defrag");
+  b.add_u64_counter(l_bluestore_tier_fast_bytes, "bluestore_tier_fast_bytes",
+		    "Bytes allocated on the fast data tier");
+  b.add_u64_counter(l_bluestore_tier_scanned, "bluestore_tier_scanned",
+		    "Onodes examined by the fast tier demotion scan");
+  b.add_u64_counter(l_bluestore_tier_demoted_objects,
+		    "bluestore_tier_demoted_objects",
+		    "Objects with data moved off the fast tier");
+  b.add_u64_counter(l_bluestore_tier_demoted_bytes,
+		    "bluestore_tier_demoted_bytes",
+		    "Bytes moved off the fast tier");
+  b.add_time_avg(l_bluestore_pmem_log_append_lat, "pmem_log_append_lat",
+		 "Average time to persist a kv transaction to the pmem log");
+  b.add_u64_counter(l_bluestore_pmem_log_bytes, "pmem_log_bytes",
+		    "Bytes of kv transactions written to the pmem log");
+  b.add_u64_counter(l_bluestore_pmem_log_checkpoints, "pmem_log_checkpoints",
+		    "Times the kv store was synced to trim the pmem log");
+  b.add_u64_counter(l_bluestore_readahead_ios, "readahead_ios",
+		    "Readahead prefetches issued");
+  b.add_u64_counter(l_bluestore_readahead_bytes, "readahead_bytes",
+		    "Bytes prefetched by readahead");
+  b.add_u64_counter(l_bluestore_readahead_hit_bytes, "readahead_hit_bytes",
+		    "Bytes read from buffers filled by readahead");
+  b.add_u64_counter(l_bluestore_readahead_dropped_bytes,
+		    "readahead_dropped_bytes",
+		    "Readahead bytes skipped or discarded (limits, races, errors)");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4079,6 +4634,12 @@ void BlueStore::_set_alloc_sizes(void)
     }
   }
 
+  // the static value is the adaptive starting point
+  deferred_adaptive = cct->_conf->bluestore_prefer_deferred_size_adaptive;
+  deferred_adapt_aio_ns = deferred_adapt_aio_num = 0;
+  deferred_adapt_kv_ns = deferred_adapt_kv_num = 0;
+  logger->set(l_bluestore_deferred_adapt_size, prefer_deferred_size);
+
   if (cct->_conf->bluestore_deferred_batch_ops) {
     deferred_batch_ops = cct->_conf->bluestore_deferred_batch_ops;
   } else {
@@ -4096,9 +4657,59 @@ void BlueStore::_set_alloc_sizes(void)
 	   << " prefer_deferred_size 0x" << prefer_deferred_size
 	   << std::dec
 	   << " deferred_batch_ops " << deferred_batch_ops
+	   << " adaptive " << (int)deferred_adaptive
 	   << dendl;
 }
 
+/*
+ * Move prefer_deferred_size based on what the last interval looked like.
+ *
+ * A direct write pays the device write latency before its kv commit can
+ * even start; a deferred write only pays the kv commit (plus the extra
+ * WAL bytes) and gets written to the device later.  So we defer more
+ * while the device is clearly slower than the kv sync, and defer less
+ * once the kv sync becomes the bottleneck or the deferred backlog fills
+ * half of its throttle.  The 2x gap between the two conditions keeps us
+ * from flapping.
+ */
+void BlueStore::_deferred_adapt(utime_t now)
+{
+  deferred_adapt_last = now;
+  uint64_t aio_num = deferred_adapt_aio_num.exchange(0);
+  uint64_t aio_ns = deferred_adapt_aio_ns.exchange(0);
+  uint64_t kv_num = deferred_adapt_kv_num.exchange(0);
+  uint64_t kv_ns = deferred_adapt_kv_ns.exchange(0);
+  if (!kv_num) {
+    return;
+  }
+  uint64_t aio_lat = aio_num ? aio_ns / aio_num : 0;
+  uint64_t kv_lat = kv_ns / kv_num;
+  uint64_t cur = prefer_deferred_size;
+  uint64_t max = cct->_conf->bluestore_prefer_deferred_size_adaptive_max;
+  uint64_t t = cur;
+  if (throttle_deferred_bytes.past_midpoint() ||
+      (aio_num && kv_lat > aio_lat)) {
+    t = cur / 2;
+    if (t < block_size) {
+      t = 0;
+    }
+  } else if (aio_num && aio_lat > kv_lat * 2) {
+    t = cur ? cur * 2 : min_alloc_size;
+    t = std::min(t, max);
+  }
+  if (t == cur) {
+    return;
+  }
+  dout(10) << __func__ << " aio_lat " << aio_lat << "ns (" << aio_num << ")"
+	   << " kv_lat " << kv_lat << "ns (" << kv_num << ")"
+	   << " prefer_deferred_size 0x" << std::hex << cur << " -> 0x" << t
+	   << std::dec << dendl;
+  prefer_deferred_size = t;
+  logger->set(l_bluestore_deferred_adapt_size, t);
+  logger->inc(t > cur ? l_bluestore_deferred_adapt_grow :
+	      l_bluestore_deferred_adapt_shrink);
+}
+
 int BlueStore::_open_bdev(bool create)
 {
   assert(bdev == NULL);
@@ -4114,6 +4725,10 @@ int BlueStore::_open_bdev(bool create)
       goto fail_close;
   }
 
+  r = _open_fast_tier(create);
+  if (r < 0)
+    goto fail_close;
+
   // initialize global block parameters
   block_size = bdev->get_block_size();
   block_mask = ~(block_size - 1);
@@ -4134,6 +4749,56 @@ int BlueStore::_open_bdev(bool create)
   return r;
 }
 
+int BlueStore::_open_fast_tier(bool create)
+{
+  string p = path + "/block.fast";
+  string s;
+  int r = read_meta("fast_base", &s);
+  uint64_t base = 0;
+  struct stat st;
+  bool present = ::stat(p.c_str(), &st) == 0;
+  if (create) {
+    if (!present) {
+      if (cct->_conf->bluestore_block_fast_path.length()) {
+	derr << __func__ << " bluestore_block_fast_path is set but " << p
+	     << " does not exist" << dendl;
+	return -ENOENT;
+      }
+      return 0;
+    }
+    // the fast tier is appended right after the main device
+    base = bdev->get_size();
+  } else if (r == 0) {
+    base = strtoull(s.c_str(), NULL, 10);
+  }
+  if (!present) {
+    if (base) {
+      derr << __func__ << " fast_base " << base << " but no " << p << dendl;
+      return -ENOENT;
+    }
+    return 0;
+  }
+  if (!base) {
+    derr << __func__ << " " << p << " present but store was not created"
+	 << " with a fast tier, ignoring it" << dendl;
+    return 0;
+  }
+  r = bdev->add_fast_tier(p, base);
+  if (r < 0) {
+    derr << __func__ << " failed to add fast tier " << p << ": "
+	 << cpp_strerror(r) << dendl;
+    return r;
+  }
+  if (create) {
+    r = write_meta("fast_base", stringify(base));
+    if (r < 0)
+      return r;
+  }
+  dout(1) << __func__ << " fast tier at 0x" << std::hex << base
+	  << "~" << (bdev->get_size() - base) << std::dec << dendl;
+  return 0;
+}
+
 void BlueStore::_close_bdev()
 {
   assert(bdev);
@@ -4255,19 +4920,46 @@ int BlueStore::_open_alloc()
                << dendl;
     return -EINVAL;
   }
+  if (bdev->get_fast_base()) {
+    fast_alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
+				   bdev->get_size(),
+				   min_alloc_size);
+  }
 
   uint64_t num = 0, bytes = 0;
 
   dout(1) << __func__ << " opening allocation metadata" << dendl;
-  // initialize from freelist
-  fm->enumerate_reset();
-  uint64_t offset, length;
-  while (fm->enumerate_next(&offset, &length)) {
-    alloc->init_add_free(offset, length);
-    ++num;
-    bytes += length;
-  }
-  fm->enumerate_reset();
+  alloc_snap_region_size = 0;
+  alloc_snap_dirty.clear();
+  int r = -ENOENT;
+  if (cct->_conf->bluestore_alloc_snapshot) {
+    alloc_snap_region_size = cct->_conf->bluestore_alloc_snapshot_region_size;
+    assert(alloc_snap_region_size);
+    alloc_snap_dirty.resize(
+      (bdev->get_size() + alloc_snap_region_size - 1) / alloc_snap_region_size);
+    r = _load_alloc_snapshot(&num, &bytes);
+  }
+  if (r < 0) {
+    bufferlist bl;
+    if (db->get(PREFIX_ALLOC_SNAP, "header", &bl) >= 0) {
+      // stale, damaged, or we stopped tracking changes; never use it
+      dout(1) << __func__ << " removing allocator snapshot" << dendl;
+      KeyValueDB::Transaction t = db->get_transaction();
+      t->rmkeys_by_prefix(PREFIX_ALLOC_SNAP);
+      db->submit_transaction_sync(t);
+    }
+    alloc_snap_dirty.reset();
+
+    // initialize from freelist
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(&offset, &length)) {
+      _alloc_add_free(offset, length);
+      ++num;
+      bytes += length;
+    }
+    fm->enumerate_reset();
+  }
   dout(1) << __func__ << " loaded " << pretty_si_t(bytes)
 	  << " in " << num << " extents"
 	  << dendl;
@@ -4282,28 +4974,253 @@ int BlueStore::_open_alloc()
   return 0;
 }
 
-void BlueStore::_close_alloc()
-{
-  assert(alloc);
-  alloc->shutdown();
-  delete alloc;
-  alloc = NULL;
-}
-
-int BlueStore::_open_fsid(bool create)
+/*
+ * The allocator snapshot is the freelist's view of free space, written
+ * at clean umount as chunks of free extents under PREFIX_ALLOC_SNAP.
+ * From then on, the first transaction that touches the freelist within
+ * a region of bluestore_alloc_snapshot_region_size also sets a dirty
+ * key for that region.  On mount we take clean regions from the
+ * snapshot and read only the dirty ones back from the freelist.
+ */
+int BlueStore::_load_alloc_snapshot(uint64_t *num, uint64_t *bytes)
 {
-  assert(fsid_fd < 0);
-  int flags = O_RDWR;
-  if (create)
-    flags |= O_CREAT;
-  fsid_fd = ::openat(path_fd, "fsid", flags, 0644);
-  if (fsid_fd < 0) {
-    int err = -errno;
-    derr << __func__ << " " << cpp_strerror(err) << dendl;
-    return err;
-  }
-  return 0;
-}
+  bluestore_alloc_snapshot_t h;
+  {
+    bufferlist bl;
+    int r = db->get(PREFIX_ALLOC_SNAP, "header", &bl);
+    if (r < 0) {
+      dout(10) << __func__ << " no allocator snapshot" << dendl;
+      return -ENOENT;
+    }
+    try {
+      bufferlist::iterator p = bl.begin();
+      ::decode(h, p);
+    } catch (buffer::error& e) {
+      derr << __func__ << " failed to decode snapshot header" << dendl;
+      return -EIO;
+    }
+  }
+  if (h.size != bdev->get_size() ||
+      h.region_size != alloc_snap_region_size) {
+    dout(1) << __func__ << " snapshot size 0x" << std::hex << h.size
+	    << " region 0x" << h.region_size << " does not match device 0x"
+	    << bdev->get_size() << " region 0x" << alloc_snap_region_size
+	    << std::dec << ", ignoring" << dendl;
+    return -ESTALE;
+  }
+
+  // verify before touching the allocator
+  vector<bufferlist> chunks;
+  chunks.reserve(h.num_chunks);
+  uint32_t crc = -1;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_ALLOC_SNAP);
+  for (it->lower_bound("c"); it->valid() && it->key()[0] == 'c'; it->next()) {
+    chunks.push_back(it->value());
+    crc = chunks.back().crc32c(crc);
+  }
+  if (chunks.size() != h.num_chunks || crc != h.crc) {
+    derr << __func__ << " snapshot has " << chunks.size() << " chunks crc 0x"
+	 << std::hex << crc << ", expected " << std::dec << h.num_chunks
+	 << " crc 0x" << std::hex << h.crc << std::dec << dendl;
+    return -EIO;
+  }
+  uint64_t num_dirty = 0;
+  for (it->lower_bound("d"); it->valid() && it->key()[0] == 'd'; it->next()) {
+    string k = it->key();
+    uint64_t region;
+    _key_decode_u64(k.c_str() + 1, &region);
+    if (region >= alloc_snap_dirty.size()) {
+      derr << __func__ << " bad dirty region " << region << dendl;
+      return -EIO;
+    }
+    alloc_snap_dirty.set(region);
+    ++num_dirty;
+  }
+
+  // clean regions come from the snapshot...
+  uint64_t pending_offset = 0, pending_length = 0;
+  auto flush = [&]() {
+    if (pending_length) {
+      _alloc_add_free(pending_offset, pending_length);
+      ++*num;
+      *bytes += pending_length;
+    }
+    pending_length = 0;
+  };
+  auto add = [&](uint64_t offset, uint64_t length) {
+    if (pending_length && pending_offset + pending_length == offset) {
+      pending_length += length;
+      return;
+    }
+    flush();
+    pending_offset = offset;
+    pending_length = length;
+  };
+  for (auto& bl : chunks) {
+    vector<pair<uint64_t,uint64_t>> extents;
+    bufferlist::iterator p = bl.begin();
+    ::decode(extents, p);
+    for (auto& e : extents) {
+      uint64_t offset = e.first, length = e.second;
+      while (length > 0) {
+	uint64_t region = offset / alloc_snap_region_size;
+	uint64_t l = std::min(length,
+			      (region + 1) * alloc_snap_region_size - offset);
+	if (!alloc_snap_dirty.test(region)) {
+	  add(offset, l);
+	}
+	offset += l;
+	length -= l;
+      }
+    }
+  }
+  // ...and dirty ones from the freelist
+  for (size_t region = alloc_snap_dirty.find_first();
+       region != boost::dynamic_bitset<uint64_t>::npos;
+       region = alloc_snap_dirty.find_next(region)) {
+    fm->enumerate_range(region * alloc_snap_region_size,
+			alloc_snap_region_size, add);
+  }
+  flush();
+  dout(1) << __func__ << " loaded snapshot of " << h.num_extents
+	  << " extents, replayed " << num_dirty << " dirty regions" << dendl;
+  return 0;
+}
+
+void BlueStore::_write_alloc_snapshot()
+{
+  interval_set<uint64_t> free;
+  auto insert = [&](uint64_t offset, uint64_t length) {
+    free.insert(offset, length);
+  };
+  if (!alloc->foreach(insert) ||
+      (fast_alloc && !fast_alloc->foreach(insert))) {
+    dout(1) << __func__ << " " << cct->_conf->bluestore_allocator
+	    << " allocator does not support snapshots" << dendl;
+    return;
+  }
+  // bluefs space is free as far as the freelist is concerned
+  for (auto e = bluefs_extents.begin(); e != bluefs_extents.end(); ++e) {
+    free.insert(e.get_start(), e.get_len());
+  }
+
+  bluestore_alloc_snapshot_t h;
+  h.size = bdev->get_size();
+  h.region_size = alloc_snap_region_size;
+  h.num_extents = free.num_intervals();
+  h.free = free.size();
+
+  // replaces the old snapshot and all dirty marks atomically
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkeys_by_prefix(PREFIX_ALLOC_SNAP);
+  const size_t chunk_extents = 65536;
+  vector<pair<uint64_t,uint64_t>> extents;
+  extents.reserve(std::min<size_t>(chunk_extents, h.num_extents));
+  auto flush = [&]() {
+    bufferlist bl;
+    ::encode(extents, bl);
+    h.crc = bl.crc32c(h.crc);
+    string key;
+    get_alloc_snap_chunk_key(h.num_chunks++, &key);
+    t->set(PREFIX_ALLOC_SNAP, key, bl);
+    extents.clear();
+  };
+  for (auto p = free.begin(); p != free.end(); ++p) {
+    extents.push_back(make_pair(p.get_start(), p.get_len()));
+    if (extents.size() >= chunk_extents) {
+      flush();
+    }
+  }
+  if (!extents.empty()) {
+    flush();
+  }
+  {
+    bufferlist bl;
+    ::encode(h, bl);
+    t->set(PREFIX_ALLOC_SNAP, "header", bl);
+  }
+  int r = db->submit_transaction_sync(t);
+  assert(r == 0);
+  dout(1) << __func__ << " wrote " << h.num_extents << " extents ("
+	  << pretty_si_t(h.free) << ") in " << h.num_chunks << " chunks"
+	  << dendl;
+}
+
+void BlueStore::_alloc_snap_mark_dirty(
+  TransContext *txc,
+  const interval_set<uint64_t>& extents,
+  KeyValueDB::Transaction t)
+{
+  std::lock_guard<std::mutex> l(alloc_snap_lock);
+  for (auto p = extents.begin(); p != extents.end(); ++p) {
+    uint64_t first = p.get_start() / alloc_snap_region_size;
+    uint64_t last = (p.get_start() + p.get_len() - 1) / alloc_snap_region_size;
+    for (uint64_t region = first; region <= last; ++region) {
+      // until a mark commits, every txc touching the region carries
+      // one; otherwise a later txc could commit without it.
+      if (alloc_snap_dirty.test(region)) {
+	continue;
+      }
+      string key;
+      get_alloc_snap_dirty_key(region, &key);
+      t->set(PREFIX_ALLOC_SNAP, key, bufferlist());
+      txc->alloc_snap_regions.push_back(region);
+    }
+  }
+}
+
+void BlueStore::_close_alloc()
+{
+  assert(alloc);
+  alloc->shutdown();
+  delete alloc;
+  alloc = NULL;
+  if (fast_alloc) {
+    fast_alloc->shutdown();
+    delete fast_alloc;
+    fast_alloc = NULL;
+  }
+}
+
+void BlueStore::_alloc_add_free(uint64_t offset, uint64_t length)
+{
+  uint64_t fast_base = bdev->get_fast_base();
+  if (fast_base && offset + length > fast_base) {
+    if (offset < fast_base) {
+      alloc->init_add_free(offset, fast_base - offset);
+      length -= fast_base - offset;
+      offset = fast_base;
+    }
+    fast_alloc->init_add_free(offset, length);
+    return;
+  }
+  alloc->init_add_free(offset, length);
+}
+
+void BlueStore::_alloc_release(uint64_t offset, uint64_t length)
+{
+  // allocations never straddle the tiers
+  if (bdev->is_fast(offset)) {
+    fast_alloc->release(offset, length);
+  } else {
+    alloc->release(offset, length);
+  }
+}
+
+int BlueStore::_open_fsid(bool create)
+{
+  assert(fsid_fd < 0);
+  int flags = O_RDWR;
+  if (create)
+    flags |= O_CREAT;
+  fsid_fd = ::openat(path_fd, "fsid", flags, 0644);
+  if (fsid_fd < 0) {
+    int err = -errno;
+    derr << __func__ << " " << cpp_strerror(err) << dendl;
+    return err;
+  }
+  return 0;
+}
 
 int BlueStore::_read_fsid(uuid_d *uuid)
 {
@@ -4441,8 +5358,13 @@ int BlueStore::_open_db(bool create)
   assert(!db);
   string fn = path + "/db";
   string options;
+  vector<KeyValueDB::ColumnFamily> cfs;
   stringstream err;
   ceph::shared_ptr<Int64ArrayMergeOperator> merge_op(new Int64ArrayMergeOperator);
+  ceph::shared_ptr<ShardDeltaMergeOperator> shard_merge_op(
+    new ShardDeltaMergeOperator);
+  ceph::shared_ptr<SharedBlobDeltaMergeOperator> sb_merge_op(
+    new SharedBlobDeltaMergeOperator);
 
   string kv_backend;
   if (create) {
@@ -4539,13 +5461,13 @@ int BlueStore::_open_db(bool create)
     if (create) {
       // note: we always leave the first SUPER_RESERVED (8k) of the device unused
       uint64_t initial =
-	bdev->get_size() * (cct->_conf->bluestore_bluefs_min_ratio +
+	bdev->get_main_size() * (cct->_conf->bluestore_bluefs_min_ratio +
 			    cct->_conf->bluestore_bluefs_gift_ratio);
       initial = MAX(initial, cct->_conf->bluestore_bluefs_min);
       // align to bluefs's alloc_size
       initial = P2ROUNDUP(initial, cct->_conf->bluefs_alloc_size);
       // put bluefs in the middle of the device in case it is an HDD
-      uint64_t start = P2ALIGN((bdev->get_size() - initial) / 2,
+      uint64_t start = P2ALIGN((bdev->get_main_size() - initial) / 2,
 			       cct->_conf->bluefs_alloc_size);
       bluefs->add_block_extent(bluefs_shared_bdev, start, initial);
       bluefs_extents.insert(start, initial);
@@ -4682,16 +5604,31 @@ int BlueStore::_open_db(bool create)
 
   FreelistManager::setup_merge_operators(db);
   db->set_merge_operator(PREFIX_STAT, merge_op);
+  db->set_merge_operator(PREFIX_OBJ, shard_merge_op);
+  db->set_merge_operator(PREFIX_SHARED_BLOB, sb_merge_op);
 
   db->set_cache_size(cache_size * cache_kv_ratio);
 
-  if (kv_backend == "rocksdb")
+  if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
+
+    // the families are fixed at mkfs; after that this only supplies
+    // the options for whichever of them exist
+    if (!create || cct->_conf->bluestore_rocksdb_cf) {
+      map<string,string> cf_map;
+      get_str_map(cct->_conf->bluestore_rocksdb_cfs, &cf_map, " \t");
+      for (auto& i : cf_map) {
+	dout(10) << __func__ << " column family " << i.first
+		 << " options " << i.second << dendl;
+	cfs.push_back(KeyValueDB::ColumnFamily(i.first, i.second));
+      }
+    }
+  }
   db->init(options);
   if (create)
-    r = db->create_and_open(err);
+    r = db->create_and_open(err, cfs);
   else
-    r = db->open(err);
+    r = db->open(err, cfs);
   if (r) {
     derr << __func__ << " erroring opening db: " << err.str() << dendl;
     if (bluefs) {
@@ -4705,6 +5642,12 @@ int BlueStore::_open_db(bool create)
   }
   dout(1) << __func__ << " opened " << kv_backend
 	  << " path " << fn << " options " << options << dendl;
+
+  r = _open_pmem_log(create);
+  if (r < 0) {
+    _close_db();
+    return r;
+  }
   return 0;
 
 free_bluefs:
@@ -4717,6 +5660,7 @@ free_bluefs:
 void BlueStore::_close_db()
 {
   assert(db);
+  _close_pmem_log();
   delete db;
   db = NULL;
   if (bluefs) {
@@ -4726,6 +5670,110 @@ void BlueStore::_close_db()
   }
 }
 
+int BlueStore::_open_pmem_log(bool create)
+{
+  string p = path + "/block.pmem";
+  string s;
+  bool expected = !create && read_meta("pmem_log", &s) == 0 && s == "1";
+  struct stat st;
+  if (::stat(p.c_str(), &st) < 0) {
+    if (expected) {
+      derr << __func__ << " store was created with a pmem log but " << p
+	   << " is missing" << dendl;
+      return -ENOENT;
+    }
+    return 0;
+  }
+  if (!create && !expected) {
+    derr << __func__ << " " << p << " present but store was not created"
+	 << " with a pmem log, ignoring it" << dendl;
+    return 0;
+  }
+
+  // records are the kv backend's own serialized transactions
+  bufferlist probe;
+  if (db->get_transaction()->get_rep(&probe) < 0) {
+    derr << __func__ << " kv backend cannot serialize transactions, so it"
+	 << " cannot be used with a pmem log" << dendl;
+    return -EOPNOTSUPP;
+  }
+
+  pmem_log = new PMEMLog(cct);
+  int r = create ? pmem_log->create(p) : pmem_log->open(p);
+  if (r < 0) {
+    derr << __func__ << " failed to open " << p << ": " << cpp_strerror(r)
+	 << dendl;
+    delete pmem_log;
+    pmem_log = nullptr;
+    return r;
+  }
+  if (create) {
+    r = write_meta("pmem_log", "1");
+    if (r < 0)
+      return r;
+  } else {
+    // redo whatever the kv store lost; each record carries the seq it
+    // was logged at, so anything at or below what the store has seen
+    // is already applied.
+    uint64_t applied = 0;
+    bufferlist bl;
+    if (db->get(PREFIX_SUPER, "pmem_log_seq", &bl) == 0) {
+      bufferlist::iterator q = bl.begin();
+      ::decode(applied, q);
+    }
+    unsigned replayed = 0;
+    r = pmem_log->replay([&](uint64_t seq, bufferlist& rep) {
+	if (seq <= applied)
+	  return 0;
+	++replayed;
+	return db->submit_transaction_rep(rep);
+      });
+    if (r < 0) {
+      derr << __func__ << " replay failed: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    dout(1) << __func__ << " replayed " << replayed << " transactions after "
+	    << applied << dendl;
+    r = _pmem_log_checkpoint();
+    if (r < 0)
+      return r;
+  }
+  dout(1) << __func__ << " " << p << " capacity " << pmem_log->get_capacity()
+	  << (pmem_log->is_pmem() ? "" : " (not pmem, using msync)") << dendl;
+  return 0;
+}
+
+void BlueStore::_close_pmem_log()
+{
+  if (!pmem_log)
+    return;
+  int r = _pmem_log_checkpoint();
+  if (r < 0) {
+    derr << __func__ << " checkpoint failed: " << cpp_strerror(r) << dendl;
+  }
+  pmem_log->close();
+  delete pmem_log;
+  pmem_log = nullptr;
+}
+
+int BlueStore::_pmem_log_checkpoint()
+{
+  // a synchronous commit also makes every earlier async commit durable,
+  // after which the log has nothing the kv store doesn't.
+  uint64_t seq = pmem_log->get_next_seq() - 1;
+  KeyValueDB::Transaction t = db->get_transaction();
+  bufferlist bl;
+  ::encode(seq, bl);
+  t->set(PREFIX_SUPER, "pmem_log_seq", bl);
+  int r = db->submit_transaction_sync(t);
+  if (r < 0)
+    return r;
+  dout(10) << __func__ << " trim to " << seq << " used "
+	   << pmem_log->get_used() << dendl;
+  logger->inc(l_bluestore_pmem_log_checkpoints);
+  return pmem_log->trim(seq);
+}
+
 int BlueStore::_reconcile_bluefs_freespace()
 {
   dout(10) << __func__ << dendl;
@@ -4784,7 +5832,7 @@ int BlueStore::_balance_bluefs_freespace(PExtentVector *extents)
   float bluefs_free_ratio = (float)bluefs_free / (float)bluefs_total;
 
   uint64_t my_free = alloc->get_free();
-  uint64_t total = bdev->get_size();
+  uint64_t total = bdev->get_main_size();
   float my_free_ratio = (float)my_free / (float)total;
 
   uint64_t total_free = bluefs_free + my_free;
@@ -5142,6 +6190,18 @@ int BlueStore::mkfs()
     if (r < 0)
       goto out_close_fsid;
   }
+  r = _setup_block_symlink_or_file("block.fast",
+    cct->_conf->bluestore_block_fast_path,
+    cct->_conf->bluestore_block_fast_size,
+    cct->_conf->bluestore_block_fast_create);
+  if (r < 0)
+    goto out_close_fsid;
+  r = _setup_block_symlink_or_file("block.pmem",
+    cct->_conf->bluestore_block_pmem_path,
+    cct->_conf->bluestore_block_pmem_size,
+    cct->_conf->bluestore_block_pmem_create);
+  if (r < 0)
+    goto out_close_fsid;
 
   r = _open_bdev(true);
   if (r < 0)
@@ -5349,7 +6409,12 @@ int BlueStore::_mount(bool kv_only)
     goto out_stop;
 
   mempool_thread.init();
-
+  defrag_thread.init();
+  if (fast_alloc) {
+    tier_mount_time = tier_clock_now();
+    tier_thread.init();
+  }
+  _set_readahead();
 
   mounted = true;
   return 0;
@@ -5378,6 +6443,13 @@ int BlueStore::umount()
   assert(mounted);
   dout(1) << __func__ << dendl;
 
+  defrag_thread.shutdown();
+  if (tier_thread.is_started()) {
+    tier_thread.shutdown();
+  }
+  readahead_max = 0;
+  _readahead_drain();
+
   _osr_drain_all();
   _osr_unregister_all();
 
@@ -5390,6 +6462,9 @@ int BlueStore::umount()
   dout(20) << __func__ << " closing" << dendl;
 
   mounted = false;
+  if (alloc_snap_region_size && cct->_conf->bluestore_alloc_snapshot) {
+    _write_alloc_snapshot();
+  }
   _close_alloc();
   _close_fm();
   _close_db();
@@ -6061,6 +7136,9 @@ int BlueStore::statfs(struct store_statfs_t *buf)
   buf->reset();
   buf->total = bdev->get_size();
   buf->available = alloc->get_free();
+  if (fast_alloc) {
+    buf->available += fast_alloc->get_free();
+  }
 
   if (bluefs) {
     // part of our shared device is "free" according to BlueFS
@@ -6159,6 +7237,14 @@ void BlueStore::_update_cache_logger()
   logger->set(l_bluestore_blobs, num_blobs);
   logger->set(l_bluestore_buffers, num_buffers);
   logger->set(l_bluestore_buffer_bytes, num_buffer_bytes);
+  logger->set(l_bluestore_decompressed_cache_bytes,
+	      decompressed_cache.get_bytes());
+  logger->set(l_bluestore_onode_shard_base_bytes,
+	      mempool::bluestore_cache_shard_base::allocated_bytes());
+  if (alloc) {
+    logger->set(l_bluestore_fragmentation,
+		alloc->get_fragmentation(min_alloc_size) * 1000);
+  }
 }
 
 // ---------------
@@ -6300,6 +7386,12 @@ int BlueStore::read(
       length = o->onode.size;
 
     r = _do_read(c, o, offset, length, bl, op_flags);
+    if (r > 0 && readahead_max &&
+	(op_flags & (CEPH_OSD_OP_FLAG_FADVISE_RANDOM |
+		     CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		     CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0) {
+      _readahead(c, o, offset, r);
+    }
   }
 
  out:
@@ -6397,6 +7489,7 @@ int BlueStore::_do_read(
   unsigned left = length;
   uint64_t pos = offset;
   unsigned num_regions = 0;
+  uint32_t tier_now = fast_alloc ? tier_clock_now() : 0;
   auto lp = o->extent_map.seek_lextent(offset);
   while (left > 0 && lp != o->extent_map.extent_map.end()) {
     if (pos < lp->logical_offset) {
@@ -6413,6 +7506,9 @@ int BlueStore::_do_read(
     unsigned l_off = pos - lp->logical_offset;
     unsigned b_off = l_off + lp->blob_offset;
     unsigned b_len = std::min(left, lp->length - l_off);
+    if (tier_now) {
+      bptr->last_access = tier_now;
+    }
 
     ready_regions_t cache_res;
     interval_set<uint32_t> cache_interval;
@@ -6458,10 +7554,26 @@ int BlueStore::_do_read(
                                     // The error isn't that much...
   vector<bufferlist> compressed_blob_bls;
   IOContext ioc(cct, NULL);
-  for (auto& p : blobs2read) {
+  for (auto pb = blobs2read.begin(); pb != blobs2read.end(); ) {
+    auto& p = *pb;
     BlobRef bptr = p.first;
     dout(20) << __func__ << "  blob " << *bptr << std::hex
 	     << " need " << p.second << std::dec << dendl;
+    if (bptr->get_blob().is_compressed() && decompressed_cache.enabled()) {
+      bufferlist raw_bl;
+      if (decompressed_cache.lookup(
+	    bptr->get_blob().get_extents().front().offset, &raw_bl)) {
+	dout(20) << __func__ << "    decompressed cache hit" << dendl;
+	logger->inc(l_bluestore_decompressed_cache_hits);
+	for (auto& i : p.second) {
+	  ready_regions[i.logical_offset].substr_of(
+	    raw_bl, i.blob_xoffset, i.length);
+	}
+	pb = blobs2read.erase(pb);
+	continue;
+      }
+      logger->inc(l_bluestore_decompressed_cache_misses);
+    }
     if (bptr->get_blob().is_compressed()) {
       // read the whole thing
       if (compressed_blob_bls.empty()) {
@@ -6526,6 +7638,7 @@ int BlueStore::_do_read(
 	assert(reg.bl.length() == r_len);
       }
     }
+    ++pb;
   }
   if (ioc.has_pending_aios()) {
     bdev->aio_submit(&ioc);
@@ -6552,6 +7665,10 @@ int BlueStore::_do_read(
       r = _decompress(compressed_bl, &raw_bl);
       if (r < 0)
 	return r;
+      if (decompressed_cache.enabled()) {
+	decompressed_cache.insert(
+	  bptr->get_blob().get_extents().front().offset, raw_bl);
+      }
       if (buffered) {
 	bptr->shared_blob->bc.did_read(bptr->shared_blob->get_cache(), 0,
 				       raw_bl);
@@ -6611,6 +7728,145 @@ int BlueStore::_do_read(
   return r;
 }
 
+void BlueStore::_readahead(
+  Collection *c,
+  OnodeRef& o,
+  uint64_t offset,
+  uint64_t length)
+{
+  uint64_t max = readahead_max;
+  if (o->onode.size <= length) {
+    return;
+  }
+  Readahead *ra = o->readahead;
+  if (!ra) {
+    ra = new Readahead;
+    ra->set_trigger_requests(cct->_conf->bluestore_readahead_trigger_requests);
+    ra->set_min_readahead_size(
+      std::min<uint64_t>(cct->_conf->bluestore_readahead_min_bytes, max));
+    ra->set_max_readahead_size(max);
+    ra->set_alignments({max_blob_size.load()});
+    Readahead *expected = nullptr;
+    if (!o->readahead.compare_exchange_strong(expected, ra)) {
+      // someone else got there first
+      delete ra;
+      ra = expected;
+    }
+  }
+  Readahead::extent_t next = ra->update(offset, length, o->onode.size);
+  if (next.second == 0) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(readahead_lock);
+    if (readahead_inflight + next.second >
+	cct->_conf->bluestore_readahead_max_inflight_bytes) {
+      dout(20) << __func__ << " " << o->oid << " skipping 0x" << std::hex
+	       << next.first << "~" << next.second << std::dec
+	       << ", 0x" << std::hex << readahead_inflight << std::dec
+	       << " in flight" << dendl;
+      logger->inc(l_bluestore_readahead_dropped_bytes, next.second);
+      return;
+    }
+    readahead_inflight += next.second;
+  }
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << next.first
+	   << "~" << next.second << std::dec << dendl;
+
+  ReadaheadContext *rc = new ReadaheadContext(cct, c, o, next.second);
+  uint64_t end = next.first + next.second;
+  o->extent_map.fault_range(db, next.first, next.second);
+  for (auto lp = o->extent_map.seek_lextent(next.first);
+       lp != o->extent_map.extent_map.end() && lp->logical_offset < end;
+       ++lp) {
+    const bluestore_blob_t& blob = lp->blob->get_blob();
+    if (blob.is_compressed()) {
+      // not worth decompressing speculatively
+      continue;
+    }
+    uint64_t l_start = std::max(next.first, (uint64_t)lp->logical_offset);
+    uint64_t l_end = std::min(end, (uint64_t)lp->logical_end());
+    uint64_t chunk_size = blob.get_chunk_size(block_size);
+    uint32_t b_off = l_start - lp->logical_offset + lp->blob_offset;
+    uint32_t r_off = P2ALIGN(b_off, chunk_size);
+    uint32_t r_len = P2ROUNDUP(b_off + (l_end - l_start), chunk_size) - r_off;
+    if (!lp->blob->shared_blob->bc.want_readahead(
+	  lp->blob->shared_blob->get_cache(), r_off, r_len)) {
+      continue;
+    }
+    rc->extents.emplace_back(lp->blob, l_start - (b_off - r_off), r_off);
+    auto& e = rc->extents.back();
+    int r = blob.map(
+      r_off, r_len,
+      [&](uint64_t offset, uint64_t length) {
+	return bdev->aio_read(offset, length, &e.bl, &rc->ioc);
+      });
+    assert(r == 0);
+    rc->bytes += r_len;
+  }
+  if (!rc->bytes) {
+    _readahead_finish(rc);
+    return;
+  }
+  logger->inc(l_bluestore_readahead_ios);
+  logger->inc(l_bluestore_readahead_bytes, rc->bytes);
+  if (rc->ioc.has_pending_aios()) {
+    // rc is gone as soon as this returns
+    bdev->aio_submit(&rc->ioc);
+  } else {
+    // the device read synchronously
+    _readahead_finish(rc);
+  }
+}
+
+void BlueStore::_readahead_finish(ReadaheadContext *rc)
+{
+  uint64_t kept = 0;
+  Collection *c = rc->c.get();
+  // a write since we issued the reads means they may be stale.  writers
+  // hold the collection lock, so check under it, but don't stall the
+  // aio thread waiting for it.
+  if (rc->bytes && c->lock.try_get_read()) {
+    OnodeRef& o = rc->o;
+    if (o->c == c && o->exists && o->write_gen == rc->write_gen) {
+      for (auto& e : rc->extents) {
+	if (e.bl.length() == 0 ||
+	    _verify_csum(o, &e.b->get_blob(), e.r_off, e.bl,
+			 e.logical_offset) < 0) {
+	  continue;
+	}
+	e.b->shared_blob->bc.did_read(e.b->shared_blob->get_cache(),
+				      e.r_off, e.bl,
+				      Buffer::FLAG_READAHEAD);
+	kept += e.bl.length();
+      }
+    }
+    c->lock.put_read();
+  }
+  if (kept < rc->bytes) {
+    dout(20) << __func__ << " " << rc->o->oid << " dropped 0x" << std::hex
+	     << (rc->bytes - kept) << std::dec << dendl;
+    logger->inc(l_bluestore_readahead_dropped_bytes, rc->bytes - kept);
+  }
+  {
+    std::lock_guard<std::mutex> l(readahead_lock);
+    assert(readahead_inflight >= rc->reserved);
+    readahead_inflight -= rc->reserved;
+    if (readahead_inflight == 0) {
+      readahead_cond.notify_all();
+    }
+  }
+  delete rc;
+}
+
+void BlueStore::_readahead_drain()
+{
+  std::unique_lock<std::mutex> l(readahead_lock);
+  while (readahead_inflight) {
+    readahead_cond.wait(l);
+  }
+}
+
 int BlueStore::_verify_csum(OnodeRef& o,
 			    const bluestore_blob_t* blob, uint64_t blob_xoffset,
 			    const bufferlist& bl,
@@ -6646,37 +7902,476 @@ int BlueStore::_verify_csum(OnodeRef& o,
       derr << __func__ << " failed with exit code: " << cpp_strerror(r) << dendl;
     }
   }
-  logger->tinc(l_bluestore_csum_lat, ceph_clock_now() - start);
-  return r;
+  logger->tinc(l_bluestore_csum_lat, ceph_clock_now() - start);
+  return r;
+}
+
+int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+{
+  int r = 0;
+  utime_t start = ceph_clock_now();
+  bufferlist::iterator i = source.begin();
+  bluestore_compression_header_t chdr;
+  ::decode(chdr, i);
+  int alg = int(chdr.type);
+  CompressorRef cp = compressor;
+  if (!cp || (int)cp->get_type() != alg) {
+    cp = Compressor::create(cct, alg);
+  }
+
+  if (!cp.get()) {
+    // if compressor isn't available - error, because cannot return
+    // decompressed data?
+    derr << __func__ << " can't load decompressor " << alg << dendl;
+    r = -EIO;
+  } else {
+    r = cp->decompress(i, chdr.length, *result);
+    if (r < 0) {
+      derr << __func__ << " decompression failed with exit code " << r << dendl;
+      r = -EIO;
+    }
+  }
+  logger->tinc(l_bluestore_decompress_lat, ceph_clock_now() - start);
+  return r;
+}
+
+/*
+ * Walk a slice of the object keyspace looking for onodes whose extent
+ * map has many shards, then rewrite the worst of them.  Like scrub,
+ * each pass is bounded (bluestore_defrag_scan_max keys,
+ * bluestore_defrag_max_objects rewrites) and we sleep
+ * bluestore_defrag_sleep between rewrites; the cursor carries over so
+ * successive passes cover the whole store.
+ */
+void BlueStore::_defrag_pass()
+{
+  uint64_t scan_max = cct->_conf->bluestore_defrag_scan_max;
+  uint64_t max_objects = cct->_conf->bluestore_defrag_max_objects;
+  uint64_t min_shards = cct->_conf->bluestore_defrag_min_shards;
+  string& cursor = defrag_thread.cursor;
+
+  dout(10) << __func__ << " from " << pretty_binary_string(cursor) << dendl;
+  vector<pair<CollectionRef, ghobject_t>> todo;
+  uint64_t scanned = 0;
+  CollectionRef c;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  for (it->lower_bound(cursor);
+       it->valid() && scanned < scan_max && todo.size() < max_objects;
+       it->next()) {
+    if (is_extent_shard_key(it->key())) {
+      continue;
+    }
+    ++scanned;
+    // the shard count is in the onode itself; no need to load shards
+    bufferlist v = it->value();
+    bluestore_onode_t onode;
+    bufferptr::iterator p = v.front().begin();
+    onode.decode(p);
+    if (onode.extent_map_shards.size() < min_shards) {
+      continue;
+    }
+    ghobject_t oid;
+    if (get_key_object(it->key(), &oid) < 0) {
+      continue;
+    }
+    if (!c || !c->contains(oid)) {
+      c = nullptr;
+      RWLock::RLocker l(coll_lock);
+      for (auto& q : coll_map) {
+	if (q.second->contains(oid)) {
+	  c = q.second;
+	  break;
+	}
+      }
+    }
+    if (c) {
+      dout(20) << __func__ << " candidate " << oid << " with "
+	       << onode.extent_map_shards.size() << " shards" << dendl;
+      todo.emplace_back(c, oid);
+    }
+  }
+  if (it->valid()) {
+    cursor = it->key();
+  } else {
+    dout(10) << __func__ << " reached end of object keyspace" << dendl;
+    cursor.clear();
+  }
+  logger->inc(l_bluestore_defrag_scanned, scanned);
+
+  for (auto& p : todo) {
+    if (!defrag_thread.wait(cct->_conf->bluestore_defrag_sleep) ||
+	!cct->_conf->bluestore_defrag) {
+      break;
+    }
+    _defrag_object(p.first, p.second);
+  }
+}
+
+/*
+ * Rewrite every data range of a fragmented object through _do_write,
+ * which lays it out again in max_blob_size, min_alloc_size aligned
+ * blobs (compressed if the policy says so) and releases the old
+ * extents.  See _rewrite_ranges() for how this is ordered against
+ * client writes.  Objects sharing blobs with clones are left alone,
+ * since their shared blob keys may be updated from other onodes.
+ */
+int BlueStore::_defrag_object(CollectionRef& c, const ghobject_t& oid)
+{
+  OnodeRef o;
+  set<Blob*> blobs;
+  interval_set<uint64_t> ranges;
+  {
+    RWLock::RLocker l(c->lock);
+    if (!c->exists) {
+      return -ENOENT;
+    }
+    o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    o->extent_map.fault_range(db, 0, o->onode.size);
+
+    for (auto& e : o->extent_map.extent_map) {
+      if (e.blob->get_blob().is_shared()) {
+	dout(20) << __func__ << " " << oid << " has shared blobs, skipping"
+		 << dendl;
+	return 0;
+      }
+      blobs.insert(e.blob.get());
+      ranges.insert(e.logical_offset, e.length);
+    }
+    // a sequential write would need about this many blobs
+    uint64_t want_blobs = 0;
+    for (auto p = ranges.begin(); p != ranges.end(); ++p) {
+      want_blobs += (p.get_len() + max_blob_size - 1) / max_blob_size;
+    }
+    dout(20) << __func__ << " " << oid << " " << blobs.size() << " blobs, "
+	     << o->extent_map.extent_map.size() << " extents, "
+	     << o->extent_map.shards.size() << " shards; want "
+	     << want_blobs << " blobs" << dendl;
+    if (blobs.size() < cct->_conf->bluestore_defrag_min_blobs ||
+	blobs.size() <= 2 * want_blobs) {
+      return 0;
+    }
+  }
+
+  int r = _rewrite_ranges(defrag_thread.seq, c, o, ranges);
+  if (r < 0) {
+    return r;
+  }
+
+  set<Blob*> new_blobs;
+  {
+    RWLock::RLocker l(c->lock);
+    for (auto& e : o->extent_map.extent_map) {
+      new_blobs.insert(e.blob.get());
+    }
+  }
+  dout(10) << __func__ << " " << oid << " rewrote 0x" << std::hex
+	   << ranges.size() << std::dec << " bytes, " << blobs.size()
+	   << " -> " << new_blobs.size() << " blobs" << dendl;
+  logger->inc(l_bluestore_defrag_objects);
+  logger->inc(l_bluestore_defrag_bytes, ranges.size());
+  if (new_blobs.size() < blobs.size()) {
+    logger->inc(l_bluestore_defrag_blobs_removed,
+		blobs.size() - new_blobs.size());
+  }
+  return 0;
+}
+
+/*
+ * Read the given logical ranges of an onode and write them back
+ * through _do_write, so they get fresh blobs and the old extents are
+ * released.  Background rewrites always land on the main device.
+ *
+ * The data is read under the shared collection lock, like any read.
+ * The rewrite itself is queued on the sequencer that last modified the
+ * collection (our own one if nothing has since mount), so it is
+ * ordered against client writes exactly like another client write:
+ * the exclusive lock is only held while the txc is prepared, and we
+ * give up if the object changed since the read or a txc ahead of us
+ * may still be preparing an update to it.  Before our txc can release
+ * the old extents we wait for everything queued ahead of it, including
+ * deferred writes that may still target those extents.  A client write
+ * that finds the collection last written by one of our threads waits
+ * for that txc to reach the kv store (see _txc_add_transaction()).
+ */
+int BlueStore::_rewrite_ranges(
+  ObjectStore::Sequencer& seq,
+  CollectionRef& c,
+  OnodeRef o,
+  const interval_set<uint64_t>& ranges)
+{
+  typedef std::tuple<uint32_t, uint32_t, BlobRef, uint32_t> extent_sig_t;
+  auto get_sig = [&o]() {
+    vector<extent_sig_t> sig;
+    for (auto& e : o->extent_map.extent_map) {
+      sig.emplace_back(e.logical_offset, e.length, e.blob, e.blob_offset);
+    }
+    return sig;
+  };
+
+  // read everything before touching anything
+  vector<bufferlist> data(ranges.num_intervals());
+  vector<extent_sig_t> sig;
+  {
+    RWLock::RLocker l(c->lock);
+    if (!c->exists || !o->exists) {
+      return -ENOENT;
+    }
+    unsigned i = 0;
+    for (auto p = ranges.begin(); p != ranges.end(); ++p, ++i) {
+      int r = _do_read(c.get(), o, p.get_start(), p.get_len(), data[i],
+		       CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+      if (r < 0) {
+	derr << __func__ << " " << o->oid << " read 0x" << std::hex
+	     << p.get_start() << "~" << p.get_len() << std::dec
+	     << " failed: " << cpp_strerror(r) << dendl;
+	return r;
+      }
+      assert((uint64_t)r == p.get_len());
+    }
+    o->extent_map.fault_range(db, 0, o->onode.size);
+    sig = get_sig();
+  }
+
+  TransContext *txc = nullptr;
+  {
+    RWLock::WLocker l(c->lock);
+    if (!c->exists || !o->exists) {
+      return -ENOENT;
+    }
+    o->extent_map.fault_range(db, 0, o->onode.size);
+    if (get_sig() != sig) {
+      dout(20) << __func__ << " " << o->oid << " changed since read, skipping"
+	       << dendl;
+      return -EAGAIN;
+    }
+    OpSequencerRef osr = c->osr;
+    if (osr && osr->zombie) {
+      // its PG has gone away; take over once its last txcs are done
+      std::lock_guard<std::mutex> ql(osr->qlock);
+      if (!osr->q.empty()) {
+	return -EAGAIN;
+      }
+      osr.reset();
+    }
+    if (!osr) {
+      if (!seq.p) {
+	OpSequencer *n = new OpSequencer(cct, this);
+	n->parent = &seq;
+	n->background = true;
+	seq.p = n;
+      }
+      osr = static_cast<OpSequencer *>(seq.p.get());
+      c->osr = osr;
+    }
+
+    // set the space aside now, so a nearly full device makes us skip
+    // the object rather than fail halfway through rewriting it
+    uint64_t need = 0;
+    for (auto p = ranges.begin(); p != ranges.end(); ++p) {
+      need += P2ROUNDUP(p.get_start() + p.get_len(), min_alloc_size) -
+	P2ALIGN(p.get_start(), min_alloc_size);
+    }
+    if (alloc->reserve(need) < 0) {
+      dout(10) << __func__ << " " << o->oid << " can't reserve 0x" << std::hex
+	       << need << std::dec << ", skipping" << dendl;
+      return -ENOSPC;
+    }
+
+    // a client txc may be between _txc_add_transaction and
+    // _txc_write_nodes on this object; let it go first.
+    txc = _txc_create_if_idle(osr.get());
+    if (!txc) {
+      dout(20) << __func__ << " " << o->oid << " " << *osr
+	       << " busy, skipping" << dendl;
+      alloc->unreserve(need);
+      return -EAGAIN;
+    }
+    txc->tier_slow = true;
+    txc->reserved = need;
+    int r = 0;
+    unsigned i = 0;
+    for (auto p = ranges.begin(); p != ranges.end(); ++p, ++i) {
+      r = _do_write(txc, c, o, p.get_start(), p.get_len(), data[i],
+		    CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+      if (r < 0) {
+	break;
+      }
+      txc->bytes += p.get_len();
+    }
+    if (txc->reserved) {
+      alloc->unreserve(txc->reserved);
+      txc->reserved = 0;
+    }
+    if (r < 0) {
+      derr << __func__ << " " << o->oid << " rewrite failed: "
+	   << cpp_strerror(r) << dendl;
+      _txc_abort_rewrite(txc, c);
+      l.unlock();
+      _txc_submit(txc, nullptr);
+      return r;
+    }
+    txc->write_onode(o);
+    _txc_prepare_kv(txc);
+  }
+
+  // deferred io queued ahead of us may still target the extents we free
+  _osr_drain_preceding(txc);
+  _txc_submit(txc, nullptr);
+  return 0;
 }
 
-int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+/*
+ * Back out a _rewrite_ranges() txc whose writes failed part way, with
+ * the collection lock still held for write.  Nothing it allocated,
+ * released or queued may reach the disk, and the cached onodes may no
+ * longer match the kv store.  Once everything queued ahead of txc has
+ * committed, the kv store is current, so drop the cached onodes and let
+ * them be read back.  txc is left empty, ready to submit.
+ */
+void BlueStore::_txc_abort_rewrite(TransContext *txc, CollectionRef& c)
 {
-  int r = 0;
-  utime_t start = ceph_clock_now();
-  bufferlist::iterator i = source.begin();
-  bluestore_compression_header_t chdr;
-  ::decode(chdr, i);
-  int alg = int(chdr.type);
-  CompressorRef cp = compressor;
-  if (!cp || (int)cp->get_type() != alg) {
-    cp = Compressor::create(cct, alg);
+  dout(10) << __func__ << " " << txc << dendl;
+  for (auto p = txc->allocated.begin(); p != txc->allocated.end(); ++p) {
+    alloc->release(p.get_start(), p.get_len());
   }
+  txc->allocated.clear();
+  txc->released.clear();
+  txc->statfs_delta.reset();
+  txc->ioc.pending_aios.clear();
+  txc->ioc.num_pending = 0;
+  delete txc->deferred_txn;
+  txc->deferred_txn = nullptr;
+  txc->bytes = 0;
+  _txc_prepare_kv(txc);
+  _osr_drain_preceding(txc);
+  c->onode_map.clear();
+}
 
-  if (!cp.get()) {
-    // if compressor isn't available - error, because cannot return
-    // decompressed data?
-    derr << __func__ << " can't load decompressor " << alg << dendl;
-    r = -EIO;
+/*
+ * Walk a slice of the object keyspace and move data that has sat on
+ * the fast tier for bluestore_tier_cold_age seconds without being read
+ * or written to the main device.  Heat lives only in the cached blobs;
+ * anything we have not seen since mount counts as last touched at
+ * mount.  Bounded like _defrag_pass(), with the cursor carried over.
+ */
+void BlueStore::_tier_pass()
+{
+  uint64_t scan_max = cct->_conf->bluestore_tier_scan_max;
+  uint64_t max_objects = cct->_conf->bluestore_tier_max_objects;
+  string& cursor = tier_thread.cursor;
+
+  dout(10) << __func__ << " from " << pretty_binary_string(cursor)
+	   << ", fast tier 0x" << std::hex << fast_alloc->get_free()
+	   << std::dec << " free" << dendl;
+  vector<pair<CollectionRef, ghobject_t>> todo;
+  CollectionRef c;
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OBJ);
+  for (it->lower_bound(cursor);
+       it->valid() && todo.size() < scan_max;
+       it->next()) {
+    if (is_extent_shard_key(it->key())) {
+      continue;
+    }
+    ghobject_t oid;
+    if (get_key_object(it->key(), &oid) < 0) {
+      continue;
+    }
+    if (!c || !c->contains(oid)) {
+      c = nullptr;
+      RWLock::RLocker l(coll_lock);
+      for (auto& q : coll_map) {
+	if (q.second->contains(oid)) {
+	  c = q.second;
+	  break;
+	}
+      }
+    }
+    if (c) {
+      todo.emplace_back(c, oid);
+    }
+  }
+  if (it->valid()) {
+    cursor = it->key();
   } else {
-    r = cp->decompress(i, chdr.length, *result);
-    if (r < 0) {
-      derr << __func__ << " decompression failed with exit code " << r << dendl;
-      r = -EIO;
+    dout(10) << __func__ << " reached end of object keyspace" << dendl;
+    cursor.clear();
+  }
+  logger->inc(l_bluestore_tier_scanned, todo.size());
+
+  uint64_t demoted = 0;
+  for (auto& p : todo) {
+    if (demoted >= max_objects) {
+      break;
+    }
+    if (_tier_demote_object(p.first, p.second) > 0) {
+      ++demoted;
+      if (!tier_thread.wait(cct->_conf->bluestore_tier_sleep)) {
+	break;
+      }
     }
   }
-  logger->tinc(l_bluestore_decompress_lat, ceph_clock_now() - start);
-  return r;
+}
+
+/// rewrite the cold fast-tier ranges of an object; >0 if we moved any
+int BlueStore::_tier_demote_object(CollectionRef& c, const ghobject_t& oid)
+{
+  OnodeRef o;
+  interval_set<uint64_t> ranges;
+  {
+    RWLock::RLocker l(c->lock);
+    if (!c->exists) {
+      return -ENOENT;
+    }
+    o = c->get_onode(oid, false);
+    if (!o || !o->exists) {
+      return -ENOENT;
+    }
+    o->extent_map.fault_range(db, 0, o->onode.size);
+
+    uint32_t now = tier_clock_now();
+    uint32_t cold_age = cct->_conf->bluestore_tier_cold_age;
+    for (auto& e : o->extent_map.extent_map) {
+      const bluestore_blob_t& blob = e.blob->get_blob();
+      if (blob.is_shared()) {
+	dout(20) << __func__ << " " << oid << " has shared blobs, skipping"
+		 << dendl;
+	return 0;
+      }
+      bool fast = false;
+      for (auto& pe : blob.get_extents()) {
+	if (pe.is_valid() && bdev->is_fast(pe.offset)) {
+	  fast = true;
+	  break;
+	}
+      }
+      if (!fast) {
+	continue;
+      }
+      uint32_t last = e.blob->last_access;
+      if (!last) {
+	last = tier_mount_time;
+      }
+      if (now - last >= cold_age) {
+	ranges.insert(e.logical_offset, e.length);
+      }
+    }
+  }
+  if (ranges.empty()) {
+    return 0;
+  }
+
+  int r = _rewrite_ranges(tier_thread.seq, c, o, ranges);
+  if (r < 0) {
+    return r;
+  }
+  dout(10) << __func__ << " " << oid << " moved 0x" << std::hex
+	   << ranges << std::dec << " to the main device" << dendl;
+  logger->inc(l_bluestore_tier_demoted_objects);
+  logger->inc(l_bluestore_tier_demoted_bytes, ranges.size());
+  return 1;
 }
 
 // this stores fiemap into interval_set, other variations
@@ -7640,12 +9335,28 @@ BlueStore::TransContext *BlueStore::_txc_create(OpSequencer *osr)
 {
   TransContext *txc = new TransContext(cct, osr);
   txc->t = db->get_transaction();
+  txc->ioc.shard_hint = osr->shard_hint;
   osr->queue_new(txc);
   dout(20) << __func__ << " osr " << osr << " = " << txc
 	   << " seq " << txc->seq << dendl;
   return txc;
 }
 
+/// like _txc_create, but nullptr if a txc queued on osr is still preparing
+BlueStore::TransContext *BlueStore::_txc_create_if_idle(OpSequencer *osr)
+{
+  TransContext *txc = new TransContext(cct, osr);
+  if (!osr->queue_new_if_idle(txc)) {
+    delete txc;
+    return nullptr;
+  }
+  txc->t = db->get_transaction();
+  txc->ioc.shard_hint = osr->shard_hint;
+  dout(20) << __func__ << " osr " << osr << " = " << txc
+	   << " seq " << txc->seq << dendl;
+  return txc;
+}
+
 void BlueStore::_txc_calc_cost(TransContext *txc)
 {
   // this is about the simplest model for transaction cost you can
@@ -7704,7 +9415,14 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       // ** fall-thru **
 
     case TransContext::STATE_AIO_WAIT:
-      txc->log_state_latency(logger, l_bluestore_state_aio_wait_lat);
+      {
+	utime_t lat = txc->log_state_latency(logger,
+					     l_bluestore_state_aio_wait_lat);
+	if (deferred_adaptive && txc->had_ios) {
+	  deferred_adapt_aio_ns += lat.to_nsec();
+	  ++deferred_adapt_aio_num;
+	}
+      }
       _txc_finish_io(txc);  // may trigger blocked txc's too
       return;
 
@@ -7731,6 +9449,11 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	} else if (txc->osr->txc_with_unstable_io) {
 	  dout(20) << __func__ << " prior txc(s) with unstable ios "
 		   << txc->osr->txc_with_unstable_io.load() << dendl;
+	} else if (pmem_log && txc->had_ios) {
+	  // a pmem log append is durable at once; our data is not until
+	  // the kv thread has flushed the device
+	  dout(20) << __func__ << " pmem log, submit via kv thread after flush"
+		   << dendl;
 	} else if (cct->_conf->bluestore_debug_randomize_serial_transaction &&
 		   rand() % cct->_conf->bluestore_debug_randomize_serial_transaction
 		   == 0) {
@@ -7738,7 +9461,7 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 		   << dendl;
 	} else {
 	  txc->state = TransContext::STATE_KV_SUBMITTED;
-	  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction(txc->t);
+	  int r = _kv_submit(txc->t);
 	  assert(r == 0);
 	  _txc_applied_kv(txc);
 	}
@@ -7898,6 +9621,7 @@ void BlueStore::_txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t)
   }
 
   // finalize shared_blobs
+  bool use_ref_log = cct->_conf->bluestore_shared_blob_ref_log;
   for (auto sb : txc->shared_blobs) {
     string key;
     auto sbid = sb->get_sbid();
@@ -7906,13 +9630,33 @@ void BlueStore::_txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t)
       dout(20) << "  shared_blob 0x" << std::hex << sbid << std::dec
 	       << " is empty" << dendl;
       t->rmkey(PREFIX_SHARED_BLOB, key);
+      sb->persisted = false;
     } else {
-      bufferlist bl;
-      ::encode(*(sb->persistent), bl);
-      dout(20) << "  shared_blob 0x" << std::hex << sbid << std::dec
-	       << " is " << bl.length() << " " << *sb << dendl;
-      t->set(PREFIX_SHARED_BLOB, key, bl);
+      size_t full = 0;
+      sb->persistent->bound_encode(full);
+      // fall back to a full record once the pending deltas outweigh it
+      if (use_ref_log && sb->persisted &&
+	  sb->ref_log_written + sb->ref_log.length() <= full) {
+	dout(20) << "  shared_blob 0x" << std::hex << sbid << std::dec
+		 << " delta " << sb->ref_log.length() << " " << *sb << dendl;
+	if (sb->ref_log.length()) {
+	  t->merge(PREFIX_SHARED_BLOB, key, sb->ref_log);
+	  sb->ref_log_written += sb->ref_log.length();
+	  logger->inc(l_bluestore_shared_blob_delta_bytes,
+		      sb->ref_log.length());
+	}
+      } else {
+	bufferlist bl;
+	::encode(*(sb->persistent), bl);
+	dout(20) << "  shared_blob 0x" << std::hex << sbid << std::dec
+		 << " is " << bl.length() << " " << *sb << dendl;
+	t->set(PREFIX_SHARED_BLOB, key, bl);
+	sb->persisted = true;
+	sb->ref_log_written = 0;
+	logger->inc(l_bluestore_shared_blob_full_bytes, bl.length());
+      }
     }
+    sb->ref_log.clear();
   }
 }
 
@@ -7972,6 +9716,11 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
     fm->release(p.get_start(), p.get_len(), t);
   }
 
+  if (alloc_snap_region_size) {
+    _alloc_snap_mark_dirty(txc, *pallocated, t);
+    _alloc_snap_mark_dirty(txc, *preleased, t);
+  }
+
   _txc_update_store_statfs(txc);
 }
 
@@ -7993,6 +9742,13 @@ void BlueStore::_txc_committed_kv(TransContext *txc)
 {
   dout(20) << __func__ << " txc " << txc << dendl;
 
+  if (!txc->alloc_snap_regions.empty()) {
+    std::lock_guard<std::mutex> l(alloc_snap_lock);
+    for (auto region : txc->alloc_snap_regions) {
+      alloc_snap_dirty.set(region);
+    }
+  }
+
   // warning: we're calling onreadable_sync inside the sequencer lock
   if (txc->onreadable_sync) {
     txc->onreadable_sync->complete(0);
@@ -8091,13 +9847,20 @@ void BlueStore::_txc_finish(TransContext *txc)
 
 void BlueStore::_txc_release_alloc(TransContext *txc)
 {
+  // drop decompressed blobs before their space can be reused
+  if (decompressed_cache.enabled()) {
+    for (auto p = txc->released.begin(); p != txc->released.end(); ++p) {
+      decompressed_cache.invalidate(p.get_start(), p.get_len());
+    }
+  }
+
   // update allocator with full released set
   if (!cct->_conf->bluestore_debug_no_reuse_blocks) {
     dout(10) << __func__ << " " << txc << " " << txc->released << dendl;
     for (interval_set<uint64_t>::iterator p = txc->released.begin();
 	 p != txc->released.end();
 	 ++p) {
-      alloc->release(p.get_start(), p.get_len());
+      _alloc_release(p.get_start(), p.get_len());
     }
   }
 
@@ -8218,7 +9981,11 @@ void BlueStore::_kv_start()
   for (auto f : finishers) {
     f->start();
   }
+  kv_sync_pipeline = cct->_conf->bluestore_kv_sync_pipeline;
   kv_sync_thread.create("bstore_kv_sync");
+  if (kv_sync_pipeline) {
+    kv_commit_thread.create("bstore_kv_commit");
+  }
   kv_finalize_thread.create("bstore_kv_final");
 }
 
@@ -8233,6 +10000,24 @@ void BlueStore::_kv_stop()
     kv_stop = true;
     kv_cond.notify_all();
   }
+  kv_sync_thread.join();
+  if (kv_sync_pipeline) {
+    // drain the last prepared batch before stopping finalize
+    {
+      std::unique_lock<std::mutex> l(kv_commit_lock);
+      while (!kv_commit_started) {
+	kv_commit_cond.wait(l);
+      }
+      kv_commit_stop = true;
+      kv_commit_cond.notify_all();
+    }
+    kv_commit_thread.join();
+    {
+      std::lock_guard<std::mutex> l(kv_commit_lock);
+      assert(!kv_commit_pending);
+      kv_commit_stop = false;
+    }
+  }
   {
     std::unique_lock<std::mutex> l(kv_finalize_lock);
     while (!kv_finalize_started) {
@@ -8241,7 +10026,6 @@ void BlueStore::_kv_stop()
     kv_finalize_stop = true;
     kv_finalize_cond.notify_all();
   }
-  kv_sync_thread.join();
   kv_finalize_thread.join();
   {
     std::lock_guard<std::mutex> l(kv_lock);
@@ -8267,7 +10051,6 @@ void BlueStore::_kv_sync_thread()
   kv_sync_started = true;
   kv_cond.notify_all();
   while (true) {
-    assert(kv_committing.empty());
     if (kv_queue.empty() &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
 	 !deferred_aggressive)) {
@@ -8277,8 +10060,21 @@ void BlueStore::_kv_sync_thread()
       kv_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
+      uint64_t linger = kv_batch_linger_ns;
+      if (linger && !kv_queue.empty() && !kv_stop && !deferred_aggressive) {
+	// recent batches committed well within the latency target; let
+	// this one pick up more txcs before we flush and sync.
+	utime_t linger_start = ceph_clock_now();
+	auto deadline = std::chrono::steady_clock::now() +
+	  std::chrono::nanoseconds(linger);
+	while (!kv_stop &&
+	       kv_cond.wait_until(l, deadline) == std::cv_status::no_timeout) ;
+	logger->tinc(l_bluestore_kv_batch_linger_lat,
+		     ceph_clock_now() - linger_start);
+      }
+
+      KVSyncBatch *b = new KVSyncBatch;
       deque<TransContext*> kv_submitting;
-      deque<DeferredBatch*> deferred_done, deferred_stable;
       uint64_t aios = 0, costs = 0;
 
       dout(20) << __func__ << " committing " << kv_queue.size()
@@ -8286,224 +10082,377 @@ void BlueStore::_kv_sync_thread()
 	       << " deferred done " << deferred_done_queue.size()
 	       << " stable " << deferred_stable_queue.size()
 	       << dendl;
-      kv_committing.swap(kv_queue);
+      b->committing.swap(kv_queue);
       kv_submitting.swap(kv_queue_unsubmitted);
-      deferred_done.swap(deferred_done_queue);
-      deferred_stable.swap(deferred_stable_queue);
+      b->deferred_done.swap(deferred_done_queue);
+      b->deferred_stable.swap(deferred_stable_queue);
       aios = kv_ios;
       costs = kv_throttle_costs;
       kv_ios = 0;
       kv_throttle_costs = 0;
-      utime_t start = ceph_clock_now();
+      b->start = ceph_clock_now();
       l.unlock();
 
-      dout(30) << __func__ << " committing " << kv_committing << dendl;
-      dout(30) << __func__ << " submitting " << kv_submitting << dendl;
-      dout(30) << __func__ << " deferred_done " << deferred_done << dendl;
-      dout(30) << __func__ << " deferred_stable " << deferred_stable << dendl;
-
-      bool force_flush = false;
-      // if bluefs is sharing the same device as data (only), then we
-      // can rely on the bluefs commit to flush the device and make
-      // deferred aios stable.  that means that if we do have done deferred
-      // txcs AND we are not on a single device, we need to force a flush.
-      if (bluefs_single_shared_device && bluefs) {
-	if (aios) {
-	  force_flush = true;
-	} else if (kv_committing.empty() && kv_submitting.empty() &&
-		   deferred_stable.empty()) {
-	  force_flush = true;  // there's nothing else to commit!
-	} else if (deferred_aggressive) {
-	  force_flush = true;
+      _kv_sync_prepare(b, kv_submitting, aios, costs);
+
+      if (kv_sync_pipeline) {
+	// hand the batch to the commit thread and go build the next
+	// one while this one syncs.
+	std::unique_lock<std::mutex> m(kv_commit_lock);
+	utime_t wait_start = ceph_clock_now();
+	while (kv_commit_pending) {
+	  kv_commit_cond.wait(m);
 	}
-      } else
-	force_flush = true;
-
-      if (force_flush) {
-	dout(20) << __func__ << " num_aios=" << aios
-		 << " force_flush=" << (int)force_flush
-		 << ", flushing, deferred done->stable" << dendl;
-	// flush/barrier on block device
-	bdev->flush();
-
-	// if we flush then deferred done are now deferred stable
-	deferred_stable.insert(deferred_stable.end(), deferred_done.begin(),
-			       deferred_done.end());
-	deferred_done.clear();
-      }
-      utime_t after_flush = ceph_clock_now();
-
-      // we will use one final transaction to force a sync
-      KeyValueDB::Transaction synct = db->get_transaction();
-
-      // increase {nid,blobid}_max?  note that this covers both the
-      // case where we are approaching the max and the case we passed
-      // it.  in either case, we increase the max in the earlier txn
-      // we submit.
-      uint64_t new_nid_max = 0, new_blobid_max = 0;
-      if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
-	bufferlist bl;
-	::encode(new_nid_max, bl);
-	t->set(PREFIX_SUPER, "nid_max", bl);
-	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
-      }
-      if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
-	bufferlist bl;
-	::encode(new_blobid_max, bl);
-	t->set(PREFIX_SUPER, "blobid_max", bl);
-	dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
+	logger->tinc(l_bluestore_kv_sync_wait_lat,
+		     ceph_clock_now() - wait_start);
+	kv_commit_pending = b;
+	kv_commit_cond.notify_all();
+      } else {
+	_kv_sync_commit(b);
       }
 
-      for (auto txc : kv_committing) {
-	if (txc->state == TransContext::STATE_KV_QUEUED) {
-	  txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
-	  int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction(txc->t);
-	  assert(r == 0);
-	  _txc_applied_kv(txc);
-	  --txc->osr->kv_committing_serially;
-	  txc->state = TransContext::STATE_KV_SUBMITTED;
-	  if (txc->osr->kv_submitted_waiters) {
-	    std::lock_guard<std::mutex> l(txc->osr->qlock);
-	    if (txc->osr->_is_all_kv_submitted()) {
-	      txc->osr->qcond.notify_all();
-	    }
-	  }
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+  kv_sync_started = false;
+}
 
-	} else {
-	  assert(txc->state == TransContext::STATE_KV_SUBMITTED);
-	  txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
-	}
-	if (txc->had_ios) {
-	  --txc->osr->txc_with_unstable_io;
+void BlueStore::_kv_sync_prepare(KVSyncBatch *b,
+				 deque<TransContext*>& kv_submitting,
+				 uint64_t aios, uint64_t costs)
+{
+  dout(30) << __func__ << " committing " << b->committing << dendl;
+  dout(30) << __func__ << " submitting " << kv_submitting << dendl;
+  dout(30) << __func__ << " deferred_done " << b->deferred_done << dendl;
+  dout(30) << __func__ << " deferred_stable " << b->deferred_stable << dendl;
+
+  bool force_flush = false;
+  // if bluefs is sharing the same device as data (only), then we
+  // can rely on the bluefs commit to flush the device and make
+  // deferred aios stable.  that means that if we do have done deferred
+  // txcs AND we are not on a single device, we need to force a flush.
+  if (bluefs_single_shared_device && bluefs) {
+    if (aios) {
+      force_flush = true;
+    } else if (b->committing.empty() && kv_submitting.empty() &&
+	       b->deferred_stable.empty()) {
+      force_flush = true;  // there's nothing else to commit!
+    } else if (deferred_aggressive) {
+      force_flush = true;
+    }
+  } else
+    force_flush = true;
+  if (pmem_log) {
+    // the kv store is not synced per batch, so nothing else will
+    // flush the device for us; only data written since the last
+    // flush needs it
+    force_flush = aios || !b->deferred_done.empty();
+  }
+
+  if (force_flush) {
+    dout(20) << __func__ << " num_aios=" << aios
+	     << " force_flush=" << (int)force_flush
+	     << ", flushing, deferred done->stable" << dendl;
+    // flush/barrier on block device
+    bdev->flush();
+
+    // if we flush then deferred done are now deferred stable
+    b->deferred_stable.insert(b->deferred_stable.end(),
+			      b->deferred_done.begin(),
+			      b->deferred_done.end());
+    b->deferred_done.clear();
+  }
+  b->after_flush = ceph_clock_now();
+
+  // we will use one final transaction to force a sync
+  b->synct = db->get_transaction();
+
+  // increase {nid,blobid}_max?  note that this covers both the
+  // case where we are approaching the max and the case we passed
+  // it.  in either case, we increase the max in the earlier txn
+  // we submit.
+  if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
+    KeyValueDB::Transaction t =
+      kv_submitting.empty() ? b->synct : kv_submitting.front()->t;
+    b->new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
+    bufferlist bl;
+    ::encode(b->new_nid_max, bl);
+    t->set(PREFIX_SUPER, "nid_max", bl);
+    dout(10) << __func__ << " new_nid_max " << b->new_nid_max << dendl;
+  }
+  if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
+    KeyValueDB::Transaction t =
+      kv_submitting.empty() ? b->synct : kv_submitting.front()->t;
+    b->new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
+    bufferlist bl;
+    ::encode(b->new_blobid_max, bl);
+    t->set(PREFIX_SUPER, "blobid_max", bl);
+    dout(10) << __func__ << " new_blobid_max " << b->new_blobid_max << dendl;
+  }
+
+  for (auto txc : b->committing) {
+    if (txc->state == TransContext::STATE_KV_QUEUED) {
+      txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
+      int r = _kv_submit(txc->t);
+      assert(r == 0);
+      _txc_applied_kv(txc);
+      --txc->osr->kv_committing_serially;
+      txc->state = TransContext::STATE_KV_SUBMITTED;
+      if (txc->osr->kv_submitted_waiters) {
+	std::lock_guard<std::mutex> l(txc->osr->qlock);
+	if (txc->osr->_is_all_kv_submitted()) {
+	  txc->osr->qcond.notify_all();
 	}
       }
 
-      // release throttle *before* we commit.  this allows new ops
-      // to be prepared and enter pipeline while we are waiting on
-      // the kv commit sync/flush.  then hopefully on the next
-      // iteration there will already be ops awake.  otherwise, we
-      // end up going to sleep, and then wake up when the very first
-      // transaction is ready for commit.
-      throttle_bytes.put(costs);
-
-      PExtentVector bluefs_gift_extents;
-      if (bluefs &&
-	  after_flush - bluefs_last_balance >
-	  cct->_conf->bluestore_bluefs_balance_interval) {
-	bluefs_last_balance = after_flush;
-	int r = _balance_bluefs_freespace(&bluefs_gift_extents);
-	assert(r >= 0);
-	if (r > 0) {
-	  for (auto& p : bluefs_gift_extents) {
-	    bluefs_extents.insert(p.offset, p.length);
-	  }
-	  bufferlist bl;
-	  ::encode(bluefs_extents, bl);
-	  dout(10) << __func__ << " bluefs_extents now 0x" << std::hex
-		   << bluefs_extents << std::dec << dendl;
-	  synct->set(PREFIX_SUPER, "bluefs_extents", bl);
-	}
+    } else {
+      assert(txc->state == TransContext::STATE_KV_SUBMITTED);
+      txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
+    }
+    if (txc->had_ios) {
+      --txc->osr->txc_with_unstable_io;
+    }
+  }
+
+  // release throttle *before* we commit.  this allows new ops
+  // to be prepared and enter pipeline while we are waiting on
+  // the kv commit sync/flush.  then hopefully on the next
+  // iteration there will already be ops awake.  otherwise, we
+  // end up going to sleep, and then wake up when the very first
+  // transaction is ready for commit.
+  throttle_bytes.put(costs);
+
+  // with kv_sync_pipeline the previous batch may still be committing;
+  // until it has handed its gift to bluefs, bluefs' free space doesn't
+  // reflect it and balancing now would gift the same shortfall twice.
+  if (bluefs &&
+      !bluefs_gift_pending &&
+      b->after_flush - bluefs_last_balance >
+      cct->_conf->bluestore_bluefs_balance_interval) {
+    bluefs_last_balance = b->after_flush;
+    int r = _balance_bluefs_freespace(&b->bluefs_gift_extents);
+    assert(r >= 0);
+    if (r > 0) {
+      bluefs_gift_pending = !b->bluefs_gift_extents.empty();
+      for (auto& p : b->bluefs_gift_extents) {
+	bluefs_extents.insert(p.offset, p.length);
       }
+      bufferlist bl;
+      ::encode(bluefs_extents, bl);
+      dout(10) << __func__ << " bluefs_extents now 0x" << std::hex
+	       << bluefs_extents << std::dec << dendl;
+      b->synct->set(PREFIX_SUPER, "bluefs_extents", bl);
+    }
+  }
+  if (deferred_adaptive &&
+      b->after_flush - deferred_adapt_last >
+      cct->_conf->bluestore_prefer_deferred_size_adaptive_interval) {
+    _deferred_adapt(b->after_flush);
+  }
 
-      // cleanup sync deferred keys
-      for (auto b : deferred_stable) {
-	for (auto& txc : b->txcs) {
-	  bluestore_deferred_transaction_t& wt = *txc.deferred_txn;
-	  if (!wt.released.empty()) {
-	    // kraken replay compat only
-	    txc.released = wt.released;
-	    dout(10) << __func__ << " deferred txn has released "
-		     << txc.released
-		     << " (we just upgraded from kraken) on " << &txc << dendl;
-	    _txc_finalize_kv(&txc, synct);
-	  }
-	  // cleanup the deferred
-	  string key;
-	  get_deferred_key(wt.seq, &key);
-	  synct->rm_single_key(PREFIX_DEFERRED, key);
-	}
+  // only release what this batch's synct makes durable
+  b->bluefs_extents_reclaiming.swap(bluefs_extents_reclaiming);
+
+  // cleanup sync deferred keys
+  for (auto batch : b->deferred_stable) {
+    for (auto& txc : batch->txcs) {
+      bluestore_deferred_transaction_t& wt = *txc.deferred_txn;
+      if (!wt.released.empty()) {
+	// kraken replay compat only
+	txc.released = wt.released;
+	dout(10) << __func__ << " deferred txn has released "
+		 << txc.released
+		 << " (we just upgraded from kraken) on " << &txc << dendl;
+	_txc_finalize_kv(&txc, b->synct);
       }
+      // cleanup the deferred
+      string key;
+      get_deferred_key(wt.seq, &key);
+      b->synct->rm_single_key(PREFIX_DEFERRED, key);
+    }
+  }
+  b->after_prepare = ceph_clock_now();
+  logger->tinc(l_bluestore_kv_prepare_lat, b->after_prepare - b->after_flush);
+  logger->inc(l_bluestore_kv_batch_txc, b->committing.size());
+}
+
+int BlueStore::_kv_submit(KeyValueDB::Transaction t)
+{
+  if (cct->_conf->bluestore_debug_omit_kv_commit)
+    return 0;
+  if (!pmem_log)
+    return db->submit_transaction(t);
+
+  std::lock_guard<std::mutex> l(pmem_log_lock);
+  uint64_t seq = pmem_log->get_next_seq();
+  bufferlist bl;
+  ::encode(seq, bl);
+  t->set(PREFIX_SUPER, "pmem_log_seq", bl);
+  bufferlist rep;
+  int r = t->get_rep(&rep);
+  assert(r == 0);
+
+  utime_t start = ceph_clock_now();
+  uint64_t logged;
+  r = pmem_log->append(rep, &logged);
+  if (r == -ENOSPC) {
+    r = _pmem_log_checkpoint();
+    assert(r == 0);
+    r = pmem_log->append(rep, &logged);
+  }
+  if (r == -ENOSPC) {
+    // bigger than the whole log; commit it the slow way and skip its seq
+    dout(10) << __func__ << " 0x" << std::hex << rep.length() << std::dec
+	     << " byte transaction does not fit in the pmem log" << dendl;
+    r = db->submit_transaction_sync(t);
+    if (r == 0)
+      r = pmem_log->trim(seq);
+    return r;
+  }
+  assert(r == 0);
+  assert(logged == seq);
+  logger->tinc(l_bluestore_pmem_log_append_lat, ceph_clock_now() - start);
+  logger->inc(l_bluestore_pmem_log_bytes, rep.length());
+  return db->submit_transaction(t);
+}
 
-      // submit synct synchronously (block and wait for it to commit)
-      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
+void BlueStore::_kv_sync_commit(KVSyncBatch *b)
+{
+  // submit synct synchronously (block and wait for it to commit)
+  utime_t sync_start = ceph_clock_now();
+  int r;
+  if (pmem_log) {
+    // once it is in the log it is as good as synced
+    r = _kv_submit(b->synct);
+    assert(r == 0);
+    if (pmem_log->get_used() > pmem_log->get_capacity() *
+	cct->_conf->bluestore_pmem_log_checkpoint_ratio) {
+      std::lock_guard<std::mutex> l(pmem_log_lock);
+      r = _pmem_log_checkpoint();
       assert(r == 0);
+    }
+  } else {
+    r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(b->synct);
+    assert(r == 0);
+  }
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
-      }
+  if (b->new_nid_max) {
+    nid_max = b->new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (b->new_blobid_max) {
+    blobid_max = b->new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+  }
 
-      {
-	utime_t finish = ceph_clock_now();
-	utime_t dur_flush = after_flush - start;
-	utime_t dur_kv = finish - after_flush;
-	utime_t dur = finish - start;
-	dout(20) << __func__ << " committed " << kv_committing.size()
-	  << " cleaned " << deferred_stable.size()
-	  << " in " << dur
-	  << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
-	  << dendl;
-	logger->tinc(l_bluestore_kv_flush_lat, dur_flush);
-	logger->tinc(l_bluestore_kv_commit_lat, dur_kv);
-	logger->tinc(l_bluestore_kv_lat, dur);
-      }
+  {
+    utime_t finish = ceph_clock_now();
+    utime_t dur_flush = b->after_flush - b->start;
+    utime_t dur_kv = finish - b->after_flush;
+    utime_t dur = finish - b->start;
+    dout(20) << __func__ << " committed " << b->committing.size()
+	     << " cleaned " << b->deferred_stable.size()
+	     << " in " << dur
+	     << " (" << dur_flush << " flush + " << dur_kv << " kv commit)"
+	     << dendl;
+    logger->tinc(l_bluestore_kv_flush_lat, dur_flush);
+    logger->tinc(l_bluestore_kv_commit_lat, dur_kv);
+    logger->tinc(l_bluestore_kv_sync_lat, finish - sync_start);
+    if (deferred_adaptive) {
+      deferred_adapt_kv_ns += (finish - sync_start).to_nsec();
+      ++deferred_adapt_kv_num;
+    }
+    logger->tinc(l_bluestore_kv_lat, dur);
+
+    // a txc in this batch waited the linger, then dur, so move the
+    // linger towards whatever dur leaves of the target
+    double target = cct->_conf->bluestore_kv_sync_target_lat;
+    if (target > 0) {
+      uint64_t target_ns = target * 1000000000ull;
+      uint64_t room = target_ns > dur.to_nsec() ? target_ns - dur.to_nsec() : 0;
+      kv_batch_linger_ns = (kv_batch_linger_ns * 3 + room) / 4;
+    } else {
+      kv_batch_linger_ns = 0;
+    }
+  }
 
-      if (bluefs) {
-	if (!bluefs_gift_extents.empty()) {
-	  _commit_bluefs_freespace(bluefs_gift_extents);
-	}
-	for (auto p = bluefs_extents_reclaiming.begin();
-	     p != bluefs_extents_reclaiming.end();
-	     ++p) {
-	  dout(20) << __func__ << " releasing old bluefs 0x" << std::hex
-		   << p.get_start() << "~" << p.get_len() << std::dec
-		   << dendl;
-	  alloc->release(p.get_start(), p.get_len());
-	}
-	bluefs_extents_reclaiming.clear();
-      }
+  if (bluefs) {
+    if (!b->bluefs_gift_extents.empty()) {
+      _commit_bluefs_freespace(b->bluefs_gift_extents);
+      bluefs_gift_pending = false;
+    }
+    for (auto p = b->bluefs_extents_reclaiming.begin();
+	 p != b->bluefs_extents_reclaiming.end();
+	 ++p) {
+      dout(20) << __func__ << " releasing old bluefs 0x" << std::hex
+	       << p.get_start() << "~" << p.get_len() << std::dec
+	       << dendl;
+      _alloc_release(p.get_start(), p.get_len());
+    }
+  }
 
-      {
-	std::unique_lock<std::mutex> m(kv_finalize_lock);
-	if (kv_committing_to_finalize.empty()) {
-	  kv_committing_to_finalize.swap(kv_committing);
-	} else {
-	  kv_committing_to_finalize.insert(
-	    kv_committing_to_finalize.end(),
-	    kv_committing.begin(),
-	    kv_committing.end());
-	  kv_committing.clear();
-	}
-	if (deferred_stable_to_finalize.empty()) {
-	  deferred_stable_to_finalize.swap(deferred_stable);
-	} else {
-	  deferred_stable_to_finalize.insert(
-	    deferred_stable_to_finalize.end(),
-	    deferred_stable.begin(),
-	    deferred_stable.end());
-          deferred_stable.clear();
-	}
-	kv_finalize_cond.notify_one();
-      }
+  {
+    std::unique_lock<std::mutex> m(kv_finalize_lock);
+    if (kv_committing_to_finalize.empty()) {
+      kv_committing_to_finalize.swap(b->committing);
+    } else {
+      kv_committing_to_finalize.insert(
+	kv_committing_to_finalize.end(),
+	b->committing.begin(),
+	b->committing.end());
+    }
+    if (deferred_stable_to_finalize.empty()) {
+      deferred_stable_to_finalize.swap(b->deferred_stable);
+    } else {
+      deferred_stable_to_finalize.insert(
+	deferred_stable_to_finalize.end(),
+	b->deferred_stable.begin(),
+	b->deferred_stable.end());
+    }
+    kv_finalize_cond.notify_one();
+  }
+
+  {
+    std::lock_guard<std::mutex> l(kv_lock);
+    // previously deferred "done" are now "stable" by virtue of this
+    // commit cycle.
+    deferred_stable_queue.insert(deferred_stable_queue.end(),
+				 b->deferred_done.begin(),
+				 b->deferred_done.end());
+    if (!b->deferred_done.empty()) {
+      kv_cond.notify_one();
+    }
+  }
+  delete b;
+}
 
+void BlueStore::_kv_commit_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_commit_lock);
+  assert(!kv_commit_started);
+  kv_commit_started = true;
+  kv_commit_cond.notify_all();
+  while (true) {
+    if (!kv_commit_pending) {
+      if (kv_commit_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_commit_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      KVSyncBatch *b = kv_commit_pending;
+      kv_commit_pending = nullptr;
+      // let the sync thread queue up the next batch while we sync
+      kv_commit_cond.notify_all();
+      l.unlock();
+      _kv_sync_commit(b);
       l.lock();
-      // previously deferred "done" are now "stable" by virtue of this
-      // commit cycle.
-      deferred_stable_queue.swap(deferred_done);
     }
   }
   dout(10) << __func__ << " finish" << dendl;
-  kv_sync_started = false;
+  kv_commit_started = false;
 }
 
 void BlueStore::_kv_finalize_thread()
@@ -8587,6 +10536,7 @@ void BlueStore::_deferred_queue(TransContext *txc)
   }
   if (!txc->osr->deferred_pending) {
     txc->osr->deferred_pending = new DeferredBatch(cct, txc->osr.get());
+    txc->osr->deferred_pending->ioc.shard_hint = txc->osr->shard_hint;
   }
   ++deferred_queue_size;
   txc->osr->deferred_pending->txcs.push_back(*txc);
@@ -8645,10 +10595,13 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   osr->deferred_pending = nullptr;
 
   uint64_t start = 0, pos = 0;
+  uint64_t fast_base = bdev->get_fast_base();
   bufferlist bl;
   auto i = b->iomap.begin();
   while (true) {
-    if (i == b->iomap.end() || i->first != pos) {
+    // never merge ios across the fast tier boundary
+    if (i == b->iomap.end() || i->first != pos ||
+	(fast_base && pos == fast_base)) {
       if (bl.length()) {
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
@@ -8798,6 +10751,7 @@ int BlueStore::queue_transactions(
   } else {
     osr = new OpSequencer(cct, this);
     osr->parent = posr;
+    osr->shard_hint = posr->shard_hint.ps();
     posr->p = osr;
     dout(10) << __func__ << " new " << osr << " " << *osr << dendl;
   }
@@ -8813,6 +10767,16 @@ int BlueStore::queue_transactions(
     txc->bytes += (*p).get_num_bytes();
     _txc_add_transaction(txc, &(*p));
   }
+  _txc_prepare_kv(txc);
+  _txc_submit(txc, handle);
+
+  logger->tinc(l_bluestore_submit_lat, ceph_clock_now() - start);
+  return 0;
+}
+
+/// encode the dirty onodes and the deferred record of a prepared txc
+void BlueStore::_txc_prepare_kv(TransContext *txc)
+{
   _txc_calc_cost(txc);
 
   _txc_write_nodes(txc, txc->t);
@@ -8828,6 +10792,11 @@ int BlueStore::queue_transactions(
   }
 
   _txc_finalize_kv(txc, txc->t);
+}
+
+/// take throttle budget for a txc and start it through the state machine
+void BlueStore::_txc_submit(TransContext *txc, ThreadPool::TPHandle *handle)
+{
   if (handle)
     handle->suspend_tp_timeout();
 
@@ -8854,9 +10823,7 @@ int BlueStore::queue_transactions(
   // execute (start)
   _txc_state_proc(txc);
 
-  logger->tinc(l_bluestore_submit_lat, ceph_clock_now() - start);
   logger->tinc(l_bluestore_throttle_lat, tend - tstart);
-  return 0;
 }
 
 void BlueStore::_txc_aio_submit(TransContext *txc)
@@ -8975,6 +10942,14 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 
     // object operations
     RWLock::WLocker l(c->lock);
+    if (c->osr != txc->osr) {
+      if (c->osr && c->osr->background) {
+	// a background rewrite may not have reached the kv store yet;
+	// it has to land before anything we encode
+	c->osr->flush();
+      }
+      c->osr = txc->osr;
+    }
     OnodeRef &o = ovec[op->oid];
     if (!o) {
       ghobject_t oid = i.get_oid(op->oid);
@@ -9453,6 +11428,9 @@ void BlueStore::_do_write_small(
 		   << std::dec << " of mutable " << *b << dendl;
 	  _buffer_cache_write(txc, b, b_off, bl,
 			      wctx->buffered ? 0 : Buffer::FLAG_NOCACHE);
+	  if (fast_alloc) {
+	    b->last_access = tier_clock_now();
+	  }
 
 	  if (!g_conf->bluestore_debug_omit_block_device_write) {
 	    if (b_len <= prefer_deferred_size) {
@@ -9542,6 +11520,9 @@ void BlueStore::_do_write_small(
 	  op->op = bluestore_deferred_op_t::OP_WRITE;
 	  _buffer_cache_write(txc, b, b_off, bl,
 			      wctx->buffered ? 0 : Buffer::FLAG_NOCACHE);
+	  if (fast_alloc) {
+	    b->last_access = tier_clock_now();
+	  }
 
 	  int r = b->get_blob().map(
 	    b_off, b_len,
@@ -9772,7 +11753,33 @@ int BlueStore::_do_alloc_write(
   for (auto &wi : wctx->writes) {
     need += wi.blob_length;
   }
-  int r = alloc->reserve(need);
+  // new data goes to the fast tier while it has room; the tier thread
+  // moves it to the main device once it cools down
+  Allocator *a = alloc;
+  uint32_t tier_now = 0;
+  int r = -ENOSPC;
+  if (fast_alloc && !txc->tier_slow) {
+    tier_now = tier_clock_now();
+    uint64_t max_write = cct->_conf->bluestore_tier_fast_max_write;
+    uint64_t fast_size = bdev->get_size() - bdev->get_fast_base();
+    if ((!max_write || need <= max_write) &&
+	fast_alloc->get_free() > need +
+	  fast_size * cct->_conf->bluestore_tier_fast_min_free_ratio) {
+      r = fast_alloc->reserve(need);
+      if (r == 0) {
+	a = fast_alloc;
+	logger->inc(l_bluestore_tier_fast_bytes, need);
+      }
+    }
+  }
+  if (r < 0 && txc->reserved >= need) {
+    // set aside by the caller (see _rewrite_ranges())
+    txc->reserved -= need;
+    r = 0;
+  }
+  if (r < 0) {
+    r = alloc->reserve(need);
+  }
   if (r < 0) {
     derr << __func__ << " failed to reserve 0x" << std::hex << need << std::dec
 	 << dendl;
@@ -9918,9 +11925,9 @@ int BlueStore::_do_alloc_write(
 
     AllocExtentVector extents;
     extents.reserve(4);  // 4 should be (more than) enough for most allocations
-    int64_t got = alloc->allocate(final_length, min_alloc_size, 
-				  max_alloc_size.load(),
-                    		  hint, &extents);
+    int64_t got = a->allocate(final_length, min_alloc_size,
+			      max_alloc_size.load(),
+			      hint, &extents);
     assert(got == (int64_t)final_length);
     need -= got;
     txc->statfs_delta.allocated() += got;
@@ -9930,6 +11937,9 @@ int BlueStore::_do_alloc_write(
       hint = p.end();
     }
     dblob.allocated(P2ALIGN(b_off, min_alloc_size), final_length, extents);
+    if (tier_now) {
+      b->last_access = tier_now;
+    }
 
     dout(20) << __func__ << " blob " << *b
 	     << " csum_type " << Checksummer::get_csum_type_string(csum)
@@ -9989,7 +11999,7 @@ int BlueStore::_do_alloc_write(
     }
   }
   if (need > 0) {
-    alloc->unreserve(need);
+    a->unreserve(need);
   }
   return 0;
 }
@@ -10274,6 +12284,7 @@ int BlueStore::_do_write(
   if (length == 0) {
     return 0;
   }
+  ++o->write_gen;
 
   uint64_t end = offset + length;
 
@@ -10386,6 +12397,7 @@ int BlueStore::_do_zero(TransContext *txc,
   int r = 0;
 
   _dump_onode(o);
+  ++o->write_gen;
 
   WriteContext wctx;
   o->extent_map.fault_range(db, offset, length);
@@ -10419,6 +12431,7 @@ void BlueStore::_do_truncate(
     return;
 
   if (offset < o->onode.size) {
+    ++o->write_gen;
     WriteContext wctx;
     uint64_t length = o->onode.size - offset;
     o->extent_map.fault_range(db, offset, length);
@@ -11115,6 +13128,8 @@ int BlueStore::_rename(TransContext *txc,
         }
       );
       s.dirty = true;
+      s.persisted.clear();  // new key; no base to apply a delta to
+      s.delta_written = 0;
     }
   }
 
@@ -11464,6 +13479,7 @@ void BlueStore::_flush_cache()
     assert(p.second->shared_blob_set.empty());
   }
   coll_map.clear();
+  decompressed_cache.clear();
 }
 
 // For external caller.
@@ -11476,6 +13492,7 @@ void BlueStore::flush_cache()
   for (auto i : cache_shards) {
     i->trim_all();
   }
+  decompressed_cache.clear();
 }
 
 void BlueStore::_apply_padding(uint64_t head_pad,
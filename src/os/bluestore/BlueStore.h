@@ -35,6 +35,7 @@
 #include "include/mempool.h"
 #include "common/Finisher.h"
 #include "common/perf_counters.h"
+#include "common/Readahead.h"
 #include "compressor/Compressor.h"
 #include "os/ObjectStore.h"
 
@@ -45,6 +46,7 @@
 class Allocator;
 class FreelistManager;
 class BlueFS;
+class PMEMLog;
 
 //#define DEBUG_CACHE
 //#define DEBUG_DEFERRED
@@ -60,6 +62,11 @@ enum {
   l_bluestore_kv_flush_lat,
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_lat,
+  l_bluestore_kv_prepare_lat,
+  l_bluestore_kv_sync_wait_lat,
+  l_bluestore_kv_sync_lat,
+  l_bluestore_kv_batch_txc,
+  l_bluestore_kv_batch_linger_lat,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -85,6 +92,9 @@ enum {
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_adapt_size,
+  l_bluestore_deferred_adapt_grow,
+  l_bluestore_deferred_adapt_shrink,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -96,12 +106,20 @@ enum {
   l_bluestore_onode_misses,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
+  l_bluestore_onode_shard_full_bytes,
+  l_bluestore_onode_shard_delta_bytes,
+  l_bluestore_onode_shard_base_bytes,
+  l_bluestore_shared_blob_full_bytes,
+  l_bluestore_shared_blob_delta_bytes,
   l_bluestore_extents,
   l_bluestore_blobs,
   l_bluestore_buffers,
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_decompressed_cache_hits,
+  l_bluestore_decompressed_cache_misses,
+  l_bluestore_decompressed_cache_bytes,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -116,6 +134,22 @@ enum {
   l_bluestore_blob_split,
   l_bluestore_extent_compress,
   l_bluestore_gc_merged,
+  l_bluestore_fragmentation,
+  l_bluestore_defrag_scanned,
+  l_bluestore_defrag_objects,
+  l_bluestore_defrag_bytes,
+  l_bluestore_defrag_blobs_removed,
+  l_bluestore_tier_fast_bytes,
+  l_bluestore_tier_scanned,
+  l_bluestore_tier_demoted_objects,
+  l_bluestore_tier_demoted_bytes,
+  l_bluestore_pmem_log_append_lat,
+  l_bluestore_pmem_log_bytes,
+  l_bluestore_pmem_log_checkpoints,
+  l_bluestore_readahead_ios,
+  l_bluestore_readahead_bytes,
+  l_bluestore_readahead_hit_bytes,
+  l_bluestore_readahead_dropped_bytes,
   l_bluestore_last
 };
 
@@ -166,11 +200,12 @@ public:
     }
     enum {
       FLAG_NOCACHE = 1,  ///< trim when done WRITING (do not become CLEAN)
-      // NOTE: fix operator<< when you define a second flag
+      FLAG_READAHEAD = 2, ///< filled by readahead rather than a read
     };
     static const char *get_flag_name(int s) {
       switch (s) {
       case FLAG_NOCACHE: return "nocache";
+      case FLAG_READAHEAD: return "readahead";
       default: return "???";
       }
     }
@@ -328,9 +363,10 @@ public:
       _add_buffer(cache, b, (flags & Buffer::FLAG_NOCACHE) ? 0 : 1, nullptr);
     }
     void finish_write(Cache* cache, uint64_t seq);
-    void did_read(Cache* cache, uint32_t offset, bufferlist& bl) {
+    void did_read(Cache* cache, uint32_t offset, bufferlist& bl,
+		  unsigned flags = 0) {
       std::lock_guard<std::recursive_mutex> l(cache->lock);
-      Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl);
+      Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, offset, bl, flags);
       b->cache_private = _discard(cache, offset, bl.length());
       _add_buffer(cache, b, 1, nullptr);
     }
@@ -339,6 +375,10 @@ public:
 	      BlueStore::ready_regions_t& res,
 	      interval_set<uint32_t>& res_intervals);
 
+    /// true if the range is worth prefetching: not all cached, and
+    /// nothing in it still being written
+    bool want_readahead(Cache* cache, uint32_t offset, uint32_t length);
+
     void truncate(Cache* cache, uint32_t offset) {
       discard(cache, offset, (uint32_t)-1 - offset);
     }
@@ -374,6 +414,10 @@ public:
     };
     BufferSpace bc;             ///< buffer cache
 
+    bool persisted = false;     ///< the kv store has a record to apply deltas to
+    uint32_t ref_log_written = 0; ///< delta bytes written since the last full record
+    bufferlist ref_log;         ///< ref changes not yet queued to the kv store
+
     SharedBlob(Collection *_coll) : coll(_coll), sbid_unloaded(0) {
       if (get_cache()) {
 	get_cache()->add_blob();
@@ -467,6 +511,8 @@ public:
     std::atomic_int nref = {0};     ///< reference count
     int16_t id = -1;                ///< id, for spanning blobs only, >= 0
     int16_t last_encoded_id = -1;   ///< (ephemeral) used during encoding only
+    /// (ephemeral) tier clock at last read or write, 0 if not seen yet
+    std::atomic<uint32_t> last_access = {0};
     SharedBlobRef shared_blob;      ///< shared blob state (if any)
 
   private:
@@ -734,6 +780,10 @@ public:
       unsigned extents = 0;  ///< count extents in this shard
       bool loaded = false;   ///< true if shard is loaded
       bool dirty = false;    ///< true if shard is dirty and needs reencoding
+      /// last encoding written to the kv store, if we are writing deltas;
+      /// empty means the next write must be a full one
+      bufferlist persisted;
+      uint32_t delta_written = 0; ///< delta bytes written since the last full shard
     };
     mempool::bluestore_cache_other::vector<Shard> shards;    ///< shards
 
@@ -1004,6 +1054,8 @@ public:
     mempool::bluestore_cache_other::string key;
 
     boost::intrusive::list_member_hook<> lru_item;
+    /// hit since trim last looked at us (bluestore_cache_concurrent_lookup)
+    std::atomic<bool> referenced = {false};
 
     bluestore_onode_t onode;  ///< metadata stored as value in kv store
     bool exists;              ///< true if object logically exists
@@ -1016,6 +1068,12 @@ public:
     std::mutex flush_lock;  ///< protect flush_txns
     std::condition_variable flush_cond;   ///< wait here for uncommitted txns
 
+    /// bumped (under c->lock) whenever our data changes, so readahead
+    /// can tell that what it read is stale
+    uint32_t write_gen = 0;
+    /// sequential read detection, once we have been read
+    std::atomic<Readahead*> readahead = {nullptr};
+
     Onode(Collection *c, const ghobject_t& o,
 	  const mempool::bluestore_cache_other::string& k)
       : nref(0),
@@ -1025,6 +1083,9 @@ public:
 	exists(false),
 	extent_map(this) {
     }
+    ~Onode() {
+      delete readahead.load();
+    }
 
     void flush();
     void get() {
@@ -1299,6 +1360,10 @@ public:
     /// forward lookups
     mempool::bluestore_cache_other::unordered_map<ghobject_t,OnodeRef> onode_map;
 
+    /// writers hold cache->lock *and* this (in that order); readers
+    /// may hold either one.
+    RWLock map_lock = {"BlueStore::OnodeSpace::map_lock", false, false};
+
     friend class Collection; // for split_cache()
 
   public:
@@ -1309,8 +1374,15 @@ public:
 
     OnodeRef add(const ghobject_t& oid, OnodeRef o);
     OnodeRef lookup(const ghobject_t& o);
-    void remove(const ghobject_t& oid) {
-      onode_map.erase(oid);
+    /// remove o unless it is pinned by more than the map and the
+    /// caller (who must hold cache->lock and a ref); true on success
+    bool try_remove(Onode *o) {
+      RWLock::WLocker l(map_lock);
+      if (o->nref.load() > 2) {
+	return false;  // raced with a concurrent lookup
+      }
+      onode_map.erase(o->oid);
+      return true;
     }
     void rename(OnodeRef& o, const ghobject_t& old_oid,
 		const ghobject_t& new_oid,
@@ -1322,6 +1394,9 @@ public:
     bool map_any(std::function<bool(OnodeRef)> f);
   };
 
+  class OpSequencer;
+  typedef boost::intrusive_ptr<OpSequencer> OpSequencerRef;
+
   struct Collection : public CollectionImpl {
     BlueStore *store;
     Cache *cache;       ///< our cache shard
@@ -1329,6 +1404,9 @@ public:
     bluestore_cnode_t cnode;
     RWLock lock;
 
+    /// sequencer of the last txc to modify an object here (under lock)
+    OpSequencerRef osr;
+
     bool exists;
 
     SharedBlobSet shared_blob_set;      ///< open SharedBlobs
@@ -1403,9 +1481,6 @@ public:
     }
   };
 
-  class OpSequencer;
-  typedef boost::intrusive_ptr<OpSequencer> OpSequencerRef;
-
   struct volatile_statfs{
     enum {
       STATFS_ALLOCATED = 0,
@@ -1517,7 +1592,7 @@ public:
     }
 #endif
 
-    void log_state_latency(PerfCounters *logger, int state) {
+    utime_t log_state_latency(PerfCounters *logger, int state) {
       utime_t lat, now = ceph_clock_now();
       lat = now - last_stamp;
       logger->tinc(state, lat);
@@ -1528,6 +1603,7 @@ public:
       }
 #endif
       last_stamp = now;
+      return lat;
     }
 
     OpSequencerRef osr;
@@ -1551,10 +1627,13 @@ public:
     bluestore_deferred_transaction_t *deferred_txn = nullptr; ///< if any
 
     interval_set<uint64_t> allocated, released;
+    vector<uint64_t> alloc_snap_regions; ///< dirty marks added to t
     volatile_statfs statfs_delta;
 
     IOContext ioc;
     bool had_ios = false;  ///< true if we submitted IOs before our kv txn
+    bool tier_slow = false;  ///< allocate from the main device only
+    uint64_t reserved = 0;   ///< main device space set aside for our writes
 
     uint64_t seq = 0;
     utime_t start;
@@ -1633,6 +1712,34 @@ public:
     }
   };
 
+  /// a prefetch into the buffer cache, completed in the aio thread
+  struct ReadaheadContext : public AioContext {
+    CollectionRef c;
+    OnodeRef o;
+    uint32_t write_gen;     ///< o->write_gen when we issued the reads
+    uint64_t reserved;      ///< counted against readahead_inflight
+    struct extent_t {
+      BlobRef b;
+      uint64_t logical_offset;
+      uint32_t r_off;       ///< blob offset of bl
+      bufferlist bl;
+      extent_t(BlobRef b, uint64_t l, uint32_t r)
+	: b(b), logical_offset(l), r_off(r) {}
+    };
+    list<extent_t> extents;
+    uint64_t bytes = 0;     ///< total length of extents
+    IOContext ioc;
+
+    ReadaheadContext(CephContext *cct, Collection *c, OnodeRef& o,
+		     uint64_t reserved)
+      : c(c), o(o), write_gen(o->write_gen), reserved(reserved),
+	ioc(cct, this) {}
+
+    void aio_finish(BlueStore *store) override {
+      store->_readahead_finish(this);
+    }
+  };
+
   class OpSequencer : public Sequencer_impl {
   public:
     std::mutex qlock;
@@ -1653,6 +1760,8 @@ public:
     Sequencer *parent;
     BlueStore *store;
 
+    int shard_hint = -1;  ///< from parent; routes our aio completions
+
     uint64_t last_seq = 0;
 
     std::atomic_int txc_with_unstable_io = {0};  ///< num txcs with unstable io
@@ -1663,6 +1772,7 @@ public:
 
     std::atomic_bool registered = {true}; ///< registered in BlueStore's osr_set
     std::atomic_bool zombie = {false};    ///< owning Sequencer has gone away
+    bool background = false;  ///< used by our own rewrite threads, not a PG
 
     OpSequencer(CephContext* cct, BlueStore *store)
       : Sequencer_impl(cct),
@@ -1716,6 +1826,21 @@ public:
 	qcond.wait(l);
     }
 
+    /// true if a txc queued ahead of txc may still be being prepared
+    /// queue txc unless a txc already queued is still being prepared;
+    /// checked under the same qlock hold, so none can slip in between
+    bool queue_new_if_idle(TransContext *txc) {
+      std::lock_guard<std::mutex> l(qlock);
+      for (auto& p : q) {
+	if (p.state == TransContext::STATE_PREPARE) {
+	  return false;
+	}
+      }
+      txc->seq = ++last_seq;
+      q.push_back(*txc);
+      return true;
+    }
+
     bool _is_all_kv_submitted() {
       // caller must hold qlock
       if (q.empty()) {
@@ -1772,6 +1897,14 @@ public:
       return NULL;
     }
   };
+  struct KVCommitThread : public Thread {
+    BlueStore *store;
+    explicit KVCommitThread(BlueStore *s) : store(s) {}
+    void *entry() override {
+      store->_kv_commit_thread();
+      return NULL;
+    }
+  };
   struct KVFinalizeThread : public Thread {
     BlueStore *store;
     explicit KVFinalizeThread(BlueStore *s) : store(s) {}
@@ -1781,6 +1914,66 @@ public:
     }
   };
 
+  /// one kv_sync_thread cycle, carried from prepare to commit
+  struct KVSyncBatch {
+    deque<TransContext*> committing;       ///< txcs made durable by synct
+    deque<DeferredBatch*> deferred_done;   ///< stable once synct commits
+    deque<DeferredBatch*> deferred_stable; ///< keys removed by synct
+    KeyValueDB::Transaction synct;
+    uint64_t new_nid_max = 0, new_blobid_max = 0;
+    PExtentVector bluefs_gift_extents;
+    interval_set<uint64_t> bluefs_extents_reclaiming;
+    utime_t start, after_flush, after_prepare;
+  };
+
+  /**
+   * decompressed contents of compressed blobs
+   *
+   * Compressed blobs are immutable and always read and decompressed
+   * whole, so the result is cached here under its own byte budget,
+   * separately from the BufferSpace.  Entries are keyed by the first
+   * physical offset of the blob, which stays unique until the blob's
+   * extents are released back to the allocator; invalidate() must be
+   * called before that happens.
+   */
+  struct DecompressedCache {
+    std::mutex lock;
+    std::atomic<uint64_t> max_bytes = {0};  ///< 0 disables the cache
+    uint64_t bytes = 0;
+
+    struct entry_t {
+      bufferlist bl;
+      list<uint64_t>::iterator lru_pos;
+    };
+    map<uint64_t, entry_t> entries;  ///< by first physical offset
+    list<uint64_t> lru;              ///< most recently used at front
+
+    bool enabled() const {
+      return max_bytes > 0;
+    }
+    void set_max(uint64_t max) {
+      std::lock_guard<std::mutex> l(lock);
+      max_bytes = max;
+      _trim();
+    }
+    bool lookup(uint64_t key, bufferlist *bl);
+    void insert(uint64_t key, const bufferlist& bl);
+    void invalidate(uint64_t offset, uint64_t length);
+    void clear() {
+      std::lock_guard<std::mutex> l(lock);
+      entries.clear();
+      lru.clear();
+      bytes = 0;
+    }
+    uint64_t get_bytes() {
+      std::lock_guard<std::mutex> l(lock);
+      return bytes;
+    }
+  private:
+    void _rm(map<uint64_t, entry_t>::iterator p);
+    void _trim();
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -1811,12 +2004,15 @@ private:
   unsigned bluefs_shared_bdev = 0;  ///< which bluefs bdev we are sharing
   bool bluefs_single_shared_device = true;
   utime_t bluefs_last_balance;
+  /// a prepared kv batch gifts extents bluefs has not been given yet
+  std::atomic<bool> bluefs_gift_pending = {false};
 
   KeyValueDB *db = nullptr;
   BlockDevice *bdev = nullptr;
   std::string freelist_type;
   FreelistManager *fm = nullptr;
   Allocator *alloc = nullptr;
+  Allocator *fast_alloc = nullptr;  ///< fast tier, [fast_base, size)
   uuid_d fsid;
   int path_fd = -1;  ///< open handle to $path
   int fsid_fd = -1;  ///< open handle (locked) to $path/fsid
@@ -1826,6 +2022,7 @@ private:
   mempool::bluestore_cache_other::unordered_map<coll_t, CollectionRef> coll_map;
 
   vector<Cache*> cache_shards;
+  DecompressedCache decompressed_cache;
 
   std::mutex osr_lock;              ///< protect osd_set
   std::set<OpSequencerRef> osr_set; ///< set of all OpSequencers
@@ -1841,6 +2038,12 @@ private:
   interval_set<uint64_t> bluefs_extents;  ///< block extents owned by bluefs
   interval_set<uint64_t> bluefs_extents_reclaiming; ///< currently reclaiming
 
+  /// regions whose freelist changed since the allocator snapshot was
+  /// taken, and whose dirty mark is already durable
+  std::mutex alloc_snap_lock;
+  uint64_t alloc_snap_region_size = 0;  ///< 0 if not tracking
+  boost::dynamic_bitset<uint64_t> alloc_snap_dirty;
+
   std::mutex deferred_lock, deferred_submit_lock;
   std::atomic<uint64_t> deferred_seq = {0};
   deferred_osr_queue_t deferred_queue; ///< osr's with deferred io pending
@@ -1859,10 +2062,23 @@ private:
   bool kv_finalize_stop = false;
   deque<TransContext*> kv_queue;             ///< ready, already submitted
   deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
-  deque<TransContext*> kv_committing;        ///< currently syncing
   deque<DeferredBatch*> deferred_done_queue;   ///< deferred ios done
   deque<DeferredBatch*> deferred_stable_queue; ///< deferred ios done + stable
 
+  bool kv_sync_pipeline = false;      ///< sync on a separate commit thread
+  KVCommitThread kv_commit_thread;
+  std::mutex kv_commit_lock;
+  std::condition_variable kv_commit_cond;
+  bool kv_commit_started = false;
+  bool kv_commit_stop = false;
+  KVSyncBatch *kv_commit_pending = nullptr;  ///< prepared, waiting to sync
+  /// how long kv_sync_thread lets a batch grow; see
+  /// bluestore_kv_sync_target_lat
+  std::atomic<uint64_t> kv_batch_linger_ns = {0};
+
+  PMEMLog *pmem_log = nullptr;  ///< kv commits land here first, if set
+  std::mutex pmem_log_lock;     ///< keeps log order == kv submit order
+
   KVFinalizeThread kv_finalize_thread;
   std::mutex kv_finalize_lock;
   std::condition_variable kv_finalize_cond;
@@ -1900,6 +2116,14 @@ private:
   ///< size threshold for forced deferred writes
   std::atomic<uint64_t> prefer_deferred_size = {0};
 
+  // adaptive prefer_deferred_size; samples are reset every interval
+  std::atomic<bool> deferred_adaptive = {false};
+  utime_t deferred_adapt_last;
+  std::atomic<uint64_t> deferred_adapt_aio_ns = {0};  ///< direct write lat
+  std::atomic<uint64_t> deferred_adapt_aio_num = {0};
+  std::atomic<uint64_t> deferred_adapt_kv_ns = {0};   ///< kv sync lat
+  std::atomic<uint64_t> deferred_adapt_kv_num = {0};
+
   ///< approx cost per io, in bytes
   std::atomic<uint64_t> throttle_cost_per_io = {0};
 
@@ -1911,6 +2135,11 @@ private:
 
   std::atomic<uint64_t> max_blob_size = {0};  ///< maximum blob size
 
+  std::atomic<uint64_t> readahead_max = {0};  ///< 0 if readahead is off
+  std::mutex readahead_lock;
+  std::condition_variable readahead_cond;
+  uint64_t readahead_inflight = 0;  ///< bytes of prefetch io outstanding
+
   uint64_t kv_ios = 0;
   uint64_t kv_throttle_costs = 0;
 
@@ -1946,6 +2175,89 @@ private:
     }
   } mempool_thread;
 
+  /// rewrites fragmented onodes in the background; see _defrag_pass()
+  struct DefragThread : public Thread {
+    BlueStore *store;
+    Cond cond;
+    Mutex lock;
+    bool stop = false;
+    ObjectStore::Sequencer seq;  ///< orders our rewrites
+    string cursor;               ///< next PREFIX_OBJ key to examine
+  public:
+    explicit DefragThread(BlueStore *s)
+      : store(s),
+	lock("BlueStore::DefragThread::lock"),
+	seq("bstore_defrag") {}
+    void *entry() override;
+    void init() {
+      assert(stop == false);
+      create("bstore_defrag");
+    }
+    void shutdown() {
+      lock.Lock();
+      stop = true;
+      cond.Signal();
+      lock.Unlock();
+      join();
+      if (seq.p) {
+	seq.p->discard();
+	seq.p.reset();
+      }
+    }
+    /// sleep for up to secs; false if we are shutting down
+    bool wait(double secs) {
+      Mutex::Locker l(lock);
+      if (!stop && secs > 0) {
+	utime_t w;
+	w.set_from_double(secs);
+	cond.WaitInterval(lock, w);
+      }
+      return !stop;
+    }
+  } defrag_thread;
+
+  /// moves cold data off the fast tier; see _tier_pass()
+  struct TierThread : public Thread {
+    BlueStore *store;
+    Cond cond;
+    Mutex lock;
+    bool stop = false;
+    ObjectStore::Sequencer seq;  ///< orders our rewrites
+    string cursor;               ///< next PREFIX_OBJ key to examine
+  public:
+    explicit TierThread(BlueStore *s)
+      : store(s),
+	lock("BlueStore::TierThread::lock"),
+	seq("bstore_tier") {}
+    void *entry() override;
+    void init() {
+      assert(stop == false);
+      create("bstore_tier");
+    }
+    void shutdown() {
+      lock.Lock();
+      stop = true;
+      cond.Signal();
+      lock.Unlock();
+      join();
+      if (seq.p) {
+	seq.p->discard();
+	seq.p.reset();
+      }
+    }
+    /// sleep for up to secs; false if we are shutting down
+    bool wait(double secs) {
+      Mutex::Locker l(lock);
+      if (!stop && secs > 0) {
+	utime_t w;
+	w.set_from_double(secs);
+	cond.WaitInterval(lock, w);
+      }
+      return !stop;
+    }
+  } tier_thread;
+  uint32_t tier_mount_time = 0;  ///< tier clock at mount
+
   // --------------------------------------------------------
   // private methods
 
@@ -1961,16 +2273,29 @@ private:
   int _write_fsid();
   void _close_fsid();
   void _set_alloc_sizes();
+  void _deferred_adapt(utime_t now);
   void _set_blob_size();
+  void _set_readahead();
 
   int _open_bdev(bool create);
+  int _open_fast_tier(bool create);
   void _close_bdev();
   int _open_db(bool create);
   void _close_db();
+  int _open_pmem_log(bool create);
+  void _close_pmem_log();
+  int _pmem_log_checkpoint();
   int _open_fm(bool create);
   void _close_fm();
   int _open_alloc();
   void _close_alloc();
+  void _alloc_add_free(uint64_t offset, uint64_t length);
+  void _alloc_release(uint64_t offset, uint64_t length);
+  int _load_alloc_snapshot(uint64_t *num, uint64_t *bytes);
+  void _write_alloc_snapshot();
+  void _alloc_snap_mark_dirty(TransContext *txc,
+			      const interval_set<uint64_t>& extents,
+			      KeyValueDB::Transaction t);
   int _open_collections(int *errors=0);
   void _close_collections();
 
@@ -2006,10 +2331,13 @@ private:
   void _dump_transaction(Transaction *t, int log_level = 30);
 
   TransContext *_txc_create(OpSequencer *osr);
+  TransContext *_txc_create_if_idle(OpSequencer *osr);
   void _txc_update_store_statfs(TransContext *txc);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
+  void _txc_prepare_kv(TransContext *txc);
+  void _txc_submit(TransContext *txc, ThreadPool::TPHandle *handle);
   void _txc_state_proc(TransContext *txc);
   void _txc_aio_submit(TransContext *txc);
 public:
@@ -2031,6 +2359,12 @@ private:
   void _kv_start();
   void _kv_stop();
   void _kv_sync_thread();
+  void _kv_sync_prepare(KVSyncBatch *b,
+			deque<TransContext*>& kv_submitting,
+			uint64_t aios, uint64_t costs);
+  void _kv_sync_commit(KVSyncBatch *b);
+  int _kv_submit(KeyValueDB::Transaction t);
+  void _kv_commit_thread();
   void _kv_finalize_thread();
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc, OnodeRef o);
@@ -2219,6 +2553,17 @@ public:
     size_t len,
     bufferlist& bl,
     uint32_t op_flags = 0);
+  void _readahead(Collection *c, OnodeRef& o, uint64_t offset, uint64_t length);
+  void _readahead_finish(ReadaheadContext *rc);
+  void _readahead_drain();
+
+  void _defrag_pass();
+  int _defrag_object(CollectionRef& c, const ghobject_t& oid);
+  int _rewrite_ranges(ObjectStore::Sequencer& seq, CollectionRef& c,
+		      OnodeRef o, const interval_set<uint64_t>& ranges);
+  void _txc_abort_rewrite(TransContext *txc, CollectionRef& c);
+  void _tier_pass();
+  int _tier_demote_object(CollectionRef& c, const ghobject_t& oid);
 
 private:
   int _fiemap(CollectionHandle &c_, const ghobject_t& oid,
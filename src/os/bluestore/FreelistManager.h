@@ -8,6 +8,7 @@
 #include <map>
 #include <mutex>
 #include <ostream>
+#include <functional>
 #include "kv/KeyValueDB.h"
 
 class FreelistManager {
@@ -34,6 +35,11 @@ public:
   virtual void enumerate_reset() = 0;
   virtual bool enumerate_next(uint64_t *offset, uint64_t *length) = 0;
 
+  /// report the free extents within [offset, offset+length)
+  virtual void enumerate_range(
+    uint64_t offset, uint64_t length,
+    std::function<void(uint64_t offset, uint64_t length)> notify) = 0;
+
   virtual void allocate(
     uint64_t offset, uint64_t length,
     KeyValueDB::Transaction txn) = 0;
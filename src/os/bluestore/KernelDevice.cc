@@ -19,10 +19,12 @@
 #include <fcntl.h>
 
 #include "KernelDevice.h"
+#include "ioring.h"
 #include "include/types.h"
 #include "include/compat.h"
 #include "include/stringify.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "common/debug.h"
 #include "common/blkdev.h"
 #include "common/align.h"
@@ -33,31 +35,83 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "bdev(" << this << " " << path << ") "
 
+enum {
+  l_bdev_first = 732800,
+  l_bdev_aio_queue_reaped_first,  ///< one counter per completion queue
+};
+
 KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv)
   : BlockDevice(cct, cb, cbpriv),
     fd_direct(-1),
     fd_buffered(-1),
     fs(NULL), aio(false), dio(false),
     debug_lock("KernelDevice::debug_lock"),
-    aio_queue(cct->_conf->bdev_aio_max_queue_depth),
     aio_stop(false),
-    aio_thread(this),
     injecting_crash(0)
 {
+  int64_t num_queues = std::max<int64_t>(cct->_conf->bdev_aio_num_queues, 1);
+  for (int i = 0; i < num_queues; ++i) {
+    io_queues.emplace_back(_create_io_queue());
+  }
+}
+
+io_queue_t *KernelDevice::_create_io_queue()
+{
+  unsigned iodepth = cct->_conf->bdev_aio_max_queue_depth;
+  if (cct->_conf->bdev_ioring) {
+#if defined(HAVE_LIBURING)
+    if (ioring_queue_t::supported()) {
+      ioring = true;
+      return new ioring_queue_t(iodepth,
+				cct->_conf->bdev_ioring_sqthread_poll);
+    }
+    derr << __func__ << " bdev_ioring is set but io_uring is not supported"
+	 << " by this kernel; falling back to libaio" << dendl;
+#else
+    derr << __func__ << " bdev_ioring is set but ceph was built without"
+	 << " liburing; falling back to libaio" << dendl;
+#endif
+  }
+  return new aio_queue_t(iodepth);
+}
+
+io_queue_t *KernelDevice::_get_io_queue(IOContext *ioc)
+{
+  // an ioc stays on one queue, so all of its completions are reaped by
+  // the same thread
+  if (ioc->io_queue < 0) {
+    if (ioc->shard_hint >= 0) {
+      ioc->io_queue = ioc->shard_hint % io_queues.size();
+    } else {
+      ioc->io_queue = next_io_queue++ % io_queues.size();
+    }
+  }
+  return io_queues[ioc->io_queue].get();
 }
 
-int KernelDevice::_lock()
+int KernelDevice::_lock(int fd)
 {
   struct flock l;
   memset(&l, 0, sizeof(l));
   l.l_type = F_WRLCK;
   l.l_whence = SEEK_SET;
-  int r = ::fcntl(fd_direct, F_SETLK, &l);
+  int r = ::fcntl(fd, F_SETLK, &l);
   if (r < 0)
     return -errno;
   return 0;
 }
 
+bool KernelDevice::_route(uint64_t *off, uint64_t len) const
+{
+  if (is_fast(*off)) {
+    *off -= fast_base;
+    return true;
+  }
+  // extents are allocated from one tier or the other, never both
+  assert(!fast_base || *off + len <= fast_base);
+  return false;
+}
+
 int KernelDevice::open(const string& p)
 {
   path = p;
@@ -91,7 +145,7 @@ int KernelDevice::open(const string& p)
     goto out_fail;
   }
 
-  r = _lock();
+  r = _lock(fd_direct);
   if (r < 0) {
     derr << __func__ << " failed to lock " << path << ": " << cpp_strerror(r)
 	 << dendl;
@@ -141,8 +195,10 @@ int KernelDevice::open(const string& p)
     }
   }
 
+  _init_logger();
   r = _aio_start();
   if (r < 0) {
+    _shutdown_logger();
     goto out_fail;
   }
 
@@ -171,10 +227,101 @@ int KernelDevice::open(const string& p)
   return r;
 }
 
+/*
+ * The fast tier is addressed as if it followed the main device, from
+ * base on.  Its aios carry their own fd, so one IOContext can mix
+ * ios for both and is still submitted and reaped as a unit.
+ */
+int KernelDevice::add_fast_tier(const string& p, uint64_t base)
+{
+  dout(1) << __func__ << " path " << p << " at 0x" << std::hex << base
+	  << std::dec << dendl;
+  assert(fast_fd_direct < 0);
+  if (base < block_size || base > size || base % block_size) {
+    derr << __func__ << " bad base 0x" << std::hex << base << " for size 0x"
+	 << size << std::dec << dendl;
+    return -EINVAL;
+  }
+  int r = 0;
+  uint64_t fast_size = 0;
+  struct stat st;
+  fast_fd_direct = ::open(p.c_str(), O_RDWR | O_DIRECT);
+  if (fast_fd_direct < 0) {
+    r = -errno;
+    derr << __func__ << " open got: " << cpp_strerror(r) << dendl;
+    fast_fd_direct = -1;
+    return r;
+  }
+  fast_fd_buffered = ::open(p.c_str(), O_RDWR);
+  if (fast_fd_buffered < 0) {
+    r = -errno;
+    derr << __func__ << " open got: " << cpp_strerror(r) << dendl;
+    goto out_direct;
+  }
+  r = posix_fadvise(fast_fd_buffered, 0, 0, POSIX_FADV_RANDOM);
+  if (r) {
+    r = -r;
+    derr << __func__ << " fadvise got: " << cpp_strerror(r) << dendl;
+    goto out_fail;
+  }
+  r = _lock(fast_fd_direct);
+  if (r < 0) {
+    derr << __func__ << " failed to lock " << p << ": " << cpp_strerror(r)
+	 << dendl;
+    goto out_fail;
+  }
+  r = ::fstat(fast_fd_direct, &st);
+  if (r < 0) {
+    r = -errno;
+    derr << __func__ << " fstat got " << cpp_strerror(r) << dendl;
+    goto out_fail;
+  }
+  if (S_ISBLK(st.st_mode)) {
+    int64_t s;
+    r = get_block_device_size(fast_fd_direct, &s);
+    if (r < 0) {
+      goto out_fail;
+    }
+    fast_size = s;
+  } else {
+    fast_size = st.st_size;
+  }
+  fast_size &= ~(block_size - 1);
+  if (!fast_size) {
+    derr << __func__ << " " << p << " is empty" << dendl;
+    r = -EINVAL;
+    goto out_fail;
+  }
+
+  // the io queues register the fds they submit to
+  _aio_stop();
+  fast_path = p;
+  fast_base = base;
+  size = base + fast_size;
+  r = _aio_start();
+  if (r < 0) {
+    fast_path.clear();
+    fast_base = 0;
+    goto out_fail;
+  }
+  dout(1) << __func__ << " fast size 0x" << std::hex << fast_size
+	  << ", total 0x" << size << std::dec << dendl;
+  return 0;
+
+ out_fail:
+  VOID_TEMP_FAILURE_RETRY(::close(fast_fd_buffered));
+  fast_fd_buffered = -1;
+ out_direct:
+  VOID_TEMP_FAILURE_RETRY(::close(fast_fd_direct));
+  fast_fd_direct = -1;
+  return r;
+}
+
 void KernelDevice::close()
 {
   dout(1) << __func__ << dendl;
   _aio_stop();
+  _shutdown_logger();
 
   assert(fs);
   delete fs;
@@ -188,6 +335,15 @@ void KernelDevice::close()
   VOID_TEMP_FAILURE_RETRY(::close(fd_buffered));
   fd_buffered = -1;
 
+  if (fast_fd_direct >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(fast_fd_direct));
+    fast_fd_direct = -1;
+    VOID_TEMP_FAILURE_RETRY(::close(fast_fd_buffered));
+    fast_fd_buffered = -1;
+    fast_path.clear();
+    fast_base = 0;
+  }
+
   path.clear();
 }
 
@@ -204,6 +360,7 @@ int KernelDevice::collect_metadata(const string& prefix, map<string,string> *pm)
   (*pm)[prefix + "size"] = stringify(get_size());
   (*pm)[prefix + "block_size"] = stringify(get_block_size());
   (*pm)[prefix + "driver"] = "KernelDevice";
+  (*pm)[prefix + "aio_backend"] = ioring ? "io_uring" : "libaio";
   if (rotational) {
     (*pm)[prefix + "type"] = "hdd";
   } else {
@@ -289,6 +446,9 @@ int KernelDevice::flush()
   }
   utime_t start = ceph_clock_now();
   int r = ::fdatasync(fd_direct);
+  if (r == 0 && fast_fd_direct >= 0) {
+    r = ::fdatasync(fast_fd_direct);
+  }
   utime_t end = ceph_clock_now();
   utime_t dur = end - start;
   if (r < 0) {
@@ -303,18 +463,31 @@ int KernelDevice::flush()
 int KernelDevice::_aio_start()
 {
   if (aio) {
-    dout(10) << __func__ << dendl;
-    int r = aio_queue.init();
-    if (r < 0) {
-      if (r == -EAGAIN) {
-	derr << __func__ << " io_setup(2) failed with EAGAIN; "
-	     << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
-      } else {
-	derr << __func__ << " io_setup(2) failed: " << cpp_strerror(r) << dendl;
+    dout(10) << __func__ << " with " << io_queues.size() << " queues" << dendl;
+    std::vector<int> fds = {fd_direct};
+    if (fast_fd_direct >= 0) {
+      fds.push_back(fast_fd_direct);
+    }
+    for (unsigned i = 0; i < io_queues.size(); ++i) {
+      int r = io_queues[i]->init(fds);
+      if (r < 0) {
+	if (r == -EAGAIN) {
+	  derr << __func__ << " io_setup(2) failed with EAGAIN; "
+	       << "try increasing /proc/sys/fs/aio-max-nr" << dendl;
+	} else {
+	  derr << __func__ << " io queue init failed: " << cpp_strerror(r)
+	       << dendl;
+	}
+	while (i-- > 0) {
+	  io_queues[i]->shutdown();
+	}
+	return r;
       }
-      return r;
     }
-    aio_thread.create("bstore_aio");
+    for (unsigned i = 0; i < io_queues.size(); ++i) {
+      aio_threads.emplace_back(new AioCompletionThread(this, i));
+      aio_threads.back()->create("bstore_aio");
+    }
   }
   return 0;
 }
@@ -324,27 +497,62 @@ void KernelDevice::_aio_stop()
   if (aio) {
     dout(10) << __func__ << dendl;
     aio_stop = true;
-    aio_thread.join();
+    for (auto& t : aio_threads) {
+      t->join();
+    }
+    aio_threads.clear();
+    reap_ioc();
     aio_stop = false;
-    aio_queue.shutdown();
+    for (auto& q : io_queues) {
+      q->shutdown();
+    }
   }
 }
 
-void KernelDevice::_aio_thread()
+void KernelDevice::_init_logger()
 {
-  dout(10) << __func__ << " start" << dendl;
+  // named after the device file (block, block.db, ...); the collection
+  // makes the name unique if the same file is opened twice
+  PerfCountersBuilder b(cct, "bdev-" + path.substr(path.rfind('/') + 1),
+			l_bdev_first,
+			l_bdev_aio_queue_reaped_first + io_queues.size());
+  logger_names.clear();
+  for (unsigned i = 0; i < io_queues.size(); ++i) {
+    logger_names.push_back("aio_queue_" + stringify(i) + "_reaped");
+  }
+  for (unsigned i = 0; i < io_queues.size(); ++i) {
+    b.add_u64_counter(l_bdev_aio_queue_reaped_first + i,
+		      logger_names[i].c_str(),
+		      "Aios reaped from this completion queue");
+  }
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+}
+
+void KernelDevice::_shutdown_logger()
+{
+  cct->get_perfcounters_collection()->remove(logger);
+  delete logger;
+  logger = nullptr;
+}
+
+void KernelDevice::_aio_thread(unsigned shard)
+{
+  dout(10) << __func__ << " " << shard << " start" << dendl;
+  io_queue_t *io_queue = io_queues[shard].get();
   int inject_crash_count = 0;
   while (!aio_stop) {
     dout(40) << __func__ << " polling" << dendl;
     int max = cct->_conf->bdev_aio_reap_max;
     aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+    int r = io_queue->get_next_completed(cct->_conf->bdev_aio_poll_ms,
 					 aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
     }
     if (r > 0) {
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
+      logger->inc(l_bdev_aio_queue_reaped_first + shard, r);
       for (int i = 0; i < r; ++i) {
 	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
 	_aio_log_finish(ioc, aio[i]->offset, aio[i]->length);
@@ -399,7 +607,9 @@ void KernelDevice::_aio_thread()
 	}
       }
     }
-    reap_ioc();
+    if (shard == 0) {
+      reap_ioc();
+    }
     if (cct->_conf->bdev_inject_crash) {
       ++inject_crash_count;
       if (inject_crash_count * cct->_conf->bdev_aio_poll_ms / 1000 >
@@ -411,8 +621,7 @@ void KernelDevice::_aio_thread()
       }
     }
   }
-  reap_ioc();
-  dout(10) << __func__ << " end" << dendl;
+  dout(10) << __func__ << " " << shard << " end" << dendl;
 }
 
 void KernelDevice::_aio_log_start(
@@ -508,8 +717,9 @@ void KernelDevice::aio_submit(IOContext *ioc)
 
   void *priv = static_cast<void*>(ioc);
   int r, retries = 0;
-  r = aio_queue.submit_batch(ioc->running_aios.begin(), e, 
-			     ioc->num_running.load(), priv, &retries);
+  r = _get_io_queue(ioc)->submit_batch(ioc->running_aios.begin(), e,
+					ioc->num_running.load(), priv,
+					&retries);
   
   if (retries)
     derr << __func__ << " retries " << retries << dendl;
@@ -533,7 +743,8 @@ int KernelDevice::_sync_write(uint64_t off, bufferlist &bl, bool buffered)
   }
   vector<iovec> iov;
   bl.prepare_iov(&iov);
-  int r = ::pwritev(buffered ? fd_buffered : fd_direct,
+  bool fast = _route(&off, len);
+  int r = ::pwritev(_get_fd(fast, buffered),
 		    &iov[0], iov.size(), off);
 
   if (r < 0) {
@@ -543,7 +754,8 @@ int KernelDevice::_sync_write(uint64_t off, bufferlist &bl, bool buffered)
   }
   if (buffered) {
     // initiate IO (but do not wait)
-    r = ::sync_file_range(fd_buffered, off, len, SYNC_FILE_RANGE_WRITE);
+    r = ::sync_file_range(_get_fd(fast, true), off, len,
+			  SYNC_FILE_RANGE_WRITE);
     if (r < 0) {
       r = -errno;
       derr << __func__ << " sync_file_range error: " << cpp_strerror(r) << dendl;
@@ -606,11 +818,14 @@ int KernelDevice::aio_write(
   bl.hexdump(*_dout);
   *_dout << dendl;
 
-  _aio_log_start(ioc, off, len);
+  // completions only see the offset within the tier, so log that
+  uint64_t dev_off = off;
+  bool fast = _route(&dev_off, len);
+  _aio_log_start(ioc, dev_off, len);
 
 #ifdef HAVE_LIBAIO
   if (aio && dio && !buffered) {
-    ioc->pending_aios.push_back(aio_t(ioc, fd_direct));
+    ioc->pending_aios.push_back(aio_t(ioc, _get_fd(fast, false)));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
     if (cct->_conf->bdev_inject_crash &&
@@ -620,7 +835,7 @@ int KernelDevice::aio_write(
 	   << dendl;
       // generate a real io so that aio_wait behaves properly, but make it
       // a read instead of write, and toss the result.
-      aio.pread(off, len);
+      aio.pread(dev_off, len);
       ++injecting_crash;
     } else {
       bl.prepare_iov(&aio.iov);
@@ -629,7 +844,7 @@ int KernelDevice::aio_write(
 		 << " " << aio.iov[i].iov_len << dendl;
       }
       aio.bl.claim_append(bl);
-      aio.pwritev(off, len);
+      aio.pwritev(dev_off, len);
     }
     dout(5) << __func__ << " 0x" << std::hex << off << "~" << len
 	    << std::dec << " aio " << &aio << dendl;
@@ -637,7 +852,7 @@ int KernelDevice::aio_write(
 #endif
   {
     int r = _sync_write(off, bl, buffered);
-    _aio_log_finish(ioc, off, len);
+    _aio_log_finish(ioc, dev_off, len);
     if (r < 0)
       return r;
   }
@@ -657,10 +872,11 @@ int KernelDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
   assert(off < size);
   assert(off + len <= size);
 
+  bool fast = _route(&off, len);
   _aio_log_start(ioc, off, len);
 
   bufferptr p = buffer::create_page_aligned(len);
-  int r = ::pread(buffered ? fd_buffered : fd_direct,
+  int r = ::pread(_get_fd(fast, buffered),
 		  p.c_str(), len, off);
   if (r < 0) {
     r = -errno;
@@ -690,11 +906,13 @@ int KernelDevice::aio_read(
   int r = 0;
 #ifdef HAVE_LIBAIO
   if (aio && dio) {
-    _aio_log_start(ioc, off, len);
-    ioc->pending_aios.push_back(aio_t(ioc, fd_direct));
+    uint64_t dev_off = off;
+    bool fast = _route(&dev_off, len);
+    _aio_log_start(ioc, dev_off, len);
+    ioc->pending_aios.push_back(aio_t(ioc, _get_fd(fast, false)));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    aio.pread(off, len);
+    aio.pread(dev_off, len);
     for (unsigned i=0; i<aio.iov.size(); ++i) {
       dout(30) << "aio " << i << " " << aio.iov[i].iov_base
 	       << " " << aio.iov[i].iov_len << dendl;
@@ -711,14 +929,15 @@ int KernelDevice::aio_read(
   return r;
 }
 
-int KernelDevice::direct_read_unaligned(uint64_t off, uint64_t len, char *buf)
+int KernelDevice::direct_read_unaligned(int fd, uint64_t off, uint64_t len,
+					char *buf)
 {
   uint64_t aligned_off = align_down(off, block_size);
   uint64_t aligned_len = align_up(off+len, block_size) - aligned_off;
   bufferptr p = buffer::create_page_aligned(aligned_len);
   int r = 0;
 
-  r = ::pread(fd_direct, p.c_str(), aligned_len, aligned_off);
+  r = ::pread(fd, p.c_str(), aligned_len, aligned_off);
   if (r < 0) {
     r = -errno;
     derr << __func__ << " 0x" << std::hex << off << "~" << len << std::dec 
@@ -747,19 +966,20 @@ int KernelDevice::read_random(uint64_t off, uint64_t len, char *buf,
   assert(off < size);
   assert(off + len <= size);
   int r = 0;
+  bool fast = _route(&off, len);
 
   //if it's direct io and unaligned, we have to use a internal buffer
   if (!buffered && ((off % block_size != 0)
                     || (len % block_size != 0)
                     || (uintptr_t(buf) % CEPH_PAGE_SIZE != 0)))
-    return direct_read_unaligned(off, len, buf);
+    return direct_read_unaligned(_get_fd(fast, false), off, len, buf);
 
   if (buffered) {
     //buffered read
     char *t = buf;
     uint64_t left = len;
     while (left > 0) {
-      r = ::pread(fd_buffered, t, left, off);
+      r = ::pread(_get_fd(fast, true), t, left, off);
       if (r < 0) {
 	r = -errno;
         derr << __func__ << " 0x" << std::hex << off << "~" << left 
@@ -772,7 +992,7 @@ int KernelDevice::read_random(uint64_t off, uint64_t len, char *buf,
     }
   } else {
     //direct and aligned read
-    r = ::pread(fd_direct, buf, len, off);
+    r = ::pread(_get_fd(fast, false), buf, len, off);
     if (r < 0) {
       r = -errno;
       derr << __func__ << " direct_aligned_read" << " 0x" << std::hex 
@@ -799,7 +1019,8 @@ int KernelDevice::invalidate_cache(uint64_t off, uint64_t len)
 	  << dendl;
   assert(off % block_size == 0);
   assert(len % block_size == 0);
-  int r = posix_fadvise(fd_buffered, off, len, POSIX_FADV_DONTNEED);
+  bool fast = _route(&off, len);
+  int r = posix_fadvise(_get_fd(fast, true), off, len, POSIX_FADV_DONTNEED);
   if (r) {
     r = -r;
     derr << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
@@ -16,6 +16,7 @@
 #define CEPH_OS_BLUESTORE_KERNELDEVICE_H
 
 #include <atomic>
+#include <memory>
 
 #include "os/fs/FS.h"
 #include "include/interval_set.h"
@@ -23,9 +24,13 @@
 #include "aio.h"
 #include "BlockDevice.h"
 
+class PerfCounters;
+
 class KernelDevice : public BlockDevice {
   int fd_direct, fd_buffered;
   std::string path;
+  int fast_fd_direct = -1, fast_fd_buffered = -1;  ///< see add_fast_tier()
+  std::string fast_path;
   FS *fs;
   bool aio, dio;
 
@@ -35,21 +40,33 @@ class KernelDevice : public BlockDevice {
   std::atomic<bool> io_since_flush = {false};
   std::mutex flush_mutex;
 
-  aio_queue_t aio_queue;
+  /// completion queues; each is drained by its own aio thread
+  std::vector<std::unique_ptr<io_queue_t>> io_queues;
+  std::atomic<unsigned> next_io_queue = {0};  ///< for iocs without a hint
+  bool ioring = false;  ///< io_queues are io_uring rather than libaio
+  PerfCounters *logger = nullptr;
+  /// names of the per-queue counters; the logger only keeps pointers
+  std::vector<std::string> logger_names;
   bool aio_stop;
 
   struct AioCompletionThread : public Thread {
     KernelDevice *bdev;
-    explicit AioCompletionThread(KernelDevice *b) : bdev(b) {}
+    unsigned shard;
+    AioCompletionThread(KernelDevice *b, unsigned s) : bdev(b), shard(s) {}
     void *entry() override {
-      bdev->_aio_thread();
+      bdev->_aio_thread(shard);
       return NULL;
     }
-  } aio_thread;
+  };
+  std::vector<std::unique_ptr<AioCompletionThread>> aio_threads;
 
   std::atomic_int injecting_crash;
 
-  void _aio_thread();
+  io_queue_t *_create_io_queue();
+  io_queue_t *_get_io_queue(IOContext *ioc);
+  void _aio_thread(unsigned shard);
+  void _init_logger();
+  void _shutdown_logger();
   int _aio_start();
   void _aio_stop();
 
@@ -58,9 +75,17 @@ class KernelDevice : public BlockDevice {
 
   int _sync_write(uint64_t off, bufferlist& bl, bool buffered);
 
-  int _lock();
+  int _lock(int fd);
+
+  /// make off relative to the tier holding [off, off+len); true if fast
+  bool _route(uint64_t *off, uint64_t len) const;
+  int _get_fd(bool fast, bool buffered) const {
+    if (fast)
+      return buffered ? fast_fd_buffered : fast_fd_direct;
+    return buffered ? fd_buffered : fd_direct;
+  }
 
-  int direct_read_unaligned(uint64_t off, uint64_t len, char *buf);
+  int direct_read_unaligned(int fd, uint64_t off, uint64_t len, char *buf);
 
   // stalled aio debugging
   aio_list_t debug_queue;
@@ -93,6 +118,7 @@ public:
   // for managing buffered readers/writers
   int invalidate_cache(uint64_t off, uint64_t len) override;
   int open(const std::string& path) override;
+  int add_fast_tier(const std::string& path, uint64_t base) override;
   void close() override;
 };
 
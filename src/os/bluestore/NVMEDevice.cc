@@ -22,6 +22,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <map>
@@ -56,6 +57,14 @@ static constexpr uint16_t inline_segment_num = 32;
 
 static thread_local int queue_id = -1;
 
+class SharedDriverQueueData;
+/// this thread's inline qpair on each SharedDriverData, keyed by the
+/// driver's instance number (never reused, so entries left behind by a
+/// destroyed driver are never looked up again); nullptr if the
+/// controller had no io queue to spare
+static thread_local std::map<uint64_t, SharedDriverQueueData*> inline_queue_map;
+static std::atomic<uint64_t> driver_instance_seq = {0};
+
 enum {
   l_bluestore_nvmedevice_first = 632430,
   l_bluestore_nvmedevice_aio_write_lat,
@@ -105,7 +114,9 @@ class SharedDriverQueueData {
 
   bool aio_stop = false;
   void _aio_thread();
+  void _alloc_data_bufs();
   int alloc_buf_from_pool(Task *t, bool write);
+  int _issue(Task *t, ceph::coarse_real_clock::time_point start);
 
   std::atomic_bool queue_empty;
   Mutex queue_lock;
@@ -155,6 +166,10 @@ class SharedDriverQueueData {
     g_ceph_context->get_perfcounters_collection()->add(logger);
    }
 
+   bool has_qpair() const {
+     return qpair != nullptr;
+   }
+
    void queue_task(Task *t, uint64_t ops = 1) {
     queue_op_seq += ops;
     Mutex::Locker l(queue_lock);
@@ -165,6 +180,10 @@ class SharedDriverQueueData {
     }
   }
 
+  /// issue t and the tasks chained after it on our qpair from the
+  /// calling thread, then poll until all of them have completed
+  void submit_and_poll(Task *t, uint64_t ops);
+
   void flush_wait() {
     uint64_t cur_seq = queue_op_seq.load();
     uint64_t left = cur_seq - completed_op_seq.load();
@@ -202,15 +221,18 @@ class SharedDriverQueueData {
 
   ~SharedDriverQueueData() {
     g_ceph_context->get_perfcounters_collection()->remove(logger);
-    if (!qpair) {
-      spdk_nvme_ctrlr_free_io_qpair(qpair); 
+    if (qpair) {
+      spdk_nvme_ctrlr_free_io_qpair(qpair);
     }
+    for (auto b : data_buf_mempool)
+      spdk_dma_free(b);
     delete logger;
   }
 };
 
 class SharedDriverData {
   unsigned id;
+  const uint64_t instance = ++driver_instance_seq;
   uint32_t core_id;
 
   std::string sn;
@@ -219,9 +241,12 @@ class SharedDriverData {
   uint64_t block_size = 0;
   uint32_t sector_size = 0;
   uint64_t size = 0;
-  uint32_t queue_number;
+  uint32_t queue_number = 0;
   std::vector<SharedDriverQueueData*> queues;
 
+  std::mutex inline_lock;
+  std::vector<SharedDriverQueueData*> inline_queues;  ///< one per submitting thread
+
   void _aio_start() {
      for (auto &&it : queues)
 	      it->start();
@@ -256,12 +281,53 @@ class SharedDriverData {
     for (auto p : queues) {
       delete p;
    }
+    for (auto p : inline_queues) {
+      delete p;
+    }
   }
 
   SharedDriverQueueData *get_queue(uint32_t i) {
 	return queues.at(i%queue_number);
   }
 
+  /// the calling thread's own qpair, allocated on first use; nullptr if
+  /// the controller has no io queues left
+  SharedDriverQueueData *get_inline_queue() {
+    auto p = inline_queue_map.find(instance);
+    if (p != inline_queue_map.end())
+      return p->second;
+    std::lock_guard<std::mutex> l(inline_lock);
+    // never start()ed, so no lcore of its own
+    auto q = new SharedDriverQueueData(
+      this, ctrlr, ns, block_size, sn, sector_size, 0,
+      queue_number + inline_queues.size());
+    if (q->has_qpair()) {
+      inline_queues.push_back(q);
+    } else {
+      delete q;
+      q = nullptr;
+    }
+    inline_queue_map[instance] = q;
+    return q;
+  }
+
+  /// hand t (and the ops - 1 tasks chained after it) to a qpair
+  void submit(Task *t, uint64_t ops, int shard_hint) {
+    if (g_conf->bluestore_spdk_inline_poll) {
+      SharedDriverQueueData *q = get_inline_queue();
+      if (q) {
+        q->submit_and_poll(t, ops);
+        return;
+      }
+    }
+    if (shard_hint < 0) {
+      if (queue_id == -1)
+        queue_id = ceph_gettid();
+      shard_hint = queue_id;
+    }
+    get_queue(shard_hint)->queue_task(t, ops);
+  }
+
   void register_device(NVMEDevice *device) {
     // in case of registered_devices, we stop thread now.
     // Because release is really a rare case, we could bear this
@@ -437,24 +503,130 @@ int SharedDriverQueueData::alloc_buf_from_pool(Task *t, bool write)
   return 0;
 }
 
-void SharedDriverQueueData::_aio_thread()
+void SharedDriverQueueData::_alloc_data_bufs()
 {
-  dout(1) << __func__ << " start" << dendl;
+  for (uint16_t i = 0; i < data_buffer_default_num; i++) {
+    void *b = spdk_dma_zmalloc(data_buffer_size, CEPH_PAGE_SIZE, NULL);
+    if (!b) {
+      derr << __func__ << " failed to create memory pool for nvme data buffer" << dendl;
+      assert(b);
+    }
+    data_buf_mempool.push_back(b);
+  }
+}
+
+int SharedDriverQueueData::_issue(Task *t,
+                                  ceph::coarse_real_clock::time_point start)
+{
+  int r = 0;
+  uint64_t lba_off = t->offset / sector_size;
+  uint64_t lba_count = t->len / sector_size;
+  ceph::coarse_real_clock::time_point cur;
+  switch (t->command) {
+    case IOCommand::WRITE_COMMAND:
+    {
+      dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count << dendl;
+      r = alloc_buf_from_pool(t, true);
+      if (r < 0) {
+        logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
+        return r;
+      }
 
-  if (data_buf_mempool.empty()) {
-    for (uint16_t i = 0; i < data_buffer_default_num; i++) {
-      void *b = spdk_dma_zmalloc(data_buffer_size, CEPH_PAGE_SIZE, NULL);
-      if (!b) {
-        derr << __func__ << " failed to create memory pool for nvme data buffer" << dendl;
-        assert(b);
+      r = spdk_nvme_ns_cmd_writev(
+          ns, qpair, lba_off, lba_count, io_complete, t, 0,
+          data_buf_reset_sgl, data_buf_next_sge);
+      if (r < 0) {
+        derr << __func__ << " failed to do write command" << dendl;
+        t->ctx->nvme_task_first = t->ctx->nvme_task_last = nullptr;
+        t->release_segs(this);
+        delete t;
+        ceph_abort();
+      }
+      cur = ceph::coarse_real_clock::now();
+      auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+      logger->tinc(l_bluestore_nvmedevice_aio_write_queue_lat, dur);
+      break;
+    }
+    case IOCommand::READ_COMMAND:
+    {
+      dout(20) << __func__ << " read command issued " << lba_off << "~" << lba_count << dendl;
+      r = alloc_buf_from_pool(t, false);
+      if (r < 0) {
+        logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
+        return r;
       }
-      data_buf_mempool.push_back(b);
+
+      r = spdk_nvme_ns_cmd_readv(
+          ns, qpair, lba_off, lba_count, io_complete, t, 0,
+          data_buf_reset_sgl, data_buf_next_sge);
+      if (r < 0) {
+        derr << __func__ << " failed to read" << dendl;
+        t->release_segs(this);
+        delete t;
+        ceph_abort();
+      } else {
+        cur = ceph::coarse_real_clock::now();
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+        logger->tinc(l_bluestore_nvmedevice_read_queue_lat, dur);
+      }
+      break;
+    }
+    case IOCommand::FLUSH_COMMAND:
+    {
+      dout(20) << __func__ << " flush command issueed " << dendl;
+      r = spdk_nvme_ns_cmd_flush(ns, qpair, io_complete, t);
+      if (r < 0) {
+        derr << __func__ << " failed to flush" << dendl;
+        t->release_segs(this);
+        delete t;
+        ceph_abort();
+      } else {
+        cur = ceph::coarse_real_clock::now();
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+        logger->tinc(l_bluestore_nvmedevice_flush_queue_lat, dur);
+      }
+      break;
     }
   }
+  return 0;
+}
+
+void SharedDriverQueueData::submit_and_poll(Task *t, uint64_t ops)
+{
+  if (data_buf_mempool.empty())
+    _alloc_data_bufs();
+  queue_op_seq += ops;
+  auto start = ceph::coarse_real_clock::now();
+  while (t) {
+    // t may complete (and be freed) by the time we poll again
+    Task *next = t->next;
+    t->queue = this;
+    while (_issue(t, start) < 0) {
+      // out of data buffers; reaping what is in flight frees some
+      if (!spdk_nvme_qpair_process_completions(
+            qpair, g_conf->bluestore_spdk_max_io_completion))
+        _mm_pause();
+    }
+    t = next;
+  }
+  while (completed_op_seq.load() < queue_op_seq.load()) {
+    if (!spdk_nvme_qpair_process_completions(
+          qpair, g_conf->bluestore_spdk_max_io_completion))
+      _mm_pause();
+  }
+  auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    ceph::coarse_real_clock::now() - start);
+  logger->tinc(l_bluestore_nvmedevice_polling_lat, dur);
+}
+
+void SharedDriverQueueData::_aio_thread()
+{
+  dout(1) << __func__ << " start" << dendl;
+
+  if (data_buf_mempool.empty())
+    _alloc_data_bufs();
 
   Task *t = nullptr;
-  int r = 0;
-  uint64_t lba_off, lba_count;
 
   ceph::coarse_real_clock::time_point cur, start
     = ceph::coarse_real_clock::now();
@@ -471,74 +643,8 @@ void SharedDriverQueueData::_aio_thread()
 
     for (; t; t = t->next) {
       t->queue = this;
-      lba_off = t->offset / sector_size;
-      lba_count = t->len / sector_size;
-      switch (t->command) {
-        case IOCommand::WRITE_COMMAND:
-        {
-          dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, true);
-          if (r < 0) {
-            logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
-            goto again;
-          }
-
-          r = spdk_nvme_ns_cmd_writev(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
-          if (r < 0) {
-            derr << __func__ << " failed to do write command" << dendl;
-            t->ctx->nvme_task_first = t->ctx->nvme_task_last = nullptr;
-            t->release_segs(this);
-            delete t;
-            ceph_abort();
-          }
-          cur = ceph::coarse_real_clock::now();
-          auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-          logger->tinc(l_bluestore_nvmedevice_aio_write_queue_lat, dur);
-          break;
-        }
-        case IOCommand::READ_COMMAND:
-        {
-          dout(20) << __func__ << " read command issued " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, false);
-          if (r < 0) {
-            logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
-            goto again;
-          }
-
-          r = spdk_nvme_ns_cmd_readv(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
-          if (r < 0) {
-            derr << __func__ << " failed to read" << dendl;
-            t->release_segs(this);
-            delete t;
-            ceph_abort();
-          } else {
-            cur = ceph::coarse_real_clock::now();
-            auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-            logger->tinc(l_bluestore_nvmedevice_read_queue_lat, dur);
-          }
-          break;
-        }
-        case IOCommand::FLUSH_COMMAND:
-        {
-          dout(20) << __func__ << " flush command issueed " << dendl;
-          r = spdk_nvme_ns_cmd_flush(ns, qpair, io_complete, t);
-          if (r < 0) {
-            derr << __func__ << " failed to flush" << dendl;
-            t->release_segs(this);
-            delete t;
-            ceph_abort();
-          } else {
-            cur = ceph::coarse_real_clock::now();
-            auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-            logger->tinc(l_bluestore_nvmedevice_flush_queue_lat, dur);
-          }
-          break;
-        }
-      }
+      if (_issue(t, start) < 0)
+        goto again;
     }
 
     if (!queue_empty.load()) {
@@ -969,11 +1075,11 @@ void NVMEDevice::aio_submit(IOContext *ioc)
     ioc->num_running += pending;
     ioc->num_pending -= pending;
     assert(ioc->num_pending.load() == 0);  // we should be only thread doing this
-    // Only need to push the first entry
-  if(queue_id == -1)
-    queue_id = ceph_gettid();
-    driver->get_queue(queue_id)->queue_task(t, pending);
+    // Only need to push the first entry.  Detach the chain first: with
+    // inline polling the completion callback may free ioc before
+    // submit() returns.
     ioc->nvme_task_first = ioc->nvme_task_last = nullptr;
+    driver->submit(t, pending, ioc->shard_hint);
   }
 }
 
@@ -1031,10 +1137,8 @@ int NVMEDevice::write(uint64_t off, bufferlist &bl, bool buffered)
   // we can reduce this copy
   t->write_bl = std::move(bl);
   t->ctx = &ioc;
-  if(queue_id == -1)
-    queue_id = ceph_gettid();
   ++ioc.num_running;
-  driver->get_queue(queue_id)->queue_task(t);
+  driver->submit(t, 1, -1);
 
   dout(5) << __func__ << " " << off << "~" << len << dendl;
   ioc.aio_wait();
@@ -1061,9 +1165,7 @@ int NVMEDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
     t->copy_to_buf(buf, 0, t->len);
   };
   ++ioc->num_running;
-  if(queue_id == -1)
-    queue_id = ceph_gettid();
-  driver->get_queue(queue_id)->queue_task(t);
+  driver->submit(t, 1, ioc->shard_hint);
 
   while(t->return_code > 0) {
     t->io_wait();
@@ -1127,9 +1229,7 @@ int NVMEDevice::read_random(uint64_t off, uint64_t len, char *buf, bool buffered
     t->copy_to_buf(buf, off-t->offset, len);
   };
   ++ioc.num_running;
-  if(queue_id == -1)
-    queue_id = ceph_gettid();
-  driver->get_queue(queue_id)->queue_task(t);
+  driver->submit(t, 1, -1);
 
   while(t->return_code > 0) {
     t->io_wait();
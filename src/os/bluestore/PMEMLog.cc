@@ -0,0 +1,397 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <random>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#if defined(HAVE_PMEM)
+#include <libpmem.h>
+#endif
+
+#include "PMEMLog.h"
+#include "include/types.h"
+#include "include/byteorder.h"
+#include "include/compat.h"
+#include "include/crc32c.h"
+#include "include/intarith.h"
+#include "include/page.h"
+#include "common/blkdev.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "pmemlog(" << path << ") "
+
+static const uint64_t PMEM_LOG_SUPER_MAGIC = 0x676f6c6d656d70ull;  // "pmemlog"
+static const uint64_t PMEM_LOG_RECORD_MAGIC = 0x6365726d656d70ull; // "pmemrec"
+static const uint32_t PMEM_LOG_WRAP = 1;  ///< skip to the start of the region
+
+struct pmem_log_super_t {
+  ceph_le64 magic;
+  ceph_le64 nonce;
+  ceph_le64 gen;
+  ceph_le64 size;
+  ceph_le64 tail_off;
+  ceph_le64 tail_seq;
+  ceph_le32 crc;       ///< of the fields above
+} __attribute__ ((packed));
+
+struct pmem_log_header_t {
+  ceph_le64 magic;
+  ceph_le64 nonce;
+  ceph_le64 seq;
+  ceph_le32 len;
+  ceph_le32 flags;
+  ceph_le32 data_crc;
+  ceph_le32 crc;       ///< of the fields above
+} __attribute__ ((packed));
+
+static_assert(2 * sizeof(pmem_log_super_t) <= PMEMLog::DATA_START,
+	      "superblock slots must fit before the data area");
+static_assert(sizeof(pmem_log_header_t) <= PMEMLog::ALIGN,
+	      "record header must fit in one cache line");
+
+template<typename T>
+static uint32_t crc_fields(const T& t)
+{
+  return ceph_crc32c(-1, (const unsigned char*)&t, offsetof(T, crc));
+}
+
+PMEMLog::PMEMLog(CephContext *cct)
+  : cct(cct)
+{
+}
+
+PMEMLog::~PMEMLog()
+{
+  if (addr) {
+    close();
+  }
+}
+
+int PMEMLog::_map(const std::string& p)
+{
+  path = p;
+#if defined(HAVE_PMEM)
+  size_t len = 0;
+  int is_pmem = 0;
+  addr = (char *)pmem_map_file(path.c_str(), 0, 0, 0, &len, &is_pmem);
+  if (addr == NULL) {
+    int r = -errno;
+    derr << __func__ << " pmem_map_file: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  size = len;
+  pmem = is_pmem;
+#else
+  int r;
+  struct stat st;
+  fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    r = -errno;
+    derr << __func__ << " open: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  if (::fstat(fd, &st) < 0) {
+    r = -errno;
+    derr << __func__ << " fstat: " << cpp_strerror(r) << dendl;
+    goto out_close;
+  }
+  if (S_ISBLK(st.st_mode)) {
+    int64_t s;
+    r = get_block_device_size(fd, &s);
+    if (r < 0)
+      goto out_close;
+    size = s;
+  } else {
+    size = st.st_size;
+  }
+  addr = (char *)::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    addr = nullptr;
+    r = -errno;
+    derr << __func__ << " mmap: " << cpp_strerror(r) << dendl;
+    goto out_close;
+  }
+  pmem = false;
+#endif
+  if (size < DATA_START + 16 * ALIGN) {
+    derr << __func__ << " region of " << size << " bytes is too small" << dendl;
+    close();
+    return -EINVAL;
+  }
+  size = DATA_START + P2ALIGN(size - DATA_START, ALIGN);
+  dout(1) << __func__ << " size " << size
+	  << (pmem ? " (pmem)" : " (emulated, msync)") << dendl;
+  return 0;
+
+#if !defined(HAVE_PMEM)
+ out_close:
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+  fd = -1;
+  return r;
+#endif
+}
+
+void PMEMLog::close()
+{
+  dout(1) << __func__ << dendl;
+  if (addr) {
+#if defined(HAVE_PMEM)
+    pmem_unmap(addr, size);
+#else
+    ::munmap(addr, size);
+#endif
+    addr = nullptr;
+  }
+  if (fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(fd));
+    fd = -1;
+  }
+}
+
+void PMEMLog::_persist(const char *p, uint64_t len)
+{
+#if defined(HAVE_PMEM)
+  if (pmem) {
+    pmem_persist(p, len);
+  } else {
+    pmem_msync(p, len);
+  }
+#else
+  uintptr_t start = (uintptr_t)p & CEPH_PAGE_MASK;
+  int r = ::msync((void *)start, (uintptr_t)p + len - start, MS_SYNC);
+  assert(r == 0);
+#endif
+}
+
+int PMEMLog::_write_super()
+{
+  pmem_log_super_t sb;
+  sb.magic = PMEM_LOG_SUPER_MAGIC;
+  sb.nonce = nonce;
+  sb.gen = sb_gen + 1;
+  sb.size = size;
+  sb.tail_off = tail_off;
+  sb.tail_seq = tail_seq;
+  sb.crc = crc_fields(sb);
+  // alternate slots so a torn update leaves the previous one intact
+  char *slot = addr + ((sb_gen + 1) % 2) * ALIGN;
+  memcpy(slot, &sb, sizeof(sb));
+  _persist(slot, sizeof(sb));
+  ++sb_gen;
+  return 0;
+}
+
+int PMEMLog::_read_super()
+{
+  const pmem_log_super_t *best = nullptr;
+  for (unsigned i = 0; i < 2; ++i) {
+    const pmem_log_super_t *sb =
+      (const pmem_log_super_t *)(addr + i * ALIGN);
+    if (sb->magic != PMEM_LOG_SUPER_MAGIC ||
+	sb->crc != crc_fields(*sb)) {
+      continue;
+    }
+    if (!best || sb->gen > best->gen) {
+      best = sb;
+    }
+  }
+  if (!best) {
+    derr << __func__ << " no valid superblock" << dendl;
+    return -EIO;
+  }
+  if (best->size > size ||
+      best->tail_off < DATA_START ||
+      best->tail_off >= best->size) {
+    derr << __func__ << " superblock does not match region: size "
+	 << best->size << " tail_off " << best->tail_off << dendl;
+    return -EIO;
+  }
+  size = best->size;
+  nonce = best->nonce;
+  sb_gen = best->gen;
+  tail_off = best->tail_off;
+  tail_seq = best->tail_seq;
+  return 0;
+}
+
+int PMEMLog::create(const std::string& p)
+{
+  int r = _map(p);
+  if (r < 0)
+    return r;
+  std::random_device rd;
+  nonce = ((uint64_t)rd() << 32) | rd();
+  memset(addr, 0, DATA_START);
+  _persist(addr, DATA_START);
+  sb_gen = 0;
+  tail_off = head_off = DATA_START;
+  tail_seq = head_seq = 1;
+  return _write_super();
+}
+
+int PMEMLog::open(const std::string& p)
+{
+  int r = _map(p);
+  if (r < 0)
+    return r;
+  r = _read_super();
+  if (r < 0) {
+    close();
+    return r;
+  }
+  std::lock_guard<std::mutex> l(lock);
+  r = _scan(nullptr);
+  if (r < 0) {
+    close();
+    return r;
+  }
+  dout(1) << __func__ << " seq " << tail_seq << "~" << (head_seq - tail_seq)
+	  << " used " << _used() << "/" << get_capacity() << dendl;
+  return 0;
+}
+
+int PMEMLog::_scan(std::function<int(uint64_t, bufferlist&)> fn)
+{
+  uint64_t off = tail_off;
+  uint64_t seq = tail_seq;
+  uint64_t walked = 0;
+  while (walked < get_capacity()) {
+    if (off + ALIGN > size) {
+      walked += size - off;
+      off = DATA_START;
+    }
+    const pmem_log_header_t *h = (const pmem_log_header_t *)(addr + off);
+    if (h->magic != PMEM_LOG_RECORD_MAGIC ||
+	h->nonce != nonce ||
+	h->seq != seq ||
+	h->crc != crc_fields(*h)) {
+      break;
+    }
+    if (h->flags & PMEM_LOG_WRAP) {
+      if (off == DATA_START)
+	break;
+      walked += size - off;
+      off = DATA_START;
+      continue;
+    }
+    uint64_t rec_len = P2ROUNDUP(ALIGN + h->len, ALIGN);
+    if (off + rec_len > size) {
+      break;
+    }
+    bufferlist bl;
+    bl.append(addr + off + ALIGN, h->len);
+    if (bl.crc32c(-1) != h->data_crc) {
+      dout(10) << __func__ << " seq " << seq << " at 0x" << std::hex << off
+	       << std::dec << " torn" << dendl;
+      break;
+    }
+    if (fn) {
+      int r = fn(seq, bl);
+      if (r < 0)
+	return r;
+    }
+    off += rec_len;
+    walked += rec_len;
+    ++seq;
+  }
+  if (off + ALIGN > size) {
+    off = DATA_START;
+  }
+  head_off = off;
+  head_seq = seq;
+  return 0;
+}
+
+int PMEMLog::replay(std::function<int(uint64_t, bufferlist&)> fn)
+{
+  std::lock_guard<std::mutex> l(lock);
+  return _scan(fn);
+}
+
+int PMEMLog::append(bufferlist& bl, uint64_t *seq)
+{
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t rec_len = P2ROUNDUP(ALIGN + bl.length(), ALIGN);
+  uint64_t off = head_off;
+  uint64_t waste = 0;
+  if (off + rec_len > size) {
+    waste = size - off;
+    off = DATA_START;
+  }
+  if (_used() + waste + rec_len >= get_capacity()) {
+    return -ENOSPC;
+  }
+
+  pmem_log_header_t h;
+  h.magic = PMEM_LOG_RECORD_MAGIC;
+  h.nonce = nonce;
+  h.seq = head_seq;
+  h.len = 0;
+  h.flags = PMEM_LOG_WRAP;
+  h.data_crc = 0;
+  if (waste >= ALIGN) {
+    // tell replay the rest of the region is unused
+    h.crc = crc_fields(h);
+    memcpy(addr + head_off, &h, sizeof(h));
+    _persist(addr + head_off, sizeof(h));
+  }
+
+  char *p = addr + off + ALIGN;
+  for (auto& b : bl.buffers()) {
+    memcpy(p, b.c_str(), b.length());
+    p += b.length();
+  }
+  h.len = bl.length();
+  h.flags = 0;
+  h.data_crc = bl.crc32c(-1);
+  h.crc = crc_fields(h);
+  memcpy(addr + off, &h, sizeof(h));
+  _persist(addr + off, ALIGN + bl.length());
+
+  *seq = head_seq++;
+  head_off = off + rec_len;
+  if (head_off + ALIGN > size) {
+    head_off = DATA_START;
+  }
+  return 0;
+}
+
+int PMEMLog::trim(uint64_t seq)
+{
+  std::lock_guard<std::mutex> l(lock);
+  if (seq < tail_seq) {
+    return 0;
+  }
+  if (seq + 1 >= head_seq) {
+    tail_off = head_off;
+    tail_seq = head_seq = seq + 1;
+  } else {
+    while (tail_seq <= seq) {
+      if (tail_off + ALIGN > size) {
+	tail_off = DATA_START;
+      }
+      const pmem_log_header_t *h =
+	(const pmem_log_header_t *)(addr + tail_off);
+      assert(h->seq == tail_seq);
+      if (h->flags & PMEM_LOG_WRAP) {
+	tail_off = DATA_START;
+	continue;
+      }
+      tail_off += P2ROUNDUP(ALIGN + h->len, ALIGN);
+      ++tail_seq;
+    }
+  }
+  if (tail_off + ALIGN > size) {
+    tail_off = DATA_START;
+  }
+  dout(20) << __func__ << " to " << seq << ", used " << _used() << dendl;
+  return _write_super();
+}
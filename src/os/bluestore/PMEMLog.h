@@ -0,0 +1,96 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_PMEMLOG_H
+#define CEPH_OS_BLUESTORE_PMEMLOG_H
+
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "include/buffer.h"
+#include "common/ceph_context.h"
+
+/*
+ * A persistent ring log on a byte-addressable (pmem or DAX) region.
+ *
+ * The region starts with two superblock slots, written alternately,
+ * that record where the oldest live record is.  Records follow, each
+ * a cache line aligned header and payload.  A record is durable once
+ * append() returns: on real pmem the bytes are flushed from the cpu
+ * cache through libpmem (clwb/clflushopt + sfence), otherwise the
+ * mapping is msync'ed, which is how a plain file emulates the region.
+ *
+ * Replay walks forward from the tail until a header with the wrong
+ * sequence or a bad crc, which is where a torn or stale record begins.
+ * Callers are expected to trim() records once whatever they describe
+ * is durable elsewhere.
+ */
+class PMEMLog {
+public:
+  static const uint64_t ALIGN = 64;
+  static const uint64_t DATA_START = 4096;
+
+  explicit PMEMLog(CephContext *cct);
+  ~PMEMLog();
+
+  /// format the region at path, discarding anything already in it
+  int create(const std::string& path);
+  /// map an existing log and find its head
+  int open(const std::string& path);
+  void close();
+
+  /// call fn(seq, payload) for every live record, oldest first
+  int replay(std::function<int(uint64_t, bufferlist&)> fn);
+
+  /// persist a record; -ENOSPC if it does not fit until we trim
+  int append(bufferlist& bl, uint64_t *seq);
+  /// discard records up to and including seq
+  int trim(uint64_t seq);
+
+  uint64_t get_next_seq() {
+    std::lock_guard<std::mutex> l(lock);
+    return head_seq;
+  }
+  uint64_t get_used() {
+    std::lock_guard<std::mutex> l(lock);
+    return _used();
+  }
+  uint64_t get_capacity() const {
+    return size - DATA_START;
+  }
+  bool is_pmem() const {
+    return pmem;
+  }
+
+private:
+  CephContext *cct;
+  std::string path;
+  std::mutex lock;
+
+  int fd = -1;
+  char *addr = nullptr;   ///< start of the mapping
+  uint64_t size = 0;      ///< mapped length
+  bool pmem = false;      ///< true pmem; else we msync
+
+  uint64_t nonce = 0;     ///< tags records of this incarnation
+  uint64_t sb_gen = 0;    ///< generation of the newest superblock slot
+  uint64_t tail_off = DATA_START;
+  uint64_t tail_seq = 1;
+  uint64_t head_off = DATA_START;
+  uint64_t head_seq = 1;
+
+  int _map(const std::string& path);
+  void _persist(const char *p, uint64_t len);
+  int _write_super();
+  int _read_super();
+  uint64_t _used() const {
+    if (head_off >= tail_off)
+      return head_off - tail_off;
+    return size - tail_off + head_off - DATA_START;
+  }
+  /// walk records from the tail; leaves head_{off,seq} past the last one
+  int _scan(std::function<int(uint64_t, bufferlist&)> fn);
+};
+
+#endif
@@ -256,6 +256,20 @@ uint64_t StupidAllocator::get_free()
   return num_free;
 }
 
+double StupidAllocator::get_fragmentation(uint64_t alloc_unit)
+{
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t free_blocks = (num_free + alloc_unit - 1) / alloc_unit;
+  if (free_blocks <= 1) {
+    return 0.0;
+  }
+  uint64_t intervals = 0;
+  for (unsigned bin = 0; bin < free.size(); ++bin) {
+    intervals += free[bin].num_intervals();
+  }
+  return (double)(intervals - 1) / (free_blocks - 1);
+}
+
 void StupidAllocator::dump()
 {
   std::lock_guard<std::mutex> l(lock);
@@ -271,6 +285,18 @@ void StupidAllocator::dump()
   }
 }
 
+bool StupidAllocator::foreach(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(lock);
+  for (unsigned bin = 0; bin < free.size(); ++bin) {
+    for (auto p = free[bin].begin(); p != free[bin].end(); ++p) {
+      notify(p.get_start(), p.get_len());
+    }
+  }
+  return true;
+}
+
 void StupidAllocator::init_add_free(uint64_t offset, uint64_t length)
 {
   std::lock_guard<std::mutex> l(lock);
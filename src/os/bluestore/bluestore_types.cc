@@ -584,6 +584,17 @@ ostream& operator<<(ostream& out, const bluestore_pextent_t& o) {
     return out << "!~" << std::hex << o.length << std::dec;
 }
 
+ostream& operator<<(ostream& out, const PExtentVector& v)
+{
+  out << "[";
+  for (auto p = v.begin(); p != v.end(); ++p) {
+    if (p != v.begin())
+      out << ",";
+    out << *p;
+  }
+  return out << "]";
+}
+
 void bluestore_pextent_t::generate_test_instances(list<bluestore_pextent_t*>& ls)
 {
   ls.push_back(new bluestore_pextent_t);
@@ -1000,7 +1011,9 @@ void bluestore_blob_t::split(uint32_t blob_offset, bluestore_blob_t& rb)
     bufferptr old;
     old.swap(csum_data);
     rb.csum_data = bufferptr(old.c_str() + pos, old.length() - pos);
+    rb.csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
     csum_data = bufferptr(old.c_str(), pos);
+    csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
   }
 }
 
@@ -1135,3 +1148,28 @@ void bluestore_compression_header_t::generate_test_instances(
   o.push_back(new bluestore_compression_header_t(1));
   o.back()->length = 1234;
 }
+
+// bluestore_alloc_snapshot_t
+
+void bluestore_alloc_snapshot_t::dump(Formatter *f) const
+{
+  f->dump_unsigned("size", size);
+  f->dump_unsigned("region_size", region_size);
+  f->dump_unsigned("num_chunks", num_chunks);
+  f->dump_unsigned("num_extents", num_extents);
+  f->dump_unsigned("free", free);
+  f->dump_unsigned("crc", crc);
+}
+
+void bluestore_alloc_snapshot_t::generate_test_instances(
+  list<bluestore_alloc_snapshot_t*>& o)
+{
+  o.push_back(new bluestore_alloc_snapshot_t);
+  o.push_back(new bluestore_alloc_snapshot_t);
+  o.back()->size = 1ull << 40;
+  o.back()->region_size = 1ull << 30;
+  o.back()->num_chunks = 2;
+  o.back()->num_extents = 70000;
+  o.back()->free = 1ull << 39;
+  o.back()->crc = 0x12345678;
+}
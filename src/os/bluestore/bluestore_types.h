@@ -17,6 +17,7 @@
 
 #include <ostream>
 #include <bitset>
+#include <boost/container/small_vector.hpp>
 #include "include/types.h"
 #include "include/interval_set.h"
 #include "include/utime.h"
@@ -161,7 +162,40 @@ WRITE_CLASS_DENC(bluestore_pextent_t)
 
 ostream& operator<<(ostream& out, const bluestore_pextent_t& o);
 
-typedef mempool::bluestore_cache_other::vector<bluestore_pextent_t> PExtentVector;
+/// stateless front for mempool::pool_allocator, so containers using it
+/// are no bigger than with std::allocator
+template<typename T>
+struct bluestore_cache_other_allocator_t {
+  typedef T value_type;
+  template<typename U> struct rebind {
+    typedef bluestore_cache_other_allocator_t<U> other;
+  };
+  bluestore_cache_other_allocator_t() {}
+  template<typename U>
+  bluestore_cache_other_allocator_t(
+    const bluestore_cache_other_allocator_t<U>&) {}
+
+  T* allocate(size_t n) {
+    return mempool::bluestore_cache_other::pool_allocator<T>().allocate(n);
+  }
+  void deallocate(T* p, size_t n) {
+    mempool::bluestore_cache_other::pool_allocator<T>().deallocate(p, n);
+  }
+  bool operator==(const bluestore_cache_other_allocator_t&) const {
+    return true;
+  }
+  bool operator!=(const bluestore_cache_other_allocator_t&) const {
+    return false;
+  }
+};
+
+/// nearly every blob maps to a single pextent; keep that one inline so
+/// a cached blob costs no extra allocation for it
+typedef boost::container::small_vector<
+  bluestore_pextent_t, 1,
+  bluestore_cache_other_allocator_t<bluestore_pextent_t>> PExtentVector;
+
+ostream& operator<<(ostream& out, const PExtentVector& v);
 
 template<>
 struct denc_traits<PExtentVector> {
@@ -558,6 +592,7 @@ public:
       int len;
       denc_varint(len, p);
       csum_data = p.get_ptr(len);
+      csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
     }
     if (has_unused()) {
       denc(unused, p);
@@ -822,6 +857,7 @@ public:
     csum_type = type;
     csum_chunk_order = order;
     csum_data = buffer::create(get_csum_value_size() * len / get_csum_chunk_size());
+    csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
     csum_data.zero();
   }
 
@@ -850,6 +886,7 @@ public:
       csum_data = bufferptr(t.c_str(),
 			    get_logical_length() / get_csum_chunk_size() *
 			    get_csum_value_size());
+      csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
     }
   }
   void add_tail(uint32_t new_len) {
@@ -866,6 +903,7 @@ public:
       t.swap(csum_data);
       csum_data = buffer::create(
 	get_csum_value_size() * logical_length / get_csum_chunk_size());
+      csum_data.try_assign_to_mempool(mempool::mempool_bluestore_cache_other);
       csum_data.copy_in(0, t.length(), t.c_str());
       csum_data.zero(t.length(), csum_data.length() - t.length());
     }
@@ -1067,5 +1105,29 @@ struct bluestore_compression_header_t {
 };
 WRITE_CLASS_DENC(bluestore_compression_header_t)
 
+/// header of the persisted allocator snapshot
+struct bluestore_alloc_snapshot_t {
+  uint64_t size = 0;         ///< device size when taken
+  uint64_t region_size = 0;  ///< dirty region granularity
+  uint64_t num_chunks = 0;   ///< free extent chunks that follow
+  uint64_t num_extents = 0;  ///< total free extents
+  uint64_t free = 0;         ///< total free bytes
+  uint32_t crc = -1;         ///< crc32c over the encoded chunks
+
+  DENC(bluestore_alloc_snapshot_t, v, p) {
+    DENC_START(1, 1, p);
+    denc(v.size, p);
+    denc(v.region_size, p);
+    denc(v.num_chunks, p);
+    denc(v.num_extents, p);
+    denc(v.free, p);
+    denc(v.crc, p);
+    DENC_FINISH(p);
+  }
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<bluestore_alloc_snapshot_t*>& o);
+};
+WRITE_CLASS_DENC(bluestore_alloc_snapshot_t)
+
 
 #endif
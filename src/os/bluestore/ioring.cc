@@ -0,0 +1,212 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "ioring.h"
+
+#if defined(HAVE_LIBURING)
+
+#include <liburing.h>
+#include <sys/epoll.h>
+
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include "include/compat.h"
+
+struct ioring_data {
+  struct io_uring io_uring;
+  std::mutex sq_mutex;   ///< serializes submitters (sqe allocation + submit)
+  std::mutex cq_mutex;   ///< serializes reapers
+  int epoll_fd = -1;
+  std::map<int, int> fixed_fds_map;  ///< fd -> index in registered file table
+};
+
+static int ioring_get_cqe(ioring_data *d, aio_t **paio, int max)
+{
+  std::lock_guard<std::mutex> l(d->cq_mutex);
+  struct io_uring *ring = &d->io_uring;
+  struct io_uring_cqe *cqe;
+
+  int nr = 0;
+  while (nr < max && io_uring_peek_cqe(ring, &cqe) == 0) {
+    aio_t *io = static_cast<aio_t*>(io_uring_cqe_get_data(cqe));
+    io->rval = cqe->res;
+    paio[nr++] = io;
+    io_uring_cqe_seen(ring, cqe);
+  }
+  return nr;
+}
+
+static int find_fixed_fd(ioring_data *d, int real_fd)
+{
+  auto it = d->fixed_fds_map.find(real_fd);
+  if (it == d->fixed_fds_map.end())
+    return -1;
+  return it->second;
+}
+
+static void init_sqe(ioring_data *d, struct io_uring_sqe *sqe, aio_t *io)
+{
+  int fixed_fd = find_fixed_fd(d, io->fd);
+  assert(fixed_fd != -1);
+
+  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    io_uring_prep_writev(sqe, fixed_fd, &io->iov[0], io->iov.size(),
+			 io->offset);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV) {
+    io_uring_prep_readv(sqe, fixed_fd, &io->iov[0], io->iov.size(),
+			io->offset);
+  } else {
+    assert(0 == "unsupported aio opcode for io_uring");
+  }
+  io_uring_sqe_set_data(sqe, io);
+  io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth, bool sq_thread)
+  : d(new ioring_data),
+    iodepth(iodepth),
+    sq_thread(sq_thread)
+{
+}
+
+ioring_queue_t::~ioring_queue_t()
+{
+  assert(d->epoll_fd < 0);
+}
+
+bool ioring_queue_t::supported()
+{
+  struct io_uring ring;
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int r = io_uring_queue_init_params(16, &ring, &p);
+  if (r < 0)
+    return false;
+  io_uring_queue_exit(&ring);
+  return true;
+}
+
+int ioring_queue_t::init(std::vector<int> &fds)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  if (sq_thread) {
+    // the kernel thread polls the sq ring for us, so submission does
+    // not need a syscall as long as the thread is awake.
+    params.flags |= IORING_SETUP_SQPOLL;
+  }
+
+  int r = io_uring_queue_init_params(iodepth, &d->io_uring, &params);
+  if (r < 0)
+    return r;
+
+  r = io_uring_register_files(&d->io_uring, &fds[0], fds.size());
+  if (r < 0)
+    goto out_ring;
+  for (unsigned i = 0; i < fds.size(); ++i)
+    d->fixed_fds_map[fds[i]] = i;
+
+  d->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (d->epoll_fd < 0) {
+    r = -errno;
+    goto out_files;
+  }
+
+  {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    r = epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, d->io_uring.ring_fd, &ev);
+    if (r < 0) {
+      r = -errno;
+      goto out_epoll;
+    }
+  }
+  return 0;
+
+ out_epoll:
+  VOID_TEMP_FAILURE_RETRY(::close(d->epoll_fd));
+  d->epoll_fd = -1;
+ out_files:
+  d->fixed_fds_map.clear();
+  io_uring_unregister_files(&d->io_uring);
+ out_ring:
+  io_uring_queue_exit(&d->io_uring);
+  return r;
+}
+
+void ioring_queue_t::shutdown()
+{
+  if (d->epoll_fd < 0)
+    return;
+  d->fixed_fds_map.clear();
+  VOID_TEMP_FAILURE_RETRY(::close(d->epoll_fd));
+  d->epoll_fd = -1;
+  io_uring_queue_exit(&d->io_uring);
+}
+
+int ioring_queue_t::submit_batch(aio_iter beg, aio_iter end,
+				 uint16_t aios_size, void *priv,
+				 int *retries)
+{
+  // same backoff policy as aio_queue_t: ~16 seconds total before we
+  // give up on a full ring.
+  int attempts = 16;
+  int delay = 125;
+
+  std::lock_guard<std::mutex> l(d->sq_mutex);
+  struct io_uring *ring = &d->io_uring;
+  int submitted = 0;
+
+  aio_iter cur = beg;
+  while (cur != end) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if (sqe) {
+      cur->priv = priv;
+      init_sqe(d.get(), sqe, &*cur);
+      ++cur;
+      continue;
+    }
+    // the sq ring is full; push what we have to the kernel and retry
+    int r = io_uring_submit(ring);
+    if (r < 0)
+      return r;
+    submitted += r;
+    if (r == 0) {
+      if (attempts-- <= 0)
+	return -EAGAIN;
+      usleep(delay);
+      delay *= 2;
+      (*retries)++;
+    }
+  }
+
+  // one io_uring_enter(2) for the whole batch (or none at all with SQPOLL)
+  int r = io_uring_submit(ring);
+  if (r < 0)
+    return r;
+  return submitted + r;
+}
+
+int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
+{
+  while (true) {
+    int events = ioring_get_cqe(d.get(), paio, max);
+    if (events)
+      return events;
+
+    struct epoll_event ev;
+    int r = epoll_wait(d->epoll_fd, &ev, 1, timeout_ms);
+    if (r < 0) {
+      if (errno == EINTR)
+	continue;
+      return -errno;
+    }
+    if (r == 0)
+      return 0;
+  }
+}
+
+#endif
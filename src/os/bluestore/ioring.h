@@ -0,0 +1,36 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include "acconfig.h"
+
+#include "aio.h"
+
+#if defined(HAVE_LIBURING)
+
+#include <memory>
+
+struct ioring_data;
+
+/// io_uring based io_queue_t
+struct ioring_queue_t final : public io_queue_t {
+  std::unique_ptr<ioring_data> d;
+  unsigned iodepth;
+  bool sq_thread;
+
+  /// true if the running kernel lets us set up an io_uring
+  static bool supported();
+
+  ioring_queue_t(unsigned iodepth, bool sq_thread);
+  ~ioring_queue_t() override;
+
+  int init(std::vector<int> &fds) override;
+  void shutdown() override;
+
+  int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
+		   void *priv, int *retries) override;
+  int get_next_completed(int timeout_ms, aio_t **paio, int max) override;
+};
+
+#endif
@@ -88,6 +88,7 @@ static ostream &operator<<(
 ostream &operator<<(ostream &lhs, const ECBackend::read_request_t &rhs)
 {
   return lhs << "read_request_t(to_read=[" << rhs.to_read << "]"
+	     << ", want_to_read=" << rhs.want_to_read
 	     << ", need=" << rhs.need
 	     << ", want_attrs=" << rhs.want_attrs
 	     << ")";
@@ -254,6 +255,7 @@ struct RecoveryMessages {
   void read(
     ECBackend *ec,
     const hobject_t &hoid, uint64_t off, uint64_t len,
+    const set<int> &want,
     const set<pg_shard_t> &need,
     bool attrs) {
     list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
@@ -264,6 +266,7 @@ struct RecoveryMessages {
 	hoid,
 	ECBackend::read_request_t(
 	  to_read,
+	  want,
 	  need,
 	  attrs,
 	  new OnRecoveryReadComplete(
@@ -568,6 +571,7 @@ void ECBackend::continue_recovery_op(
 	op.hoid,
 	op.recovery_progress.data_recovered_to,
 	amount,
+	want,
 	to_read,
 	op.recovery_progress.first && !op.obc);
       op.extent_requested = make_pair(
@@ -1201,10 +1205,8 @@ void ECBackend::handle_sub_read_reply(
         have.insert(j->first.shard);
         dout(20) << __func__ << " have shard=" << j->first.shard << dendl;
       }
-      set<int> want_to_read, dummy_minimum;
-      get_want_to_read_shards(&want_to_read);
       int err;
-      if ((err = ec_impl->minimum_to_decode(want_to_read, have, &dummy_minimum)) < 0) {
+      if ((err = rop.check_decodable(ec_impl, iter->first, have)) < 0) {
 	dout(20) << __func__ << " minimum_to_decode failed" << dendl;
         if (rop.in_progress.empty()) {
 	  // If we don't have enough copies and we haven't sent reads for all shards
@@ -2090,6 +2092,8 @@ void ECBackend::objects_read_async(
   map<hobject_t,std::list<boost::tuple<uint64_t, uint64_t, uint32_t> > >
     reads;
 
+  map<hobject_t, set<int> > want_to_read;
+
   uint32_t flags = 0;
   extent_set es;
   for (list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
@@ -2105,6 +2109,11 @@ void ECBackend::objects_read_async(
     esnew.insert(tmp.first, tmp.second);
     es.union_of(esnew);
     flags |= i->first.get<2>();
+    if (cct->_conf->osd_read_ec_partial_stripe) {
+      get_want_to_read_shards(
+	make_pair(i->first.get<0>(), i->first.get<1>()),
+	&want_to_read[hoid]);
+    }
   }
 
   if (!es.empty()) {
@@ -2188,6 +2197,7 @@ void ECBackend::objects_read_async(
   };
   objects_read_and_reconstruct(
     reads,
+    want_to_read,
     fast_read,
     make_gen_lambda_context<
       map<hobject_t,pair<int, extent_map> > &&, cb>(
@@ -2203,12 +2213,15 @@ struct CallClientContexts :
   ECBackend *ec;
   ECBackend::ClientAsyncReadStatus *status;
   list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  set<int> want_to_read;
   CallClientContexts(
     hobject_t hoid,
     ECBackend *ec,
     ECBackend::ClientAsyncReadStatus *status,
-    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read)
-    : hoid(hoid), ec(ec), status(status), to_read(to_read) {}
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    const set<int> &want_to_read)
+    : hoid(hoid), ec(ec), status(status), to_read(to_read),
+      want_to_read(want_to_read) {}
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
     ECBackend::read_result_t &res = in.second;
     extent_map result;
@@ -2231,6 +2244,21 @@ struct CallClientContexts :
 	   ++j) {
 	to_decode[j->first.shard].claim(j->second);
       }
+      if (want_to_read.size() < ec->sinfo.get_data_chunk_count()) {
+	int r = ECUtil::decode(
+	  ec->sinfo,
+	  ec->ec_impl,
+	  adjusted.first,
+	  want_to_read,
+	  to_decode,
+	  &result);
+	if (r < 0) {
+	  res.r = r;
+	  goto out;
+	}
+	res.returned.pop_front();
+	continue;
+      }
       int r = ECUtil::decode(
 	ec->sinfo,
 	ec->ec_impl,
@@ -2260,6 +2288,7 @@ void ECBackend::objects_read_and_reconstruct(
   const map<hobject_t,
     std::list<boost::tuple<uint64_t, uint64_t, uint32_t> >
   > &reads,
+  const map<hobject_t, set<int> > &want_to_read,
   bool fast_read,
   GenContextURef<map<hobject_t,pair<int, extent_map> > &&> &&func)
 {
@@ -2270,30 +2299,39 @@ void ECBackend::objects_read_and_reconstruct(
     return;
   }
 
-  set<int> want_to_read;
-  get_want_to_read_shards(&want_to_read);
-    
+  set<int> all_data_shards;
+  get_want_to_read_shards(&all_data_shards);
+
   map<hobject_t, read_request_t> for_read_op;
   for (auto &&to_read: reads) {
+    auto want = want_to_read.find(to_read.first);
+    const set<int> &want_shards =
+      (want == want_to_read.end() || want->second.empty()) ?
+      all_data_shards : want->second;
+
     set<pg_shard_t> shards;
     int r = get_min_avail_to_read_shards(
       to_read.first,
-      want_to_read,
+      want_shards,
       false,
       fast_read,
       &shards);
     assert(r == 0);
+    dout(20) << __func__ << ": " << to_read.first << " want " << want_shards
+	     << " reading " << shards << dendl;
 
     CallClientContexts *c = new CallClientContexts(
       to_read.first,
       this,
       &(in_progress_client_reads.back()),
-      to_read.second);
+      to_read.second,
+      want_shards);
     for_read_op.insert(
       make_pair(
 	to_read.first,
 	read_request_t(
 	  to_read.second,
+	  want_shards,
 	  shards,
 	  false,
 	  c)));
@@ -2331,6 +2369,7 @@ int ECBackend::send_all_remaining_reads(
     rop.to_read.find(hoid)->second.to_read;
   GenContext<pair<RecoveryMessages *, read_result_t& > &> *c =
     rop.to_read.find(hoid)->second.cb;
+  set<int> want_to_read = rop.to_read.find(hoid)->second.want_to_read;
 
   map<hobject_t, read_request_t> for_read_op;
   for_read_op.insert(
@@ -2338,6 +2377,7 @@ int ECBackend::send_all_remaining_reads(
       hoid,
       read_request_t(
 	offsets,
+	want_to_read,
 	shards,
 	false,
 	c)));
@@ -144,10 +144,17 @@ public:
    * still only perform a client read from shards in the acting set.  This
    * ensures that we won't ever have to restart a client initiated read in
    * check_recovery_sources.
+   *
+   * reads are stripe aligned, but the caller usually only needs some of
+   * the data chunks in them.  want_to_read names those shards per object
+   * (objects not in it want every data chunk); only they are read when
+   * available, and only they are reconstructed when not.  The returned
+   * extent_map then covers just the wanted chunks of each stripe.
    */
   void objects_read_and_reconstruct(
     const map<hobject_t, std::list<boost::tuple<uint64_t, uint64_t, uint32_t> >
     > &reads,
+    const map<hobject_t, set<int> > &want_to_read,
     bool fast_read,
     GenContextURef<map<hobject_t,pair<int, extent_map> > &&> &&func);
 
@@ -197,6 +204,7 @@ public:
     }
     objects_read_and_reconstruct(
       _to_read,
+      map<hobject_t, set<int> >(),
       false,
       make_gen_lambda_context<
       map<hobject_t,pair<int, extent_map> > &&, Func>(
@@ -224,6 +232,18 @@ private:
       want_to_read->insert(chunk);
     }
   }
+  /// shards holding the data chunks of the logical range off_len
+  void get_want_to_read_shards(
+    pair<uint64_t, uint64_t> off_len,
+    set<int> *want_to_read) const {
+    const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    set<int> data_chunks;
+    sinfo.offset_len_to_data_chunks(off_len, &data_chunks);
+    for (int i : data_chunks) {
+      int chunk = (int)chunk_mapping.size() > i ? chunk_mapping[i] : i;
+      want_to_read->insert(chunk);
+    }
+  }
 
   /**
    * Recovery
@@ -354,16 +374,18 @@ public:
   };
   struct read_request_t {
     const list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+    const set<int> want_to_read; // shards the reader must end up with
     const set<pg_shard_t> need;
     const bool want_attrs;
     GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb;
     read_request_t(
       const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+      const set<int> &want_to_read,
       const set<pg_shard_t> &need,
       bool want_attrs,
       GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb)
-      : to_read(to_read), need(need), want_attrs(want_attrs),
-	cb(cb) {}
+      : to_read(to_read), want_to_read(want_to_read), need(need),
+	want_attrs(want_attrs), cb(cb) {}
   };
   friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -411,6 +433,23 @@ public:
 	}
       }
     }
+    /// < 0 unless the shards in have can produce what the read of hoid wants
+    int check_decodable(
+      ErasureCodeInterfaceRef &ec_impl,
+      const hobject_t &hoid,
+      const set<int> &have) const {
+      set<int> want_to_read, dummy_minimum;
+      auto req = to_read.find(hoid);
+      if (req != to_read.end())
+	want_to_read = req->second.want_to_read;
+      if (want_to_read.empty()) {
+	const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+	for (int i = 0; i < (int)ec_impl->get_data_chunk_count(); ++i)
+	  want_to_read.insert((int)chunk_mapping.size() > i ?
+			      chunk_mapping[i] : i);
+      }
+      return ec_impl->minimum_to_decode(want_to_read, have, &dummy_minimum);
+    }
     ReadOp() = delete;
     ReadOp(const ReadOp &) = default;
     ReadOp(ReadOp &&) = default;
@@ -97,6 +97,41 @@ int ECUtil::decode(
   return 0;
 }
 
+int ECUtil::decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  uint64_t off,
+  const set<int> &want,
+  map<int, bufferlist> &to_decode,
+  extent_map *out) {
+  assert(to_decode.size());
+  assert(out);
+
+  map<int, bufferlist> decoded;
+  map<int, bufferlist*> decoded_ptrs;
+  for (set<int>::const_iterator i = want.begin(); i != want.end(); ++i)
+    decoded_ptrs[*i] = &decoded[*i];
+  int r = decode(sinfo, ec_impl, to_decode, decoded_ptrs);
+  if (r < 0)
+    return r;
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t total_data_size = to_decode.begin()->second.length();
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  for (uint64_t i = 0; i < total_data_size; i += chunk_size) {
+    uint64_t stripe_off = off + (i / chunk_size) * sinfo.get_stripe_width();
+    for (int j = 0; j < (int)sinfo.get_data_chunk_count(); ++j) {
+      int shard = (int)chunk_mapping.size() > j ? chunk_mapping[j] : j;
+      if (!decoded.count(shard))
+	continue;
+      bufferlist chunk;
+      chunk.substr_of(decoded[shard], i, chunk_size);
+      out->insert(stripe_off + j * chunk_size, chunk_size, std::move(chunk));
+    }
+  }
+  return 0;
+}
+
 int ECUtil::encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
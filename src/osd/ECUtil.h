@@ -20,6 +20,7 @@
 #include "include/assert.h"
 #include "include/encoding.h"
 #include "common/Formatter.h"
+#include "osd/ExtentCache.h"
 
 namespace ECUtil {
 
@@ -46,6 +47,9 @@ public:
   uint64_t get_chunk_size() const {
     return chunk_size;
   }
+  uint64_t get_data_chunk_count() const {
+    return stripe_width / chunk_size;
+  }
   uint64_t logical_to_prev_chunk_offset(uint64_t offset) const {
     return (offset / stripe_width) * chunk_size;
   }
@@ -81,6 +85,20 @@ public:
       (in.first - off) + in.second);
     return std::make_pair(off, len);
   }
+  /// logical data chunk indexes [0, k) holding any byte of in
+  void offset_len_to_data_chunks(
+    std::pair<uint64_t, uint64_t> in,
+    std::set<int> *out) const {
+    if (in.second == 0)
+      return;
+    uint64_t k = get_data_chunk_count();
+    uint64_t first = in.first / chunk_size;
+    uint64_t last = (in.first + in.second - 1) / chunk_size;
+    if (last - first + 1 >= k)
+      last = first + k - 1;
+    for (uint64_t i = first; i <= last; ++i)
+      out->insert(i % k);
+  }
 };
 
 int decode(
@@ -95,6 +113,16 @@ int decode(
   std::map<int, bufferlist> &to_decode,
   std::map<int, bufferlist*> &out);
 
+/// decode only the data chunks in want from the stripes read at logical
+/// offset off, inserting each at its logical offset in out
+int decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  uint64_t off,
+  const std::set<int> &want,
+  std::map<int, bufferlist> &to_decode,
+  extent_map *out);
+
 int encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -3030,6 +3030,9 @@ void OSD::create_logger()
     "Latency of IO before calling queue(before really queue into ShardedOpWq)"); // client io before queue op_wq latency
   osd_plb.add_time_avg(l_osd_op_before_dequeue_op_lat, "op_before_dequeue_op_lat",
     "Latency of IO before calling dequeue_op(already dequeued and get PG lock)"); // client io before dequeue_op latency
+  osd_plb.add_u64_counter(
+    l_osd_op_inline, "op_inline",
+    "Ops processed on the dispatching thread (osd_op_inline_dispatch)");
 
   osd_plb.add_u64_counter(
     l_osd_sop, "subop", "Suboperations");
@@ -6936,11 +6939,12 @@ void OSD::ms_fast_dispatch(Message *m)
 
   if (m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) ||
       m->get_type() != CEPH_MSG_OSD_OP) {
-    // queue it directly
+    // queue it directly (or run it here, if nothing is ahead of it)
     enqueue_op(
       static_cast<MOSDFastDispatchOp*>(m)->get_spg(),
       op,
-      static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch());
+      static_cast<MOSDFastDispatchOp*>(m)->get_map_epoch(),
+      op_may_run_inline(m));
   } else {
     // legacy client, and this is an MOSDOp (the *only* fast dispatch
     // message that didn't have an explicit spg_t); we need to map
@@ -8152,6 +8156,10 @@ void OSD::consume_map()
   assert(osd_lock.is_locked());
   dout(7) << "consume_map version " << osdmap->get_epoch() << dendl;
 
+  if (op_queue == io_queue::mclock_client) {
+    ceph::mClockClientQueue::update_pool_qos(*osdmap);
+  }
+
   int num_pg_primary = 0, num_pg_replica = 0, num_pg_stray = 0;
   list<PGRef> to_remove;
 
@@ -9470,7 +9478,20 @@ bool OSD::op_is_discardable(const MOSDOp *op)
   return false;
 }
 
-void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
+bool OSD::op_may_run_inline(const Message *m)
+{
+  // anything that queues a transaction can block on the store throttle,
+  // which must never happen on a messenger thread, so only client reads
+  // are run inline.  those still read synchronously from the store.
+  if (m->get_type() != CEPH_MSG_OSD_OP) {
+    return false;
+  }
+  int flags = static_cast<const MOSDOp*>(m)->get_flags();
+  return (flags & CEPH_OSD_FLAG_READ) && !(flags & CEPH_OSD_FLAG_WRITE);
+}
+
+void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch,
+		     bool allow_inline)
 {
   utime_t latency = ceph_clock_now() - op->get_req()->get_recv_stamp();
   dout(15) << "enqueue_op " << op << " prio " << op->get_req()->get_priority()
@@ -9483,7 +9504,14 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch)
   op->osd_trace.keyval("cost", op->get_req()->get_cost());
   op->mark_queued_for_pg();
   logger->tinc(l_osd_op_before_queue_op_lat, latency);
-  op_shardedwq.queue(make_pair(pg, PGQueueable(op, epoch)));
+  auto item = make_pair(pg, PGQueueable(op, epoch));
+  if (allow_inline &&
+      cct->_conf->osd_op_inline_dispatch &&
+      op_shardedwq.try_process_inline(item)) {
+    logger->inc(l_osd_op_inline);
+    return;
+  }
+  op_shardedwq.queue(std::move(item));
 }
 
 
@@ -10131,6 +10159,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
 
   // peek at spg_t
   sdata->sdata_op_ordering_lock.Lock();
+  sdata->_drain_intake(osd->op_prio_cutoff);
   if (sdata->pqueue->empty()) {
     dout(20) << __func__ << " empty q, waiting" << dendl;
     // optimistically sleep a moment; maybe another work item will come along.
@@ -10138,10 +10167,15 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
       osd->cct->_conf->threadpool_default_timeout, 0);
     sdata->sdata_lock.Lock();
     sdata->sdata_op_ordering_lock.Unlock();
-    sdata->sdata_cond.WaitInterval(sdata->sdata_lock,
-      utime_t(osd->cct->_conf->threadpool_empty_queue_max_wait, 0));
+    // intake producers signal under sdata_lock after pushing, so an
+    // empty intake here means their signal is still to come.
+    if (sdata->intake.empty()) {
+      sdata->sdata_cond.WaitInterval(sdata->sdata_lock,
+	utime_t(osd->cct->_conf->threadpool_empty_queue_max_wait, 0));
+    }
     sdata->sdata_lock.Unlock();
     sdata->sdata_op_ordering_lock.Lock();
+    sdata->_drain_intake(osd->op_prio_cutoff);
     if (sdata->pqueue->empty()) {
       sdata->sdata_op_ordering_lock.Unlock();
       return;
@@ -10327,19 +10361,14 @@ void OSD::ShardedOpWQ::_enqueue(pair<spg_t, PGQueueable> item) {
 
   ShardData* sdata = shard_list[shard_index];
   assert (NULL != sdata);
-  unsigned priority = item.second.get_priority();
-  unsigned cost = item.second.get_cost();
-  sdata->sdata_op_ordering_lock.Lock();
-
   dout(20) << __func__ << " " << item.first << " " << item.second << dendl;
-  if (priority >= osd->op_prio_cutoff)
-    sdata->pqueue->enqueue_strict(
-      item.second.get_owner(), priority, item);
-  else
-    sdata->pqueue->enqueue(
-      item.second.get_owner(),
-      priority, cost, item);
-  sdata->sdata_op_ordering_lock.Unlock();
+  if (lockfree_intake) {
+    sdata->intake.push(std::move(item));
+  } else {
+    sdata->sdata_op_ordering_lock.Lock();
+    sdata->_enqueue(std::move(item), osd->op_prio_cutoff);
+    sdata->sdata_op_ordering_lock.Unlock();
+  }
 
   sdata->sdata_lock.Lock();
   sdata->sdata_cond.SignalOne();
@@ -10347,6 +10376,70 @@ void OSD::ShardedOpWQ::_enqueue(pair<spg_t, PGQueueable> item) {
 
 }
 
+bool OSD::ShardedOpWQ::try_process_inline(pair<spg_t, PGQueueable>& item)
+{
+  uint32_t shard_index = item.first.hash_to_shard(shard_list.size());
+  ShardData* sdata = shard_list[shard_index];
+  assert (NULL != sdata);
+  PGRef pg;
+  {
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    // anything still in pqueue may be for this pg and must go first.
+    // a _process thread owns the slot from dequeue until it drops the
+    // ordering lock to run, and holds the pg lock while running, so an
+    // idle slot plus a free pg lock means nothing is ahead of us.
+    if (!sdata->pqueue->empty() || !sdata->intake.empty()) {
+      return false;
+    }
+    auto p = sdata->pg_slots.find(item.first);
+    if (p == sdata->pg_slots.end()) {
+      return false;
+    }
+    auto& slot = p->second;
+    if (!slot.pg ||
+	slot.waiting_for_pg ||
+	slot.num_running ||
+	!slot.to_process.empty()) {
+      return false;
+    }
+    // never wait for the pg lock on a messenger thread
+    if (!slot.pg->try_lock()) {
+      return false;
+    }
+    pg = slot.pg;
+  }
+  dout(20) << __func__ << " " << item.first << " item " << item.second
+	   << " pg " << pg << dendl;
+
+  heartbeat_handle_d *hb = get_inline_hb();
+  ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval, 0);
+  tp_handle.reset_tp_timeout();
+  item.second.run(osd, pg, tp_handle);
+  osd->cct->get_heartbeat_map()->clear_timeout(hb);
+
+  pg->unlock();
+  return true;
+}
+
+heartbeat_handle_d *OSD::ShardedOpWQ::get_inline_hb()
+{
+  pthread_t self = pthread_self();
+  {
+    RWLock::RLocker l(inline_hb_lock);
+    auto p = inline_hbs.find(self);
+    if (p != inline_hbs.end()) {
+      return p->second;
+    }
+  }
+  RWLock::WLocker l(inline_hb_lock);
+  auto& hb = inline_hbs[self];
+  if (!hb) {
+    hb = osd->cct->get_heartbeat_map()->add_worker(
+      "OSD::ShardedOpWQ::inline", self);
+  }
+  return hb;
+}
+
 void OSD::ShardedOpWQ::_enqueue_front(pair<spg_t, PGQueueable> item)
 {
   uint32_t shard_index = item.first.hash_to_shard(shard_list.size());
@@ -23,6 +23,8 @@
 #include "common/RWLock.h"
 #include "common/Timer.h"
 #include "common/WorkQueue.h"
+#include "common/HeartbeatMap.h"
+#include "common/MPSCQueue.h"
 #include "common/AsyncReserver.h"
 #include "common/ceph_context.h"
 #include "common/zipkin_trace.h"
@@ -96,6 +98,7 @@ enum {
 
   l_osd_op_before_queue_op_lat,
   l_osd_op_before_dequeue_op_lat,
+  l_osd_op_inline,
 
   l_osd_sop,
   l_osd_sop_inb,
@@ -1605,14 +1608,18 @@ private:
   /*
    * The ordered op delivery chain is:
    *
-   *   fast dispatch -> pqueue back
-   *                    pqueue front <-> to_process back
+   *   fast dispatch -> [intake ->] pqueue back
+   *                                pqueue front <-> to_process back
    *                                     to_process front  -> RunVis(item)
    *                                                      <- queue_front()
    *
    * The pqueue is per-shard, and to_process is per pg_slot.  Items can be
    * pushed back up into to_process and/or pqueue while order is preserved.
    *
+   * With osd_op_queue_lockfree_intake, new items are pushed onto the
+   * shard's lock-free intake list instead of taking the ordering lock, and
+   * whoever next holds the ordering lock moves them into the pqueue.
+   *
    * Multiple worker threads can operate on each shard.
    *
    * Under normal circumstances, num_running == to_process.size().  There are
@@ -1656,6 +1663,28 @@ private:
       /// priority queue
       std::unique_ptr<OpQueue< pair<spg_t, PGQueueable>, entity_inst_t>> pqueue;
 
+      /// new items not yet in pqueue; pushed without any lock
+      MPSCQueue<pair<spg_t, PGQueueable>> intake;
+
+      void _enqueue(pair<spg_t, PGQueueable> item, unsigned cutoff) {
+	unsigned priority = item.second.get_priority();
+	unsigned cost = item.second.get_cost();
+	if (priority >= cutoff)
+	  pqueue->enqueue_strict(
+	    item.second.get_owner(), priority, item);
+	else
+	  pqueue->enqueue(
+	    item.second.get_owner(),
+	    priority, cost, item);
+      }
+
+      /// move the intake into pqueue; call with the ordering lock held
+      void _drain_intake(unsigned cutoff) {
+	intake.drain([&](pair<spg_t, PGQueueable>&& item) {
+	    _enqueue(std::move(item), cutoff);
+	  });
+      }
+
       void _enqueue_front(pair<spg_t, PGQueueable> item, unsigned cutoff) {
 	unsigned priority = item.second.get_priority();
 	unsigned cost = item.second.get_cost();
@@ -1699,6 +1728,17 @@ private:
     vector<ShardData*> shard_list;
     OSD *osd;
     uint32_t num_shards;
+    /// osd_op_queue_lockfree_intake, fixed for our lifetime so that no
+    /// item can be enqueued under the lock ahead of one still in intake
+    const bool lockfree_intake;
+
+    /// heartbeats for ops run by try_process_inline(), one per
+    /// dispatching thread.  they have no suicide grace, so they only
+    /// feed the health check.
+    RWLock inline_hb_lock;
+    map<pthread_t, heartbeat_handle_d*> inline_hbs;
+
+    heartbeat_handle_d *get_inline_hb();
 
   public:
     ShardedOpWQ(uint32_t pnum_shards,
@@ -1708,7 +1748,9 @@ private:
 		ShardedThreadPool* tp)
       : ShardedThreadPool::ShardedWQ<pair<spg_t,PGQueueable>>(ti, si, tp),
         osd(o),
-        num_shards(pnum_shards) {
+        num_shards(pnum_shards),
+        lockfree_intake(osd->cct->_conf->osd_op_queue_lockfree_intake),
+        inline_hb_lock("OSD::ShardedOpWQ::inline_hb_lock") {
       for (uint32_t i = 0; i < num_shards; i++) {
 	char lock_name[32] = {0};
 	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
@@ -1723,6 +1765,9 @@ private:
       }
     }
     ~ShardedOpWQ() override {
+      for (auto& p : inline_hbs) {
+	osd->cct->get_heartbeat_map()->remove_worker(p.second);
+      }
       while (!shard_list.empty()) {
 	delete shard_list.back();
 	shard_list.pop_back();
@@ -1749,6 +1794,10 @@ private:
 
     /// requeue an old item (at the front of the line)
     void _enqueue_front(pair <spg_t, PGQueueable> item) override;
+
+    /// run item on the calling thread if nothing could be ordered
+    /// before it; false if it must be queued instead
+    bool try_process_inline(pair<spg_t, PGQueueable>& item);
       
     void return_waiting_threads() override {
       for(uint32_t i = 0; i < num_shards; i++) {
@@ -1767,6 +1816,7 @@ private:
 	snprintf(lock_name, sizeof(lock_name), "%s%d", "OSD:ShardedOpWQ:", i);
 	assert (NULL != sdata);
 	sdata->sdata_op_ordering_lock.Lock();
+	sdata->_drain_intake(osd->op_prio_cutoff);
 	f->open_object_section(lock_name);
 	sdata->pqueue->dump(f);
 	f->close_section();
@@ -1807,12 +1857,14 @@ private:
       ShardData* sdata = shard_list[shard_index];
       assert(NULL != sdata);
       Mutex::Locker l(sdata->sdata_op_ordering_lock);
-      return sdata->pqueue->empty();
+      return sdata->pqueue->empty() && sdata->intake.empty();
     }
   } op_shardedwq;
 
 
-  void enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch);
+  static bool op_may_run_inline(const Message *m);
+  void enqueue_op(spg_t pg, OpRequestRef& op, epoch_t epoch,
+		  bool allow_inline = false);
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
@@ -164,7 +164,15 @@ void PGLog::trim(
     assert(trim_to <= info.last_complete);
 
     dout(10) << "trim " << log << " to " << trim_to << dendl;
-    log.trim(cct, trim_to, &trimmed, &trimmed_dups, &dirty_dups);
+    if (!log.log.empty() && log.log.front().version <= trim_to) {
+      // the trimmed entries are a prefix of the log, so their keys are
+      // a single range; track its ends instead of every version
+      if (log.log.front().version < trimmed_from)
+	trimmed_from = log.log.front().version;
+      if (trimmed_to < trim_to)
+	trimmed_to = trim_to;
+    }
+    log.trim(cct, trim_to, nullptr, &trimmed_dups, &dirty_dups);
     info.log_tail = log.tail;
   }
 }
@@ -570,7 +578,7 @@ void PGLog::write_log_and_missing(
 	     << "dirty_to: " << dirty_to
 	     << ", dirty_from: " << dirty_from
 	     << ", writeout_from: " << writeout_from
-	     << ", trimmed: " << trimmed
+	     << ", trimmed: " << trimmed_from << "~" << trimmed_to
 	     << ", trimmed_dups: " << trimmed_dups
 	     << ", clear_divergent_priors: " << clear_divergent_priors
 	     << dendl;
@@ -579,7 +587,8 @@ void PGLog::write_log_and_missing(
       dirty_to,
       dirty_from,
       writeout_from,
-      trimmed,
+      trimmed_from,
+      trimmed_to,
       trimmed_dups,
       missing,
       !touched_log,
@@ -607,7 +616,7 @@ void PGLog::write_log_and_missing_wo_missing(
   _write_log_and_missing_wo_missing(
     t, km, log, coll, log_oid,
     divergent_priors, eversion_t::max(), eversion_t(), eversion_t(),
-    set<eversion_t>(),
+    eversion_t::max(), eversion_t(),
     set<string>(),
     true, true, require_rollback, dirty_dups, nullptr);
 }
@@ -629,7 +638,8 @@ void PGLog::write_log_and_missing(
     eversion_t::max(),
     eversion_t(),
     eversion_t(),
-    set<eversion_t>(),
+    eversion_t::max(),
+    eversion_t(),
     set<string>(),
     missing,
     true, require_rollback, false, dirty_dups, rebuilt_missing_with_deletes, nullptr);
@@ -645,7 +655,8 @@ void PGLog::_write_log_and_missing_wo_missing(
   eversion_t dirty_to,
   eversion_t dirty_from,
   eversion_t writeout_from,
-  const set<eversion_t> &trimmed,
+  eversion_t trimmed_from,
+  eversion_t trimmed_to,
   const set<string> &trimmed_dups,
   bool dirty_divergent_priors,
   bool touch_log,
@@ -655,15 +666,6 @@ void PGLog::_write_log_and_missing_wo_missing(
   )
 {
   set<string> to_remove(trimmed_dups);
-  for (set<eversion_t>::const_iterator i = trimmed.begin();
-       i != trimmed.end();
-       ++i) {
-    to_remove.insert(i->get_key_name());
-    if (log_keys_debug) {
-      assert(log_keys_debug->count(i->get_key_name()));
-      log_keys_debug->erase(i->get_key_name());
-    }
-  }
 
   // dout(10) << "write_log_and_missing, clearing up to " << dirty_to << dendl;
   if (touch_log)
@@ -681,6 +683,12 @@ void PGLog::_write_log_and_missing_wo_missing(
       dirty_from.get_key_name(), eversion_t::max().get_key_name());
     clear_after(log_keys_debug, dirty_from.get_key_name());
   }
+  if (trimmed_from <= trimmed_to) {
+    string last = eversion_t(
+      trimmed_to.epoch, trimmed_to.version + 1).get_key_name();
+    t.omap_rmkeyrange(coll, log_oid, trimmed_from.get_key_name(), last);
+    clear_range(log_keys_debug, trimmed_from.get_key_name(), last);
+  }
 
   for (list<pg_log_entry_t>::iterator p = log.log.begin();
        p != log.log.end() && p->version <= dirty_to;
@@ -751,7 +759,8 @@ void PGLog::_write_log_and_missing(
   eversion_t dirty_to,
   eversion_t dirty_from,
   eversion_t writeout_from,
-  const set<eversion_t> &trimmed,
+  eversion_t trimmed_from,
+  eversion_t trimmed_to,
   const set<string> &trimmed_dups,
   const pg_missing_tracker_t &missing,
   bool touch_log,
@@ -762,15 +771,6 @@ void PGLog::_write_log_and_missing(
   set<string> *log_keys_debug
   ) {
   set<string> to_remove(trimmed_dups);
-  for (set<eversion_t>::const_iterator i = trimmed.begin();
-       i != trimmed.end();
-       ++i) {
-    to_remove.insert(i->get_key_name());
-    if (log_keys_debug) {
-      assert(log_keys_debug->count(i->get_key_name()));
-      log_keys_debug->erase(i->get_key_name());
-    }
-  }
 
   if (touch_log)
     t.touch(coll, log_oid);
@@ -787,6 +787,12 @@ void PGLog::_write_log_and_missing(
       dirty_from.get_key_name(), eversion_t::max().get_key_name());
     clear_after(log_keys_debug, dirty_from.get_key_name());
   }
+  if (trimmed_from <= trimmed_to) {
+    string last = eversion_t(
+      trimmed_to.epoch, trimmed_to.version + 1).get_key_name();
+    t.omap_rmkeyrange(coll, log_oid, trimmed_from.get_key_name(), last);
+    clear_range(log_keys_debug, trimmed_from.get_key_name(), last);
+  }
 
   for (list<pg_log_entry_t>::iterator p = log.log.begin();
        p != log.log.end() && p->version <= dirty_to;
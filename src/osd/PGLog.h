@@ -418,9 +418,9 @@ public:
 
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        if (objects.count(e.soid) == 0 ||
-            objects[e.soid]->version < e.version)
-          objects[e.soid] = &e;
+        auto p = objects.emplace(e.soid, &e);
+        if (!p.second && p.first->second->version < e.version)
+          p.first->second = &e;
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
 	// divergent merge_log indexes new before unindexing old
@@ -448,14 +448,16 @@ public:
     void unindex(const pg_log_entry_t& e) {
       // NOTE: this only works if we remove from the _tail_ of the log!
       if (indexed_data & PGLOG_INDEXED_OBJECTS) {
-        if (objects.count(e.soid) && objects[e.soid]->version == e.version)
-          objects.erase(e.soid);
+        auto p = objects.find(e.soid);
+        if (p != objects.end() && p->second->version == e.version)
+          objects.erase(p);
       }
       if (e.reqid_is_indexed()) {
         if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
 	  // divergent merge_log indexes new before unindexing old
-          if (caller_ops.count(e.reqid) && caller_ops[e.reqid] == &e)
-            caller_ops.erase(e.reqid);
+          auto p = caller_ops.find(e.reqid);
+          if (p != caller_ops.end() && p->second == &e)
+            caller_ops.erase(p);
         }
       }
       if (indexed_data & PGLOG_INDEXED_EXTRA_CALLER_OPS) {
@@ -553,7 +555,8 @@ protected:
   eversion_t dirty_to;         ///< must clear/writeout all keys <= dirty_to
   eversion_t dirty_from;       ///< must clear/writeout all keys >= dirty_from
   eversion_t writeout_from;    ///< must writout keys >= writeout_from
-  set<eversion_t> trimmed;     ///< must clear keys in trimmed
+  eversion_t trimmed_from;     ///< must clear keys in [trimmed_from,
+  eversion_t trimmed_to;       ///<                    trimmed_to]
   set<string> trimmed_dups;    ///< must clear keys in trimmed_dups
   CephContext *cct;
   bool pg_log_debug;
@@ -581,7 +584,7 @@ public:
       (dirty_to != eversion_t()) ||
       (dirty_from != eversion_t::max()) ||
       (writeout_from != eversion_t::max()) ||
-      !(trimmed.empty()) ||
+      (trimmed_from <= trimmed_to) ||
       !missing.is_clean() ||
       !(trimmed_dups.empty()) ||
       dirty_dups ||
@@ -613,13 +616,22 @@ protected:
 	 i != log_keys_debug->end() && *i < ub;
 	 log_keys_debug->erase(i++));
   }
+  static void clear_range(set<string> *log_keys_debug,
+			  const string &lb, const string &ub) {
+    if (!log_keys_debug)
+      return;
+    for (set<string>::iterator i = log_keys_debug->lower_bound(lb);
+	 i != log_keys_debug->end() && *i < ub;
+	 log_keys_debug->erase(i++));
+  }
 
   void check();
   void undirty() {
     dirty_to = eversion_t();
     dirty_from = eversion_t::max();
     touched_log = true;
-    trimmed.clear();
+    trimmed_from = eversion_t::max();
+    trimmed_to = eversion_t();
     trimmed_dups.clear();
     writeout_from = eversion_t::max();
     check();
@@ -633,6 +645,7 @@ public:
     prefix_provider(dpp),
     dirty_from(eversion_t::max()),
     writeout_from(eversion_t::max()),
+    trimmed_from(eversion_t::max()),
     cct(cct),
     pg_log_debug(!(cct && !(cct->_conf->osd_debug_pg_log_writeout))),
     touched_log(false),
@@ -1204,7 +1217,8 @@ public:
     eversion_t dirty_to,
     eversion_t dirty_from,
     eversion_t writeout_from,
-    const set<eversion_t> &trimmed,
+    eversion_t trimmed_from,
+    eversion_t trimmed_to,
     const set<string> &trimmed_dups,
     bool dirty_divergent_priors,
     bool touch_log,
@@ -1221,7 +1235,8 @@ public:
     eversion_t dirty_to,
     eversion_t dirty_from,
     eversion_t writeout_from,
-    const set<eversion_t> &trimmed,
+    eversion_t trimmed_from,
+    eversion_t trimmed_to,
     const set<string> &trimmed_dups,
     const pg_missing_tracker_t &missing,
     bool touch_log,
@@ -16,6 +16,8 @@
 #include <memory>
 
 #include "osd/mClockClientQueue.h"
+#include "osd/OSDMap.h"
+#include "messages/MOSDOp.h"
 #include "common/dout.h"
 
 
@@ -62,8 +64,15 @@ namespace ceph {
   mClockClientQueue::op_class_client_info_f(
     const mClockClientQueue::InnerClient& client)
   {
-    switch(client.second) {
+    switch(std::get<1>(client)) {
     case osd_op_type_t::client_op:
+      if (std::get<2>(client) >= 0) {
+	auto qos = std::atomic_load(&pool_qos);
+	auto p = qos->find(std::get<2>(client));
+	if (p != qos->end()) {
+	  return p->second;
+	}
+      }
       return mclock_op_tags->client_op;
     case osd_op_type_t::osd_subop:
       return mclock_op_tags->osd_subop;
@@ -90,6 +99,35 @@ namespace ceph {
   mClockClientQueue::pg_queueable_visitor_t
   mClockClientQueue::pg_queueable_visitor;
 
+  std::shared_ptr<const mClockClientQueue::pool_qos_map_t>
+  mClockClientQueue::pool_qos(new pool_qos_map_t);
+
+  void mClockClientQueue::update_pool_qos(const OSDMap& osdmap)
+  {
+    if (!mclock_op_tags) {
+      return;  // no mclock_client queue in this process
+    }
+    std::shared_ptr<pool_qos_map_t> m(new pool_qos_map_t);
+    for (auto& p : osdmap.get_pools()) {
+      const pool_opts_t& opts = p.second.opts;
+      if (!opts.is_set(pool_opts_t::QOS_RESERVATION) &&
+	  !opts.is_set(pool_opts_t::QOS_WEIGHT) &&
+	  !opts.is_set(pool_opts_t::QOS_LIMIT)) {
+	continue;
+      }
+      // unset values fall back to the osd-wide client op profile
+      double res = mclock_op_tags->client_op.reservation;
+      double wgt = mclock_op_tags->client_op.weight;
+      double lim = mclock_op_tags->client_op.limit;
+      opts.get(pool_opts_t::QOS_RESERVATION, &res);
+      opts.get(pool_opts_t::QOS_WEIGHT, &wgt);
+      opts.get(pool_opts_t::QOS_LIMIT, &lim);
+      m->emplace(p.first, dmc::ClientInfo(res, wgt, lim));
+    }
+    std::atomic_store(&pool_qos,
+		      std::shared_ptr<const pool_qos_map_t>(std::move(m)));
+  }
+
   mClockClientQueue::mClockClientQueue(CephContext *cct) :
     queue(&mClockClientQueue::op_class_client_info_f)
   {
@@ -118,10 +156,18 @@ namespace ceph {
     }
   }
 
+  int64_t mClockClientQueue::get_qos_pool(const Request& request) {
+    int64_t pool = request.first.pool();
+    return std::atomic_load(&pool_qos)->count(pool) ? pool : -1;
+  }
+
   mClockClientQueue::InnerClient
   inline mClockClientQueue::get_inner_client(const Client& cl,
 				      const Request& request) {
-    return InnerClient(cl, get_osd_op_type(request));
+    osd_op_type_t type = get_osd_op_type(request);
+    return InnerClient(cl, type,
+		       type == osd_op_type_t::client_op ?
+		       get_qos_pool(request) : -1);
   }
 
   // Formatted output of the queue
@@ -147,7 +193,18 @@ namespace ceph {
 					 unsigned priority,
 					 unsigned cost,
 					 Request item) {
-    queue.enqueue(get_inner_client(cl, item), priority, cost, item);
+    InnerClient inner = get_inner_client(cl, item);
+    if (std::get<1>(inner) == osd_op_type_t::client_op) {
+      OpRequestRef op = *item.second.maybe_get_op();
+      if (op->get_req()->get_type() == CEPH_MSG_OSD_OP) {
+	// carry the delta/rho the client's ServiceTracker sent
+	auto m = static_cast<const MOSDOp*>(op->get_req());
+	queue.enqueue_distributed(inner, priority, cost, item,
+				  m->get_qos_params());
+	return;
+      }
+    }
+    queue.enqueue(inner, priority, cost, item);
   }
 
   // Enqueue the op in the front of the regular queue
@@ -160,6 +217,13 @@ namespace ceph {
 
   // Return an op to be dispatched
   inline Request mClockClientQueue::dequeue() {
-    return queue.dequeue();
+    dmc::PhaseType phase;
+    Request r = queue.dequeue_distributed(&phase);
+    boost::optional<OpRequestRef> op = r.second.maybe_get_op();
+    if (op && (*op)->get_req()->get_type() == CEPH_MSG_OSD_OP) {
+      // so the reply can tell the client which phase served it
+      static_cast<MOSDOp*>((*op)->get_nonconst_req())->set_qos_phase(phase);
+    }
+    return r;
   }
 } // namespace ceph
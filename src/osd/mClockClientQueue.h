@@ -16,6 +16,9 @@
 #pragma once
 
 #include <ostream>
+#include <map>
+#include <memory>
+#include <tuple>
 
 #include "boost/variant.hpp"
 
@@ -25,6 +28,7 @@
 
 #include "common/mClockPriorityQueue.h"
 
+class OSDMap;
 
 namespace ceph {
 
@@ -41,7 +45,9 @@ namespace ceph {
     enum class osd_op_type_t {
       client_op, osd_subop, bg_snaptrim, bg_recovery, bg_scrub };
 
-    using InnerClient = std::pair<entity_inst_t,osd_op_type_t>;
+    // the pool is only filled in for client ops on a pool with a qos
+    // profile, and is -1 otherwise
+    using InnerClient = std::tuple<entity_inst_t,osd_op_type_t,int64_t>;
 
     using queue_t = mClockQueue<Request, InnerClient>;
 
@@ -59,6 +65,13 @@ namespace ceph {
 
     static std::unique_ptr<mclock_op_tags_t> mclock_op_tags;
 
+    // per-pool client op profiles from the pool qos_* options.  the map
+    // is never modified once published; update_pool_qos() swaps in a new
+    // one with std::atomic_store() and readers take a reference to the
+    // current one with std::atomic_load().
+    typedef std::map<int64_t,crimson::dmclock::ClientInfo> pool_qos_map_t;
+    static std::shared_ptr<const pool_qos_map_t> pool_qos;
+
   public:
 
     mClockClientQueue(CephContext *cct);
@@ -66,6 +79,11 @@ namespace ceph {
     static crimson::dmclock::ClientInfo
     op_class_client_info_f(const InnerClient& client);
 
+    // Pick up the pool qos_reservation/qos_weight/qos_limit options.
+    // A changed profile applies to a client once the queue has dropped
+    // its idle record and made a new one.
+    static void update_pool_qos(const OSDMap& osdmap);
+
     inline unsigned length() const override final {
       return queue.length();
     }
@@ -141,6 +159,7 @@ namespace ceph {
 
     osd_op_type_t get_osd_op_type(const Request& request);
     InnerClient get_inner_client(const Client& cl, const Request& request);
+    static int64_t get_qos_pool(const Request& request);
   }; // class mClockClientAdapter
 
 } // namespace ceph
@@ -1049,6 +1049,9 @@ public:
     CSUM_TYPE,
     CSUM_MAX_BLOCK,
     CSUM_MIN_BLOCK,
+    QOS_RESERVATION,
+    QOS_WEIGHT,
+    QOS_LIMIT,
   };
 
   enum type_t {
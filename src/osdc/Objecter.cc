@@ -3244,6 +3244,10 @@ void Objecter::_send_op(Op *op, MOSDOp *m)
 
   m->set_tid(op->tid);
 
+  if (qos_tracker) {
+    m->set_qos_params(qos_tracker->get_req_params(op->session->osd));
+  }
+
   if (op->trace.valid()) {
     m->trace.init("op msg", nullptr, &op->trace);
   }
@@ -3357,6 +3361,10 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
   Op *op = iter->second;
   op->trace.event("osd op reply");
 
+  if (qos_tracker) {
+    qos_tracker->track_resp(s->osd, m->get_qos_phase());
+  }
+
   if (retry_writes_after_first_reply && op->attempts == 1 &&
       (op->target.flags & CEPH_OSD_FLAG_WRITE)) {
     ldout(cct, 7) << "retrying write after first reply: " << tid << dendl;
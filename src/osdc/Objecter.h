@@ -37,6 +37,8 @@
 #include "common/shunique_lock.h"
 #include "common/zipkin_trace.h"
 
+#include "dmclock/src/dmclock_client.h"
+
 #include "messages/MOSDOp.h"
 #include "osd/OSDMap.h"
 
@@ -2012,7 +2014,11 @@ private:
     op_throttle_ops(cct, "objecter_ops", cct->_conf->objecter_inflight_ops),
     epoch_barrier(0),
     retry_writes_after_first_reply(cct->_conf->objecter_retry_writes_after_first_reply)
-  { }
+  {
+    if (cct->_conf->objecter_mclock_service_tracker) {
+      qos_tracker.reset(new crimson::dmclock::ServiceTracker<int>());
+    }
+  }
   ~Objecter() override;
 
   void init();
@@ -3038,6 +3044,8 @@ public:
 private:
   epoch_t epoch_barrier;
   bool retry_writes_after_first_reply;
+  // per-osd dmclock delta/rho, if objecter_mclock_service_tracker
+  std::unique_ptr<crimson::dmclock::ServiceTracker<int>> qos_tracker;
 public:
   void set_epoch_barrier(epoch_t epoch);
 
@@ -255,6 +255,65 @@ TEST(Crc32c, RangeZero) {
   free(b);
 }
 
+TEST(Crc32c, Multi) {
+  const unsigned num = 11;
+  unsigned char const *bufs[num];
+  uint32_t out[num];
+  for (unsigned len = 0; len < 300; len += 7) {
+    for (unsigned i = 0; i < num; i++) {
+      unsigned char *b = (unsigned char *)malloc(len + 1);
+      for (unsigned j = 0; j < len; j++)
+	b[j] = (i * 31 + j * 7) & 0xff;
+      bufs[i] = b;
+    }
+    for (unsigned n = 1; n <= num; n++) {
+      ceph_crc32c_multi(1234, bufs, len, n, out);
+      for (unsigned i = 0; i < n; i++)
+	ASSERT_EQ(ceph_crc32c(1234, bufs[i], len), out[i]);
+    }
+    for (unsigned i = 0; i < num; i++)
+      free((void *)bufs[i]);
+  }
+}
+
+TEST(Crc32c, MultiPerformance) {
+  // a batch of 4k csum blocks, as BlueStore verifies them
+  const unsigned len = 4096;
+  const unsigned max_num = 16;
+  const uint64_t total = 256 * 1024 * 1024;
+  unsigned char const *bufs[max_num];
+  uint32_t out[max_num], expected[max_num];
+  for (unsigned i = 0; i < max_num; i++) {
+    unsigned char *b = (unsigned char *)malloc(len);
+    for (unsigned j = 0; j < len; j++)
+      b[j] = (i * 31 + j * 7) & 0xff;
+    bufs[i] = b;
+  }
+  unsigned nums[] = {1, 2, 3, 4, 5, 8, 16};
+  for (unsigned num : nums) {
+    uint64_t iters = total / (len * num);
+    utime_t start = ceph_clock_now();
+    for (uint64_t k = 0; k < iters; k++)
+      for (unsigned i = 0; i < num; i++)
+	expected[i] = ceph_crc32c(k, bufs[i], len);
+    utime_t end = ceph_clock_now();
+    float one_rate = (float)total / (float)(1024*1024) / (float)(end - start);
+
+    start = ceph_clock_now();
+    for (uint64_t k = 0; k < iters; k++)
+      ceph_crc32c_multi(k, bufs, len, num, out);
+    end = ceph_clock_now();
+    float multi_rate = (float)total / (float)(1024*1024) / (float)(end - start);
+
+    std::cout << num << " x " << len << " bytes: one at a time = " << one_rate
+	      << " MB/sec, multi = " << multi_rate << " MB/sec" << std::endl;
+    for (unsigned i = 0; i < num; i++)
+      ASSERT_EQ(expected[i], out[i]);
+  }
+  for (unsigned i = 0; i < max_num; i++)
+    free((void *)bufs[i]);
+}
+
 TEST(Crc32c, RangeNull) {
   int len = sizeof(crc_zero_check_table) / sizeof(crc_zero_check_table[0]);
   uint32_t crc = 1; /* when checking zero buffer we want to start with a non zero crc, otherwise
@@ -316,3 +316,42 @@ TEST(mClockPriorityQueue, RemoveByFilter)
       "expect this value to have been left in";
    }
 }
+
+
+TEST(mClockPriorityQueue, Distributed)
+{
+  ceph::mClockQueue<Request,Client> q(&client_info_func);
+
+  Client c1(1);
+  Client c2(2);
+
+  q.enqueue_strict(c1, 12, Request(1));
+  q.enqueue_distributed(c2, 12, 0, Request(2),
+			crimson::dmclock::ReqParams(1, 1));
+
+  crimson::dmclock::PhaseType phase;
+  Request r;
+
+  r = q.dequeue_distributed(&phase);
+  ASSERT_EQ(1, r.value);
+  ASSERT_EQ(crimson::dmclock::PhaseType::priority, phase);
+
+  // a fresh client is within its reservation
+  r = q.dequeue_distributed(&phase);
+  ASSERT_EQ(2, r.value);
+  ASSERT_EQ(crimson::dmclock::PhaseType::reservation, phase);
+
+  // a client that other servers have been serving by reservation is
+  // pushed out of its reservation here
+  q.enqueue_distributed(c2, 12, 0, Request(3),
+			crimson::dmclock::ReqParams(1000, 1000));
+  q.enqueue_distributed(c2, 12, 0, Request(4),
+			crimson::dmclock::ReqParams(1000, 1000));
+  r = q.dequeue_distributed(&phase);
+  ASSERT_EQ(3, r.value);
+  ASSERT_EQ(crimson::dmclock::PhaseType::priority, phase);
+  r = q.dequeue_distributed(&phase);
+  ASSERT_EQ(4, r.value);
+  ASSERT_EQ(crimson::dmclock::PhaseType::priority, phase);
+  ASSERT_TRUE(q.empty());
+}
@@ -0,0 +1,63 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/MPSCQueue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST(MPSCQueue, fifo) {
+  MPSCQueue<int> q;
+  EXPECT_TRUE(q.empty());
+  for (int i = 0; i < 10; ++i) {
+    q.push(i);
+  }
+  EXPECT_FALSE(q.empty());
+  int expect = 0;
+  EXPECT_EQ(10u, q.drain([&](int&& i) { EXPECT_EQ(expect++, i); }));
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.drain([&](int&& i) { ADD_FAILURE(); }));
+}
+
+TEST(MPSCQueue, move_only) {
+  MPSCQueue<std::unique_ptr<int>> q;
+  q.push(std::unique_ptr<int>(new int(1)));
+  q.push(std::unique_ptr<int>(new int(2)));
+  std::vector<int> out;
+  q.drain([&](std::unique_ptr<int>&& p) { out.push_back(*p); });
+  EXPECT_EQ((std::vector<int>{1, 2}), out);
+  // whatever is left is freed with the queue
+  q.push(std::unique_ptr<int>(new int(3)));
+}
+
+TEST(MPSCQueue, producers) {
+  const int producers = 4;
+  const int per_producer = 100000;
+  MPSCQueue<std::pair<int,int>> q;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.emplace_back([&q, p]() {
+	for (int i = 0; i < per_producer; ++i) {
+	  q.push(std::make_pair(p, i));
+	}
+      });
+  }
+  // drain while they push; each producer's items must stay in order
+  std::vector<int> next(producers, 0);
+  int total = 0;
+  while (total < producers * per_producer) {
+    total += q.drain([&](std::pair<int,int>&& item) {
+	ASSERT_EQ(next[item.first], item.second);
+	++next[item.first];
+      });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  EXPECT_TRUE(q.empty());
+  for (int p = 0; p < producers; ++p) {
+    EXPECT_EQ(per_producer, next[p]);
+  }
+}
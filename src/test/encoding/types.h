@@ -133,6 +133,7 @@ TYPE(bluestore_pextent_t)
 TYPE(bluestore_onode_t)
 TYPE(bluestore_deferred_op_t)
 TYPE(bluestore_deferred_transaction_t)
+TYPE(bluestore_alloc_snapshot_t)
 #endif
 
 #include "common/hobject.h"
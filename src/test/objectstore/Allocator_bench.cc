@@ -0,0 +1,117 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Allocation throughput benchmark for the bluestore allocators.
+ *
+ * Fills the device to a target utilization with randomly sized
+ * allocations, then churns (release one, allocate one) and reports
+ * allocations per second and the fragmentation score at the end.
+ */
+#include <iostream>
+#include <random>
+#include <boost/scoped_ptr.hpp>
+#include <gtest/gtest.h>
+
+#include "common/Clock.h"
+#include "global/global_context.h"
+#include "include/stringify.h"
+#include "include/utime.h"
+#include "os/bluestore/Allocator.h"
+
+
+#if GTEST_HAS_PARAM_TEST
+
+class AllocBench : public ::testing::TestWithParam<const char*> {
+public:
+  boost::scoped_ptr<Allocator> alloc;
+  AllocBench(): alloc(0) { }
+  void init_alloc(int64_t size, uint64_t min_alloc_size) {
+    std::cout << "Creating alloc type " << string(GetParam()) << " \n";
+    alloc.reset(Allocator::create(g_ceph_context, string(GetParam()), size,
+				  min_alloc_size));
+  }
+
+  void init_close() {
+    alloc.reset(0);
+  }
+
+  // fill to `utilization`, then run `rounds` release+allocate pairs
+  void churn(uint64_t capacity, uint64_t alloc_unit,
+	     unsigned max_units, double utilization, unsigned rounds);
+};
+
+void AllocBench::churn(uint64_t capacity, uint64_t alloc_unit,
+		       unsigned max_units, double utilization,
+		       unsigned rounds)
+{
+  std::mt19937_64 rng(0);
+  std::uniform_int_distribution<unsigned> units(1, max_units);
+
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+
+  vector<AllocExtent> allocated;
+  auto do_alloc = [&]() -> int64_t {
+    uint64_t want = units(rng) * alloc_unit;
+    if (alloc->reserve(want) < 0) {
+      return -ENOSPC;
+    }
+    AllocExtentVector extents;
+    int64_t r = alloc->allocate(want, alloc_unit, 0, 0, &extents);
+    if (r < (int64_t)want) {
+      alloc->unreserve(want - std::max<int64_t>(r, 0));
+    }
+    for (auto& e : extents) {
+      allocated.push_back(e);
+    }
+    return r;
+  };
+  auto do_release = [&]() {
+    std::uniform_int_distribution<size_t> pick(0, allocated.size() - 1);
+    size_t i = pick(rng);
+    alloc->release(allocated[i].offset, allocated[i].length);
+    allocated[i] = allocated.back();
+    allocated.pop_back();
+  };
+
+  uint64_t ops = 0;
+  utime_t start = ceph_clock_now();
+  while (capacity - alloc->get_free() < capacity * utilization) {
+    ASSERT_GT(do_alloc(), 0);
+    ++ops;
+  }
+  utime_t filled = ceph_clock_now();
+  for (unsigned i = 0; i < rounds; ++i) {
+    do_release();
+    ASSERT_GT(do_alloc(), 0);
+  }
+  utime_t end = ceph_clock_now();
+
+  std::cout << GetParam()
+	    << " fill: " << ops << " allocs in " << (filled - start)
+	    << " (" << (uint64_t)(ops / (double)(filled - start)) << "/s)"
+	    << " churn: " << rounds << " allocs in " << (end - filled)
+	    << " (" << (uint64_t)(rounds / (double)(end - filled)) << "/s)"
+	    << " fragmentation " << alloc->get_fragmentation(alloc_unit)
+	    << std::endl;
+}
+
+TEST_P(AllocBench, churn_4k)
+{
+  churn(16ull << 30, 4096, 16, 0.8, 100000);
+}
+
+TEST_P(AllocBench, churn_64k)
+{
+  churn(64ull << 30, 65536, 16, 0.9, 100000);
+}
+
+INSTANTIATE_TEST_CASE_P(
+  Allocator,
+  AllocBench,
+  ::testing::Values("stupid", "bitmap", "avl"));
+
+#else
+
+TEST(DummyTest, ValueParameterizedTestsAreNotSupportedOnThisPlatform) {}
+#endif
@@ -291,10 +291,42 @@ TEST_P(AllocTest, test_alloc_non_aligned_len)
 }
 
 
+TEST_P(AllocTest, test_alloc_fragmentation)
+{
+  if (GetParam() == std::string("bitmap")) {
+    return;
+  }
+  uint64_t capacity = 4 * 1024 * 1024;
+  uint64_t alloc_unit = 4096;
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(0, capacity);
+  EXPECT_EQ(0.0, alloc->get_fragmentation(alloc_unit));
+
+  EXPECT_EQ(0, alloc->reserve(capacity));
+  AllocExtentVector extents;
+  EXPECT_EQ((int64_t)capacity,
+	    alloc->allocate(capacity, alloc_unit, alloc_unit, 0, &extents));
+  EXPECT_EQ(capacity / alloc_unit, extents.size());
+  EXPECT_EQ(0u, alloc->get_free());
+  EXPECT_EQ(0.0, alloc->get_fragmentation(alloc_unit));
+
+  // every other unit free: as fragmented as it gets
+  for (size_t i = 0; i < extents.size(); i += 2) {
+    alloc->release(extents[i].offset, extents[i].length);
+  }
+  EXPECT_EQ(capacity / 2, alloc->get_free());
+  EXPECT_EQ(1.0, alloc->get_fragmentation(alloc_unit));
+
+  // and a single free extent is not fragmented at all
+  init_alloc(capacity, alloc_unit);
+  alloc->init_add_free(alloc_unit, capacity / 2);
+  EXPECT_EQ(0.0, alloc->get_fragmentation(alloc_unit));
+}
+
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "avl"));
 
 #else
 
@@ -0,0 +1,157 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Clone-heavy workload benchmark for bluestore.
+ *
+ * Mimics an rbd image under a snapshot schedule: a head object is
+ * cloned again and again, and small random overwrites land on the
+ * head between clones, each one dropping references on blobs shared
+ * with every earlier snapshot.  Reports overwrite latency per round and
+ * the shared blob bytes written to the kv store, with and without
+ * bluestore_shared_blob_ref_log.
+ */
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+#include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "global/global_init.h"
+#include "include/stringify.h"
+#include "include/utime.h"
+#include "os/ObjectStore.h"
+#include "os/bluestore/BlueStore.h"
+#include "store_test_fixture.h"
+
+#if GTEST_HAS_PARAM_TEST
+
+namespace {
+
+const coll_t cid;
+
+ghobject_t make_ghobject(const string& oid, snapid_t snap)
+{
+  return ghobject_t(hobject_t(sobject_t(oid, snap)));
+}
+
+} // anonymous namespace
+
+class CloneBench : public StoreTestFixture,
+		   public ::testing::WithParamInterface<const char*> {
+public:
+  CloneBench()
+    : StoreTestFixture("bluestore")
+  {}
+  void SetUp() override {
+    g_conf->set_val("bluestore_shared_blob_ref_log", GetParam());
+    g_conf->apply_changes(NULL);
+    StoreTestFixture::SetUp();
+    if (HasFailure()) {
+      return;
+    }
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+  }
+  void TearDown() override {
+    StoreTestFixture::TearDown();
+    g_conf->set_val("bluestore_shared_blob_ref_log", "false");
+    g_conf->apply_changes(NULL);
+  }
+
+  ObjectStore::Sequencer osr{"clone_bench"};
+
+  /// clone the head `rounds` times, with `writes` overwrites of
+  /// `write_size` bytes on the head after each clone
+  void run(uint64_t obj_size, unsigned rounds, unsigned writes,
+	   unsigned write_size);
+};
+
+void CloneBench::run(uint64_t obj_size, unsigned rounds, unsigned writes,
+		     unsigned write_size)
+{
+  std::mt19937_64 rng(0);
+  std::uniform_int_distribution<uint64_t> pos(0, obj_size / write_size - 1);
+  ghobject_t head = make_ghobject("rbd_data.0", CEPH_NOSNAP);
+  const PerfCounters *logger = store->get_perf_counters();
+
+  {
+    bufferlist bl;
+    bl.append(string(1024 * 1024, 'x'));
+    for (uint64_t off = 0; off < obj_size; off += bl.length()) {
+      ObjectStore::Transaction t;
+      t.write(cid, head, off, bl.length(), bl);
+      ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+    }
+  }
+
+  bufferlist data;
+  data.append(string(write_size, 'y'));
+  uint64_t full0 = logger->get(l_bluestore_shared_blob_full_bytes);
+  uint64_t delta0 = logger->get(l_bluestore_shared_blob_delta_bytes);
+  utime_t start = ceph_clock_now();
+  for (unsigned r = 1; r <= rounds; ++r) {
+    {
+      ObjectStore::Transaction t;
+      t.clone(cid, head, make_ghobject("rbd_data.0", r));
+      ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+    }
+    utime_t round_start = ceph_clock_now();
+    for (unsigned i = 0; i < writes; ++i) {
+      ObjectStore::Transaction t;
+      t.write(cid, head, pos(rng) * write_size, data.length(), data);
+      ASSERT_EQ(0, store->apply_transaction(&osr, std::move(t)));
+    }
+    utime_t lat = ceph_clock_now() - round_start;
+    if (r == 1 || r % 10 == 0 || r == rounds) {
+      std::cout << "  round " << r << ": "
+		<< lat.to_nsec() / 1000 / writes << " us/write" << std::endl;
+    }
+  }
+  utime_t elapsed = ceph_clock_now() - start;
+  std::cout << "ref_log=" << GetParam() << ": " << rounds << " clones, "
+	    << rounds * writes << " writes in " << elapsed << "s, "
+	    << "shared blob bytes written: full "
+	    << logger->get(l_bluestore_shared_blob_full_bytes) - full0
+	    << " delta "
+	    << logger->get(l_bluestore_shared_blob_delta_bytes) - delta0
+	    << std::endl;
+}
+
+TEST_P(CloneBench, snapshot_churn)
+{
+  run(4 * 1024 * 1024, 50, 200, 4096);
+}
+
+TEST_P(CloneBench, many_snapshots)
+{
+  run(4 * 1024 * 1024, 200, 20, 16384);
+}
+
+INSTANTIATE_TEST_CASE_P(
+  BlueStore,
+  CloneBench,
+  ::testing::Values("false", "true"));
+
+#else
+
+TEST(DummyTest, ValueParameterizedTestsAreNotSupportedOnThisPlatform) {}
+
+#endif
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  g_ceph_context->_conf->set_val("bluestore_block_size", "10240000000");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -29,6 +29,9 @@
 #if defined(HAVE_LIBAIO)
 #include "os/bluestore/BlueStore.h"
 #endif
+#if defined(HAVE_LIBURING)
+#include "os/bluestore/ioring.h"
+#endif
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -36,6 +39,8 @@
 #include "common/Cond.h"
 #include "common/errno.h"
 #include "include/stringify.h"
+#include "include/str_list.h"
+#include "include/scope_guard.h"
 #include "include/coredumpctl.h"
 
 #include "include/unordered_map.h"
@@ -5714,6 +5719,149 @@ TEST_P(StoreTestSpecificAUSize, Many4KWritesTest) {
   ASSERT_EQ(res_stat.allocated, max_object);
 }
 
+TEST_P(StoreTestSpecificAUSize, Many4KWritesIoRingTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bdev_ioring", "true");
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bdev_ioring", "false");
+  });
+  StartDeferred(0x10000);
+
+  // io_uring is used wherever the kernel offers it, libaio otherwise
+  string backend = "libaio";
+#if defined(HAVE_LIBURING)
+  if (ioring_queue_t::supported()) {
+    backend = "io_uring";
+  }
+#endif
+  map<string,string> pm;
+  store->collect_metadata(&pm);
+  ASSERT_EQ(backend, pm["bluestore_bdev_aio_backend"]);
+
+  store_statfs_t res_stat;
+  unsigned max_object = 4*1024*1024;
+
+  doMany4KWritesTest(store, 1, 1000, 4*1024*1024, 4*1024, 0, &res_stat);
+
+  ASSERT_LE(res_stat.stored, max_object);
+  ASSERT_EQ(res_stat.allocated, max_object);
+}
+
+TEST_P(StoreTest, AioMultiQueueReapTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  const unsigned num_queues = 4;
+  g_conf->set_val("bdev_aio_num_queues", stringify(num_queues));
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bdev_aio_num_queues", "1");
+  });
+  // the queues are set up when the device is opened
+  store->umount();
+  ASSERT_EQ(0, store->mount());
+
+  // the io of a sequencer is reaped from the queue its shard hint maps
+  // to, so one sequencer per queue should keep every queue busy
+  for (unsigned i = 0; i < num_queues; ++i) {
+    ObjectStore::Sequencer osr("test");
+    osr.shard_hint = spg_t(pg_t(i, 555));
+    coll_t cid(spg_t(pg_t(i, 555), shard_id_t::NO_SHARD));
+    ghobject_t hoid(hobject_t("multi_queue", "", CEPH_NOSNAP, 0, -1, ""));
+    {
+      ObjectStore::Transaction t;
+      t.create_collection(cid, 0);
+      ASSERT_EQ(0, apply_transaction(store, &osr, std::move(t)));
+    }
+    for (unsigned j = 0; j < 16; ++j) {
+      // large enough to be written directly rather than deferred
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(0x10000, 'a' + j));
+      t.write(cid, hoid, j * 0x10000, bl.length(), bl);
+      ASSERT_EQ(0, apply_transaction(store, &osr, std::move(t)));
+    }
+  }
+
+  // the main device is opened first, so its counters keep the plain
+  // name while bluefs' handle on the same file gets a suffix
+  g_ceph_context->get_perfcounters_collection()->with_counters(
+    [&](const PerfCountersCollection::CounterMap& by_path) {
+      for (unsigned i = 0; i < num_queues; ++i) {
+	auto p = by_path.find(
+	  "bdev-block.aio_queue_" + stringify(i) + "_reaped");
+	ASSERT_NE(by_path.end(), p);
+	ASSERT_LT(0u, p->second->u64.load());
+      }
+      ASSERT_EQ(by_path.end(), by_path.find(
+	"bdev-block.aio_queue_" + stringify(num_queues) + "_reaped"));
+    });
+}
+
+TEST_P(StoreTestSpecificAUSize, Many4KWritesKVPipelineTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bluestore_kv_sync_pipeline", "true");
+  g_conf->set_val("bluestore_kv_sync_target_lat", "0.01");
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bluestore_kv_sync_pipeline", "false");
+    g_conf->set_val("bluestore_kv_sync_target_lat", "0");
+  });
+  StartDeferred(0x10000);
+
+  store_statfs_t res_stat;
+  unsigned max_object = 4*1024*1024;
+
+  doMany4KWritesTest(store, 1, 1000, 4*1024*1024, 4*1024, 0, &res_stat);
+
+  ASSERT_LE(res_stat.stored, max_object);
+  ASSERT_EQ(res_stat.allocated, max_object);
+
+  // batches were handed to the commit thread, which synced them
+  const PerfCounters* logger = store->get_perf_counters();
+  uint64_t handoffs = logger->get_tavg_ms(l_bluestore_kv_sync_wait_lat).first;
+  uint64_t syncs = logger->get_tavg_ms(l_bluestore_kv_sync_lat).first;
+  ASSERT_LT(0u, handoffs);
+  ASSERT_LT(0u, syncs);
+  ASSERT_LE(syncs, handoffs);
+  // and a local sync is far below the target, so batches were held
+  // open to grow
+  ASSERT_LT(0u, logger->get_tavg_ms(l_bluestore_kv_batch_linger_lat).first);
+}
+
+TEST_P(StoreTestSpecificAUSize, Many4KWritesAdaptiveDeferredTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  // a deferred throttle that a few txcs fill past its midpoint, so the
+  // controller has to back the threshold off
+  g_conf->set_val("bluestore_prefer_deferred_size", "65536");
+  g_conf->set_val("bluestore_prefer_deferred_size_adaptive", "true");
+  g_conf->set_val("bluestore_prefer_deferred_size_adaptive_interval", "0");
+  g_conf->set_val("bluestore_throttle_bytes", "1048576");
+  g_conf->set_val("bluestore_throttle_deferred_bytes", "1048576");
+  g_conf->set_val("bluestore_throttle_cost_per_io", "400000");
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bluestore_prefer_deferred_size", "0");
+    g_conf->set_val("bluestore_prefer_deferred_size_adaptive", "false");
+    g_conf->set_val("bluestore_prefer_deferred_size_adaptive_interval", "1");
+    g_conf->set_val("bluestore_throttle_bytes", "67108864");
+    g_conf->set_val("bluestore_throttle_deferred_bytes", "134217728");
+    g_conf->set_val("bluestore_throttle_cost_per_io", "0");
+  });
+  StartDeferred(0x10000);
+
+  store_statfs_t res_stat;
+  unsigned max_object = 4*1024*1024;
+
+  doMany4KWritesTest(store, 1, 1000, 4*1024*1024, 4*1024, 0, &res_stat);
+
+  ASSERT_LE(res_stat.stored, max_object);
+  ASSERT_EQ(res_stat.allocated, max_object);
+
+  const PerfCounters* logger = store->get_perf_counters();
+  ASSERT_LT(0u, logger->get(l_bluestore_deferred_adapt_shrink));
+  ASSERT_GT(65536u, logger->get(l_bluestore_deferred_adapt_size));
+}
+
 TEST_P(StoreTestSpecificAUSize, Many4KWritesNoCSumTest) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -6382,6 +6530,756 @@ TEST_P(StoreTestSpecificAUSize, SmallWriteOnShardedExtents) {
   g_conf->set_val("bluestore_csum_type", "crc32c");
 }
 
+TEST_P(StoreTestSpecificAUSize, AllocSnapshotTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_alloc_snapshot", "true");
+  g_conf->set_val("bluestore_alloc_snapshot_region_size", "1048576");
+  StartDeferred(0x10000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  const unsigned obj_size = 0x40000;
+  auto obj = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  };
+  auto write_objs = [&](unsigned from, unsigned to) {
+    for (unsigned i = from; i < to; ++i) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(std::string(obj_size, 'a' + i));
+      t.write(cid, obj(i), 0, bl.length(), bl, 0);
+      r = apply_transaction(store, &osr, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+  };
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  write_objs(0, 10);
+
+  // snapshot written at umount, loaded at mount
+  store->umount();
+  store->mount();
+
+  write_objs(10, 20);
+  for (unsigned i = 0; i < 5; ++i) {
+    ObjectStore::Transaction t;
+    t.remove(cid, obj(i));
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  // leave the old snapshot in place, as if we crashed; mount has to
+  // replay the regions dirtied since
+  g_conf->set_val("bluestore_alloc_snapshot", "false");
+  store->umount();
+  g_conf->set_val("bluestore_alloc_snapshot", "true");
+  store->mount();
+
+  // new allocations must not land on live data
+  write_objs(20, 30);
+  for (unsigned i = 5; i < 30; ++i) {
+    bufferlist bl, expected;
+    expected.append(std::string(obj_size, 'a' + i));
+    r = store->read(cid, obj(i), 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 5; i < 30; ++i) {
+      t.remove(cid, obj(i));
+    }
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_alloc_snapshot", "false");
+  g_conf->set_val("bluestore_alloc_snapshot_region_size", "1073741824");
+}
+
+TEST_P(StoreTestSpecificAUSize, DecompressedCacheTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_compression_algorithm", "snappy");
+  g_conf->set_val("bluestore_compression_mode", "force");
+  g_conf->set_val("bluestore_cache_decompressed_size", "1048576");
+  StartDeferred(0x10000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x20000;
+  // keep the BufferSpace out of the way
+  const uint32_t flags = CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
+
+  auto write_obj = [&](char c) {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    for (unsigned i = 0; i < obj_size / 16; ++i) {
+      bl.append(std::string(15, c));
+      bl.append('0' + i % 10);
+    }
+    t.write(cid, hoid, 0, bl.length(), bl, flags);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  };
+  auto check_read = [&](char c, uint64_t off) {
+    bufferlist bl;
+    r = store->read(cid, hoid, off, 0x1000, bl, flags);
+    ASSERT_EQ(r, 0x1000);
+    ASSERT_EQ(c, bl[0]);
+    ASSERT_EQ(c, bl[0x1000 - 2]);
+  };
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  write_obj('a');
+
+  uint64_t hits = logger->get(l_bluestore_decompressed_cache_hits);
+  uint64_t misses = logger->get(l_bluestore_decompressed_cache_misses);
+  check_read('a', 0);
+  ASSERT_EQ(misses + 1, logger->get(l_bluestore_decompressed_cache_misses));
+  check_read('a', 0x3000);
+  ASSERT_EQ(hits + 1, logger->get(l_bluestore_decompressed_cache_hits));
+
+  // the old blob is released; its cached contents must not be served
+  write_obj('b');
+  misses = logger->get(l_bluestore_decompressed_cache_misses);
+  check_read('b', 0x3000);
+  ASSERT_EQ(misses + 1, logger->get(l_bluestore_decompressed_cache_misses));
+
+  // disabling drops everything
+  g_conf->set_val("bluestore_cache_decompressed_size", "0");
+  g_conf->apply_changes(NULL);
+  hits = logger->get(l_bluestore_decompressed_cache_hits);
+  check_read('b', 0);
+  ASSERT_EQ(hits, logger->get(l_bluestore_decompressed_cache_hits));
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_compression_mode", "none");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, DefragTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // tiny blobs so a sequential write comes out fragmented
+  g_conf->set_val("bluestore_max_blob_size", "4096");
+  g_conf->set_val("bluestore_defrag_interval", "0.1");
+  g_conf->set_val("bluestore_defrag_sleep", "0");
+  g_conf->set_val("bluestore_defrag_min_shards", "0");
+  g_conf->set_val("bluestore_defrag_min_blobs", "8");
+  StartDeferred(0x1000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x40000;
+  bufferlist data;
+  for (unsigned i = 0; i < obj_size / 0x1000; ++i) {
+    data.append(std::string(0x1000, 'a' + i % 26));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  g_conf->set_val("bluestore_max_blob_size", "65536");
+  g_conf->set_val("bluestore_defrag", "true");
+  g_conf->apply_changes(NULL);
+
+  uint64_t blobs_removed = logger->get(l_bluestore_defrag_blobs_removed);
+  for (unsigned i = 0;
+       i < 100 && logger->get(l_bluestore_defrag_objects) == 0;
+       ++i) {
+    usleep(100000);
+  }
+  g_conf->set_val("bluestore_defrag", "false");
+  g_conf->apply_changes(NULL);
+  ASSERT_EQ(1u, logger->get(l_bluestore_defrag_objects));
+  ASSERT_EQ(obj_size, logger->get(l_bluestore_defrag_bytes));
+  ASSERT_LT(blobs_removed, logger->get(l_bluestore_defrag_blobs_removed));
+
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_defrag_interval", "60");
+  g_conf->set_val("bluestore_defrag_sleep", ".1");
+  g_conf->set_val("bluestore_defrag_min_shards", "4");
+  g_conf->set_val("bluestore_defrag_min_blobs", "16");
+  g_conf->set_val("bluestore_max_blob_size", "0");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, ShardDeltaTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_extent_map_shard_max_size", "300");
+  g_conf->set_val("bluestore_extent_map_shard_target_size", "150");
+  g_conf->set_val("bluestore_extent_map_shard_min_size", "60");
+  g_conf->set_val("bluestore_extent_map_shard_delta", "true");
+  StartDeferred(0x1000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned chunks = 64;
+  const unsigned obj_size = chunks * 0x2000;
+  bufferlist expected;
+  expected.append_zero(obj_size);
+  auto write_chunk = [&](unsigned i, char c) {
+    bufferlist bl;
+    bl.append(std::string(0x1000, c));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, i * 0x2000, bl.length(), bl, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected.copy_in(i * 0x2000, bl.length(), bl.c_str());
+  };
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.touch(cid, hoid);
+    t.truncate(cid, hoid, obj_size);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // a hole between every chunk keeps them in separate extents
+  for (unsigned i = 0; i < chunks; ++i) {
+    write_chunk(i, 'a' + i % 26);
+  }
+  uint64_t delta_bytes = logger->get(l_bluestore_onode_shard_delta_bytes);
+  for (unsigned i = 0; i < 16; ++i) {
+    write_chunk(i * 3 % chunks, 'A' + i);
+  }
+  ASSERT_LT(delta_bytes, logger->get(l_bluestore_onode_shard_delta_bytes));
+  // rewriting one shard over and over eventually falls back to a full
+  // write rather than growing its chain of merge operands forever
+  uint64_t full_bytes = logger->get(l_bluestore_onode_shard_full_bytes);
+  for (unsigned i = 0; i < 64; ++i) {
+    write_chunk(0, 'a' + i % 26);
+  }
+  ASSERT_LT(full_bytes, logger->get(l_bluestore_onode_shard_full_bytes));
+
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_extent_map_shard_max_size", "1200");
+  g_conf->set_val("bluestore_extent_map_shard_target_size", "500");
+  g_conf->set_val("bluestore_extent_map_shard_min_size", "150");
+  g_conf->set_val("bluestore_extent_map_shard_delta", "false");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, SharedBlobRefLogTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_shared_blob_ref_log", "true");
+  StartDeferred(0x1000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x40000;
+  const unsigned clones = 4;
+  vector<ghobject_t> oids;
+  vector<bufferlist> expected(clones + 1);
+  for (unsigned i = 0; i <= clones; ++i) {
+    oids.push_back(ghobject_t(hobject_t(sobject_t(
+      "Object " + stringify(i), CEPH_NOSNAP))));
+  }
+  for (unsigned i = 0; i < obj_size / 0x1000; ++i) {
+    expected[0].append(std::string(0x1000, 'a' + i % 26));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, oids[0], 0, obj_size, expected[0], 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // the first clone shares the blobs, the rest take more references
+  uint64_t delta_bytes = logger->get(l_bluestore_shared_blob_delta_bytes);
+  for (unsigned i = 1; i <= clones; ++i) {
+    ObjectStore::Transaction t;
+    t.clone(cid, oids[0], oids[i]);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected[i] = expected[0];
+  }
+  ASSERT_LT(delta_bytes, logger->get(l_bluestore_shared_blob_delta_bytes));
+
+  // overwrites drop references
+  delta_bytes = logger->get(l_bluestore_shared_blob_delta_bytes);
+  for (unsigned i = 0; i <= clones; ++i) {
+    bufferlist bl;
+    bl.append(std::string(0x1000, 'A' + i));
+    uint64_t off = i * 0x9000 % obj_size;
+    ObjectStore::Transaction t;
+    t.write(cid, oids[i], off, bl.length(), bl, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    expected[i].copy_in(off, bl.length(), bl.c_str());
+  }
+  ASSERT_LT(delta_bytes, logger->get(l_bluestore_shared_blob_delta_bytes));
+
+  auto check = [&]() {
+    for (unsigned i = 0; i <= clones; ++i) {
+      bufferlist bl;
+      r = store->read(cid, oids[i], 0, obj_size, bl);
+      ASSERT_EQ(r, (int)obj_size);
+      ASSERT_TRUE(bl_eq(expected[i], bl));
+    }
+  };
+  check();
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  check();
+
+  // removing all but one leaves nothing behind for fsck to find
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < clones; ++i) {
+      t.remove(cid, oids[i]);
+    }
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  {
+    bufferlist bl;
+    r = store->read(cid, oids[clones], 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(expected[clones], bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, oids[clones]);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_shared_blob_ref_log", "false");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, TieringTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_block_fast_size", stringify(64 << 20));
+  g_conf->set_val("bluestore_block_fast_create", "true");
+  g_conf->set_val("bluestore_tier_cold_age", "0");
+  g_conf->set_val("bluestore_tier_interval", "0.1");
+  g_conf->set_val("bluestore_tier_sleep", "0");
+  StartDeferred(0x1000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x40000;
+  bufferlist data;
+  for (unsigned i = 0; i < obj_size / 0x1000; ++i) {
+    data.append(std::string(0x1000, 'a' + i % 26));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(obj_size, logger->get(l_bluestore_tier_fast_bytes));
+
+  for (unsigned i = 0;
+       i < 100 && logger->get(l_bluestore_tier_demoted_objects) == 0;
+       ++i) {
+    usleep(100000);
+  }
+  ASSERT_EQ(1u, logger->get(l_bluestore_tier_demoted_objects));
+  ASSERT_EQ(obj_size, logger->get(l_bluestore_tier_demoted_bytes));
+
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_block_fast_size", "0");
+  g_conf->set_val("bluestore_block_fast_create", "false");
+  g_conf->set_val("bluestore_tier_cold_age", "3600");
+  g_conf->set_val("bluestore_tier_interval", "60");
+  g_conf->set_val("bluestore_tier_sleep", ".01");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, TieringDeferredOverwrite) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // small in-place overwrites go through the deferred path; demotion
+  // must not free extents those writes still target
+  g_conf->set_val("bluestore_block_fast_size", stringify(64 << 20));
+  g_conf->set_val("bluestore_block_fast_create", "true");
+  g_conf->set_val("bluestore_tier_cold_age", "0");
+  g_conf->set_val("bluestore_tier_interval", "0.01");
+  g_conf->set_val("bluestore_tier_sleep", "0");
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bluestore_block_fast_size", "0");
+    g_conf->set_val("bluestore_block_fast_create", "false");
+    g_conf->set_val("bluestore_tier_cold_age", "3600");
+    g_conf->set_val("bluestore_tier_interval", "60");
+    g_conf->set_val("bluestore_tier_sleep", ".01");
+    g_conf->apply_changes(NULL);
+  });
+  StartDeferred(0x1000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x40000;
+  bufferlist data;
+  data.append(std::string(obj_size, 'a'));
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  for (unsigned i = 0; i < 200; ++i) {
+    unsigned off = (i * 0x1100) % (obj_size - 0x100);
+    bufferlist bl;
+    bl.append(std::string(0x100, 'b' + i % 24));
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, off, bl.length(), bl, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    bufferlist newdata, tail;
+    newdata.substr_of(data, 0, off);
+    newdata.append(bl);
+    tail.substr_of(data, off + bl.length(), obj_size - off - bl.length());
+    newdata.append(tail);
+    data.swap(newdata);
+    usleep(1000);
+  }
+  ASSERT_LE(1u, logger->get(l_bluestore_tier_demoted_objects));
+
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, obj_size, bl);
+    ASSERT_EQ(r, (int)obj_size);
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, TieringWithoutFastDevice) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // mkfs and mount must work when block.fast was never set up
+  StartDeferred(0x1000);
+  ASSERT_NE(0, ::access((string(GetParam()) +
+			 ".test_temp_dir/block.fast").c_str(), F_OK));
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  bufferlist data;
+  data.append(std::string(0x10000, 'a'));
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(0u, logger->get(l_bluestore_tier_fast_bytes));
+
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  ASSERT_EQ(store->mount(), 0);
+  {
+    bufferlist bl;
+    r = store->read(cid, hoid, 0, data.length(), bl);
+    ASSERT_EQ(r, (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, ReadaheadTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  g_conf->set_val("bluestore_readahead_max_bytes", "262144");
+  g_conf->set_val("bluestore_readahead_min_bytes", "65536");
+  g_conf->set_val("bluestore_readahead_trigger_requests", "2");
+  StartDeferred(0x10000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 0x400000;
+  const unsigned chunk = 0x10000;
+  bufferlist data;
+  for (unsigned i = 0; i < obj_size / 0x1000; ++i) {
+    data.append(std::string(0x1000, 'a' + i % 26));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // start with nothing cached
+  store->umount();
+  store->mount();
+
+  for (unsigned off = 0; off < obj_size; off += chunk) {
+    if (off == obj_size / 2) {
+      // overwrite a chunk that has likely been prefetched already
+      bufferlist bl;
+      bl.append(std::string(chunk, 'Z'));
+      data.copy_in(off + chunk, chunk, bl.c_str());
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, off + chunk, chunk, bl, 0);
+      r = apply_transaction(store, &osr, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    bufferlist bl, expected;
+    r = store->read(cid, hoid, off, chunk, bl);
+    ASSERT_EQ(r, (int)chunk);
+    expected.substr_of(data, off, chunk);
+    ASSERT_TRUE(bl_eq(expected, bl));
+    // give the prefetch a moment to land
+    usleep(10000);
+  }
+  ASSERT_LT(0u, logger->get(l_bluestore_readahead_ios));
+  ASSERT_LT(0u, logger->get(l_bluestore_readahead_hit_bytes));
+  ASSERT_GE(logger->get(l_bluestore_readahead_bytes),
+	    logger->get(l_bluestore_readahead_hit_bytes));
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_readahead_max_bytes", "0");
+  g_conf->set_val("bluestore_readahead_min_bytes", "131072");
+  g_conf->set_val("bluestore_readahead_trigger_requests", "3");
+  g_conf->apply_changes(NULL);
+}
+
+TEST_P(StoreTestSpecificAUSize, PMEMLogTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  // a regular file emulates the pmem region
+  g_conf->set_val("bluestore_block_pmem_size", stringify(1 << 20));
+  g_conf->set_val("bluestore_block_pmem_create", "true");
+  g_conf->set_val("bluestore_prefer_deferred_size", "65536");
+  StartDeferred(0x10000);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned num_objs = 200;
+  auto oid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  };
+  auto data = [](unsigned i) {
+    bufferlist bl;
+    bl.append(std::string(0x1000, 'a' + i % 26));
+    return bl;
+  };
+
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // small writes are deferred, so their data goes through the log too,
+  // enough of them to fill it past the checkpoint ratio
+  for (unsigned i = 0; i < num_objs; ++i) {
+    bufferlist bl = data(i);
+    ObjectStore::Transaction t;
+    t.write(cid, oid(i), 0, bl.length(), bl, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_LT(num_objs * 0x1000u, logger->get(l_bluestore_pmem_log_bytes));
+  ASSERT_LT(0u, logger->get(l_bluestore_pmem_log_checkpoints));
+
+  store->umount();
+  ASSERT_EQ(store->fsck(false), 0);
+  store->mount();
+  for (unsigned i = 0; i < num_objs; ++i) {
+    bufferlist bl;
+    r = store->read(cid, oid(i), 0, 0x1000, bl);
+    ASSERT_EQ(r, 0x1000);
+    bufferlist expected = data(i);
+    ASSERT_TRUE(bl_eq(expected, bl));
+  }
+
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i < num_objs; ++i) {
+      t.remove(cid, oid(i));
+    }
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_block_pmem_size", "0");
+  g_conf->set_val("bluestore_block_pmem_create", "false");
+  g_conf->set_val("bluestore_prefer_deferred_size", "0");
+  g_conf->apply_changes(NULL);
+}
+
 #endif //#if defined(HAVE_LIBAIO)
 
 TEST_P(StoreTest, KVDBHistogramTest) {
@@ -12,6 +12,8 @@
 #include "common/ceph_argparse.h"
 #include "include/stringify.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
+#include "include/scope_guard.h"
 #include <gtest/gtest.h>
 
 #include "os/bluestore/BlueFS.h"
@@ -101,6 +103,70 @@ TEST(BlueFS, write_read) {
   rm_temp_bdev(fn);
 }
 
+TEST(BlueFS, read_prefetch) {
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  uint64_t file_size = 4 * 1048576;
+  char *data = gen_buffer(file_size);
+  {
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.mkdir("dir"));
+    ASSERT_EQ(0, fs.open_for_write("dir", "file", &h, false));
+    h->append(data, file_size);
+    fs.fsync(h);
+    fs.close_writer(h);
+  }
+  {
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir", "file", &h));
+    uint64_t block_size = fs.get_block_size();
+    BlueFS::FileReaderBuffer buf(1048576);
+    char out[65536];
+
+    // a seek shrinks the window to one block...
+    ASSERT_EQ(1000, fs.read(h, &buf, 12345, 1000, NULL, out));
+    ASSERT_EQ(0, memcmp(data + 12345, out, 1000));
+    ASSERT_EQ(block_size, buf.cur_prefetch);
+
+    // ...and sequential reads grow it back
+    uint64_t off = 13345;
+    for (unsigned i = 0; i < 32; ++i) {
+      ASSERT_EQ(1000, fs.read(h, &buf, off, 1000, NULL, out));
+      ASSERT_EQ(0, memcmp(data + off, out, 1000));
+      off += 1000;
+    }
+    ASSERT_EQ(1048576u, buf.cur_prefetch);
+
+    const PerfCounters *logger = fs.get_perf_counters();
+    ASSERT_TRUE(logger);
+    ASSERT_EQ(0u, logger->get(l_bluefs_read_direct_bytes));
+    uint64_t prefetch_bytes = logger->get(l_bluefs_read_prefetch_bytes);
+    ASSERT_GT(prefetch_bytes, 0u);
+
+    // reads at least as large as the window bypass the prefetch buffer
+    buf.max_prefetch = 4096;
+    ASSERT_EQ(65536, fs.read(h, &buf, 2 * 1048576 + 7, 65536, NULL, out));
+    ASSERT_EQ(0, memcmp(data + 2 * 1048576 + 7, out, 65536));
+    ASSERT_EQ(65536u, logger->get(l_bluefs_read_direct_bytes));
+    ASSERT_EQ(prefetch_bytes, logger->get(l_bluefs_read_prefetch_bytes));
+
+    // clipped at eof
+    ASSERT_EQ(100, fs.read(h, &buf, file_size - 100, 65536, NULL, out));
+    ASSERT_EQ(0, memcmp(data + file_size - 100, out, 100));
+    ASSERT_EQ(65536u, logger->get(l_bluefs_read_direct_bytes));
+    delete h;
+  }
+  delete[] data;
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 TEST(BlueFS, small_appends) {
   uint64_t size = 1048576 * 128;
   string fn = get_temp_bdev(size);
@@ -133,6 +199,48 @@ TEST(BlueFS, small_appends) {
   rm_temp_bdev(fn);
 }
 
+TEST(BlueFS, aio_multi_queue_ioc) {
+  // an ioc submitted several times before aio_wait() must keep its
+  // completions on one queue
+  g_ceph_context->_conf->set_val("bdev_aio_num_queues", "4");
+  g_ceph_context->_conf->apply_changes(NULL);
+  auto restore = make_scope_guard([] {
+    g_ceph_context->_conf->set_val("bdev_aio_num_queues", "1");
+    g_ceph_context->_conf->apply_changes(NULL);
+  });
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  {
+    std::unique_ptr<BlockDevice> bdev(
+      BlockDevice::create(g_ceph_context, fn, NULL, NULL));
+    ASSERT_EQ(0, bdev->open(fn));
+    for (unsigned n = 0; n < 8; ++n) {
+      IOContext *ioc = new IOContext(g_ceph_context, NULL);
+      int queue = -1;
+      for (unsigned i = 0; i < 64; ++i) {
+	bufferlist bl;
+	bufferptr bp = buffer::create_page_aligned(4096);
+	bp.zero();
+	bl.append(bp);
+	ASSERT_EQ(0, bdev->aio_write(1048576 + (n * 64 + i) * 4096, bl, ioc,
+				     false));
+	bdev->aio_submit(ioc);
+	if (queue < 0) {
+	  queue = ioc->io_queue;
+	}
+	ASSERT_EQ(queue, ioc->io_queue);
+      }
+      ASSERT_LE(0, queue);
+      ASSERT_GT(4, queue);
+      ioc->aio_wait();
+      ASSERT_EQ(0, ioc->num_running.load());
+      bdev->queue_reap_ioc(ioc);
+    }
+    bdev->close();
+  }
+  rm_temp_bdev(fn);
+}
+
 #define ALLOC_SIZE 4096
 
 void write_data(BlueFS &fs, uint64_t rationed_bytes)
@@ -240,6 +348,46 @@ void join_all(std::vector<std::thread>& v)
     std::for_each(v.begin(),v.end(),do_join);
 }
 
+TEST(BlueFS, small_appends_multi_queue) {
+  g_ceph_context->_conf->set_val("bdev_aio_num_queues", "4");
+  g_ceph_context->_conf->apply_changes(NULL);
+  auto restore = make_scope_guard([] {
+    g_ceph_context->_conf->set_val("bdev_aio_num_queues", "1");
+    g_ceph_context->_conf->apply_changes(NULL);
+  });
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+  std::vector<std::thread> writers;
+  for (unsigned t = 0; t < 4; ++t) {
+    writers.push_back(std::thread([&fs, t] {
+      BlueFS::FileWriter *h;
+      ASSERT_EQ(0, fs.open_for_write("dir", "file." + stringify(t), &h,
+				     false));
+      for (unsigned i = 0; i < 1000; ++i) {
+	h->append("abcdeabcdeabcdeabcdeabcdeabc", 23);
+	if (i % 10 == 0) {
+	  fs.flush(h);
+	}
+	if (i % 100 == 0) {
+	  ASSERT_EQ(0, fs.fsync(h));
+	}
+      }
+      ASSERT_EQ(0, fs.fsync(h));
+      fs.close_writer(h);
+    }));
+  }
+  join_all(writers);
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 #define NUM_WRITERS 3
 #define NUM_SYNC_THREADS 1
 
@@ -526,6 +674,94 @@ TEST(BlueFS, test_compaction_async) {
   rm_temp_bdev(fn);
 }
 
+void churn_files(BlueFS &fs, int n, unsigned count)
+{
+  string dir = "churn." + stringify(n);
+  ASSERT_EQ(0, fs.mkdir(dir));
+  for (unsigned i = 0; i < count; ++i) {
+    BlueFS::FileWriter *h;
+    string file = "file." + stringify(i);
+    ASSERT_EQ(0, fs.open_for_write(dir, file, &h, false));
+    bufferlist bl;
+    bl.append_zero(ALLOC_SIZE * (1 + i % 4));
+    h->append(bl.c_str(), bl.length());
+    ASSERT_EQ(0, fs.fsync(h));
+    fs.close_writer(h);
+    if (i % 3 == 0) {
+      ASSERT_EQ(0, fs.unlink(dir, file));
+    }
+  }
+}
+
+void compact_until_done(BlueFS &fs)
+{
+  // each compaction strands its old log space until the next
+  // sync_metadata, so keep the number bounded
+  for (int i = 0; i < 10 && !writes_done; ++i) {
+    fs.sync_metadata();
+    fs.compact_log();
+    usleep(100000);
+  }
+}
+
+TEST(BlueFS, test_compaction_async_concurrent) {
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  g_ceph_context->_conf->set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf->set_val(
+    "bluefs_compact_log_sync",
+    "false");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  {
+    // namespace changes race with the unlocked part of each compaction
+    writes_done = false;
+    std::vector<std::thread> write_threads;
+    for (int i=0; i<NUM_WRITERS; i++) {
+      write_threads.push_back(std::thread(churn_files, std::ref(fs), i, 300));
+    }
+    std::thread compact_thread(compact_until_done, std::ref(fs));
+    join_all(write_threads);
+    writes_done = true;
+    compact_thread.join();
+  }
+  map<string,uint64_t> before;
+  for (int i=0; i<NUM_WRITERS; i++) {
+    string dir = "churn." + stringify(i);
+    vector<string> ls;
+    ASSERT_EQ(0, fs.readdir(dir, &ls));
+    for (auto& f : ls) {
+      if (f == "." || f == "..")
+	continue;
+      uint64_t fsize;
+      utime_t mtime;
+      ASSERT_EQ(0, fs.stat(dir, f, &fsize, &mtime));
+      before[dir + "/" + f] = fsize;
+    }
+  }
+  ASSERT_EQ((size_t)NUM_WRITERS * 200, before.size());
+  fs.umount();
+
+  ASSERT_EQ(0, fs.mount());
+  for (auto& p : before) {
+    size_t pos = p.first.find('/');
+    uint64_t fsize;
+    utime_t mtime;
+    ASSERT_EQ(0, fs.stat(p.first.substr(0, pos), p.first.substr(pos + 1),
+			 &fsize, &mtime));
+    ASSERT_EQ(p.second, fsize);
+  }
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   string fn = get_temp_bdev(size);
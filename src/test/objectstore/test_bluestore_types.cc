@@ -10,8 +10,10 @@
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
 #include "global/global_context.h"
+#include "include/scope_guard.h"
 
 #include <sstream>
+#include <thread>
 
 #define _STR(x) #x
 #define STRINGIFY(x) _STR(x)
@@ -306,6 +308,58 @@ TEST(bluestore_blob_t, calc_csum)
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_fragmented)
+{
+  // 40 x 4k blocks spread over buffers whose boundaries fall both on
+  // and between csum blocks, so both batched and per-block paths run.
+  const unsigned block = 4096;
+  const unsigned blocks = 40;
+  bufferlist bl;
+  unsigned sizes[] = { block * 17, 100, block * 3 - 100, 5000,
+		       block * 20 - 5000 };
+  unsigned pos = 0;
+  for (auto len : sizes) {
+    bufferptr bp(len);
+    for (unsigned i = 0; i < len; ++i)
+      bp.c_str()[i] = (pos + i) * 13 >> 3;
+    bl.append(bp);
+    pos += len;
+  }
+  ASSERT_EQ(blocks * block, bl.length());
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX;
+       ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	 << std::endl;
+    bluestore_blob_t b, one;
+    b.init_csum(csum_type, 12, bl.length());
+    one.init_csum(csum_type, 12, bl.length());
+    b.calc_csum(0, bl);
+    for (unsigned i = 0; i < blocks; ++i) {
+      bufferlist t;
+      t.substr_of(bl, i * block, block);
+      t.rebuild();
+      one.calc_csum(i * block, t);
+    }
+    for (unsigned i = 0; i < blocks; ++i) {
+      ASSERT_EQ(one.get_csum_item(i), b.get_csum_item(i));
+    }
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, b.verify_csum(0, bl, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+
+    bufferlist bad;
+    bad.append(bl);
+    bad.rebuild();
+    bad.c_str()[block * 33 + 5] ^= 1;
+    ASSERT_EQ(-1, b.verify_csum(0, bad, &bad_off, &bad_csum));
+    ASSERT_EQ((int)(block * 33), bad_off);
+  }
+}
+
 TEST(bluestore_blob_t, csum_bench)
 {
   bufferlist bl;
@@ -896,6 +950,34 @@ TEST(bluestore_blob_t, prune_tail)
   ASSERT_FALSE(a.can_prune_tail());
 }
 
+TEST(bluestore_blob_t, mempool)
+{
+  // a single pextent lives inside the blob itself
+  size_t items = mempool::bluestore_cache_other::allocated_items();
+  bluestore_blob_t a;
+  a.allocated_test(bluestore_pextent_t(0x10000, 0x2000));
+  ASSERT_EQ(items, mempool::bluestore_cache_other::allocated_items());
+  a.allocated_test(bluestore_pextent_t(0x20000, 0x2000));
+  ASSERT_LT(items, mempool::bluestore_cache_other::allocated_items());
+
+  // decoded checksums are charged to the cache as well
+  a.init_csum(Checksummer::CSUM_CRC32C, 12, 0x4000);
+  bufferlist bl;
+  {
+    size_t len = 0;
+    a.bound_encode(len, 2);
+    auto app = bl.get_contiguous_appender(len);
+    a.encode(app, 2);
+  }
+  size_t bytes = mempool::bluestore_cache_other::allocated_bytes();
+  bluestore_blob_t b;
+  auto p = bl.front().begin_deep();
+  b.decode(p, 2);
+  ASSERT_EQ(a.csum_data.length(), b.csum_data.length());
+  ASSERT_LE(bytes + b.csum_data.length(),
+	    mempool::bluestore_cache_other::allocated_bytes());
+}
+
 TEST(Blob, split)
 {
   BlueStore store(g_ceph_context, "", 4096);
@@ -1443,6 +1525,115 @@ TEST(GarbageCollector, BasicTest)
   }
  }
 
+TEST(OnodeSpace, trim_second_chance)
+{
+  const char *types[] = {"lru", "2q"};
+  for (auto type : types) {
+    BlueStore store(g_ceph_context, "", 4096);
+    BlueStore::Cache *cache = BlueStore::Cache::create(
+      g_ceph_context, type, NULL);
+    BlueStore::CollectionRef coll(
+      new BlueStore::Collection(&store, cache, coll_t()));
+
+    // lru is now 3, 2, 1, 0 (0 is the oldest)
+    vector<ghobject_t> oids;
+    vector<BlueStore::Onode*> onodes;
+    for (unsigned i = 0; i < 4; ++i) {
+      ghobject_t oid(hobject_t(sobject_t(stringify(i), CEPH_NOSNAP)));
+      BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), oid, ""));
+      coll->onode_map.add(oid, o);
+      oids.push_back(oid);
+      onodes.push_back(o.get());
+    }
+
+    // a concurrent lookup hit the oldest onode; trim should promote it
+    // and evict the next two instead.
+    onodes[0]->referenced = true;
+    {
+      std::lock_guard<std::recursive_mutex> l(cache->lock);
+      cache->_trim(2, 0);
+      ASSERT_EQ(2u, cache->_get_num_onodes());
+    }
+    ASSERT_FALSE(onodes[0]->referenced.load());
+    for (unsigned i = 0; i < 4; ++i) {
+      bool present = coll->onode_map.map_any(
+	[&](BlueStore::OnodeRef o) {
+	  return o->oid == oids[i];
+	});
+      ASSERT_EQ(i == 0 || i == 3, present);
+    }
+    coll->onode_map.clear();
+  }
+}
+
+TEST(OnodeSpace, trim_races_lookup)
+{
+  g_conf->set_val("bluestore_cache_concurrent_lookup", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+  auto restore = make_scope_guard([] {
+    g_conf->set_val("bluestore_cache_concurrent_lookup", "false");
+    g_ceph_context->_conf->apply_changes(NULL);
+  });
+
+  const char *types[] = {"lru", "2q"};
+  for (auto type : types) {
+    BlueStore store(g_ceph_context, "", 4096);
+    BlueStore::Cache *cache = BlueStore::Cache::create(
+      g_ceph_context, type, NULL);
+    BlueStore::CollectionRef coll(
+      new BlueStore::Collection(&store, cache, coll_t()));
+
+    const unsigned num_oids = 16;
+    vector<ghobject_t> oids;
+    for (unsigned i = 0; i < num_oids; ++i) {
+      oids.push_back(ghobject_t(hobject_t(sobject_t(stringify(i),
+						     CEPH_NOSNAP))));
+    }
+
+    // keep re-adding whatever was evicted and trimming down to a few
+    // onodes, while another thread looks them up without the cache lock
+    std::atomic<bool> stop = {false};
+    std::thread trimmer([&] {
+      while (!stop) {
+	for (auto& oid : oids) {
+	  BlueStore::OnodeRef o(new BlueStore::Onode(coll.get(), oid, ""));
+	  coll->onode_map.add(oid, o);
+	}
+	std::lock_guard<std::recursive_mutex> l(cache->lock);
+	cache->_trim(2, 0);
+      }
+    });
+
+    unsigned hits = 0, wrong = 0, evicted = 0;
+    for (unsigned n = 0; n < 100000; ++n) {
+      const ghobject_t& oid = oids[n % num_oids];
+      BlueStore::OnodeRef o = coll->onode_map.lookup(oid);
+      if (!o) {
+	continue;
+      }
+      ++hits;
+      if (o->oid != oid) {
+	++wrong;
+      }
+      // trim must not evict an onode a lookup has pinned, even if the
+      // lookup landed after trim decided it was unpinned
+      bool present = coll->onode_map.map_any(
+	[&](BlueStore::OnodeRef p) {
+	  return p == o;
+	});
+      if (!present) {
+	++evicted;
+      }
+    }
+    stop = true;
+    trimmer.join();
+    ASSERT_GT(hits, 0u);
+    ASSERT_EQ(0u, wrong);
+    ASSERT_EQ(0u, evicted);
+    coll->onode_map.clear();
+  }
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -308,6 +308,98 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, ColumnFamilies) {
+  shared_ptr<KeyValueDB::MergeOperator> p(new AppendMOP);
+  db->set_merge_operator("A", p);
+  vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("A", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("C", "write_buffer_size=1048576"));
+  int r = db->create_and_open(cout, cfs);
+  if (r == -EOPNOTSUPP)
+    return; // No column families for this database type
+  ASSERT_EQ(0, r);
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist v;
+    v.append(string("v"));
+    t->set("A", "a1", v);
+    t->set("A", "a2", v);
+    t->merge("A", "a3", v);
+    t->set("B", "b1", v);
+    t->set("C", "c1", v);
+    t->set("C", "c2", v);
+    t->set("D", "d1", v);
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkey("C", "c2");
+    db->submit_transaction_sync(t);
+  }
+  fini();
+
+  // families must be found again without being named
+  init();
+  db->set_merge_operator("A", p);
+  ASSERT_EQ(0, db->open(cout));
+  {
+    bufferlist v;
+    ASSERT_EQ(0, db->get("A", "a3", &v));
+    ASSERT_EQ(tostr(v), "?v");
+    v.clear();
+    ASSERT_EQ(0, db->get("C", "c1", &v));
+    v.clear();
+    ASSERT_EQ(-ENOENT, db->get("C", "c2", &v));
+  }
+  {
+    KeyValueDB::Iterator it = db->get_iterator("A");
+    vector<string> keys;
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      keys.push_back(it->key());
+    }
+    ASSERT_EQ(vector<string>({"a1", "a2", "a3"}), keys);
+    it->lower_bound("a2");
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("a2", it->key());
+    it->upper_bound("a3");
+    ASSERT_FALSE(it->valid());
+  }
+  {
+    // the whole keyspace reads as if there were a single family
+    vector<pair<string,string>> expected = {
+      {"A", "a1"}, {"A", "a2"}, {"A", "a3"}, {"B", "b1"}, {"C", "c1"},
+      {"D", "d1"}};
+    KeyValueDB::WholeSpaceIterator it = db->get_iterator();
+    vector<pair<string,string>> keys;
+    for (it->seek_to_first(); it->valid(); it->next()) {
+      keys.push_back(it->raw_key());
+    }
+    ASSERT_EQ(expected, keys);
+    keys.clear();
+    for (it->seek_to_last(); it->valid(); it->prev()) {
+      keys.push_back(it->raw_key());
+    }
+    std::reverse(keys.begin(), keys.end());
+    ASSERT_EQ(expected, keys);
+
+    it->lower_bound("B", "");
+    ASSERT_EQ(make_pair(string("B"), string("b1")), it->raw_key());
+    it->prev();
+    ASSERT_EQ(make_pair(string("A"), string("a3")), it->raw_key());
+    it->next();
+    it->next();
+    ASSERT_EQ(make_pair(string("C"), string("c1")), it->raw_key());
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rmkeys_by_prefix("A");
+    db->submit_transaction_sync(t);
+    KeyValueDB::Iterator it = db->get_iterator("A");
+    it->seek_to_first();
+    ASSERT_FALSE(it->valid());
+  }
+  fini();
+}
 
 INSTANTIATE_TEST_CASE_P(
   KeyValueDB,
@@ -0,0 +1,189 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "include/stringify.h"
+#include <gtest/gtest.h>
+
+#include "os/bluestore/PMEMLog.h"
+
+// a plain file stands in for the pmem region; PMEMLog msyncs it
+string get_temp_region(uint64_t size)
+{
+  static int n = 0;
+  string fn = "ceph_test_pmem_log.tmp." + stringify(getpid())
+    + "." + stringify(++n);
+  int fd = ::open(fn.c_str(), O_CREAT|O_RDWR|O_TRUNC, 0644);
+  assert(fd >= 0);
+  int r = ::ftruncate(fd, size);
+  assert(r >= 0);
+  ::close(fd);
+  return fn;
+}
+
+void rm_temp_region(string f)
+{
+  ::unlink(f.c_str());
+}
+
+bufferlist make_record(uint64_t seq, unsigned len)
+{
+  bufferlist bl;
+  bl.append(string(len, 'a' + seq % 26));
+  return bl;
+}
+
+// replay everything, checking it is seq first..last with the
+// contents make_record() gave them
+void check_replay(PMEMLog& log, uint64_t first, uint64_t last,
+		  unsigned len)
+{
+  uint64_t expect = first;
+  int r = log.replay([&](uint64_t seq, bufferlist& bl) {
+      EXPECT_EQ(expect, seq);
+      EXPECT_TRUE(make_record(seq, len).contents_equal(bl));
+      ++expect;
+      return 0;
+    });
+  ASSERT_EQ(0, r);
+  ASSERT_EQ(last + 1, expect);
+}
+
+TEST(PMEMLog, append_replay) {
+  string fn = get_temp_region(1048576);
+  {
+    PMEMLog log(g_ceph_context);
+    ASSERT_EQ(0, log.create(fn));
+    ASSERT_EQ(1u, log.get_next_seq());
+    for (uint64_t i = 1; i <= 100; ++i) {
+      bufferlist bl = make_record(i, 1000);
+      uint64_t seq;
+      ASSERT_EQ(0, log.append(bl, &seq));
+      ASSERT_EQ(i, seq);
+    }
+    log.close();
+  }
+  {
+    PMEMLog log(g_ceph_context);
+    ASSERT_EQ(0, log.open(fn));
+    ASSERT_EQ(101u, log.get_next_seq());
+    check_replay(log, 1, 100, 1000);
+
+    ASSERT_EQ(0, log.trim(60));
+    log.close();
+  }
+  {
+    PMEMLog log(g_ceph_context);
+    ASSERT_EQ(0, log.open(fn));
+    ASSERT_EQ(101u, log.get_next_seq());
+    check_replay(log, 61, 100, 1000);
+    log.close();
+  }
+  rm_temp_region(fn);
+}
+
+TEST(PMEMLog, wrap) {
+  string fn = get_temp_region(65536);
+  PMEMLog log(g_ceph_context);
+  ASSERT_EQ(0, log.create(fn));
+  // fill and trim repeatedly so the head laps the region several times
+  uint64_t next = 1;
+  for (unsigned round = 0; round < 20; ++round) {
+    while (true) {
+      bufferlist bl = make_record(next, 3000);
+      uint64_t seq;
+      int r = log.append(bl, &seq);
+      if (r == -ENOSPC)
+	break;
+      ASSERT_EQ(0, r);
+      ASSERT_EQ(next, seq);
+      ++next;
+    }
+    ASSERT_LT(log.get_capacity() / 2, log.get_used());
+    // keep the last few across a reopen
+    uint64_t keep = 3;
+    ASSERT_EQ(0, log.trim(next - 1 - keep));
+    log.close();
+    ASSERT_EQ(0, log.open(fn));
+    ASSERT_EQ(next, log.get_next_seq());
+    check_replay(log, next - keep, next - 1, 3000);
+  }
+  log.close();
+  rm_temp_region(fn);
+}
+
+TEST(PMEMLog, torn_record) {
+  string fn = get_temp_region(1048576);
+  {
+    PMEMLog log(g_ceph_context);
+    ASSERT_EQ(0, log.create(fn));
+    for (uint64_t i = 1; i <= 10; ++i) {
+      bufferlist bl = make_record(i, 500);
+      uint64_t seq;
+      ASSERT_EQ(0, log.append(bl, &seq));
+    }
+    log.close();
+  }
+  {
+    // scribble over the payload of the last record
+    int fd = ::open(fn.c_str(), O_RDWR);
+    ASSERT_LE(0, fd);
+    uint64_t rec = PMEMLog::ALIGN + 512;  // 500 bytes rounded up
+    uint64_t off = PMEMLog::DATA_START + 9 * rec + PMEMLog::ALIGN + 100;
+    ASSERT_EQ(4, ::pwrite(fd, "torn", 4, off));
+    ::close(fd);
+  }
+  {
+    PMEMLog log(g_ceph_context);
+    ASSERT_EQ(0, log.open(fn));
+    ASSERT_EQ(10u, log.get_next_seq());
+    check_replay(log, 1, 9, 500);
+    // and the next append takes its place
+    bufferlist bl = make_record(10, 500);
+    uint64_t seq;
+    ASSERT_EQ(0, log.append(bl, &seq));
+    ASSERT_EQ(10u, seq);
+    check_replay(log, 1, 10, 500);
+    log.close();
+  }
+  rm_temp_region(fn);
+}
+
+TEST(PMEMLog, recreate) {
+  string fn = get_temp_region(1048576);
+  PMEMLog log(g_ceph_context);
+  ASSERT_EQ(0, log.create(fn));
+  for (uint64_t i = 1; i <= 10; ++i) {
+    bufferlist bl = make_record(i, 100);
+    uint64_t seq;
+    ASSERT_EQ(0, log.append(bl, &seq));
+  }
+  log.close();
+  // records left over from before a create must not replay
+  ASSERT_EQ(0, log.create(fn));
+  log.close();
+  ASSERT_EQ(0, log.open(fn));
+  ASSERT_EQ(1u, log.get_next_seq());
+  check_replay(log, 1, 0, 100);
+  log.close();
+  rm_temp_region(fn);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -16,7 +16,9 @@
 #include <sstream>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
 #include "osd/ECBackend.h"
+#include "erasure-code/ErasureCode.h"
 #include "gtest/gtest.h"
 
 TEST(ECUtil, stripe_info_t)
@@ -58,3 +60,239 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ECUtil, offset_len_to_data_chunks)
+{
+  const uint64_t swidth = 4096;
+  const uint64_t ssize = 4;
+  const uint64_t csize = swidth / ssize;
+
+  ECUtil::stripe_info_t s(ssize, swidth);
+  ASSERT_EQ(s.get_data_chunk_count(), ssize);
+
+  set<int> chunks;
+  s.offset_len_to_data_chunks(make_pair((uint64_t)0, (uint64_t)0), &chunks);
+  ASSERT_EQ(chunks, set<int>());
+
+  // within one chunk, including in a later stripe
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair(csize + 10, (uint64_t)20), &chunks);
+  ASSERT_EQ(chunks, set<int>({1}));
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair(3*swidth + 2*csize, csize), &chunks);
+  ASSERT_EQ(chunks, set<int>({2}));
+
+  // across a chunk boundary
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair(csize - 1, (uint64_t)2), &chunks);
+  ASSERT_EQ(chunks, set<int>({0, 1}));
+
+  // across a stripe boundary
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair(swidth - 1, (uint64_t)2), &chunks);
+  ASSERT_EQ(chunks, set<int>({0, 3}));
+
+  // less than a stripe, but touching every chunk
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair(csize - 1, swidth - csize + 2),
+			      &chunks);
+  ASSERT_EQ(chunks, set<int>({0, 1, 2, 3}));
+
+  chunks.clear();
+  s.offset_len_to_data_chunks(make_pair((uint64_t)10, 10*swidth), &chunks);
+  ASSERT_EQ(chunks, set<int>({0, 1, 2, 3}));
+}
+
+// k data chunks and one parity chunk, the xor of the data chunks
+class ErasureCodeXor : public ceph::ErasureCode {
+public:
+  const unsigned int k;
+  explicit ErasureCodeXor(unsigned int k) : k(k) {}
+  unsigned int get_chunk_count() const override {
+    return k + 1;
+  }
+  unsigned int get_data_chunk_count() const override {
+    return k;
+  }
+  unsigned int get_chunk_size(unsigned int object_size) const override {
+    return (object_size + k - 1) / k;
+  }
+  int encode_chunks(const set<int> &want_to_encode,
+		    map<int, bufferlist> *encoded) override {
+    char *parity = (*encoded)[k].c_str();
+    unsigned int len = (*encoded)[k].length();
+    memset(parity, 0, len);
+    for (unsigned int i = 0; i < k; ++i) {
+      const char *data = (*encoded)[i].c_str();
+      for (unsigned int j = 0; j < len; ++j)
+	parity[j] ^= data[j];
+    }
+    return 0;
+  }
+  int decode_chunks(const set<int> &want_to_read,
+		    const map<int, bufferlist> &chunks,
+		    map<int, bufferlist> *decoded) override {
+    for (unsigned int missing = 0; missing <= k; ++missing) {
+      if (chunks.count(missing))
+	continue;
+      char *out = (*decoded)[missing].c_str();
+      unsigned int len = (*decoded)[missing].length();
+      memset(out, 0, len);
+      for (unsigned int i = 0; i <= k; ++i) {
+	if (i == missing)
+	  continue;
+	const char *in = (*decoded)[i].c_str();
+	for (unsigned int j = 0; j < len; ++j)
+	  out[j] ^= in[j];
+      }
+    }
+    return 0;
+  }
+};
+
+TEST(ECUtil, decode_partial)
+{
+  const uint64_t ssize = 3;
+  const uint64_t csize = 8;
+  const uint64_t swidth = ssize * csize;
+  const uint64_t stripes = 2;
+
+  ECUtil::stripe_info_t s(ssize, swidth);
+  ErasureCodeInterfaceRef ec_impl(new ErasureCodeXor(ssize));
+
+  bufferlist logical;
+  for (uint64_t i = 0; i < stripes * swidth; ++i)
+    logical.append((char)i);
+  map<int, bufferlist> shards;
+  ASSERT_EQ(0, ECUtil::encode(s, ec_impl, logical, set<int>({0, 1, 2, 3}),
+			      &shards));
+  ASSERT_EQ(4u, shards.size());
+
+  // the logical bytes [off, off+len) each extent of result should hold
+  auto check = [&](const extent_map &result) {
+    for (auto &&extent : result) {
+      bufferlist expected;
+      expected.substr_of(logical, extent.get_off(), extent.get_len());
+      bufferlist got = extent.get_val();
+      ASSERT_TRUE(got.contents_equal(expected));
+    }
+  };
+
+  // the wanted chunk is there: one extent per stripe, at its logical offset
+  {
+    map<int, bufferlist> to_decode;
+    to_decode[1] = shards[1];
+    extent_map result;
+    ASSERT_EQ(0, ECUtil::decode(s, ec_impl, 0, set<int>({1}), to_decode,
+				&result));
+    ASSERT_EQ(2u, result.ext_count());
+    auto i = result.begin();
+    ASSERT_EQ(csize, i.get_off());
+    ASSERT_EQ(csize, i.get_len());
+    ++i;
+    ASSERT_EQ(swidth + csize, i.get_off());
+    ASSERT_EQ(csize, i.get_len());
+    check(result);
+  }
+
+  // the wanted chunk is missing and has to be reconstructed
+  {
+    map<int, bufferlist> to_decode;
+    to_decode[0] = shards[0];
+    to_decode[2] = shards[2];
+    to_decode[3] = shards[3];
+    extent_map result;
+    ASSERT_EQ(0, ECUtil::decode(s, ec_impl, 0, set<int>({1}), to_decode,
+				&result));
+    ASSERT_EQ(2u, result.ext_count());
+    ASSERT_EQ(csize, result.begin().get_off());
+    check(result);
+  }
+
+  // stripes read at a later offset land after it
+  {
+    map<int, bufferlist> to_decode;
+    to_decode[2].substr_of(shards[2], csize, csize);
+    extent_map result;
+    ASSERT_EQ(0, ECUtil::decode(s, ec_impl, swidth, set<int>({2}), to_decode,
+				&result));
+    ASSERT_EQ(1u, result.ext_count());
+    ASSERT_EQ(swidth + 2*csize, result.begin().get_off());
+    check(result);
+  }
+
+  // a read spanning the stripe boundary wants the last chunk of the first
+  // stripe and the first chunk of the second; their extents are adjacent
+  // and merge, so the whole read falls in one extent
+  {
+    const uint64_t off = swidth - 4;
+    const uint64_t len = 10;
+    set<int> want;
+    s.offset_len_to_data_chunks(make_pair(off, len), &want);
+    ASSERT_EQ(set<int>({0, 2}), want);
+
+    map<int, bufferlist> to_decode;
+    to_decode[0] = shards[0];
+    to_decode[2] = shards[2];
+    extent_map result;
+    ASSERT_EQ(0, ECUtil::decode(s, ec_impl, 0, want, to_decode, &result));
+    ASSERT_EQ(3u, result.ext_count());
+    check(result);
+
+    auto range = result.get_containing_range(off, len);
+    ASSERT_TRUE(range.first != range.second);
+    ASSERT_EQ(2*csize, range.first.get_off());
+    ASSERT_EQ(2*csize, range.first.get_len());
+    bufferlist got, expected;
+    got.substr_of(range.first.get_val(), off - range.first.get_off(), len);
+    expected.substr_of(logical, off, len);
+    ASSERT_TRUE(got.contents_equal(expected));
+
+    // same when chunk 0 has to be reconstructed
+    to_decode.clear();
+    to_decode[1] = shards[1];
+    to_decode[2] = shards[2];
+    to_decode[3] = shards[3];
+    result.clear();
+    ASSERT_EQ(0, ECUtil::decode(s, ec_impl, 0, want, to_decode, &result));
+    ASSERT_EQ(3u, result.ext_count());
+    check(result);
+  }
+}
+
+TEST(ECBackend, ReadOp_check_decodable)
+{
+  ErasureCodeInterfaceRef ec_impl(new ErasureCodeXor(3));
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > extents;
+  extents.push_back(boost::make_tuple(0, 24, 0));
+
+  hobject_t partial(object_t("partial"), "", CEPH_NOSNAP, 0, 0, "");
+  hobject_t full(object_t("full"), "", CEPH_NOSNAP, 0, 0, "");
+  hobject_t unknown(object_t("unknown"), "", CEPH_NOSNAP, 0, 0, "");
+  map<hobject_t, ECBackend::read_request_t> to_read;
+  to_read.insert(
+    make_pair(partial,
+	      ECBackend::read_request_t(extents, set<int>({1}),
+					set<pg_shard_t>(), false, nullptr)));
+  to_read.insert(
+    make_pair(full,
+	      ECBackend::read_request_t(extents, set<int>({0, 1, 2}),
+					set<pg_shard_t>(), false, nullptr)));
+  ECBackend::ReadOp rop(0, 1, false, false, OpRequestRef(),
+			std::move(to_read));
+
+  // each object is complete once its own wanted chunks are decodable
+  ASSERT_EQ(0, rop.check_decodable(ec_impl, partial, set<int>({1})));
+  ASSERT_GT(0, rop.check_decodable(ec_impl, partial, set<int>({0})));
+  ASSERT_GT(0, rop.check_decodable(ec_impl, partial, set<int>({0, 2})));
+  ASSERT_EQ(0, rop.check_decodable(ec_impl, partial, set<int>({0, 2, 3})));
+
+  ASSERT_GT(0, rop.check_decodable(ec_impl, full, set<int>({1})));
+  ASSERT_GT(0, rop.check_decodable(ec_impl, full, set<int>({0, 1})));
+  ASSERT_EQ(0, rop.check_decodable(ec_impl, full, set<int>({0, 1, 2})));
+  ASSERT_EQ(0, rop.check_decodable(ec_impl, full, set<int>({1, 2, 3})));
+
+  // without a want set every data chunk is wanted
+  ASSERT_GT(0, rop.check_decodable(ec_impl, unknown, set<int>({1})));
+  ASSERT_EQ(0, rop.check_decodable(ec_impl, unknown, set<int>({0, 1, 3})));
+}
@@ -2391,6 +2391,74 @@ TEST_F(PGLogTestRebuildMissing, MissingNotInLog) {
   run_rebuild_missing_test(expected);
 }
 
+class PGLogTestWriteTrim : public PGLogTest, public StoreTestFixture {
+public:
+  PGLogTestWriteTrim() : PGLogTest(), StoreTestFixture("memstore") {}
+  void SetUp() override {
+    StoreTestFixture::SetUp();
+    ObjectStore::Transaction t;
+    test_coll = coll_t(spg_t(pg_t(1, 1)));
+    t.create_collection(test_coll, 0);
+    ASSERT_EQ(0u, store->apply_transaction(&osr, std::move(t)));
+  }
+
+  void TearDown() override {
+    clear();
+    StoreTestFixture::TearDown();
+  }
+
+  ObjectStore::Sequencer osr{"PGLogTestWriteTrim"};
+  coll_t test_coll;
+  ghobject_t log_oid{hobject_t(sobject_t("pglog", CEPH_NOSNAP))};
+
+  void write() {
+    ObjectStore::Transaction t;
+    map<string,bufferlist> km;
+    write_log_and_missing(t, &km, test_coll, log_oid, false);
+    if (!km.empty())
+      t.omap_setkeys(test_coll, log_oid, km);
+    ASSERT_EQ(0u, store->apply_transaction(&osr, std::move(t)));
+  }
+
+  // the log entry keys, without dups or other metadata
+  set<string> entry_keys() {
+    set<string> keys, ret;
+    store->omap_get_keys(test_coll, log_oid, &keys);
+    for (auto& k : keys) {
+      if (isdigit(k[0]))
+	ret.insert(k);
+    }
+    return ret;
+  }
+};
+
+TEST_F(PGLogTestWriteTrim, TrimRemovesKeys) {
+  pg_info_t info;
+  for (unsigned i = 1; i <= 10; ++i) {
+    add(mk_ple_mod(mk_obj(i), mk_evt(i < 6 ? 1 : 2, i), mk_evt(0, 0),
+		   osd_reqid_t()));
+  }
+  log.skip_can_rollback_to_to_head();
+  info.last_complete = log.head;
+  write();
+  ASSERT_EQ(10u, entry_keys().size());
+
+  trim(mk_evt(1, 4), info);
+  write();
+  set<string> keys = entry_keys();
+  ASSERT_EQ(6u, keys.size());
+  ASSERT_EQ(mk_evt(1, 5).get_key_name(), *keys.begin());
+
+  // several trims, one write, across an epoch boundary
+  trim(mk_evt(1, 5), info);
+  trim(mk_evt(2, 8), info);
+  write();
+  keys = entry_keys();
+  ASSERT_EQ(2u, keys.size());
+  ASSERT_EQ(mk_evt(2, 9).get_key_name(), *keys.begin());
+  ASSERT_EQ(mk_evt(2, 10).get_key_name(), *keys.rbegin());
+}
+
 
 class PGLogMergeDupsTest : public ::testing::Test, protected PGLog {
 
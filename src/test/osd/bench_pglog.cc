@@ -0,0 +1,158 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * PG log microbenchmark.
+ *
+ * Drives a PGLog the way a busy primary does: every op appends one
+ * entry, the log is trimmed back to osd_min_pg_log_entries once it
+ * grows past osd_max_pg_log_entries, and the dirty part of the log is
+ * encoded into a transaction after every op.  Reports the CPU cost of
+ * each step per op and the osd_pglog mempool footprint.  Nothing is
+ * applied to a store.
+ */
+
+#include <chrono>
+#include <iostream>
+
+#include "include/mempool.h"
+#include "common/ceph_argparse.h"
+#include "global/global_init.h"
+#include "os/ObjectStore.h"
+#include "osd/PGLog.h"
+
+#define dout_context g_ceph_context
+
+static void usage()
+{
+  derr << "usage: ceph_bench_pglog [flags]\n"
+      "	 --ops\n"
+      "	       number of log entries to append (default 1000000)\n"
+      "	 --objects\n"
+      "	       number of distinct objects written (default 10000)\n"
+      "	 --pgs\n"
+      "	       number of PG logs kept in memory (default 1)\n" << dendl;
+  generic_server_usage();
+}
+
+using bench_clock = std::chrono::steady_clock;
+
+int main(int argc, const char *argv[])
+{
+  uint64_t ops = 1000000;
+  unsigned objects = 10000;
+  unsigned pgs = 1;
+
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  auto cct = global_init(nullptr, args, CEPH_ENTITY_TYPE_OSD,
+			 CODE_ENVIRONMENT_UTILITY, 0);
+
+  std::string val;
+  vector<const char*>::iterator i = args.begin();
+  while (i != args.end()) {
+    if (ceph_argparse_double_dash(args, i))
+      break;
+
+    if (ceph_argparse_witharg(args, i, &val, "--ops", (char*)nullptr)) {
+      ops = strtoull(val.c_str(), nullptr, 10);
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)nullptr)) {
+      objects = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--pgs", (char*)nullptr)) {
+      pgs = atoi(val.c_str());
+    } else {
+      derr << "Error: can't understand argument: " << *i << "\n" << dendl;
+      usage();
+      return 1;
+    }
+  }
+  if (!ops || !objects || !pgs) {
+    usage();
+    return 1;
+  }
+
+  common_init_finish(g_ceph_context);
+
+  const uint64_t min_entries = g_conf->osd_min_pg_log_entries;
+  const uint64_t max_entries = g_conf->osd_max_pg_log_entries;
+
+  std::vector<hobject_t> oids;
+  for (unsigned j = 0; j < objects; ++j) {
+    char name[32];
+    snprintf(name, sizeof(name), "rbd_data.%08x", j);
+    hobject_t h(object_t(name), "", CEPH_NOSNAP, j * 2654435761u, 1, "");
+    oids.push_back(h);
+  }
+
+  struct pg_state_t {
+    std::unique_ptr<PGLog> log;
+    pg_info_t info;
+    coll_t coll;
+    ghobject_t log_oid;
+  };
+  std::vector<pg_state_t> pg(pgs);
+  for (unsigned j = 0; j < pgs; ++j) {
+    pg[j].log.reset(new PGLog(g_ceph_context));
+    pg[j].log->index();
+    pg[j].coll = coll_t(spg_t(pg_t(j, 1)));
+    pg[j].log_oid = spg_t(pg_t(j, 1)).make_pgmeta_oid();
+  }
+
+  bench_clock::duration add_time{}, trim_time{}, write_time{};
+  uint64_t trims = 0, write_bytes = 0;
+  size_t peak_bytes = 0;
+
+  for (uint64_t n = 1; n <= ops; ++n) {
+    pg_state_t& p = pg[n % pgs];
+    const hobject_t& oid = oids[n % objects];
+    eversion_t v(1, n);
+
+    pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, v,
+		     p.log->get_head(),  // prior_version is not looked at here
+		     0, osd_reqid_t(entity_name_t::CLIENT(n % 64), 0, n),
+		     utime_t(), 0);
+    e.mark_unrollbackable();
+
+    auto start = bench_clock::now();
+    p.log->add(e, false);
+    auto added = bench_clock::now();
+    add_time += added - start;
+
+    p.info.last_update = p.info.last_complete = v;
+    if (p.log->get_log().log.size() > max_entries) {
+      auto trim_to = p.log->get_log().log.begin();
+      std::advance(trim_to, p.log->get_log().log.size() - min_entries - 1);
+      p.log->trim(trim_to->version, p.info);
+      ++trims;
+      trim_time += bench_clock::now() - added;
+      peak_bytes = std::max(peak_bytes, mempool::osd_pglog::allocated_bytes());
+    }
+
+    auto write_start = bench_clock::now();
+    ObjectStore::Transaction t;
+    map<string,bufferlist> km;
+    p.log->write_log_and_missing(t, &km, p.coll, p.log_oid, false);
+    if (!km.empty())
+      t.omap_setkeys(p.coll, p.log_oid, km);
+    write_time += bench_clock::now() - write_start;
+    write_bytes += t.get_encoded_bytes();
+  }
+
+  auto ns_per_op = [ops](bench_clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() /
+      (double)ops;
+  };
+  std::cout << ops << " ops over " << pgs << " pg log(s), "
+	    << min_entries << ".." << max_entries << " entries each, "
+	    << trims << " trims\n"
+	    << "  add:   " << ns_per_op(add_time) << " ns/op\n"
+	    << "  trim:  " << ns_per_op(trim_time) << " ns/op\n"
+	    << "  write: " << ns_per_op(write_time) << " ns/op, "
+	    << write_bytes / ops << " bytes/op encoded\n"
+	    << "  osd_pglog mempool: peak " << peak_bytes << " bytes, now "
+	    << mempool::osd_pglog::allocated_bytes() << " bytes in "
+	    << mempool::osd_pglog::allocated_items() << " items"
+	    << std::endl;
+  return 0;
+}